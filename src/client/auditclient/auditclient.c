@@ -48,6 +48,13 @@ void spindle_la_activity (uintptr_t *cookie, unsigned int flag)
 unsigned int spindle_la_objopen(struct link_map *map, Lmid_t lmid, uintptr_t *cookie)
 {
    patch_on_linkactivity(map);
+   note_object_bindings(map, cookie);
+
+   /* Every object stays audited in both directions.  ld.so never rewrites
+      the GOT for an audited process, so a call that doesn't reach our
+      pltenter would go through _dl_runtime_profile forever.  Instead,
+      pltenter skips the binding lookup for objects that can't be the
+      target of one. */
    return LA_FLG_BINDTO | LA_FLG_BINDFROM;
 }
 
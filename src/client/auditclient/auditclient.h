@@ -25,20 +25,39 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 
 struct link_map *get_linkmap_from_cookie(uintptr_t *cookie);
 void patch_on_linkactivity(struct link_map *lmap);
-ElfX_Addr client_call_binding(const char *symname, ElfX_Addr symvalue);
+ElfX_Addr client_call_binding(const char *symname, ElfX_Addr symvalue, uintptr_t *defcook);
+int binding_is_passthrough(const char *symname, uintptr_t *defcook);
+void note_object_bindings(struct link_map *map, uintptr_t *cookie);
+unsigned long long binding_stats_begin();
+void binding_stats_end(unsigned long long start);
+void report_binding_stats();
 struct link_map *get_linkmap_from_cookie(uintptr_t *cookie);
 
-Elf64_Addr doPermanentBinding_idx(struct link_map *map,
+/* What we store in each object's rtld-audit cookie */
+#define COOKIE_NO_BOUND_SYMS 0
+#define COOKIE_HAS_BOUND_SYMS 1
+
+Elf64_Addr doPermanentBinding_idx(struct link_map *map, uintptr_t *defcook,
                                   unsigned long plt_reloc_idx,
                                   Elf64_Addr target,
-                                  const char *symname);
+                                  const char *symname, int cacheable);
 Elf64_Addr doPermanentBinding_noidx(uintptr_t *refcook, uintptr_t *defcook,
                                     Elf64_Addr target, const char *symname,
-                                    void *stack_begin, void *stack_end);
+                                    void *stack_begin, void *stack_end, int cacheable);
+
+void reloccache_preinit(uintptr_t *cookie);
+int reloccache_can_record(ElfW(Sym) *sym, const char *symname, uintptr_t *defcook);
+void reloccache_note_binding(struct link_map *refmap, uintptr_t *defcook,
+                             ElfW(Addr) *got_entry, ElfW(Addr) target);
+void reloccache_save();
 
 void patchDTV_init();
 void patchDTV_check();
 
+void search_path_note_library(struct link_map *map);
+char *search_path_find_soname(const char *soname, uintptr_t *cookie);
+int search_path_is_known_miss(const char *name, unsigned int flag);
+
 #define AUDIT_EXPORT __attribute__((__visibility__("default")))
 
 #endif
@@ -41,10 +41,15 @@ Elf64_Addr la_aarch64_gnu_pltenter (Elf64_Sym *sym, unsigned int ndx,
 {
    Elf64_Addr target;
    void *sp;
+   int cacheable;
+   unsigned long long start = binding_stats_begin();
 
    __asm__("mov %0, sp\n" : "=r" (sp));
 
-   target = client_call_binding(symname, sym->st_value);
-   return doPermanentBinding_noidx(refcook, defcook, target, symname,
-                                   sp, (void *) regs);
+   cacheable = reloccache_can_record(sym, symname, defcook);
+   target = client_call_binding(symname, sym->st_value, defcook);
+   target = doPermanentBinding_noidx(refcook, defcook, target, symname,
+                                     sp, (void *) regs, cacheable);
+   binding_stats_end(start);
+   return target;
 }
@@ -45,11 +45,10 @@ unsigned int la_version(unsigned int version)
       return 0;
    debug_printf("la_version function is loaded at %p\n", la_version);
    debug_printf3("la_version(): %d\n", version);
-   init_bindings_hash();
    return spindle_la_version(version);
 }
 
-char *la_objsearch(const char *name, uintptr_t *cookie, unsigned int flag)
+static char *objsearch(const char *name, uintptr_t *cookie, unsigned int flag)
 {
    debug_printf3("la_objsearch(): name = %s; cookie = %p; flag = %s\n", name, cookie,
                  (flag == LA_SER_ORIG) ?    "LA_SER_ORIG" :
@@ -60,15 +59,34 @@ char *la_objsearch(const char *name, uintptr_t *cookie, unsigned int flag)
                  (flag == LA_SER_SECURE) ?  "LA_SER_SECURE" :
                  "???");
 
-   /* check if direct name given --> return name  */
+   /* check if direct name given --> resolve it on the server, or return name */
    if (!strchr(name, '/')) {
+      char *newname = NULL;
+      if (flag == LA_SER_ORIG)
+         newname = search_path_find_soname(name, cookie);
+      if (newname)
+         return newname;
       debug_printf3("Returning direct name %s after input %s\n", name, name);
       return (char *) name;
    }
+
+   if (search_path_is_known_miss(name, flag)) {
+      debug_printf3("Skipping %s, server already searched for it\n", name);
+      return NULL;
+   }
    
    return client_library_load(name);
 }
 
+char *la_objsearch(const char *name, uintptr_t *cookie, unsigned int flag)
+{
+   char *result;
+   client_trace(TRACE_CL_LIBRARY, TRACE_BEGIN);
+   result = objsearch(name, cookie, flag);
+   client_trace(TRACE_CL_LIBRARY, TRACE_END);
+   return result;
+}
+
 extern unsigned int spindle_la_objopen(struct link_map *map, Lmid_t lmid, uintptr_t *cookie);
 unsigned int la_objopen(struct link_map *map, Lmid_t lmid, uintptr_t *cookie)
 {
@@ -105,10 +123,34 @@ unsigned int la_objopen(struct link_map *map, Lmid_t lmid, uintptr_t *cookie)
    }
 
    add_wgot_library(map);
+   search_path_note_library(map);
 
    return spindle_la_objopen(map, lmid, cookie);
 }
 
+/**
+ * For the launch trace, a load runs from LA_ACT_ADD to LA_ACT_CONSISTENT.
+ * After the first one ld.so relocates the initial objects, which ends
+ * when it calls la_preinit.
+ **/
+static void trace_activity(unsigned int flag)
+{
+   static int loading = 0, relocating = 0;
+
+   if (flag == LA_ACT_ADD) {
+      client_trace(TRACE_CL_LOAD, TRACE_BEGIN);
+      loading = 1;
+   }
+   else if (flag == LA_ACT_CONSISTENT && loading) {
+      client_trace(TRACE_CL_LOAD, TRACE_END);
+      loading = 0;
+      if (!relocating) {
+         client_trace(TRACE_CL_RELOCATE, TRACE_BEGIN);
+         relocating = 1;
+      }
+   }
+}
+
 void spindle_la_activity (uintptr_t *cookie, unsigned int flag);
 void la_activity (uintptr_t *cookie, unsigned int flag)
 {
@@ -121,6 +163,7 @@ void la_activity (uintptr_t *cookie, unsigned int flag)
    if (flag == LA_ACT_CONSISTENT) {
       mark_newlibs_as_need_writable_got();
    }
+   trace_activity(flag);
 
    spindle_la_activity(cookie, flag);
    return;
@@ -134,6 +177,10 @@ struct link_map *get_linkmap_from_cookie(uintptr_t *cookie)
 void la_preinit(uintptr_t *cookie)
 {
    debug_printf3("la_preinit(): %p\n", cookie);
+   reloccache_preinit(cookie);
+   client_trace(TRACE_CL_RELOCATE, TRACE_END);
+   client_trace(TRACE_CL_MAIN, TRACE_INSTANT);
+   client_trace_flush();
 }
 
 extern unsigned int spindle_la_objclose(uintptr_t *cookie);
@@ -146,6 +193,8 @@ unsigned int la_objclose (uintptr_t *cookie)
   rm_wgot_library(map);
 
   if(cookie == firstcookie) {
+     reloccache_save();
+     report_binding_stats();
      client_done();
   }
 
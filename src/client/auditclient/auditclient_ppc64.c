@@ -54,10 +54,15 @@ Elf64_Addr SPINDLE_PLTENTER(Elf64_Sym *sym,
 {
    Elf64_Addr target;
    void *sp;
+   int cacheable;
+   unsigned long long start = binding_stats_begin();
 
    __asm__("or %0, %%r1, %%r1\n" : "=r" (sp));
 
-   target = client_call_binding(symname, sym->st_value);
-   return doPermanentBinding_noidx(refcook, defcook, target, symname,
-                                   sp, (void *) regs);
+   cacheable = reloccache_can_record(sym, symname, defcook);
+   target = client_call_binding(symname, sym->st_value, defcook);
+   target = doPermanentBinding_noidx(refcook, defcook, target, symname,
+                                     sp, (void *) regs, cacheable);
+   binding_stats_end(start);
+   return target;
 }
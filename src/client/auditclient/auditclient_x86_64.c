@@ -22,11 +22,6 @@ Elf64_Addr la_x86_64_gnu_pltenter(Elf64_Sym *sym, unsigned int ndx,
                                   La_x86_64_regs *regs, unsigned int *flags,
                                   const char *symname, long int *framesizep) AUDIT_EXPORT;
 
-Elf64_Addr doPermanentBinding_idx(struct link_map *map,
-                                  unsigned long plt_reloc_idx,
-                                  Elf64_Addr target,
-                                  const char *symname);
-
 Elf64_Addr la_x86_64_gnu_pltenter(Elf64_Sym *sym,
                                   unsigned int ndx,
                                   uintptr_t *refcook,
@@ -36,8 +31,12 @@ Elf64_Addr la_x86_64_gnu_pltenter(Elf64_Sym *sym,
                                   const char *symname,
                                   long int *framesizep)
 {
+   unsigned long long start = binding_stats_begin();
    struct link_map *map = get_linkmap_from_cookie(refcook);
    unsigned long reloc_index = *((unsigned long *) (regs->lr_rsp-8));
-   Elf64_Addr target = client_call_binding(symname, sym->st_value);
-   return doPermanentBinding_idx(map, reloc_index, target, symname);
+   int cacheable = reloccache_can_record(sym, symname, defcook);
+   Elf64_Addr target = client_call_binding(symname, sym->st_value, defcook);
+   target = doPermanentBinding_idx(map, defcook, reloc_index, target, symname, cacheable);
+   binding_stats_end(start);
+   return target;
 }
@@ -129,7 +129,7 @@ static int find_refsymbol_index(uint32_t *begin, uint32_t *end,
 
 Elf64_Addr doPermanentBinding_noidx(uintptr_t *refcook, uintptr_t *defcook,
                                     Elf64_Addr target, const char *symname,
-                                    void *stack_begin, void *stack_end)
+                                    void *stack_begin, void *stack_end, int cacheable)
 {
    int plt_reloc_idx;
    Elf64_Rela *rels = NULL, *rel;
@@ -177,15 +177,17 @@ Elf64_Addr doPermanentBinding_noidx(uintptr_t *refcook, uintptr_t *defcook,
    debug_printf3("%s: Rewriting GOT at %p from %p to %p\n",
                  symname, got_entry, (void*)(*got_entry), (void*)target);
    *got_entry = target;
+   if (cacheable)
+      reloccache_note_binding(rmap, defcook, got_entry, target);
 #endif
 
    return target;
 }
 
-Elf64_Addr doPermanentBinding_idx(struct link_map *map,
+Elf64_Addr doPermanentBinding_idx(struct link_map *map, uintptr_t *defcook,
                                   unsigned long plt_reloc_idx,
                                   Elf64_Addr target,
-                                  const char *symname)
+                                  const char *symname, int cacheable)
 {
    Elf64_Dyn *dynamic_section = map->l_ld;
    Elf64_Rela *rel = NULL;
@@ -204,5 +206,7 @@ Elf64_Addr doPermanentBinding_idx(struct link_map *map,
    make_got_writable(got_entry, map);
    debug_printf3("binding %s at %p to target %lx in %s\n", symname, got_entry, target, map->l_name);
    *got_entry = target;
+   if (cacheable)
+      reloccache_note_binding(map, defcook, got_entry, target);
    return target;
 }
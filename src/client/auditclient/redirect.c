@@ -16,15 +16,42 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 
 #include "intercept.h"
 #include "client.h"
+#include "auditclient.h"
 #include "spindle_debug.h"
 
 #include <string.h>
 #include <elf.h>
+#include <time.h>
 
-ElfX_Addr client_call_binding(const char *symname, ElfX_Addr symvalue)
+static unsigned long objects_seen, objects_bound;
+static unsigned long bindings, bindings_looked_up;
+static unsigned long long binding_ns;
+
+/**
+ * Called from la_objopen.  Remember whether this object defines anything
+ * spindle binds, so calls resolving into the rest of the process don't
+ * have to be checked against the bindings table.
+ **/
+void note_object_bindings(struct link_map *map, uintptr_t *cookie)
+{
+   int result = defines_bound_symbol(map);
+   *cookie = result ? COOKIE_HAS_BOUND_SYMS : COOKIE_NO_BOUND_SYMS;
+   objects_seen++;
+   if (result) {
+      objects_bound++;
+      debug_printf3("%s defines symbols spindle binds\n",
+                    map->l_name && map->l_name[0] ? map->l_name : "[executable]");
+   }
+}
+
+ElfX_Addr client_call_binding(const char *symname, ElfX_Addr symvalue, uintptr_t *defcook)
 {
    struct spindle_binding_t *binding;
 
+   if (*defcook == COOKIE_NO_BOUND_SYMS)
+      return symvalue;
+   __atomic_fetch_add(&bindings_looked_up, 1, __ATOMIC_RELAXED);
+
    if (run_tests && strcmp(symname, "spindle_test_log_msg") == 0)
       return (Elf64_Addr) int_spindle_test_log_msg;
    if (!app_errno_location && strcmp(symname, ERRNO_NAME) == 0) {
@@ -45,3 +72,41 @@ ElfX_Addr client_call_binding(const char *symname, ElfX_Addr symvalue)
       return symvalue;
 }
 
+/**
+ * Whether client_call_binding leaves a binding of symname alone and has
+ * no side effects for it, so ld.so's answer could be reused.
+ **/
+int binding_is_passthrough(const char *symname, uintptr_t *defcook)
+{
+   if (*defcook == COOKIE_NO_BOUND_SYMS)
+      return 1;
+   if (strcmp(symname, "spindle_test_log_msg") == 0 || strcmp(symname, ERRNO_NAME) == 0)
+      return 0;
+   return lookup_in_binding_hash(symname) == NULL;
+}
+
+unsigned long long binding_stats_begin()
+{
+   struct timespec ts;
+   __atomic_fetch_add(&bindings, 1, __ATOMIC_RELAXED);
+   if (!spindle_debug_prints)
+      return 0;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void binding_stats_end(unsigned long long start)
+{
+   struct timespec ts;
+   if (!start)
+      return;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   __atomic_fetch_add(&binding_ns, ts.tv_sec * 1000000000ull + ts.tv_nsec - start, __ATOMIC_RELAXED);
+}
+
+void report_binding_stats()
+{
+   debug_printf("Binding stats: %lu of %lu objects define bound symbols.  %lu PLT bindings, "
+                "%lu checked against the bindings table, %llu us spent binding\n",
+                objects_bound, objects_seen, bindings, bindings_looked_up, binding_ns / 1000);
+}
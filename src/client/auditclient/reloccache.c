@@ -0,0 +1,334 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT
+file in the top level directory, or at
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms
+and conditions of the GNU Lesser General Public License for more details.  You should
+have received a copy of the GNU Lesser General Public License along with this
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "ldcs_api.h"
+#include "client.h"
+#include "auditclient.h"
+#include "client_heap.h"
+#include "spindle_debug.h"
+#include "writablegot.h"
+
+/**
+ * Every process on a node resolves the same PLT symbols against the same
+ * libraries, and for big C++ applications those lookups in ld.so are most
+ * of the binding cost.  With OPT_RELOCCACHE a process that starts up
+ * without a relocation cache records where each of its PLT slots got
+ * bound, and writes that out under the location when it exits.  Later
+ * processes with the same executable and library set fill their GOTs from
+ * the file in la_preinit, and ld.so never looks those symbols up.  glibc
+ * calls la_preinit only after the libraries' constructors and the
+ * executable's init functions have run, so PLT calls made from those are
+ * still bound by ld.so.  The cache helps everything from main on.
+ *
+ * Libraries load at different addresses in every process, so a binding is
+ * stored as the offsets of the GOT slot and target from the bases of the
+ * referencing and defining objects, which are named by their position in
+ * the link map.  Only bindings spindle leaves alone are stored, as
+ * client_call_binding must still see the ones it redirects.  IFUNCs,
+ * which ld.so resolves at each binding, are also left to ld.so.
+ **/
+
+#define RELOCCACHE_MAGIC 0x524c4348
+#define RELOCCACHE_PREFIX "spindle_relocs"
+
+typedef struct {
+   uint32_t magic;
+   uint32_t num_objects;
+   uint64_t key;
+   uint64_t num_entries;
+} reloccache_header_t;
+
+typedef struct {
+   uint32_t ref_object;
+   uint32_t def_object;
+   uint64_t got_offset;
+   uint64_t target_offset;
+} reloccache_entry_t;
+
+extern char *location;
+
+static struct link_map **objects;
+static unsigned int num_objects;
+static uint64_t objects_key;
+static int recording;
+
+static reloccache_entry_t *entries;
+static unsigned long num_entries, entries_size;
+static struct lock_t entries_lock;
+
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t len)
+{
+   const unsigned char *c = (const unsigned char *) data;
+   size_t i;
+   for (i = 0; i < len; i++) {
+      hash ^= c[i];
+      hash *= 1099511628211ull;
+   }
+   return hash;
+}
+
+/**
+ * Key a link map on the name and file identity of each of its objects, in
+ * order.  The executable has no name in its link_map, so we identify it
+ * through /proc.
+ **/
+static uint64_t hash_object(uint64_t hash, struct link_map *map)
+{
+   const char *name = (map->l_name && map->l_name[0]) ? map->l_name : "/proc/self/exe";
+   struct stat buf;
+
+   hash = hash_bytes(hash, name, strlen(name) + 1);
+   if (stat(name, &buf) == 0) {
+      hash = hash_bytes(hash, &buf.st_dev, sizeof(buf.st_dev));
+      hash = hash_bytes(hash, &buf.st_ino, sizeof(buf.st_ino));
+      hash = hash_bytes(hash, &buf.st_size, sizeof(buf.st_size));
+      hash = hash_bytes(hash, &buf.st_mtime, sizeof(buf.st_mtime));
+   }
+   return hash;
+}
+
+static int object_index(struct link_map *map)
+{
+   unsigned int i;
+   for (i = 0; i < num_objects; i++) {
+      if (objects[i] == map)
+         return (int) i;
+   }
+   return -1;
+}
+
+static int get_cache_path(char *path, size_t size)
+{
+   int len = snprintf(path, size, "%s/%s.%016llx", location, RELOCCACHE_PREFIX, (unsigned long long) objects_key);
+   if (len < 0 || (size_t) len >= size) {
+      debug_printf("Location %s is too long for a relocation cache path\n", location);
+      return -1;
+   }
+   return 0;
+}
+
+/**
+ * Fill the GOT slots of our objects from a relocation cache.  Returns -1
+ * if there isn't a usable one.  Every entry is checked against its
+ * object's PLT GOT before any is applied, and a cache with an entry
+ * outside of one is discarded whole and removed, so the next process
+ * records a fresh one.
+ **/
+static int apply_reloccache()
+{
+   char path[MAX_PATH_LEN+1];
+   reloccache_header_t header;
+   reloccache_entry_t *cached = NULL;
+   unsigned long *got_start = NULL, *got_end = NULL;
+   ElfW(Addr) *got_entry, got_addr;
+   unsigned long i;
+   struct stat buf;
+   int result = -1;
+   FILE *f;
+
+   if (get_cache_path(path, sizeof(path)) == -1)
+      return -1;
+   f = fopen(path, "r");
+   if (!f) {
+      debug_printf2("No relocation cache at %s\n", path);
+      return -1;
+   }
+   if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != RELOCCACHE_MAGIC ||
+       header.key != objects_key || header.num_objects != num_objects) {
+      debug_printf("Relocation cache %s does not match this process\n", path);
+      fclose(f);
+      return -1;
+   }
+   if (fstat(fileno(f), &buf) == -1 ||
+       header.num_entries != (buf.st_size - sizeof(header)) / sizeof(reloccache_entry_t)) {
+      err_printf("Relocation cache %s has the wrong size.  Discarding it\n", path);
+      goto discard;
+   }
+
+   cached = (reloccache_entry_t *) spindle_malloc(header.num_entries * sizeof(*cached) + 1);
+   got_start = (unsigned long *) spindle_malloc(num_objects * sizeof(unsigned long));
+   got_end = (unsigned long *) spindle_malloc(num_objects * sizeof(unsigned long));
+   if (!cached || !got_start || !got_end)
+      goto done;
+   if (fread(cached, sizeof(*cached), header.num_entries, f) != header.num_entries) {
+      err_printf("Relocation cache %s is truncated.  Discarding it\n", path);
+      goto discard;
+   }
+
+   for (i = 0; i < num_objects; i++) {
+      if (get_got_range(objects[i], got_start + i, got_end + i) == -1)
+         got_start[i] = got_end[i] = 0;
+   }
+   for (i = 0; i < header.num_entries; i++) {
+      if (cached[i].ref_object >= num_objects || cached[i].def_object >= num_objects)
+         break;
+      got_addr = objects[cached[i].ref_object]->l_addr + cached[i].got_offset;
+      if (got_addr < got_start[cached[i].ref_object] ||
+          got_addr + sizeof(ElfW(Addr)) > got_end[cached[i].ref_object] ||
+          got_addr % sizeof(ElfW(Addr)))
+         break;
+   }
+   if (i < header.num_entries) {
+      err_printf("Relocation cache %s has a binding outside of its object's GOT.  Discarding it\n", path);
+      goto discard;
+   }
+
+   for (i = 0; i < header.num_entries; i++) {
+      got_entry = (ElfW(Addr) *) (objects[cached[i].ref_object]->l_addr + cached[i].got_offset);
+      if (make_got_writable(got_entry, objects[cached[i].ref_object]) == -1)
+         continue;
+      *got_entry = objects[cached[i].def_object]->l_addr + cached[i].target_offset;
+   }
+   debug_printf("Filled %lu GOT entries from relocation cache %s\n", (unsigned long) header.num_entries, path);
+   result = 0;
+   goto done;
+
+  discard:
+   unlink(path);
+  done:
+   fclose(f);
+   if (cached)
+      spindle_free(cached);
+   if (got_start)
+      spindle_free(got_start);
+   if (got_end)
+      spindle_free(got_end);
+   return result;
+}
+
+/**
+ * Called from la_preinit, once the initial objects are loaded and
+ * relocated.  Their constructors and the executable's init functions
+ * have already run by then.
+ **/
+void reloccache_preinit(uintptr_t *cookie)
+{
+   struct link_map *head, *map;
+   unsigned int i;
+
+   if (!(opts & OPT_RELOCCACHE) || objects)
+      return;
+
+   head = get_linkmap_from_cookie(cookie);
+   while (head->l_prev)
+      head = head->l_prev;
+   for (map = head, i = 0; map; map = map->l_next)
+      i++;
+   objects = (struct link_map **) spindle_malloc(i * sizeof(struct link_map *));
+   if (!objects)
+      return;
+   for (map = head, num_objects = 0; map; map = map->l_next)
+      objects[num_objects++] = map;
+
+   objects_key = 14695981039346656037ull;
+   for (i = 0; i < num_objects; i++)
+      objects_key = hash_object(objects_key, objects[i]);
+
+   if (apply_reloccache() == -1)
+      recording = 1;
+}
+
+/**
+ * Whether a binding ld.so made for sym can go in the relocation cache.
+ **/
+int reloccache_can_record(ElfW(Sym) *sym, const char *symname, uintptr_t *defcook)
+{
+   return recording && ELF64_ST_TYPE(sym->st_info) != STT_GNU_IFUNC &&
+      binding_is_passthrough(symname, defcook);
+}
+
+void reloccache_note_binding(struct link_map *refmap, uintptr_t *defcook,
+                             ElfW(Addr) *got_entry, ElfW(Addr) target)
+{
+   struct link_map *defmap = get_linkmap_from_cookie(defcook);
+   reloccache_entry_t *new_entries;
+   int ref, def;
+
+   ref = object_index(refmap);
+   def = object_index(defmap);
+   if (ref == -1 || def == -1)
+      return;
+
+   if (lock(&entries_lock) == -1)
+      return;
+   if (num_entries == entries_size) {
+      new_entries = (reloccache_entry_t *) spindle_realloc(entries, (entries_size ? entries_size * 2 : 256) * sizeof(*entries));
+      if (new_entries) {
+         entries = new_entries;
+         entries_size = entries_size ? entries_size * 2 : 256;
+      }
+   }
+   if (num_entries < entries_size) {
+      entries[num_entries].ref_object = (uint32_t) ref;
+      entries[num_entries].def_object = (uint32_t) def;
+      entries[num_entries].got_offset = (uint64_t) ((ElfW(Addr)) got_entry - refmap->l_addr);
+      entries[num_entries].target_offset = (uint64_t) (target - defmap->l_addr);
+      num_entries++;
+   }
+   unlock(&entries_lock);
+}
+
+/**
+ * Called as the process exits.  Write out what we recorded, unless another
+ * process got there first.  The file is built under a temporary name and
+ * linked into place so readers never see a partial one.
+ **/
+void reloccache_save()
+{
+   char path[MAX_PATH_LEN+1], tmppath[MAX_PATH_LEN+16];
+   reloccache_header_t header;
+   int fd, result;
+
+   if (!recording || !num_entries)
+      return;
+   recording = 0;
+
+   if (get_cache_path(path, sizeof(path)) == -1)
+      return;
+   snprintf(tmppath, sizeof(tmppath), "%s.%d", path, getpid());
+   fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+   if (fd == -1) {
+      debug_printf("Could not create relocation cache %s: %s\n", tmppath, strerror(errno));
+      return;
+   }
+
+   header.magic = RELOCCACHE_MAGIC;
+   header.num_objects = num_objects;
+   header.key = objects_key;
+   header.num_entries = num_entries;
+   result = (write(fd, &header, sizeof(header)) == sizeof(header) &&
+             write(fd, entries, num_entries * sizeof(*entries)) == (ssize_t) (num_entries * sizeof(*entries)));
+   close(fd);
+   if (!result)
+      debug_printf("Could not write relocation cache %s\n", tmppath);
+   else if (link(tmppath, path) == 0)
+      debug_printf("Wrote %lu bindings to relocation cache %s\n", num_entries, path);
+   else
+      debug_printf2("Not writing relocation cache %s: %s\n", path, strerror(errno));
+   unlink(tmppath);
+}
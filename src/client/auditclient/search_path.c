@@ -0,0 +1,227 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT
+file in the top level directory, or at
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms
+and conditions of the GNU Lesser General Public License for more details.  You should
+have received a copy of the GNU Lesser General Public License along with this
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+/* When ld.so looks for a bare soname it walks LD_LIBRARY_PATH and the
+   requesting object's DT_RUNPATH, calling la_objsearch for every candidate.
+   Each of those becomes a server round trip.  Instead we build the same
+   ordered directory list up front and let the server find the first hit.
+   Anything we can't reproduce exactly (DT_RPATH chains, $LIB/$PLATFORM,
+   secure mode) is left to ld.so. */
+
+#define _GNU_SOURCE
+
+#include <elf.h>
+#include <link.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/auxv.h>
+
+#include "ldcs_api.h"
+#include "client.h"
+#include "auditclient.h"
+#include "client_heap.h"
+
+extern int is_in_spindle_cache(const char *pathname);
+
+static int rpath_in_use = 0;
+static int ldlibpath_read = 0;
+static char *ldlibpath = NULL;
+static char *searched_soname = NULL;
+
+/**
+ * Called from la_objopen.  ld.so searches the DT_RPATH of an object and
+ * every object that loaded it, which we can't see from the audit interface,
+ * so once any object with a DT_RPATH (and no DT_RUNPATH) is loaded we stop
+ * doing searches on the server.
+ **/
+void search_path_note_library(struct link_map *map)
+{
+   ElfW(Dyn) *dyn;
+   int has_rpath = 0, has_runpath = 0;
+
+   if (rpath_in_use || !map->l_ld)
+      return;
+   for (dyn = map->l_ld; dyn->d_tag != DT_NULL; dyn++) {
+      if (dyn->d_tag == DT_RPATH)
+         has_rpath = 1;
+      else if (dyn->d_tag == DT_RUNPATH)
+         has_runpath = 1;
+   }
+   if (has_rpath && !has_runpath) {
+      debug_printf2("%s has a DT_RPATH.  Leaving soname searches to ld.so\n",
+                    map->l_name && map->l_name[0] ? map->l_name : "[executable]");
+      rpath_in_use = 1;
+   }
+}
+
+static const char *get_runpath(struct link_map *map)
+{
+   ElfW(Dyn) *dyn;
+   const char *strtab = NULL;
+   ElfW(Addr) runpath = 0;
+   int found = 0;
+
+   if (!map->l_ld)
+      return NULL;
+   for (dyn = map->l_ld; dyn->d_tag != DT_NULL; dyn++) {
+      if (dyn->d_tag == DT_STRTAB)
+         strtab = (const char *) dyn->d_un.d_ptr;
+      else if (dyn->d_tag == DT_RUNPATH) {
+         runpath = dyn->d_un.d_val;
+         found = 1;
+      }
+   }
+   if (!found || !strtab)
+      return NULL;
+   return strtab + runpath;
+}
+
+/**
+ * Append the elements of a colon-separated path to dirs, expanding $ORIGIN
+ * and making relative elements absolute.  Returns -1 if the path can't be
+ * expressed as a plain directory list.
+ **/
+static int add_path_elements(const char *path, const char *origin, char *dirs, size_t *pos, size_t size)
+{
+   char cwd[MAX_PATH_LEN+1];
+   char elem[MAX_PATH_LEN+1];
+   const char *cur, *end;
+   size_t len, origin_len;
+
+   cwd[0] = '\0';
+   for (cur = path; ; cur = end + 1) {
+      end = cur + strcspn(cur, ":;");
+      len = end - cur;
+      if (len >= sizeof(elem))
+         return -1;
+      memcpy(elem, cur, len);
+      elem[len] = '\0';
+
+      if (strchr(elem, '$')) {
+         if (strncmp(elem, "$ORIGIN", 7) == 0 && (elem[7] == '/' || elem[7] == '\0')) {
+            origin_len = 7;
+         }
+         else if (strncmp(elem, "${ORIGIN}", 9) == 0 && (elem[9] == '/' || elem[9] == '\0')) {
+            origin_len = 9;
+         }
+         else {
+            debug_printf3("Search path element %s has an unsupported token\n", elem);
+            return -1;
+         }
+         if (!origin || strchr(elem + origin_len, '$'))
+            return -1;
+         if (strlen(origin) + strlen(elem + origin_len) >= sizeof(elem))
+            return -1;
+         memmove(elem + strlen(origin), elem + origin_len, strlen(elem + origin_len) + 1);
+         memcpy(elem, origin, strlen(origin));
+      }
+
+      if (elem[0] != '/') {
+         /* Empty and relative elements are relative to the cwd, as in ld.so */
+         if (!cwd[0] && !getcwd(cwd, sizeof(cwd)))
+            return -1;
+         len = strlen(cwd) + 1 + strlen(elem);
+         if (*pos + len + 1 > size)
+            return -1;
+         *pos += sprintf(dirs + *pos, "%s/%s", cwd, elem) + 1;
+      }
+      else {
+         len = strlen(elem);
+         if (*pos + len + 1 > size)
+            return -1;
+         memcpy(dirs + *pos, elem, len + 1);
+         *pos += len + 1;
+      }
+
+      if (*end == '\0')
+         break;
+   }
+   return 0;
+}
+
+/**
+ * Called from la_objsearch with LA_SER_ORIG for a name without a slash.
+ * Returns the relocated library if the server found it, or NULL to have
+ * la_objsearch hand the name back to ld.so.
+ **/
+char *search_path_find_soname(const char *soname, uintptr_t *cookie)
+{
+   char dirs[MAX_PATH_LEN];
+   char origin[MAX_PATH_LEN+1];
+   const char *runpath, *origin_p = NULL;
+   char *last_slash, *result;
+   struct link_map *map;
+   size_t pos = 0;
+   int searched;
+
+   if (searched_soname) {
+      spindle_free(searched_soname);
+      searched_soname = NULL;
+   }
+
+   if (rpath_in_use || !cookie || getauxval(AT_SECURE))
+      return NULL;
+   map = get_linkmap_from_cookie(cookie);
+   if (!map)
+      return NULL;
+
+   if (!ldlibpath_read) {
+      /* ld.so reads LD_LIBRARY_PATH once at startup, so do the same */
+      char *env = getenv("LD_LIBRARY_PATH");
+      ldlibpath = env && *env ? spindle_strdup(env) : NULL;
+      ldlibpath_read = 1;
+   }
+
+   runpath = get_runpath(map);
+   if (runpath && map->l_name && map->l_name[0] == '/' && !is_in_spindle_cache(map->l_name)) {
+      strncpy(origin, map->l_name, sizeof(origin));
+      origin[sizeof(origin)-1] = '\0';
+      last_slash = strrchr(origin, '/');
+      if (last_slash == origin)
+         last_slash[1] = '\0';
+      else
+         *last_slash = '\0';
+      origin_p = origin;
+   }
+
+   if (ldlibpath && add_path_elements(ldlibpath, NULL, dirs, &pos, sizeof(dirs)) == -1)
+      return NULL;
+   if (runpath && *runpath && add_path_elements(runpath, origin_p, dirs, &pos, sizeof(dirs)) == -1)
+      return NULL;
+   if (!pos)
+      return NULL;
+
+   result = client_library_search(soname, dirs, pos, &searched);
+   if (!result && searched)
+      searched_soname = spindle_strdup(soname);
+   return result;
+}
+
+/**
+ * ld.so will still walk LD_LIBRARY_PATH and DT_RUNPATH after we hand back a
+ * soname the server didn't find there.  Those candidates are known misses,
+ * so tell la_objsearch to have ld.so skip them.
+ **/
+int search_path_is_known_miss(const char *name, unsigned int flag)
+{
+   const char *last_slash;
+
+   if (!searched_soname || (flag != LA_SER_LIBPATH && flag != LA_SER_RUNPATH))
+      return 0;
+   last_slash = strrchr(name, '/');
+   return last_slash && strcmp(last_slash+1, searched_soname) == 0;
+}
@@ -57,32 +57,15 @@ static signed int gots_size;
 #error Need to fill in got info
 #endif
 
-int add_wgot_library(struct link_map *map)
+/**
+ * Find the range of map's PLT GOT.  Returns -1 if it doesn't have one.
+ **/
+int get_got_range(struct link_map *map, unsigned long *start, unsigned long *end)
 {
    ElfW(Dyn) *dynamic_section;
    void *got_table = NULL;
-   unsigned long rel_size = 0, relent_size = 0, relcount, gotsize, start, end;
-   signed int i;
-   struct got_range_t *tmprange;
-   
+   unsigned long rel_size = 0, relent_size = 0, relcount, gotsize;
 
-   //Allocate or grow the gots array if needed.
-   if (!gots) {
-      gots_size = GOTS_INITIAL_SIZE;
-      gots = (struct got_range_t *) malloc(sizeof(struct got_range_t) * GOTS_INITIAL_SIZE);
-      memset(gots, 0, sizeof(struct got_range_t) * GOTS_INITIAL_SIZE);
-   }
-   if (gots_last_entry+1 == gots_size) {
-      gots_size *= 2;
-      tmprange = (struct got_range_t *) realloc(gots, sizeof(struct got_range_t) * gots_size);
-      if (!tmprange) {
-         err_printf("Could not allocate memory for gots_range table of size %lu\n", sizeof(struct got_range_t) * gots_size);
-         return -1;
-      }
-      gots = tmprange;
-   }
-
-   //For the current library, map, lookup the range of its GOT table.
    dynamic_section = map->l_ld;
    if (!dynamic_section) {
       err_printf("Library %s does not have a dynamic section\n", map->l_name ? map->l_name : "[NO NAME]");
@@ -117,8 +100,37 @@ int add_wgot_library(struct link_map *map)
    relcount = rel_size / relent_size;
    gotsize = (relcount + EXTRA_GOT_ENTRIES + 1) * sizeof(void*);
 
-   start = (unsigned long) got_table;
-   end = start + gotsize;
+   *start = (unsigned long) got_table;
+   *end = *start + gotsize;
+   return 0;
+}
+
+int add_wgot_library(struct link_map *map)
+{
+   unsigned long start, end;
+   signed int i;
+   struct got_range_t *tmprange;
+   
+
+   //Allocate or grow the gots array if needed.
+   if (!gots) {
+      gots_size = GOTS_INITIAL_SIZE;
+      gots = (struct got_range_t *) malloc(sizeof(struct got_range_t) * GOTS_INITIAL_SIZE);
+      memset(gots, 0, sizeof(struct got_range_t) * GOTS_INITIAL_SIZE);
+   }
+   if (gots_last_entry+1 == gots_size) {
+      gots_size *= 2;
+      tmprange = (struct got_range_t *) realloc(gots, sizeof(struct got_range_t) * gots_size);
+      if (!tmprange) {
+         err_printf("Could not allocate memory for gots_range table of size %lu\n", sizeof(struct got_range_t) * gots_size);
+         return -1;
+      }
+      gots = tmprange;
+   }
+
+   //For the current library, map, lookup the range of its GOT table.
+   if (get_got_range(map, &start, &end) == -1)
+      return -1;
 
    //Sorted-insert the info for the new library into the gots array.
    for (i = gots_last_entry-1; i >= 0; i--) {
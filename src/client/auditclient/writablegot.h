@@ -26,6 +26,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 int add_wgot_library(struct link_map *map);
 int rm_wgot_library(struct link_map *map);
 int make_got_writable(void *got_entry, struct link_map *map);
+int get_got_range(struct link_map *map, unsigned long *start, unsigned long *end);
 void mark_newlibs_as_need_writable_got();
 
 #endif
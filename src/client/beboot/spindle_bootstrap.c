@@ -25,6 +25,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include <sys/wait.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 
 #include "spindle_debug.h"
 #include "ldcs_api.h"
@@ -33,6 +34,8 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include "client_api.h"
 #include "exec_util.h"
 #include "shmcache.h"
+#include "dirindex.h"
+#include "warmcache.h"
 
 #include "config.h"
 
@@ -48,6 +51,8 @@ char spindle_interceptlib[] = PROGLIBDIR "/libspindleint.so";
 
 int ldcsid;
 unsigned int shm_cachesize;
+dirindex_t *dir_index;
+warmcache_t *warm_cache;
 
 static int rankinfo[4]={-1,-1,-1,-1};
 static int number;
@@ -60,16 +65,19 @@ static char *client_lib;
 static char *opts_s;
 static char **daemon_args;
 static char *cachesize_s;
+static unsigned long long trace_start;
 
 opt_t opts;
 
 char libstr_socket_subaudit[] = PROGLIBDIR "/libspindle_subaudit_socket.so";
 char libstr_pipe_subaudit[] = PROGLIBDIR "/libspindle_subaudit_pipe.so";
 char libstr_biter_subaudit[] = PROGLIBDIR "/libspindle_subaudit_biter.so";
+char libstr_shmem_subaudit[] = PROGLIBDIR "/libspindle_subaudit_shmem.so";
 
 char libstr_socket_audit[] = PROGLIBDIR "/libspindle_audit_socket.so";
 char libstr_pipe_audit[] = PROGLIBDIR "/libspindle_audit_pipe.so";
 char libstr_biter_audit[] = PROGLIBDIR "/libspindle_audit_biter.so";
+char libstr_shmem_audit[] = PROGLIBDIR "/libspindle_audit_shmem.so";
 
 #if defined(COMM_SOCKET)
 static char *default_audit_libstr = libstr_socket_audit;
@@ -80,6 +88,9 @@ static char *default_subaudit_libstr = libstr_pipe_subaudit;
 #elif defined(COMM_BITER)
 static char *default_audit_libstr = libstr_biter_audit;
 static char *default_subaudit_libstr = libstr_biter_subaudit;
+#elif defined(COMM_SHMEM)
+static char *default_audit_libstr = libstr_shmem_audit;
+static char *default_subaudit_libstr = libstr_shmem_subaudit;
 #else
 #error Unknown connection type
 #endif
@@ -88,6 +99,13 @@ extern int spindle_mkdir(char *path);
 extern char *parse_location(char *loc, int number);
 extern char *realize(char *path);
 
+static unsigned long long trace_now()
+{
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return ((unsigned long long) tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
 static int establish_connection()
 {
    debug_printf2("Opening connection to server\n");
@@ -123,6 +141,12 @@ static void setup_environment()
    setenv("LDCS_CACHESIZE", cachesize_s, 1);
    setenv("LDCS_BOOTSTRAPPED", "1", 1);
    setenv("SPINDLE", "true", 1);
+   if (opts & OPT_TRACE) {
+      /* The client sends our part of the launch trace once it's up */
+      char trace_str[64];
+      snprintf(trace_str, sizeof(trace_str), "%llu %llu", trace_start, trace_now());
+      setenv("LDCS_TRACE_BOOT", trace_str, 1);
+   }
    if (opts & OPT_SUBAUDIT) {
       char *preload_str = spindle_interceptlib;
       char *preload_env = getenv("LD_PRELOAD");
@@ -301,6 +325,7 @@ int main(int argc, char *argv[])
    int error, result;
    char **j, *spindle_env;
 
+   trace_start = trace_now();
    LOGGING_INIT_PREEXEC("Client");
    debug_printf("Launched Spindle Bootstrapper\n");
 
@@ -348,8 +373,11 @@ int main(int argc, char *argv[])
 #endif
       shmcache_init(location, number, cachesize, shm_cache_limit);
       use_cache = 1;
-   }      
-   
+   }
+
+   if (opts & OPT_RELOCAOUT)
+      warm_cache = warmcache_map(location);
+
    get_executable();
    get_clientlib();
    adjust_script();
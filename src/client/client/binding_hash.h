@@ -0,0 +1,80 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT 
+file in the top level directory, or at 
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms 
+and conditions of the GNU Lesser General Public License for more details.  You should 
+have received a copy of the GNU Lesser General Public License along with this 
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#if !defined(BINDING_HASH_H_)
+#define BINDING_HASH_H_
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Hash used for the perfect hash over spindle_bindings names.
+ * gen_bindings_hash picks a seed that gives every name its own slot and
+ * writes the table to bindings_hash_table.h.  Hashing stops once a name
+ * is longer than maxlen, since it can't be a binding, and *len is set
+ * to maxlen+1.
+ **/
+
+struct binding_hash_entry_t {
+   uint32_t hash;
+   uint16_t len;
+   uint16_t idx;    /* Index into spindle_bindings, 0 for an empty slot */
+};
+
+static inline uint32_t binding_hash(const char *name, uint32_t seed, unsigned int maxlen, unsigned int *len)
+{
+   uint32_t hash = seed;
+   unsigned int i;
+
+   for (i = 0; name[i]; i++) {
+      if (i == maxlen) {
+         *len = maxlen + 1;
+         return 0;
+      }
+      hash = hash * 33 + (unsigned char) name[i];
+   }
+   *len = i;
+   return hash ^ (hash >> 15);
+}
+
+/**
+ * Look name up in a table written by gen_bindings_hash.  name_of(idx)
+ * returns the name stored at idx.  A name that isn't a binding almost
+ * always fails the length and hash comparison, so name_of and the memcmp
+ * only run on real bindings.  Returns the index, or 0 if name isn't in
+ * the table.
+ **/
+static inline unsigned int binding_hash_find(const char *name, const struct binding_hash_entry_t *table,
+                                             uint32_t seed, unsigned int size, unsigned int maxlen,
+                                             const char *(*name_of)(unsigned int idx))
+{
+   const struct binding_hash_entry_t *entry;
+   unsigned int len;
+   uint32_t hash;
+
+   hash = binding_hash(name, seed, maxlen, &len);
+   if (len > maxlen)
+      return 0;
+
+   entry = table + (hash & (size - 1));
+   if (!entry->idx || entry->hash != hash || entry->len != len)
+      return 0;
+   if (memcmp(name, name_of(entry->idx), len) != 0)
+      return 0;
+   return entry->idx;
+}
+
+#endif
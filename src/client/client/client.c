@@ -37,6 +37,8 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include "client_api.h"
 #include "spindle_launch.h"
 #include "shmcache.h"
+#include "dirindex.h"
+#include "warmcache.h"
 #include "ccwarns.h"
 
 errno_location_t app_errno_location;
@@ -44,6 +46,8 @@ errno_location_t app_errno_location;
 opt_t opts;
 int ldcsid = -1;
 unsigned int shm_cachesize;
+dirindex_t *dir_index = NULL;
+warmcache_t *warm_cache = NULL;
 static unsigned int shm_cache_limit;
 
 int intercept_open;
@@ -264,6 +268,10 @@ static int init_server_connection()
 
    if (opts & OPT_RELOCPY)
       parse_python_prefixes(ldcsid);
+   if (!dir_index)
+      dir_index = dirindex_map(location);
+   if (!warm_cache)
+      warm_cache = warmcache_map(location);
    return 0;
 }
 
@@ -332,6 +340,7 @@ void set_errno(int newerrno)
 int client_init()
 {
   int initial_run = 0;
+  unsigned long long init_start = client_trace_now();
   LOGGING_INIT("Client");
   check_for_fork();
   if (!use_ldcs)
@@ -347,6 +356,7 @@ int client_init()
   if (getenv("LDCS_BOOTSTRAPPED")) {
      initial_run = 1;
      unsetenv("LDCS_BOOTSTRAPPED");
+     client_trace_bootstrap();
   }
   
   if ((opts & OPT_REMAPEXEC) &&
@@ -356,6 +366,8 @@ int client_init()
      remap_executable(ldcsid);
   }
 
+  client_trace_at(TRACE_CL_INIT, TRACE_BEGIN, init_start);
+  client_trace(TRACE_CL_INIT, TRACE_END);
   return 0;
 }
 
@@ -366,6 +378,7 @@ int client_done()
       return 0;
 
    debug_printf2("Done. Closing connection %d\n", ldcsid);
+   client_trace_flush();
    send_end(ldcsid);
    client_close_connection(ldcsid);
    return 0;
@@ -418,6 +431,94 @@ char *client_library_load(const char *name)
    return newname;
 }
 
+/* The linker puts this at our own ELF header */
+extern const ElfW(Ehdr) __ehdr_start;
+
+/**
+ * ld.so skips libraries built for another ELF class or machine and keeps
+ * searching.  The server only looks at directory listings, so check what
+ * it found the same way.
+ **/
+static int library_matches_us(const char *path)
+{
+   ElfW(Ehdr) ehdr;
+   ssize_t result;
+   int fd;
+
+   fd = open(path, O_RDONLY);
+   if (fd == -1)
+      return 0;
+   do {
+      result = read(fd, &ehdr, sizeof(ehdr));
+   } while (result == -1 && errno == EINTR);
+   close(fd);
+
+   if (result != sizeof(ehdr) || memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0)
+      return 0;
+   return ehdr.e_ident[EI_CLASS] == __ehdr_start.e_ident[EI_CLASS] &&
+      ehdr.e_machine == __ehdr_start.e_machine;
+}
+
+/**
+ * Resolve a bare soname that ld.so would look for in dirs (a NUL-separated
+ * list in ld.so's search order).  Returns the relocated library, or NULL
+ * if ld.so should do its own search.  *searched is set if the server
+ * checked every directory in dirs and none had the library.
+ **/
+char *client_library_search(const char *soname, const char *dirs, size_t dirs_len, int *searched)
+{
+   char origpath[MAX_PATH_LEN+1];
+   char *last_slash, *newpath;
+   int errcode = 0;
+
+   *searched = 0;
+   check_for_fork();
+   if (!use_ldcs || ldcsid == -1)
+      return NULL;
+   if (!(opts & OPT_RELOCSO))
+      return NULL;
+#if !defined(__x86_64__)
+   /* The server only knows x86_64's hardware-capability subdirectories
+      and declines everywhere else, so don't ask. */
+   return NULL;
+#endif
+
+   find_libc_name();
+   if (libc_name) {
+      last_slash = strrchr(libc_name, '/');
+      if (strcmp(last_slash ? last_slash+1 : libc_name, soname) == 0)
+         return NULL;
+   }
+
+   sync_cwd();
+
+   if (get_soname_search(ldcsid, soname, dirs, dirs_len, origpath, &errcode) == -1)
+      return NULL;
+   if (errcode == ENOENT) {
+      debug_printf2("Server found no %s in the search path\n", soname);
+      *searched = 1;
+      return NULL;
+   }
+   if (errcode) {
+      debug_printf2("Server declined search for %s, leaving it to ld.so\n", soname);
+      return NULL;
+   }
+
+   debug_printf2("Server resolved %s to %s\n", soname, origpath);
+   newpath = client_library_load(origpath);
+   if (newpath == origpath)
+      return NULL;
+   if (strncmp(newpath, NOT_FOUND_PREFIX, strlen(NOT_FOUND_PREFIX)) == 0)
+      return newpath;
+   if (!library_matches_us(newpath)) {
+      /* newpath stays allocated, as the link map patching still points at it */
+      debug_printf2("%s is not a library for our ELF class and machine, leaving the search to ld.so\n",
+                    origpath);
+      return NULL;
+   }
+   return newpath;
+}
+
 static void read_python_prefixes(int fd, char **path)
 {
    int use_cache = (opts & OPT_SHMCACHE) && (shm_cachesize > 0);
@@ -488,7 +589,14 @@ int get_ldso_metadata(signed int *binding_offset)
    find_interp_name();
    debug_printf2("Requesting interpreter metadata for %s\n", interp_name);
 
-   if (use_cache) {
+   if (warm_cache && interp_name[0] == '/') {
+      snprintf(cachename, MAX_PATH_LEN, "LDSOINFO:%s", interp_name);
+      cachename[MAX_PATH_LEN] = '\0';
+      ldso_info_name = (char *) warmcache_lookup(warm_cache, cachename);
+      found_file = (ldso_info_name != NULL);
+   }
+
+   if (!found_file && use_cache) {
       debug_printf2("Looking up interpreter info in shared cache\n");
       snprintf(cachename, MAX_PATH_LEN, "LDSOINFO:%s", interp_name);
       cachename[MAX_PATH_LEN] = '\0';
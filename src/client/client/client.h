@@ -37,8 +37,9 @@ typedef unsigned long ElfX_Addr;
  * These functions are called by the audit hooks to do the major
  * pieces of work.
  **/
-ElfX_Addr client_call_binding(const char *symname, ElfX_Addr symvalue);
+ElfX_Addr client_call_binding(const char *symname, ElfX_Addr symvalue, uintptr_t *defcook);
 char *client_library_load(const char *libname);
+char *client_library_search(const char *soname, const char *dirs, size_t dirs_len, int *searched);
 int client_init();
 int client_done();
 
@@ -71,9 +72,15 @@ int get_ldso_metadata(signed int *binding_offset);
 
 
 int get_relocated_file(int fd, const char *name, char** newname, int *errcode);
+int get_relocated_fd(int fd, const char *name, char** newname, int *errcode, int *passed_fd);
+void forget_passed_fd(int fd);
 int get_stat_result(int fd, const char *path, int is_lstat, int *exists, struct stat *buf);
 int get_existance_test(int fd, const char *path, int *exists);
 int fetch_from_cache(const char *name, char **newname);
+int get_soname_search(int fd, const char *soname, const char *dirs, size_t dirs_len,
+                      char *result, int *errcode);
+int get_exec_search(int fd, const char *exec, const char *dirs, size_t dirs_len,
+                    char *result, int *errcode);
 
 /**
  * Tracking python prefixes
@@ -87,6 +94,16 @@ void parse_python_prefixes(int fd);
 
 void test_log(const char *name);
 
+/**
+ * Launch tracing, with OPT_TRACE.  Phases and kinds are the trace_phase_t
+ * and TRACE_* values from ldcs_api.h.
+ **/
+unsigned long long client_trace_now();
+void client_trace_at(int phase, int kind, unsigned long long time_us);
+void client_trace(int phase, int kind);
+void client_trace_bootstrap();
+void client_trace_flush();
+
 extern opt_t opts;
 
 extern int intercept_open;
@@ -100,6 +117,7 @@ typedef void* (*malloc_sig_t)(size_t);
 malloc_sig_t get_libc_malloc();
 
 int lookup_libc_symbols();
+int defines_bound_symbol(struct link_map *map);
 
 /* ERRNO_NAME currently refers to a glibc internal symbol. */
 #define ERRNO_NAME "__errno_location"
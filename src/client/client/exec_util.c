@@ -214,31 +214,16 @@ int adjust_if_script(const char *orig_path, char *reloc_path, char **argv, char
    return 0;
 }
 
-int exec_pathsearch(int ldcsid, const char *orig_exec, char **reloc_exec, int *errcode)
+/**
+ * Search PATH one candidate at a time, with a stat and then a file request
+ * to the server for each.  Used when the whole PATH doesn't fit in a single
+ * execpath search.
+ **/
+static int exec_pathsearch_each(int ldcsid, const char *orig_exec, char *path, char **reloc_exec, int *errcode)
 {
-   char *saveptr = NULL, *path, *cur;
+   char *saveptr = NULL, *cur;
    char newexec[MAX_PATH_LEN+1];
 
-   if (!orig_exec) {
-      err_printf("Null exec passed to exec_pathsearch\n");
-      *reloc_exec = NULL;
-      return -1;
-   }
-   
-   if (orig_exec[0] == '/' || orig_exec[0] == '.') {
-      get_relocated_file(ldcsid, (char *) orig_exec, reloc_exec, errcode);
-      debug_printf3("exec_pathsearch translated %s to %s\n", orig_exec, *reloc_exec);
-      return 0;
-   }
-
-   path = getenv("PATH");
-   if (!path) {
-      get_relocated_file(ldcsid, (char *) orig_exec, reloc_exec, errcode);
-      debug_printf3("No path.  exec_pathsearch translated %s to %s\n", orig_exec, *reloc_exec);
-      return 0;
-   }
-   path = spindle_strdup(path);
-
    debug_printf3("exec_pathsearch using path %s on file %s\n", path, orig_exec);
    int found = 0;
    int access_denied_found = 0;
@@ -275,7 +260,6 @@ int exec_pathsearch(int ldcsid, const char *orig_exec, char **reloc_exec, int *e
          break;
       }
    }
-   spindle_free(path);
    if (found)
       return 0;
 
@@ -288,6 +272,71 @@ int exec_pathsearch(int ldcsid, const char *orig_exec, char **reloc_exec, int *e
    return -1;
 }
 
+
+int exec_pathsearch(int ldcsid, const char *orig_exec, char **reloc_exec, int *errcode)
+{
+   char *saveptr = NULL, *path, *cur;
+   char dirs[MAX_PATH_LEN+1];
+   char result[MAX_PATH_LEN+1];
+   char cwd[MAX_PATH_LEN+1];
+   size_t pos = 0, len;
+   int too_long = 0, ret;
+
+   if (!orig_exec) {
+      err_printf("Null exec passed to exec_pathsearch\n");
+      *reloc_exec = NULL;
+      return -1;
+   }
+   
+   if (orig_exec[0] == '/' || orig_exec[0] == '.') {
+      get_relocated_file(ldcsid, (char *) orig_exec, reloc_exec, errcode);
+      debug_printf3("exec_pathsearch translated %s to %s\n", orig_exec, *reloc_exec);
+      return 0;
+   }
+
+   path = getenv("PATH");
+   if (!path) {
+      get_relocated_file(ldcsid, (char *) orig_exec, reloc_exec, errcode);
+      debug_printf3("No path.  exec_pathsearch translated %s to %s\n", orig_exec, *reloc_exec);
+      return 0;
+   }
+   path = spindle_strdup(path);
+
+   /* Send the whole PATH to the server, which searches it in one exchange */
+   cwd[0] = '\0';
+   for (cur = strtok_r(path, ":", &saveptr); cur && !too_long; cur = strtok_r(NULL, ":", &saveptr)) {
+      if (cur[0] != '/' && !cwd[0] && !getcwd(cwd, sizeof(cwd))) {
+         too_long = 1;
+         break;
+      }
+      len = snprintf(dirs + pos, sizeof(dirs) - pos, "%s%s%s", cur[0] == '/' ? "" : cwd,
+                     cur[0] == '/' ? "" : "/", cur);
+      if (len >= sizeof(dirs) - pos)
+         too_long = 1;
+      pos += len + 1;
+   }
+   spindle_free(path);
+
+   if (!too_long && pos) {
+      ret = get_exec_search(ldcsid, orig_exec, dirs, pos, result, errcode);
+      if (ret == 0 && *errcode != ENOTSUP) {
+         if (!result[0]) {
+            debug_printf3("exec_pathsearch did not find %s (errcode %d)\n", orig_exec, *errcode);
+            return -1;
+         }
+         /* With EACCES, result is the original file, which prep_exec runs in place */
+         *reloc_exec = spindle_strdup(result);
+         debug_printf3("exec_pathsearch translated %s to %s\n", orig_exec, *reloc_exec);
+         return 0;
+      }
+   }
+
+   path = spindle_strdup(getenv("PATH"));
+   ret = exec_pathsearch_each(ldcsid, orig_exec, path, reloc_exec, errcode);
+   spindle_free(path);
+   return ret;
+}
+
 int read_buffer(char *localname, char *buffer, int size)
 {
    int result, bytes_read, fd;
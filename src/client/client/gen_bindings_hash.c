@@ -0,0 +1,95 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT 
+file in the top level directory, or at 
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms 
+and conditions of the GNU Lesser General Public License for more details.  You should 
+have received a copy of the GNU Lesser General Public License along with this 
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+/**
+ * Build-time generator for bindings_hash_table.h.  Searches for a hash
+ * seed that maps every name in intercept_bindings.def to a distinct slot,
+ * growing the table if none is found.
+ *
+ * Usage: gen_bindings_hash > bindings_hash_table.h
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "binding_hash.h"
+
+static const char *names[] = {
+   "",
+#define SPINDLE_BINDING(NAME, LIBC_FUNC, SPINDLE_NAME, SPINDLE_FUNC) NAME,
+#include "intercept_bindings.def"
+#undef SPINDLE_BINDING
+};
+
+#define NUM_NAMES (sizeof(names) / sizeof(*names))
+#define MAX_SEEDS (1 << 20)
+
+int main()
+{
+   struct binding_hash_entry_t *table = NULL;
+   unsigned int size, maxlen = 0, len, i, slot;
+   uint32_t seed = 0, hash;
+   int found = 0;
+
+   for (i = 1; i < NUM_NAMES; i++) {
+      if (strlen(names[i]) > maxlen)
+         maxlen = strlen(names[i]);
+   }
+
+   for (size = 16; size < 2 * NUM_NAMES; size *= 2);
+   for (; !found && size <= 4096; size *= 2) {
+      table = (struct binding_hash_entry_t *) realloc(table, size * sizeof(*table));
+      for (seed = 5381u; seed < 5381u + MAX_SEEDS; seed++) {
+         memset(table, 0, size * sizeof(*table));
+         for (i = 1; i < NUM_NAMES; i++) {
+            hash = binding_hash(names[i], seed, maxlen, &len);
+            slot = hash & (size - 1);
+            if (table[slot].idx)
+               break;
+            table[slot].hash = hash;
+            table[slot].len = (uint16_t) len;
+            table[slot].idx = (uint16_t) i;
+         }
+         if (i == NUM_NAMES) {
+            found = 1;
+            break;
+         }
+      }
+      if (found)
+         break;
+   }
+   if (!found) {
+      fprintf(stderr, "gen_bindings_hash: could not find a perfect hash for %u names\n",
+              (unsigned int) NUM_NAMES - 1);
+      return -1;
+   }
+
+   printf("/* Generated by gen_bindings_hash from intercept_bindings.def.  Do not edit. */\n\n");
+   printf("#define BINDING_HASH_SEED 0x%08xu\n", seed);
+   printf("#define BINDING_HASH_SIZE %u\n", size);
+   printf("#define BINDING_MAX_NAME_LEN %u\n\n", maxlen);
+   printf("static const struct binding_hash_entry_t binding_hash_table[BINDING_HASH_SIZE] = {\n");
+   for (i = 0; i < size; i++) {
+      if (table[i].idx)
+         printf("   { 0x%08xu, %u, %u },   /* %s */\n", table[i].hash, table[i].len, table[i].idx, names[table[i].idx]);
+      else
+         printf("   { 0, 0, 0 },\n");
+   }
+   printf("};\n");
+   free(table);
+   return 0;
+}
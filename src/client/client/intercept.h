@@ -98,7 +98,6 @@ struct spindle_binding_t {
    void *spindle_func;
 };
 
-void init_bindings_hash();
 struct spindle_binding_t *lookup_in_binding_hash(const char *name);
 struct spindle_binding_t *get_bindings();
 
@@ -47,8 +47,9 @@ int (*orig_close)(int fd);
 /* returns:
    0 if not existent
    -1 could not check, use orig open
-   1 exists, newpath contains real location */
-static int do_check_file(const char *path, char **newpath) {
+   1 exists, newpath contains real location.  If passed_fd is non-NULL, it
+     may also hold an fd of the opened file that the server passed us */
+static int do_check_file(const char *path, char **newpath, int *passed_fd) {
    char *myname, *newname;
    int errcode;
   
@@ -62,7 +63,10 @@ static int do_check_file(const char *path, char **newpath) {
    }
    sync_cwd();
 
-   get_relocated_file(ldcsid, myname, &newname, &errcode);
+   if (passed_fd)
+      get_relocated_fd(ldcsid, myname, &newname, &errcode, passed_fd);
+   else
+      get_relocated_file(ldcsid, myname, &newname, &errcode);
 
    if (newname != NULL) {
       *newpath=newname;
@@ -101,11 +105,19 @@ static int call_orig_open(const char *path, int oflag, mode_t mode, int is_64)
 
 GCC_ENABLE_WARNING;
 
+/* A passed fd is a plain read-only open of the file */
+static int can_use_passed_fd(int oflag)
+{
+   if (!(opts & OPT_FDPASS))
+      return 0;
+   return (oflag & ~(O_CLOEXEC | O_LARGEFILE | O_NOCTTY)) == O_RDONLY;
+}
+
 int open_worker(const char *path, int oflag, mode_t mode, int is_64)
 {
    int rc;
    char *newpath;
-   int result, exists;
+   int result, exists, passed_fd = -1;
 
    if (!path) {
       return call_orig_open(path, oflag, mode, is_64);
@@ -117,7 +129,7 @@ int open_worker(const char *path, int oflag, mode_t mode, int is_64)
    }
    else if (result == REDIRECT) {
       /* Lookup and do open through local path */
-      result = do_check_file(path, &newpath);
+      result = do_check_file(path, &newpath, can_use_passed_fd(oflag) ? &passed_fd : NULL);
       if (result == 0) {
          /* File doesn't exist */
          set_errno(errno);
@@ -127,6 +139,15 @@ int open_worker(const char *path, int oflag, mode_t mode, int is_64)
          /* Spindle error, fallback to orig open */
          return call_orig_open(path, oflag, mode, is_64);
       }
+      else if (passed_fd != -1) {
+         /* The server already opened it for us */
+         debug_printf("Redirecting 'open' call, %s to fd %d for %s\n", path, passed_fd, newpath);
+         test_log(newpath);
+         if (!(oflag & O_CLOEXEC))
+            fcntl(passed_fd, F_SETFD, 0);
+         spindle_free(newpath);
+         return passed_fd;
+      }
       else {
          /* Successfully redirect open */
          debug_printf("Redirecting 'open' call, %s to %s\n", path, newpath);
@@ -186,7 +207,7 @@ FILE *fopen_worker(const char *path, const char *mode, int is_64)
    }
    else if (result == REDIRECT) {
       /* Lookup and do open through local path */
-      result = do_check_file(path, &newpath);
+      result = do_check_file(path, &newpath, NULL);
       if (result == 0) {
          /* File doesn't exist */
          set_errno(errno);
@@ -274,6 +295,7 @@ int rtcache_close(int fd)
       set_errno(EBADF);
       return -1;
    }
+   forget_passed_fd(fd);
    return orig_close(fd);
 }
 
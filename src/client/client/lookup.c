@@ -6,6 +6,11 @@
 #include "client_heap.h"
 #include "client_api.h"
 #include "ccwarns.h"
+#include "dirindex.h"
+#include "warmcache.h"
+
+extern dirindex_t *dir_index;
+extern warmcache_t *warm_cache;
 
 #define SPINDLE_ENODIR -68
 #define SPINDLE_ENODIR_STR "NODR"
@@ -123,6 +128,53 @@ static int update_cache(char *cache_name, char *dir_name, char *result_name, int
    return 0;
 }
 
+/**
+ * Library and python searches probe many names that don't exist.  The
+ * server publishes the entries of each directory it lists, so those probes
+ * can be answered here without a request or a shmcache entry.
+ **/
+static int known_missing_file(const char *path)
+{
+   if (!dir_index || path[0] != '/')
+      return 0;
+   if (dirindex_lookup(dir_index, path) != DIRINDEX_MISSING)
+      return 0;
+   debug_printf2("Directory index reports %s does not exist\n", path);
+   return 1;
+}
+
+/**
+ * A persistent server publishes the answers it gave earlier jobs.  Those
+ * are keyed like the shmcache, but only by absolute path, as a relative
+ * path depends on the cwd.  Returns 1 with result_name (or errcode) set
+ * if the answer was found.
+ **/
+static int check_warm_cache(const char *path, const char *prefix, int *errcode, char **result_name)
+{
+   char key[MAX_PATH_LEN+3];
+   const char *value;
+
+   if (!warm_cache || path[0] != '/')
+      return 0;
+   snprintf(key, sizeof(key), "%s%s", prefix, path);
+   value = warmcache_lookup(warm_cache, key);
+   if (!value)
+      return 0;
+
+   debug_printf3("Warm cache has %s as %s\n", key, value);
+   if (strncmp(value, "ERRNO:", 6) == 0) {
+      *errcode = atoi(value+6);
+      if (*errcode == SPINDLE_ENODIR)
+         *errcode = ENOENT;
+      *result_name = NULL;
+   }
+   else {
+      *errcode = 0;
+      *result_name = spindle_strdup(value);
+   }
+   return 1;
+}
+
 int get_existance_test(int fd, const char *path, int *exists)
 {
    int use_cache = (opts & OPT_SHMCACHE);
@@ -130,6 +182,17 @@ int get_existance_test(int fd, const char *path, int *exists)
    char cache_name[MAX_PATH_LEN+2], dir_name[MAX_PATH_LEN+2];
    char *exist_str = NULL;
 
+   if (known_missing_file(path)) {
+      *exists = 0;
+      return 0;
+   }
+
+   if (check_warm_cache(path, "&", &errcode, &exist_str)) {
+      *exists = (exist_str && *exist_str == 'y');
+      spindle_free(exist_str);
+      return 0;
+   }
+
    if (use_cache) {
       debug_printf2("Looking up file existance for %s in shared cache\n", path);
       found_file = check_cache(path, "&", cache_name, dir_name, ENOENT, &errcode, &exist_str);
@@ -164,7 +227,19 @@ int get_stat_result(int fd, const char *path, int is_lstat, int *exists, struct
    int found_file = 0;
    buffer[0] = '\0';
 
-   if (use_cache) {
+   if (known_missing_file(path)) {
+      *exists = 0;
+      return 0;
+   }
+
+   found_file = check_warm_cache(path, is_lstat ? "**" : "*", &errcode, &newpath);
+   if (found_file) {
+      strncpy(buffer, newpath, (sizeof(buffer)-1));
+      buffer[sizeof(buffer)-1] = '\0';
+      spindle_free(newpath);
+      newpath = NULL;
+   }
+   else if (use_cache) {
       debug_printf2("Looking up %s stat for %s in shared cache\n", is_lstat ? "l" : "", path);
       found_file = check_cache(path, is_lstat ? "**" : "*", cache_name, dir_name, 
                                ENOENT, &errcode, &newpath);
@@ -205,12 +280,67 @@ int get_stat_result(int fd, const char *path, int is_lstat, int *exists, struct
    return network_result;
 }
 
-int get_relocated_file(int fd, const char *name, char** newname, int *errorcode)
+/**
+ * Fds the server passed us (see get_relocated_fd) that the application
+ * hasn't closed yet.  The server stops passing them once we hold its limit.
+ * Fds closed behind our back, e.g. by dup2 or fclose, are never forgotten,
+ * which only makes us fall back to opening by path sooner.
+ **/
+static int *passed_fds;
+static int num_passed_fds, passed_fds_size;
+static struct lock_t passed_fds_lock;
+
+static void track_passed_fd(int fd)
+{
+   int *new_fds;
+   if (lock(&passed_fds_lock) == -1)
+      return;
+   if (num_passed_fds == passed_fds_size) {
+      new_fds = (int *) spindle_realloc(passed_fds, (passed_fds_size ? passed_fds_size * 2 : 16) * sizeof(int));
+      if (new_fds) {
+         passed_fds = new_fds;
+         passed_fds_size = passed_fds_size ? passed_fds_size * 2 : 16;
+      }
+   }
+   if (num_passed_fds < passed_fds_size)
+      passed_fds[num_passed_fds++] = fd;
+   unlock(&passed_fds_lock);
+}
+
+void forget_passed_fd(int fd)
+{
+   int i;
+   if (!num_passed_fds)
+      return;
+   if (lock(&passed_fds_lock) == -1)
+      return;
+   for (i = 0; i < num_passed_fds; i++) {
+      if (passed_fds[i] == fd) {
+         passed_fds[i] = passed_fds[--num_passed_fds];
+         break;
+      }
+   }
+   unlock(&passed_fds_lock);
+}
+
+static int lookup_relocated_file(int fd, const char *name, char** newname, int *errorcode, int *passed_fd)
 {
    int use_cache = (opts & OPT_SHMCACHE);
    int found_file = 0, result;
    char cache_name[MAX_PATH_LEN+2], dir_name[MAX_PATH_LEN+2];
 
+   if (passed_fd)
+      *passed_fd = -1;
+
+   if (known_missing_file(name)) {
+      *newname = NULL;
+      *errorcode = ENOENT;
+      return 0;
+   }
+
+   if (check_warm_cache(name, "", errorcode, newname))
+      return 0;
+
    if (use_cache) {
       debug_printf2("Looking up %s in shared cache\n", name);
       found_file = check_cache(name, "", cache_name, dir_name, ENOENT, errorcode, newname);
@@ -219,8 +349,19 @@ int get_relocated_file(int fd, const char *name, char** newname, int *errorcode)
    }
 
    debug_printf2("Send file request to server: %s\n", name);
-   result = send_file_query(fd, (char *) name, newname, errorcode);
+   if (passed_fd)
+      result = send_file_query_fd(fd, (char *) name, num_passed_fds, newname, errorcode, passed_fd);
+   else
+      result = send_file_query(fd, (char *) name, newname, errorcode);
    debug_printf2("Recv file from server: %s\n", *newname ? *newname : "NONE");
+   if (passed_fd && *passed_fd != -1) {
+      if (*newname)
+         track_passed_fd(*passed_fd);
+      else {
+         close(*passed_fd);
+         *passed_fd = -1;
+      }
+   }
 
    if (use_cache) {
       update_cache(cache_name, dir_name, *newname, errorcode, ENOENT);
@@ -231,3 +372,106 @@ int get_relocated_file(int fd, const char *name, char** newname, int *errorcode)
    return result;
 }
 
+int get_relocated_file(int fd, const char *name, char** newname, int *errorcode)
+{
+   return lookup_relocated_file(fd, name, newname, errorcode, NULL);
+}
+
+/**
+ * Like get_relocated_file, but if this lookup goes to the server then it
+ * also hands us the relocated file already opened read-only (and
+ * close-on-exec) in passed_fd.  Otherwise passed_fd is -1.
+ **/
+int get_relocated_fd(int fd, const char *name, char** newname, int *errorcode, int *passed_fd)
+{
+   return lookup_relocated_file(fd, name, newname, errorcode, passed_fd);
+}
+
+
+/**
+ * Search an ordered list of directories for name with one server request.
+ * Results are keyed in the shmcache by name and a hash of the directory
+ * list, so other processes with the same environment skip the request.
+ * Only answers from the server are cached; a search we can't even send
+ * is refused before the cache is touched.
+ **/
+static int get_search_result(int fd, int is_exec, const char *name, const char *dirs, size_t dirs_len,
+                             char *result, int *errcode)
+{
+   int use_cache = (opts & OPT_SHMCACHE);
+   char cache_name[MAX_NAME_LEN+32];
+   char *cached = NULL;
+   char errstr[MAX_PATH_LEN+16];
+   uint64_t hash = 14695981039346656037ull;
+   size_t i;
+   int ret;
+
+   if (strlen(name) + 1 + dirs_len > MAX_PATH_LEN) {
+      debug_printf2("Search path for %s is too long for a search message\n", name);
+      *errcode = ENOTSUP;
+      return -1;
+   }
+
+   if (use_cache) {
+      for (i = 0; i < dirs_len; i++) {
+         hash ^= (unsigned char) dirs[i];
+         hash *= 1099511628211ull;
+      }
+      snprintf(cache_name, sizeof(cache_name), "#%s%s@%016llx", is_exec ? "exec:" : "", name,
+               (unsigned long long) hash);
+      debug_printf2("Looking up search %s in shared cache\n", cache_name);
+      if (fetch_from_cache(cache_name, &cached)) {
+         if (!cached) {
+            *errcode = ENOTSUP;
+         }
+         else if (strncmp(cached, "ERRNO:", 6) == 0) {
+            char *path = strchr(cached+6, ':');
+            *errcode = atoi(cached+6);
+            result[0] = '\0';
+            if (path) {
+               strncpy(result, path+1, MAX_PATH_LEN);
+               result[MAX_PATH_LEN] = '\0';
+            }
+         }
+         else {
+            *errcode = 0;
+            strncpy(result, cached, MAX_PATH_LEN);
+            result[MAX_PATH_LEN] = '\0';
+         }
+         spindle_free(cached);
+         return 0;
+      }
+   }
+
+   debug_printf2("Send %s search for %s to server\n", is_exec ? "exec" : "soname", name);
+   if (is_exec)
+      ret = send_exec_search(fd, name, dirs, dirs_len, result, errcode);
+   else
+      ret = send_soname_search(fd, name, dirs, dirs_len, result, errcode);
+   debug_printf2("Server resolved %s to %s (errcode %d)\n", name, result[0] ? result : "NONE", *errcode);
+   if (ret == -1)
+      return ret;
+
+   if (use_cache) {
+      if (*errcode) {
+         /* An exec target we must run in place comes back as EACCES plus its path */
+         snprintf(errstr, sizeof(errstr), "ERRNO:%d%s%s", *errcode, result[0] ? ":" : "", result);
+         shmcache_update(cache_name, errstr);
+      }
+      else
+         shmcache_update(cache_name, result);
+   }
+   return ret;
+}
+
+int get_soname_search(int fd, const char *soname, const char *dirs, size_t dirs_len,
+                      char *result, int *errcode)
+{
+   return get_search_result(fd, 0, soname, dirs, dirs_len, result, errcode);
+}
+
+int get_exec_search(int fd, const char *exec, const char *dirs, size_t dirs_len,
+                    char *result, int *errcode)
+{
+   return get_search_result(fd, 1, exec, dirs, dirs_len, result, errcode);
+}
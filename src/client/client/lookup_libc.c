@@ -203,6 +203,48 @@ int lookup_libc_symbols()
    return 0;
 }
 
+/**
+ * Returns 1 if map's dynamic symbol table defines a symbol that spindle
+ * binds (anything in the bindings table, or __errno_location).  Used by the
+ * audit client to skip binding lookups for calls into other libraries.
+ **/
+int defines_bound_symbol(struct link_map *map)
+{
+   struct spindle_binding_t *binding;
+   signed long result;
+   const char *name;
+
+   INIT_DYNAMIC(map);
+   if (!symtab || !strtab || (!gnu_hash && !elf_hash))
+      return 0;
+
+   /* ld.so leaves read-only dynamic sections, like the vdso's, unrelocated */
+   if ((ElfW(Addr)) symtab < map->l_addr) {
+      symtab = (ElfW(Sym) *) (((ElfW(Addr)) symtab) + map->l_addr);
+      strtab += map->l_addr;
+      if (gnu_hash)
+         gnu_hash += map->l_addr;
+      if (elf_hash)
+         elf_hash += map->l_addr;
+   }
+
+   for (binding = get_bindings(); ; binding++) {
+      name = binding->name ? binding->name : ERRNO_NAME;
+      if (name[0] != '\0') {
+         result = -1;
+         if (gnu_hash)
+            result = lookup_gnu_hash_symbol(name, symtab, strtab, (struct gnu_hash_header *) gnu_hash);
+         if (elf_hash && result == -1)
+            result = lookup_elf_hash_symbol(name, symtab, strtab, (ElfW(Word) *) elf_hash);
+         if (result != -1 && symtab[result].st_shndx != SHN_UNDEF)
+            return 1;
+      }
+      if (!binding->name)
+         break;
+   }
+   return 0;
+}
+
 malloc_sig_t get_libc_malloc()
 {
    if (mallocfunc)
@@ -0,0 +1,144 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT
+file in the top level directory, or at
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms
+and conditions of the GNU Lesser General Public License for more details.  You should
+have received a copy of the GNU Lesser General Public License along with this
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "ldcs_api.h"
+#include "client.h"
+#include "client_api.h"
+#include "spindle_debug.h"
+
+/**
+ * The client's part of the launch trace.  Events go into a fixed buffer,
+ * as we may be running before libc's malloc is usable, and are sent to
+ * the server when the application reaches main and again at exit.  A
+ * forked child inherits its parent's unsent events, so only our own pid's
+ * are sent.
+ *
+ * A process that loads many libraries could fill the buffer with
+ * TRACE_CL_LIBRARY events, so those stop short of the last
+ * CLIENT_TRACE_RESERVED slots, which are kept for the coarse phases.
+ * Events that don't fit are counted and the count is sent with the rest.
+ **/
+
+#define CLIENT_TRACE_MAX_EVENTS 512
+#define CLIENT_TRACE_RESERVED 16
+
+/* One extra slot for the TRACE_DROPPED event */
+static trace_event_t trace_events[CLIENT_TRACE_MAX_EVENTS + 1];
+static int num_trace_events;
+static unsigned long long num_dropped;
+static int32_t dropped_pid;
+static int library_begin_dropped;
+
+unsigned long long client_trace_now()
+{
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return ((unsigned long long) tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+void client_trace_at(int phase, int kind, unsigned long long time_us)
+{
+   int32_t pid;
+   int limit;
+
+   if (!(opts & OPT_TRACE))
+      return;
+   pid = (int32_t) getpid();
+   limit = CLIENT_TRACE_MAX_EVENTS;
+   if (phase == TRACE_CL_LIBRARY) {
+      /* Keep a library's BEGIN only if its END will fit too */
+      limit -= CLIENT_TRACE_RESERVED;
+      if (kind == TRACE_BEGIN) {
+         limit--;
+         library_begin_dropped = (num_trace_events >= limit);
+      }
+      else if (kind == TRACE_END && library_begin_dropped) {
+         library_begin_dropped = 0;
+         limit = 0;
+      }
+   }
+   if (num_trace_events >= limit) {
+      if (dropped_pid != pid) {
+         dropped_pid = pid;
+         num_dropped = 0;
+      }
+      num_dropped++;
+      return;
+   }
+   trace_events[num_trace_events].time_us = time_us;
+   trace_events[num_trace_events].pid = pid;
+   trace_events[num_trace_events].phase = (uint16_t) phase;
+   trace_events[num_trace_events].kind = (uint16_t) kind;
+   num_trace_events++;
+}
+
+void client_trace(int phase, int kind)
+{
+   if (!(opts & OPT_TRACE))
+      return;
+   client_trace_at(phase, kind, client_trace_now());
+}
+
+/**
+ * The bootstrapper can't reach the server's trace after it execs the
+ * application, so it leaves its start and connection times in
+ * LDCS_TRACE_BOOT for the client to send.
+ **/
+void client_trace_bootstrap()
+{
+   char *boot = getenv("LDCS_TRACE_BOOT");
+   unsigned long long start, connected;
+
+   if (!boot)
+      return;
+   if (sscanf(boot, "%llu %llu", &start, &connected) == 2) {
+      client_trace_at(TRACE_CL_BOOTSTRAP, TRACE_BEGIN, start);
+      client_trace_at(TRACE_CL_BOOTSTRAP, TRACE_END, connected);
+   }
+   unsetenv("LDCS_TRACE_BOOT");
+}
+
+void client_trace_flush()
+{
+   int32_t pid = (int32_t) getpid();
+   int i, j;
+
+   if (!(opts & OPT_TRACE) || ldcsid == -1 || !use_ldcs)
+      return;
+   for (i = 0, j = 0; i < num_trace_events; i++) {
+      if (trace_events[i].pid == pid)
+         trace_events[j++] = trace_events[i];
+   }
+   num_trace_events = 0;
+   if (dropped_pid == pid && num_dropped) {
+      debug_printf("Dropped %llu trace events that did not fit in the buffer\n", num_dropped);
+      trace_events[j].time_us = num_dropped;
+      trace_events[j].pid = pid;
+      trace_events[j].phase = 0;
+      trace_events[j].kind = TRACE_DROPPED;
+      j++;
+      num_dropped = 0;
+   }
+   if (!j)
+      return;
+   debug_printf2("Sending %d trace events to server\n", j);
+   send_trace_events(ldcsid, trace_events, j);
+}
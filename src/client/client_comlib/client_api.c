@@ -37,7 +37,7 @@ static struct lock_t comm_lock;
 #define COMM_LOCK do { if (lock(&comm_lock) == -1) return -1; } while (0)
 #define COMM_UNLOCK unlock(&comm_lock)
    
-int send_file_query(int fd, char* path, char** newpath, int *errcode) {
+static int file_query(int fd, char* path, char** newpath, int *errcode, int *passed_fd, int held_fds) {
    ldcs_message_t message;
    char buffer[MAX_PATH_LEN+1+sizeof(int)];
    int result;
@@ -50,10 +50,15 @@ int send_file_query(int fd, char* path, char** newpath, int *errcode) {
    }
 
    /* Setup packet */
-   message.header.type = LDCS_MSG_FILE_QUERY_EXACT_PATH;
+   message.header.type = passed_fd ? LDCS_MSG_FILE_QUERY_FD : LDCS_MSG_FILE_QUERY_EXACT_PATH;
    message.header.len = path_len;
    message.data = buffer;
    strncpy(message.data, path, MAX_PATH_LEN);
+   if (passed_fd) {
+      memcpy(message.data + path_len, &held_fds, sizeof(int));
+      message.header.len += sizeof(int);
+      *passed_fd = -1;
+   }
 
    COMM_LOCK;
 
@@ -64,6 +69,11 @@ int send_file_query(int fd, char* path, char** newpath, int *errcode) {
    /* get new filename */
    client_recv_msg_static(fd, &message, LDCS_READ_BLOCK);
 
+   /* An fd announced in the answer is already waiting for us */
+   if (passed_fd && message.header.type == LDCS_MSG_FILE_QUERY_ANSWER &&
+       message.header.len > sizeof(int) && *((int *) message.data) == LDCS_ANSWER_PASSED_FD)
+      *passed_fd = client_recv_fd(fd);
+
    COMM_UNLOCK;
 
    if (message.header.type != LDCS_MSG_FILE_QUERY_ANSWER) {
@@ -85,6 +95,21 @@ int send_file_query(int fd, char* path, char** newpath, int *errcode) {
    return result;
 }
 
+int send_file_query(int fd, char* path, char** newpath, int *errcode)
+{
+   return file_query(fd, path, newpath, errcode, NULL, 0);
+}
+
+/**
+ * Like send_file_query, but also asks the server for an open read-only fd of
+ * the relocated file, which is returned in passed_fd (or -1 if the server
+ * didn't send one).  held_fds is how many passed fds we still have open.
+ **/
+int send_file_query_fd(int fd, char* path, int held_fds, char** newpath, int *errcode, int *passed_fd)
+{
+   return file_query(fd, path, newpath, errcode, passed_fd, held_fds);
+}
+
 int send_stat_request(int fd, char *path, int is_lstat, char *newpath)
 {
    int path_len = strlen(path) + (is_lstat ? 0 : 1) + 1;
@@ -200,6 +225,69 @@ int send_orig_path_request(int fd, const char *path, char *newpath)
    return 0;
 }
 
+/**
+ * Ask the server to find soname in the NUL-separated list of directories in
+ * dirs.  On success result gets the first dir/soname that exists.  Otherwise
+ * errcode is ENOENT if no directory has it, or ENOTSUP if the server can't
+ * reproduce ld.so's search for this list.
+ **/
+static int send_search(int fd, ldcs_message_ids_t query, ldcs_message_ids_t answer, const char *name,
+                       const char *dirs, size_t dirs_len, char *result, int *errcode)
+{
+   ldcs_message_t message;
+   char buffer[MAX_PATH_LEN+1];
+   size_t name_len = strlen(name)+1;
+
+   if (name_len + dirs_len > MAX_PATH_LEN) {
+      debug_printf2("Search path for %s is too long for a search message\n", name);
+      *errcode = ENOTSUP;
+      return -1;
+   }
+   memcpy(buffer, name, name_len);
+   memcpy(buffer + name_len, dirs, dirs_len);
+
+   message.header.type = query;
+   message.header.len = name_len + dirs_len;
+   message.data = buffer;
+
+   debug_printf3("Sending message of type: %s len=%d, name=%s\n",
+                 query == LDCS_MSG_SONAME_QUERY ? "soname_query" : "execpath_query",
+                 message.header.len, name);
+   COMM_LOCK;
+
+   client_send_msg(fd, &message);
+
+   client_recv_msg_static(fd, &message, LDCS_READ_BLOCK);
+
+   COMM_UNLOCK;
+
+   if (message.header.type != answer || message.header.len < (int) sizeof(int) ||
+       message.header.len > MAX_PATH_LEN) {
+      err_printf("Got unexpected message after search: %d\n", (int) message.header.type);
+      assert(0);
+   }
+
+   memcpy(errcode, buffer, sizeof(int));
+   if (message.header.len > (int) sizeof(int)) {
+      strncpy(result, buffer + sizeof(int), MAX_PATH_LEN);
+      result[MAX_PATH_LEN] = '\0';
+   }
+   else {
+      result[0] = '\0';
+   }
+   return 0;
+}
+
+int send_soname_search(int fd, const char *soname, const char *dirs, size_t dirs_len, char *result, int *errcode)
+{
+   return send_search(fd, LDCS_MSG_SONAME_QUERY, LDCS_MSG_SONAME_ANSWER, soname, dirs, dirs_len, result, errcode);
+}
+
+int send_exec_search(int fd, const char *exec, const char *dirs, size_t dirs_len, char *result, int *errcode)
+{
+   return send_search(fd, LDCS_MSG_EXECPATH_QUERY, LDCS_MSG_EXECPATH_ANSWER, exec, dirs, dirs_len, result, errcode);
+}
+
 int send_dir_cwd(int fd, char *cwd)
 {
    ldcs_message_t message;
@@ -273,6 +361,29 @@ int send_cpu(int fd, int cpu) {
    return(rc);
 }
 
+int send_trace_events(int fd, trace_event_t *events, int num_events) {
+   ldcs_message_t message;
+   int i, count;
+
+   debug_printf3("Sending %d trace events\n", num_events);
+
+   COMM_LOCK;
+
+   for (i = 0; i < num_events; i += count) {
+      count = num_events - i;
+      if (count > (int) TRACE_EVENTS_PER_MSG)
+         count = (int) TRACE_EVENTS_PER_MSG;
+      message.header.type = LDCS_MSG_TRACE;
+      message.header.len = count * sizeof(trace_event_t);
+      message.data = (char *) (events + i);
+      client_send_msg(fd, &message);
+   }
+
+   COMM_UNLOCK;
+
+   return 0;
+}
+
 int send_location(int fd, char *location) {
    ldcs_message_t message;
 
@@ -26,6 +26,7 @@
  * Communication functions for sending messages to the server
  **/
 int send_file_query(int fd, char* path, char **newpath, int *errcode);
+int send_file_query_fd(int fd, char* path, int held_fds, char **newpath, int *errcode, int *passed_fd);
 int send_dir_cwd(int fd, char *cwd);
 int send_cwd(int fd);
 int send_pid(int fd);
@@ -33,10 +34,13 @@ int send_cpu(int fd, int cpu);
 int send_location(int fd, char *location);
 int send_rankinfo_query(int fd, int *mylrank, int *mylsize, int *mymdrank, int *mymdsize);
 int send_end(int fd);
+int send_trace_events(int fd, trace_event_t *events, int num_events);
 int send_existance_test(int fd, char *path, int *exists);
 int send_stat_request(int fd, char *path, int islstat, char *result);
 int send_ldso_info_request(int fd, const char *ldso_path, char *result_path);
 int send_orig_path_request(int fd, const char *path, char *newpath);
+int send_soname_search(int fd, const char *soname, const char *dirs, size_t dirs_len, char *result, int *errcode);
+int send_exec_search(int fd, const char *exec, const char *dirs, size_t dirs_len, char *result, int *errcode);
 
 int get_python_prefix(int fd, char **prefix);
 
@@ -48,6 +52,7 @@ char *client_get_connection_string(int fd);
 int client_send_msg(int connid, ldcs_message_t * msg);
 int client_recv_msg_static(int fd, ldcs_message_t *msg, ldcs_read_block_t block);
 int client_recv_msg_dynamic(int fd, ldcs_message_t *msg, ldcs_read_block_t block);
+int client_recv_fd(int fd);
 int is_client_fd(int connfd, int fd);
 
 #endif
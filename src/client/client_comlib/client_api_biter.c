@@ -147,3 +147,8 @@ int is_client_fd(int connid, int fd)
 {
    return biterc_is_client_fd(session, fd);
 }
+
+int client_recv_fd_biter(int fd)
+{
+   return -1;
+}
@@ -400,3 +400,8 @@ int client_close_connection_pipe(int fd)
 
    return 0;
 }
+
+int client_recv_fd_pipe(int fd)
+{
+   return -1;
+}
@@ -0,0 +1,488 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT
+file in the top level directory, or at
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms
+and conditions of the GNU Lesser General Public License for more details.  You should
+have received a copy of the GNU Lesser General Public License along with this
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+
+#include "client_heap.h"
+#include "ldcs_api.h"
+#include "shmem_ring.h"
+#include "spindle_launch.h"
+
+/**
+ * Shared-memory transport.  Each client creates a memory region holding a
+ * ring in each direction and hands it to the server over a unix socket.  After
+ * that, messages travel through the rings.  The socket stays open as the
+ * doorbell the server selects on (one byte per request) and so the server sees
+ * a disconnect when we exit.  The server wakes us through the ring's futex,
+ * and only when we've actually gone to sleep.  In the other direction the
+ * socket only carries fds the server passes us alongside a reply.
+ **/
+
+#define MAX_FD 1
+static struct {
+   int sock_fd;
+   int mem_fd;
+   shmem_region_t *region;
+} fdlist_shmem[MAX_FD];
+
+/* How long to poll for a reply before sleeping, and how often to
+   check that the server is still alive while sleeping.  Spinning only
+   pays off if the server can run on another CPU at the same time. */
+#define SHMEM_CLIENT_SPINS 4096
+#define SHMEM_LIVENESS_MS 1000
+static int client_spins = -1;
+
+static int get_new_fd_shmem()
+{
+   /* Each client should establish one connection, just return 0 as our fd */
+   return 0;
+}
+
+#define MIN_REMAP_FD 315
+#define MAX_REMAP_FD 315+1024
+extern unsigned long opts;
+static int remap_to_high_fd(int fd)
+{
+#if !defined(MIN_REMAP_FD) || !defined(MAX_REMAP_FD)
+   return fd;
+#else
+   int i;
+   if (opts & OPT_NOHIDE)
+      return fd;
+
+   /* Find an unused fd */
+   for (i = MIN_REMAP_FD; i < MAX_REMAP_FD; i++) {
+      errno = 0;
+      fcntl(i, F_GETFD);
+      if (errno != EBADF)
+         continue;
+      dup2(fd, i);
+      close(fd);
+      debug_printf3("Remapped fd %d to high fd %d\n", fd, i);
+      return i;
+   }
+   err_printf("Failed to map fd %d to higher limit\n", fd);
+   return fd;
+#endif
+}
+
+static int create_region_fd(char *location)
+{
+   int fd;
+#if defined(SYS_memfd_create)
+   fd = syscall(SYS_memfd_create, "spindle_comm", 0);
+   if (fd != -1)
+      return fd;
+   debug_printf2("memfd_create failed (%s).  Using a file under %s\n", strerror(errno), location);
+#endif
+   char path[MAX_PATH_LEN+1];
+   snprintf(path, sizeof(path), "%s/spindle_comm/shmem-%d", location, getpid());
+   fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+   if (fd == -1) {
+      err_printf("Could not create shared memory file %s: %s\n", path, strerror(errno));
+      return -1;
+   }
+   unlink(path);
+   return fd;
+}
+
+static shmem_region_t *map_region(int mem_fd)
+{
+   void *mem = mmap(NULL, sizeof(shmem_region_t), PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd, 0);
+   if (mem == MAP_FAILED) {
+      err_printf("Could not map shared memory region for fd %d: %s\n", mem_fd, strerror(errno));
+      return NULL;
+   }
+   return (shmem_region_t *) mem;
+}
+
+static int server_alive(int fd)
+{
+   struct pollfd pfd;
+   int result;
+
+   pfd.fd = fdlist_shmem[fd].sock_fd;
+   pfd.events = POLLIN | POLLRDHUP;
+   pfd.revents = 0;
+   do {
+      result = poll(&pfd, 1, 0);
+   } while (result == -1 && errno == EINTR);
+
+   /* The server only writes to the socket to pass an fd, so unless one is
+      queued, anything readable is a hangup */
+   if (result == 1 && (pfd.revents & POLLIN) && !(pfd.revents & (POLLRDHUP | POLLHUP | POLLERR))) {
+      char c;
+      do {
+         result = recv(pfd.fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+      } while (result == -1 && errno == EINTR);
+      if (result == 1)
+         return 1;
+      result = -1;
+   }
+   if (result == -1 || (pfd.revents & (POLLIN | POLLRDHUP | POLLHUP | POLLERR))) {
+      err_printf("Lost connection to server on fd %d\n", pfd.fd);
+      return 0;
+   }
+   return 1;
+}
+
+static int ring_doorbell(int fd)
+{
+   char c = 0;
+   ssize_t result;
+   do {
+      result = write(fdlist_shmem[fd].sock_fd, &c, 1);
+   } while (result == -1 && errno == EINTR);
+   if (result != 1) {
+      err_printf("Failed to signal server on fd %d: %s\n", fdlist_shmem[fd].sock_fd, strerror(errno));
+      return -1;
+   }
+   return 0;
+}
+
+struct send_state_t {
+   int fd;
+   int rang;
+};
+
+static int wait_space(shmem_ring_t *ring, void *arg)
+{
+   struct send_state_t *state = (struct send_state_t *) arg;
+
+   /* A message bigger than the ring is streamed.  Make sure the server
+      knows it's coming before we wait for it to make room. */
+   if (!state->rang) {
+      if (ring_doorbell(state->fd) == -1)
+         return -1;
+      state->rang = 1;
+   }
+   sched_yield();
+   return server_alive(state->fd) ? 0 : -1;
+}
+
+static int wait_data(shmem_ring_t *ring, void *arg)
+{
+   int fd = *((int *) arg);
+   if (client_spins == -1)
+      client_spins = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SHMEM_CLIENT_SPINS : 0;
+   if (shmem_ring_wait_data(ring, client_spins, SHMEM_LIVENESS_MS) == 0)
+      return 0;
+   return server_alive(fd) ? 0 : -1;
+}
+
+int client_open_connection_shmem(char* location, int number)
+{
+   int fd, result, sock_fd = -1, mem_fd = -1;
+   struct stat st;
+   int stat_cnt;
+   char ready[MAX_PATH_LEN];
+   struct sockaddr_un addr;
+   int dir_fd;
+   shmem_region_t *region = NULL;
+   pid_t pid;
+   struct msghdr hdr;
+   struct iovec iov;
+   struct cmsghdr *cmsg;
+   union {
+      char buf[CMSG_SPACE(sizeof(int))];
+      struct cmsghdr align;
+   } control;
+
+   debug_printf("Client creating shared memory connection to server\n");
+   fd = get_new_fd_shmem();
+   if (fd < 0)
+      return -1;
+
+   /* wait for directory (at most one minute) */
+   stat_cnt = 0;
+   snprintf(ready, MAX_PATH_LEN, "%s/spindle_comm/ready", location);
+   memset(&st, 0, sizeof(st));
+
+   while (((stat(ready, &st) == -1) || ((st.st_mode & (S_IRUSR | S_IWUSR)) == 0)) &&
+          (stat_cnt<600)) {
+      if (stat_cnt % 10 == 0)
+         debug_printf3("waiting: location %s does not exists (after %d seconds)\n", ready, stat_cnt/10);
+      usleep(100000); /* .1 seconds */
+      stat_cnt++;
+   }
+
+   pid = getpid();
+   mem_fd = create_region_fd(location);
+   if (mem_fd == -1)
+      goto error;
+   if (ftruncate(mem_fd, sizeof(shmem_region_t)) == -1) {
+      err_printf("Could not size shared memory region: %s\n", strerror(errno));
+      goto error;
+   }
+   region = map_region(mem_fd);
+   if (!region)
+      goto error;
+   region->magic = SHMEM_REGION_MAGIC;
+   region->size = sizeof(shmem_region_t);
+   region->client_pid = pid;
+   shmem_ring_init(&region->to_server);
+   shmem_ring_init(&region->to_client);
+
+   sock_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (sock_fd == -1) {
+      err_printf("Could not create unix socket: %s\n", strerror(errno));
+      goto error;
+   }
+
+   result = shmem_socket_addr(location, &addr, &dir_fd);
+   if (result == -1) {
+      err_printf("Could not open %s/spindle_comm: %s\n", location, strerror(errno));
+      goto error;
+   }
+   debug_printf3("Connecting to server socket %s\n", addr.sun_path);
+   result = connect(sock_fd, (struct sockaddr *) &addr, sizeof(addr));
+   if (dir_fd != -1)
+      close(dir_fd);
+   if (result == -1) {
+      err_printf("Could not connect to server at %s/spindle_comm: %s\n", location, strerror(errno));
+      goto error;
+   }
+
+   /* Hand the region to the server */
+   memset(&hdr, 0, sizeof(hdr));
+   memset(&control, 0, sizeof(control));
+   iov.iov_base = &pid;
+   iov.iov_len = sizeof(pid);
+   hdr.msg_iov = &iov;
+   hdr.msg_iovlen = 1;
+   hdr.msg_control = control.buf;
+   hdr.msg_controllen = sizeof(control.buf);
+   cmsg = CMSG_FIRSTHDR(&hdr);
+   cmsg->cmsg_level = SOL_SOCKET;
+   cmsg->cmsg_type = SCM_RIGHTS;
+   cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+   memcpy(CMSG_DATA(cmsg), &mem_fd, sizeof(int));
+   do {
+      result = sendmsg(sock_fd, &hdr, 0);
+   } while (result == -1 && errno == EINTR);
+   if (result != sizeof(pid)) {
+      err_printf("Could not send shared memory region to server: %s\n", strerror(errno));
+      goto error;
+   }
+
+   fdlist_shmem[fd].sock_fd = remap_to_high_fd(sock_fd);
+   fdlist_shmem[fd].mem_fd = remap_to_high_fd(mem_fd);
+   fdlist_shmem[fd].region = region;
+   debug_printf3("Opened shared memory connection with socket %d and region fd %d\n",
+                 fdlist_shmem[fd].sock_fd, fdlist_shmem[fd].mem_fd);
+   return fd;
+
+  error:
+   if (region)
+      munmap(region, sizeof(shmem_region_t));
+   if (sock_fd != -1)
+      close(sock_fd);
+   if (mem_fd != -1)
+      close(mem_fd);
+   return -1;
+}
+
+int client_register_connection_shmem(char *connection_str)
+{
+   int sock_fd, mem_fd, result, fd;
+   shmem_region_t *region;
+
+   result = sscanf(connection_str, "%d %d", &sock_fd, &mem_fd);
+   if (result != 2) {
+      err_printf("Reading connection string.  Returned %d on '%s'\n", result, connection_str);
+      return -1;
+   }
+
+   fd = get_new_fd_shmem();
+   if (fd < 0) {
+      err_printf("Could not create new shared memory connection\n");
+      return -1;
+   }
+
+   /* Our mapping didn't survive the exec, but the region's fd did */
+   region = map_region(mem_fd);
+   if (!region)
+      return -1;
+   if (region->magic != SHMEM_REGION_MAGIC || region->size != sizeof(shmem_region_t)) {
+      err_printf("Inherited shared memory region on fd %d is not a spindle connection\n", mem_fd);
+      munmap(region, sizeof(shmem_region_t));
+      return -1;
+   }
+
+   fdlist_shmem[fd].sock_fd = sock_fd;
+   fdlist_shmem[fd].mem_fd = mem_fd;
+   fdlist_shmem[fd].region = region;
+   return fd;
+}
+
+char *client_get_connection_string_shmem(int fd)
+{
+   char *str = (char *) spindle_malloc(64);
+   if (!str)
+      return NULL;
+   snprintf(str, 64, "%d %d", fdlist_shmem[fd].sock_fd, fdlist_shmem[fd].mem_fd);
+   return str;
+}
+
+int client_send_msg_shmem(int fd, ldcs_message_t *msg)
+{
+   struct iovec iov[2];
+   struct send_state_t state;
+   int result;
+
+   assert(fd >= 0 && fd < MAX_FD);
+
+   debug_printf3("sending message of size len=%d\n", msg->header.len);
+
+   iov[0].iov_base = &msg->header;
+   iov[0].iov_len = sizeof(msg->header);
+   iov[1].iov_base = msg->data;
+   iov[1].iov_len = msg->header.len;
+
+   state.fd = fd;
+   state.rang = 0;
+   result = shmem_ring_write(&fdlist_shmem[fd].region->to_server, iov, msg->header.len ? 2 : 1,
+                             wait_space, &state);
+   if (result == -1)
+      return -1;
+
+   if (!state.rang)
+      return ring_doorbell(fd);
+   return 0;
+}
+
+static int client_recv_msg_shmem(int fd, ldcs_message_t *msg, ldcs_read_block_t block, int is_dynamic)
+{
+   shmem_ring_t *ring;
+   int result;
+   msg->header.type=LDCS_MSG_UNKNOWN;
+   msg->header.len=0;
+
+   assert(fd >= 0 && fd < MAX_FD);
+   assert(block == LDCS_READ_BLOCK); /* Non-blocking isn't implemented yet */
+
+   ring = &fdlist_shmem[fd].region->to_client;
+   result = shmem_ring_read(ring, &msg->header, sizeof(msg->header), wait_data, &fd);
+   if (result == -1)
+      return -1;
+
+   if (msg->header.len == 0) {
+      msg->data = NULL;
+      return 0;
+   }
+
+   if (is_dynamic) {
+      msg->data = (char *) spindle_malloc(msg->header.len);
+   }
+
+   return shmem_ring_read(ring, msg->data, msg->header.len, wait_data, &fd);
+}
+
+int client_recv_msg_dynamic_shmem(int fd, ldcs_message_t *msg, ldcs_read_block_t block)
+{
+   return client_recv_msg_shmem(fd, msg, block, 1);
+}
+
+int client_recv_msg_static_shmem(int fd, ldcs_message_t *msg, ldcs_read_block_t block)
+{
+   return client_recv_msg_shmem(fd, msg, block, 0);
+}
+
+int is_client_fd(int connfd, int fd)
+{
+   return (fdlist_shmem[connfd].sock_fd == fd || fdlist_shmem[connfd].mem_fd == fd);
+}
+
+int client_close_connection_shmem(int fd)
+{
+   assert(fd >= 0 && fd < MAX_FD);
+
+   debug_printf2("Closing client connection.  Closing socket %d and region %d\n",
+                 fdlist_shmem[fd].sock_fd, fdlist_shmem[fd].mem_fd);
+
+   if (fdlist_shmem[fd].region)
+      munmap(fdlist_shmem[fd].region, sizeof(shmem_region_t));
+   fdlist_shmem[fd].region = NULL;
+
+   if (close(fdlist_shmem[fd].sock_fd) != 0)
+      err_printf("Error while closing socket %d: %s\n", fdlist_shmem[fd].sock_fd, strerror(errno));
+   if (close(fdlist_shmem[fd].mem_fd) != 0)
+      err_printf("Error while closing region %d: %s\n", fdlist_shmem[fd].mem_fd, strerror(errno));
+
+   return 0;
+}
+
+/**
+ * Collect an fd the server passed with its last reply.  It's close-on-exec
+ * until the caller decides otherwise.
+ **/
+int client_recv_fd_shmem(int fd)
+{
+   struct msghdr hdr;
+   struct iovec iov;
+   struct cmsghdr *cmsg;
+   char c;
+   int passfd = -1;
+   ssize_t result;
+   union {
+      char buf[CMSG_SPACE(sizeof(int))];
+      struct cmsghdr align;
+   } control;
+
+   assert(fd >= 0 && fd < MAX_FD);
+
+   memset(&hdr, 0, sizeof(hdr));
+   memset(&control, 0, sizeof(control));
+   iov.iov_base = &c;
+   iov.iov_len = 1;
+   hdr.msg_iov = &iov;
+   hdr.msg_iovlen = 1;
+   hdr.msg_control = control.buf;
+   hdr.msg_controllen = sizeof(control.buf);
+   do {
+      result = recvmsg(fdlist_shmem[fd].sock_fd, &hdr, MSG_CMSG_CLOEXEC);
+   } while (result == -1 && errno == EINTR);
+   if (result != 1) {
+      err_printf("Could not receive fd from server: %s\n", result == 0 ? "connection closed" : strerror(errno));
+      return -1;
+   }
+
+   cmsg = CMSG_FIRSTHDR(&hdr);
+   if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+       cmsg->cmsg_len != CMSG_LEN(sizeof(int))) {
+      err_printf("Server message on socket %d did not carry an fd\n", fdlist_shmem[fd].sock_fd);
+      return -1;
+   }
+   memcpy(&passfd, CMSG_DATA(cmsg), sizeof(int));
+   debug_printf3("Received fd %d from server\n", passfd);
+   return passfd;
+}
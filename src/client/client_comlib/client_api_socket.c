@@ -247,3 +247,8 @@ int client_recv_msg_static_socket(int fd, ldcs_message_t *msg,  ldcs_read_block_
   
   return(0);
 }
+
+int client_recv_fd_socket(int fd)
+{
+   return -1;
+}
@@ -42,6 +42,7 @@ extern char *RENAME(client_get_connection_string) (int fd);
 extern int RENAME(client_send_msg) (int connid, ldcs_message_t * msg);
 extern int RENAME(client_recv_msg_static) (int fd, ldcs_message_t *msg, ldcs_read_block_t block);
 extern int RENAME(client_recv_msg_dynamic) (int fd, ldcs_message_t *msg, ldcs_read_block_t block);
+extern int RENAME(client_recv_fd) (int fd);
 
 int client_open_connection(char* location, int number)
 {
@@ -78,3 +79,7 @@ int client_recv_msg_dynamic(int fd, ldcs_message_t *msg, ldcs_read_block_t block
    return RENAME(client_recv_msg_dynamic) (fd, msg, block);
 }
 
+int client_recv_fd(int fd)
+{
+   return RENAME(client_recv_fd) (fd);
+}
@@ -51,6 +51,9 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #ifndef COBO_CONNECT_SLEEP  
 #define COBO_CONNECT_SLEEP   (10) /* milliseconds -- wait this long before trying a new round of connects() */
 #endif
+#ifndef COBO_HANDSHAKE_STEP_TIMEOUT
+#define COBO_HANDSHAKE_STEP_TIMEOUT (10000) /* milliseconds -- drop a connection whose handshake peer goes quiet this long */
+#endif
 #ifndef COBO_CONNECT_TIMELIMIT
 #define COBO_CONNECT_TIMELIMIT (600) /* seconds -- wait this long before giving up for good */
 #endif
@@ -108,6 +111,7 @@ static int* cobo_child_fd   = NULL;  /* sockets to children */
 static int  cobo_num_child  = 0;     /* number of children */
 static int* cobo_child_incl = NULL;  /* number of children each child is responsible for (includes itself) */
 static int  cobo_num_child_incl = 0; /* total number of children this node is responsible for */
+static int  cobo_tree_fanout = 0;    /* children per task, 0 for a binomial tree */
 
 static int cobo_root_fd = -1;
 
@@ -119,6 +123,9 @@ double __cobo_ts = 0.0f;
 static struct timeval time_open, time_close;
 static struct timeval tree_start, tree_end;
 
+/* time spent in each phase of cobo_open, reduced to its max across the tree on rank 0 */
+static cobo_open_times_t cobo_open_times;
+
 /*
  * ==========================================================================
  * ==========================================================================
@@ -137,6 +144,11 @@ void cobo_register_preconnect_cb(cobo_preconnect_cb_t f)
    preconnect_cb = f;
 }
 
+void cobo_set_tree_fanout(int fanout)
+{
+   cobo_tree_fanout = (fanout > 0) ? fanout : 0;
+}
+
 
 /* Return the number of secs as a double between two timeval structs (tv2-tv1) */
 static double cobo_getsecs(struct timeval* tv2, struct timeval* tv1)
@@ -347,266 +359,378 @@ static int cobo_read_fd(int fd, void* buf, int size)
     return cobo_read_fd_w_timeout(fd, buf, size, -1);
 }
 
-/* Open a connection on socket FD to peer at ADDR (which LEN bytes long).
- * This function uses a non-blocking filedescriptor for the connect(),
- * and then does a bounded poll() for the connection to complete.  This
- * allows us to timeout the connect() earlier than TCP might do it on
- * its own.  We have seen timeouts that failed after several minutes,
- * where we would really prefer to time out earlier and retry the connect.
- *
- * Return 0 on success, -1 for errors.
- */
-static int cobo_connect_w_timeout(int fd, struct sockaddr const * addr, socklen_t len, int millisec)
+/* State of one outgoing connection in cobo_connect_hostnames */
+typedef enum {
+    COBO_CONN_CONNECT,    /* nonblocking connect() in progress */
+    COBO_CONN_HANDSHAKE,  /* authentication handshake in progress */
+    COBO_CONN_IDS,        /* waiting for the service and accept ids */
+    COBO_CONN_SLEEP,      /* scanned all ports, waiting to rescan */
+    COBO_CONN_DONE
+} cobo_conn_stage_t;
+
+typedef struct {
+    char* hostname;
+    int rank;
+    struct in_addr saddr;
+    int fd;
+    int fd_flags;
+    int port_index;
+    cobo_conn_stage_t stage;
+    handshake_session_t* hsession;
+    int connect_timeout;      /* milliseconds */
+    int reply_timeout;        /* milliseconds */
+    struct timeval deadline;  /* when the current connect/reply/sleep expires */
+    struct timeval connected; /* when our last TCP connection was established */
+    struct timeval authenticated;
+} cobo_conn_t;
+
+/* Returns the number of milliseconds from now until tv, or 0 if tv has passed */
+static int cobo_msecs_until(struct timeval* tv, struct timeval* now)
 {
-    int rc, flags, err;
-    socklen_t err_len;
-    struct pollfd ufds;
-
-    flags = fcntl(fd, F_GETFL);
-    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
-
-    err = 0;
-    rc = connect(fd , addr , len);
-    if (rc < 0 && errno != EINPROGRESS) {
-/*
-        err_printf("Nonblocking connect failed immediately (connect() %m errno=%d)\n",
-                   errno);
-*/
-        return -1;
-    }
-    if (rc == 0) {
-        goto done;  /* connect completed immediately */
+    if (!timercmp(now, tv, <)) {
+        return 0;
     }
+    struct timeval result;
+    timersub(tv, now, &result);
+    return (int) (result.tv_sec * 1000 + (result.tv_usec + 999) / 1000);
+}
 
-    ufds.fd = fd;
-    ufds.events = POLLIN | POLLOUT;
-    ufds.revents = 0;
+static void cobo_set_deadline(struct timeval* deadline, struct timeval* now, int millisec)
+{
+    struct timeval delta;
+    delta.tv_sec  = millisec / 1000;
+    delta.tv_usec = (millisec % 1000) * 1000;
+    timeradd(now, &delta, deadline);
+}
 
-again:	rc = poll(&ufds, 1, millisec);
-    if (rc == -1) {
-        /* poll failed */
-        if (errno == EINTR) {
-            /* NOTE: connect() is non-interruptible in Linux */
-            goto again;
-        } else {
-/*
-            err_printf("Polling connection (poll() %m errno=%d)\n",
-                       errno);
-*/
+/* Start a nonblocking connect() to the next port in our list.  If we've
+ * run out of ports, put the connection to sleep before the next scan. */
+static void cobo_conn_next_port(cobo_conn_t* conn, struct timeval* now)
+{
+    while (conn->port_index < cobo_num_ports) {
+        int port = cobo_ports[conn->port_index++];
+        struct sockaddr_in sockaddr;
+        memset(&sockaddr, 0, sizeof(sockaddr));
+        sockaddr.sin_family = AF_INET;
+        sockaddr.sin_addr = conn->saddr;
+        sockaddr.sin_port = htons(port);
+
+        debug_printf3("Trying rank %d port %d on %s\n", conn->rank, port, conn->hostname);
+        int s = socket(AF_INET, SOCK_STREAM, 0); /* IPPROTO_TCP */
+        if (s < 0) {
+            err_printf("Creating socket (socket() %m errno=%d)\n", errno);
+            continue;
         }
-        return -1;
-    } else if (rc == 0) {
-        /* poll timed out before any socket events */
-        /* perror("cobo_connect_w_timeout poll timeout"); */
-        return -1;
-    } else {
-        /* poll saw some event on the socket
-         * We need to check if the connection succeeded by
-         * using getsockopt.  The revent is not necessarily
-         * POLLERR when the connection fails! */
-        err_len = (socklen_t) sizeof(err);
-        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &err_len) < 0) {
-/*
-            err_printf("Failed to read event on socket (getsockopt() %m errno=%d)\n",
-                       errno);
-*/
-            return -1; /* solaris pending error */
+        conn->fd_flags = fcntl(s, F_GETFL);
+        fcntl(s, F_SETFL, conn->fd_flags | O_NONBLOCK);
+
+        int rc = connect(s, (struct sockaddr *) &sockaddr, sizeof(sockaddr));
+        if (rc < 0 && errno != EINPROGRESS) {
+            close(s);
+            continue;
         }
+        conn->fd = s;
+        conn->stage = COBO_CONN_CONNECT;
+        cobo_set_deadline(&conn->deadline, now, conn->connect_timeout);
+        return;
     }
 
-done:
-    fcntl(fd, F_SETFL, flags);
+    /* sleep for some time before we try another port scan */
+    conn->fd = -1;
+    conn->stage = COBO_CONN_SLEEP;
+    cobo_set_deadline(&conn->deadline, now, cobo_connect_sleep);
+}
 
-    /* NOTE: Connection refused is typically reported for
-     * non-responsive nodes plus attempts to communicate
-     * with terminated launcher. */
-    if (err) {
-/*
-        err_printf("Error on socket in cobo_connect_w_timeout() (getsockopt() set err=%d)\n",
-                   err);
-*/
-        return -1;
+/* Drop the current connection attempt and move on to the next port */
+static void cobo_conn_retry(cobo_conn_t* conn, struct timeval* now)
+{
+    if (conn->hsession) {
+        spindle_handshake_cancel(conn->hsession);
+        conn->hsession = NULL;
     }
- 
-    return 0;
+    if (conn->fd != -1) {
+        close(conn->fd);
+        conn->fd = -1;
+    }
+    cobo_conn_next_port(conn, now);
 }
 
-/* Connect to given IP:port.  Upon successful connection, cobo_connect
- * shall return the connected socket file descriptor.  Otherwise, -1 shall be
- * returned.
- */
-static int cobo_connect(struct in_addr ip, int port, int timeout)
+/* Act on the result of a (possibly partial) handshake */
+static void cobo_conn_handshake_result(cobo_conn_t* conn, int result, struct timeval* now)
 {
-    struct sockaddr_in sockaddr;
+    switch (result) {
+       case HSHAKE_IN_PROGRESS:
+          /* give the peer as long to answer as a blocking handshake read would */
+          conn->stage = COBO_CONN_HANDSHAKE;
+          cobo_set_deadline(&conn->deadline, now, COBO_HANDSHAKE_STEP_TIMEOUT);
+          return;
+       case HSHAKE_SUCCESS:
+          break;
+       case HSHAKE_INTERNAL_ERROR:
+          err_printf("Internal error doing handshake: %s", spindle_handshake_last_error_str());
+          exit(-1);
+          break;
+       case HSHAKE_DROP_CONNECTION:
+       case HSHAKE_CONNECTION_REFUSED:
+          debug_printf3("Handshake said to drop connection\n");
+          conn->hsession = NULL;
+          cobo_conn_retry(conn, now);
+          return;
+       case HSHAKE_ABORT:
+          handle_security_error(spindle_handshake_last_error_str());
+          abort();
+       default:
+          assert(0 && "Unknown return value from handshake_client\n");
+    }
+    conn->hsession = NULL;
+
+    /* write cobo service id and our session id */
+    if (cobo_write_fd_w_suppress(conn->fd, &cobo_serviceid, sizeof(cobo_serviceid), 1) < 0 ||
+        cobo_write_fd_w_suppress(conn->fd, &cobo_sessionid, sizeof(cobo_sessionid), 1) < 0)
+    {
+        debug_printf3("Writing service and session id to %s failed\n", conn->hostname);
+        cobo_conn_retry(conn, now);
+        return;
+    }
+    conn->stage = COBO_CONN_IDS;
+    cobo_set_deadline(&conn->deadline, now, conn->reply_timeout);
+}
 
-    /* set up address to connect to */
-    sockaddr.sin_family = AF_INET;
-    sockaddr.sin_addr = ip;
-    sockaddr.sin_port = port;
+/* Read the service and accept ids once the peer has replied, and ack them */
+static void cobo_conn_check_ids(cobo_conn_t* conn, struct timeval* now)
+{
+    unsigned int received_serviceid = 0;
+    unsigned int received_acceptid = 0;
+    unsigned int ack = 1;
 
-    /* create a socket */
-    int s = socket(AF_INET, SOCK_STREAM, 0); /* IPPROTO_TCP */
-    if (s < 0) {
-        err_printf("Creating socket (socket() %m errno=%d)\n",
-                   errno);
-        return -1;
+    if (cobo_read_fd_w_timeout(conn->fd, &received_serviceid, sizeof(received_serviceid), conn->reply_timeout) < 0 ||
+        cobo_read_fd_w_timeout(conn->fd, &received_acceptid, sizeof(received_acceptid), conn->reply_timeout) < 0)
+    {
+        debug_printf3("Receiving service or accept id from %s failed\n", conn->hostname);
+        cobo_conn_retry(conn, now);
+        return;
     }
 
-    /* connect socket to address */
-    if (cobo_connect_w_timeout(s, (struct sockaddr *) &sockaddr, sizeof(sockaddr), timeout) < 0) {
-        close(s);
-        return -1;
+    /* check that we got the expected service and accept ids */
+    if (received_serviceid != cobo_serviceid || received_acceptid != cobo_acceptid) {
+        cobo_conn_retry(conn, now);
+        return;
     }
 
-    _cobo_opt_socket(s);
+    /* write ack to finalize connection (no need to suppress write errors any longer) */
+    if (cobo_write_fd(conn->fd, &ack, sizeof(ack)) < 0) {
+        debug_printf3("Writing ack to finalize connection to rank %d on %s\n",
+                      conn->rank, conn->hostname);
+        cobo_conn_retry(conn, now);
+        return;
+    }
 
-    return s;
+    conn->stage = COBO_CONN_DONE;
+    conn->authenticated = *now;
 }
 
-/* Attempts to connect to a given hostname using a port list and timeouts */
-static int cobo_connect_hostname(char* hostname, int rank)
+/* Attempts to connect to each of the given hostnames using a port list and timeouts.
+ * All connections, including their handshakes, are driven concurrently from a single
+ * poll loop, so the cost of a slow peer or slow authentication is only paid once
+ * rather than once per host.  On success fds[i] is the connected socket for hostnames[i]
+ * and connect_secs/handshake_secs (if non-NULL) are set to the time taken until all TCP
+ * connections were established and from then until all were authenticated. */
+static int cobo_connect_hostnames(int num, char** hostnames, int* ranks, int* fds,
+                                  double* connect_secs, double* handshake_secs)
 {
-    int s = -1;
-    struct in_addr saddr;
-
-    /* lookup host address by name */
-    struct hostent* he = gethostbyname(hostname);
-    if (!he) {
-       /* gethostbyname doesn't know how to resolve hostname, trying inet_addr */ 
-       saddr.s_addr = inet_addr(hostname);
-       if (saddr.s_addr == -1) {
-           err_printf("Hostname lookup failed (gethostbyname(%s) %s h_errno=%d)\n",
-                hostname, hstrerror(h_errno), h_errno);
-           return s;
-       }
-    }
-    else {
-      saddr = *((struct in_addr *) (*he->h_addr_list));
-    }
+    int i, result, remaining = num;
+    struct timeval start, now, last_connected, last_authenticated;
+    cobo_conn_t* conns = (cobo_conn_t*) cobo_malloc(num * sizeof(cobo_conn_t), "Connection state array");
+    struct pollfd* pfds = (struct pollfd*) cobo_malloc(num * sizeof(struct pollfd), "Connection poll array");
+    cobo_conn_t** polled = (cobo_conn_t**) cobo_malloc(num * sizeof(cobo_conn_t*), "Connection poll map");
 
-    /* Loop until we make a connection or until our timeout expires. */
-    struct timeval start, end;
     cobo_gettimeofday(&start);
-    double secs = 0;
-    int connected = 0;
-    int connect_timeout = cobo_connect_timeout;
-    int reply_timeout = cobo_connect_timeout * 10;
-    int result;
-    while (!connected && secs < cobo_connect_timelimit) {
-        /* iterate over our ports trying to find a connection */
-        int i;
-        for (i=0; i < cobo_num_ports; i++) {
-            /* get our port */
-            int port = cobo_ports[i];
-
-            /* attempt to connect to hostname on this port */
-            debug_printf3("Trying rank %d port %d on %s\n", rank, port, hostname);
-            /* s = cobo_connect(*(struct in_addr *) (*he->h_addr_list), htons(port)); */
-            s = cobo_connect(saddr, htons(port), connect_timeout);
-            if (s != -1) {
-                /* got a connection, let's test it out */
-                debug_printf3("Connected to rank %d port %d on %s\n", rank, port, hostname);
-                int test_failed = 0;
-
-                result = spindle_handshake_client(s, &cobo_handshake, cobo_sessionid);
-                switch (result) {
-                   case HSHAKE_SUCCESS:
-                      break;
-                   case HSHAKE_INTERNAL_ERROR:
-                      err_printf("Internal error doing handshake: %s", spindle_handshake_last_error_str());
-                      exit(-1);
-                      break;
-                   case HSHAKE_DROP_CONNECTION:
-                      debug_printf3("Handshake said to drop connection\n");
-                      close(s);
-                      continue;
-                   case HSHAKE_ABORT:
-                      handle_security_error(spindle_handshake_last_error_str());
-                      abort();
-                   default:
-                      assert(0 && "Unknown return value from handshake_server\n");
-                }
-                
-                /* write cobo service id */
-                if (!test_failed && cobo_write_fd_w_suppress(s, &cobo_serviceid, sizeof(cobo_serviceid), 1) < 0) {
-                    debug_printf3("Writing service id to %s on port %d\n",
-                                  hostname, port);
-                    test_failed = 1;
-                }
-
-                /* write our session id */
-                if (!test_failed && cobo_write_fd_w_suppress(s, &cobo_sessionid, sizeof(cobo_sessionid), 1) < 0) {
-                    debug_printf3("Writing session id to %s on port %d\n",
-                                  hostname, port);
-                    test_failed = 1;
-                }
+    now = start;
+    last_connected = last_authenticated = start;
+
+    for (i = 0; i < num; i++) {
+        cobo_conn_t* conn = conns + i;
+        memset(conn, 0, sizeof(*conn));
+        conn->hostname = hostnames[i];
+        conn->rank = ranks[i];
+        conn->fd = -1;
+        conn->connect_timeout = cobo_connect_timeout;
+        conn->reply_timeout = cobo_connect_timeout * 10;
+        fds[i] = -1;
+
+        /* lookup host address by name */
+        struct hostent* he = gethostbyname(conn->hostname);
+        if (!he) {
+            /* gethostbyname doesn't know how to resolve hostname, trying inet_addr */ 
+            conn->saddr.s_addr = inet_addr(conn->hostname);
+            if (conn->saddr.s_addr == -1) {
+                err_printf("Hostname lookup failed (gethostbyname(%s) %s h_errno=%d)\n",
+                           conn->hostname, hstrerror(h_errno), h_errno);
+                result = -1;
+                goto done;
+            }
+        }
+        else {
+            conn->saddr = *((struct in_addr *) (*he->h_addr_list));
+        }
 
-                /* read the service id */
-                unsigned int received_serviceid = 0;
-                if (!test_failed && cobo_read_fd_w_timeout(s, &received_serviceid, sizeof(received_serviceid), reply_timeout) < 0) {
-                    debug_printf3("Receiving service id from %s on port %d failed\n",
-                              hostname, port);
-                    test_failed = 1;
-                }
+        cobo_conn_next_port(conn, &now);
+    }
 
-                /* read the accept id */
-                unsigned int received_acceptid = 0;
-                if (!test_failed && cobo_read_fd_w_timeout(s, &received_acceptid, sizeof(received_acceptid), reply_timeout) < 0) {
-                    debug_printf3("Receiving accept id from %s on port %d failed\n",
-                              hostname, port);
-                    test_failed = 1;
-                }
+    /* Loop until we make every connection or until our timeout expires. */
+    while (remaining) {
+        int num_polled = 0;
+        int timeout = -1;
+        for (i = 0; i < num; i++) {
+            cobo_conn_t* conn = conns + i;
+            if (conn->stage == COBO_CONN_DONE) {
+                continue;
+            }
+            int msecs = cobo_msecs_until(&conn->deadline, &now);
+            if (timeout == -1 || msecs < timeout) {
+                timeout = msecs;
+            }
+            if (conn->stage == COBO_CONN_SLEEP) {
+                continue;
+            }
+            pfds[num_polled].fd = conn->fd;
+            pfds[num_polled].events = (conn->stage == COBO_CONN_CONNECT) ? (POLLIN | POLLOUT) : POLLIN;
+            pfds[num_polled].revents = 0;
+            polled[num_polled] = conn;
+            num_polled++;
+        }
 
-                /* check that we got the expected service and accept ids */
-                if (!test_failed && (received_serviceid != cobo_serviceid || received_acceptid != cobo_acceptid)) {
-                    test_failed = 1;
-                }
+        /* wake up regularly to check the time limit */
+        if (timeout == -1 || timeout > 1000) {
+            timeout = 1000;
+        }
 
-                /* write ack to finalize connection (no need to suppress write errors any longer) */
-                unsigned int ack = 1;
-                if (!test_failed && cobo_write_fd(s, &ack, sizeof(ack)) < 0) {
-                    debug_printf3("Writing ack to finalize connection to rank %d on %s port %d\n",
-                               rank, hostname, port);
-                    test_failed = 1;
-                }
+        int nready = poll(pfds, num_polled, timeout);
+        if (nready == -1 && errno != EINTR) {
+            err_printf("Polling connections (poll() %m errno=%d)\n", errno);
+            result = -1;
+            goto done;
+        }
+        cobo_gettimeofday(&now);
 
-                /* if the connection test failed, close the socket, otherwise we've got a good connection */
-                if (test_failed) {
-                    close(s);
-                } else {
-                    connected = 1;
-                    break;
-                }
+        /* progress any connection with socket events */
+        for (i = 0; i < num_polled && nready > 0; i++) {
+            cobo_conn_t* conn = polled[i];
+            if (!pfds[i].revents) {
+                continue;
+            }
+            switch (conn->stage) {
+               case COBO_CONN_CONNECT: {
+                  /* We need to check if the connection succeeded by
+                   * using getsockopt.  The revent is not necessarily
+                   * POLLERR when the connection fails! */
+                  int err = 0;
+                  socklen_t err_len = (socklen_t) sizeof(err);
+                  if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &err, &err_len) < 0 || err) {
+                      /* NOTE: Connection refused is typically reported for
+                       * non-responsive nodes plus attempts to communicate
+                       * with terminated launcher. */
+                      cobo_conn_retry(conn, &now);
+                      break;
+                  }
+                  fcntl(conn->fd, F_SETFL, conn->fd_flags);
+                  _cobo_opt_socket(conn->fd);
+                  conn->connected = now;
+
+                  /* got a connection, let's test it out */
+                  debug_printf3("Connected to rank %d port %d on %s\n", conn->rank,
+                                cobo_ports[conn->port_index - 1], conn->hostname);
+                  result = spindle_handshake_begin(conn->fd, &cobo_handshake, cobo_sessionid, 0, &conn->hsession);
+                  cobo_conn_handshake_result(conn, result, &now);
+                  break;
+               }
+               case COBO_CONN_HANDSHAKE:
+                  result = spindle_handshake_step(conn->hsession);
+                  cobo_conn_handshake_result(conn, result, &now);
+                  break;
+               case COBO_CONN_IDS:
+                  cobo_conn_check_ids(conn, &now);
+                  break;
+               default:
+                  break;
+            }
+            if (conn->stage == COBO_CONN_DONE) {
+                remaining--;
             }
         }
 
-        /* sleep for some time before we try another port scan */
-        if (!connected) {
-            usleep(cobo_connect_sleep * 1000);
-
-            /* maybe we connected ok, but we were too impatient waiting for a reply, extend the reply timeout for the next attempt */
-            if (connect_timeout < 30000) {
-              connect_timeout *= cobo_connect_backoff;
-              reply_timeout   *= cobo_connect_backoff;
+        /* handle expired timers and the overall time limit */
+        for (i = 0; i < num; i++) {
+            cobo_conn_t* conn = conns + i;
+            if (conn->stage == COBO_CONN_DONE) {
+                continue;
+            }
+            if (cobo_getsecs(&now, &start) >= cobo_connect_timelimit) {
+                err_printf("Time limit to connect to rank %d on %s expired\n",
+                           conn->rank, conn->hostname);
+                err_printf("Connecting socket to %s at %s failed\n",
+                           conn->hostname, inet_ntoa(conn->saddr));
+                result = -1;
+                goto done;
+            }
+            if (cobo_msecs_until(&conn->deadline, &now) > 0) {
+                continue;
+            }
+            if (conn->stage == COBO_CONN_SLEEP) {
+                /* maybe we connected ok, but we were too impatient waiting for a reply, extend the reply timeout for the next attempt */
+                if (conn->connect_timeout < 30000) {
+                    conn->connect_timeout *= cobo_connect_backoff;
+                    conn->reply_timeout   *= cobo_connect_backoff;
+                }
+                conn->port_index = 0;
+                cobo_conn_next_port(conn, &now);
+            }
+            else {
+                /* connect(), handshake or reply timed out */
+                cobo_conn_retry(conn, &now);
             }
         }
+    }
 
-        /* compute how many seconds we've spent trying to connect */
-        cobo_gettimeofday(&end);
-        secs = cobo_getsecs(&end, &start);
-        if (secs >= cobo_connect_timelimit) {
-            err_printf("Time limit to connect to rank %d on %s expired\n",
-                       rank, hostname);
+    for (i = 0; i < num; i++) {
+        fds[i] = conns[i].fd;
+        if (timercmp(&conns[i].connected, &last_connected, >)) {
+            last_connected = conns[i].connected;
+        }
+        if (timercmp(&conns[i].authenticated, &last_authenticated, >)) {
+            last_authenticated = conns[i].authenticated;
         }
     }
+    if (connect_secs) {
+        *connect_secs = cobo_getsecs(&last_connected, &start);
+    }
+    if (handshake_secs) {
+        *handshake_secs = cobo_getsecs(&last_authenticated, &last_connected);
+    }
+    result = 0;
 
-    /* check that we successfully opened a socket */
-    if (s == -1) {
-        err_printf("Connecting socket to %s at %s failed\n",
-                   hostname, inet_ntoa(saddr));
-        return s;
+  done:
+    if (result != 0) {
+        for (i = 0; i < num; i++) {
+            if (conns[i].hsession) {
+                spindle_handshake_cancel(conns[i].hsession);
+            }
+            if (conns[i].fd != -1) {
+                close(conns[i].fd);
+            }
+        }
     }
+    cobo_free(conns);
+    cobo_free(pfds);
+    cobo_free(polled);
+    return result;
+}
 
+/* Attempts to connect to a given hostname using a port list and timeouts */
+static int cobo_connect_hostname(char* hostname, int rank)
+{
+    int s = -1;
+    cobo_connect_hostnames(1, &hostname, &rank, &s, NULL, NULL);
     return s;
 }
 
@@ -636,6 +760,13 @@ static int cobo_send_hostlist(int s, char* hostname, int rank, int ranks, void*
         return (!COBO_SUCCESS);
     }
 
+    /* forward the tree shape, so every task computes the same tree */
+    if (cobo_write_fd(s, &cobo_tree_fanout, sizeof(cobo_tree_fanout)) < 0) {
+        err_printf("Writing hostname table to rank %d on %s failed\n",
+                   rank, hostname);
+        return (!COBO_SUCCESS);
+    }
+
     /* forward the size of the hostlist in bytes */
     if (cobo_write_fd(s, &bytes, sizeof(bytes)) < 0) {
         err_printf("Writing hostname table to rank %d on %s failed\n",
@@ -673,9 +804,77 @@ static char* cobo_expand_hostname(int rank)
     return strdup(hostname);
 }
 
-/* given cobo_me and cobo_nprocs, fills in parent and children ranks -- currently implements a binomial tree */
+/* given cobo_me, cobo_nprocs and cobo_tree_fanout, fills in parent and children ranks of a k-ary tree.
+ * As in the binomial tree, each subtree covers a contiguous range of ranks and children are
+ * stored with the highest rank first. */
+static int cobo_compute_children_kary()
+{
+    int max_children = cobo_tree_fanout;
+
+    /* prepare data structures to store our parent and children */
+    cobo_parent = 0;
+    cobo_num_child = 0;
+    cobo_num_child_incl = 0;
+    cobo_child      = (int*) cobo_malloc(max_children * sizeof(int), "Child rank array");
+    cobo_child_fd    = (int*) cobo_malloc(max_children * sizeof(int), "Child socket fd array");
+    cobo_child_incl = (int*) cobo_malloc(max_children * sizeof(int), "Child children count array");
+
+    /* walk down from the root, splitting the ranks below each task evenly among its children */
+    int low  = 0;
+    int high = cobo_nprocs - 1;
+    while (high - low > 0) {
+        int n = high - low;
+        int base = n / cobo_tree_fanout;
+        int extra = n % cobo_tree_fanout;
+        int start = low + 1;
+        int c;
+        int next_low = -1, next_high = -1;
+        for (c = 0; c < cobo_tree_fanout && start <= high; c++) {
+            int size = base + (c < extra ? 1 : 0);
+            if (low == cobo_me) {
+                cobo_child[cobo_num_child] = start;
+                cobo_child_incl[cobo_num_child] = size;
+                cobo_num_child++;
+                cobo_num_child_incl += size;
+            }
+            else if (cobo_me >= start && cobo_me < start + size) {
+                next_low = start;
+                next_high = start + size - 1;
+            }
+            start += size;
+        }
+
+        if (low == cobo_me) {
+            break;
+        }
+        cobo_parent = low;
+        low = next_low;
+        high = next_high;
+    }
+
+    /* match the binomial tree's ordering, farthest child first */
+    int i;
+    for (i = 0; i < cobo_num_child / 2; i++) {
+        int j = cobo_num_child - 1 - i;
+        int tmp = cobo_child[i];
+        cobo_child[i] = cobo_child[j];
+        cobo_child[j] = tmp;
+        tmp = cobo_child_incl[i];
+        cobo_child_incl[i] = cobo_child_incl[j];
+        cobo_child_incl[j] = tmp;
+    }
+
+    return COBO_SUCCESS;
+}
+
+/* given cobo_me and cobo_nprocs, fills in parent and children ranks -- implements a binomial tree
+ * unless a fanout was set with cobo_set_tree_fanout */
 static int cobo_compute_children()
 {
+    if (cobo_tree_fanout > 0) {
+        return cobo_compute_children_kary();
+    }
+
     /* compute the maximum number of children this task may have */
     int n = 1;
     int max_children = 0;
@@ -764,6 +963,9 @@ static int cobo_compute_children_root_C1()
 /* open socket tree across tasks */
 static int cobo_open_tree()
 {
+    struct timeval phase_start, phase_end;
+    cobo_gettimeofday(&phase_start);
+
     /* create a socket to accept connection from parent IPPROTO_TCP */
     int sockfd = socket(AF_INET, SOCK_STREAM, 0);
     if (sockfd < 0) {
@@ -901,7 +1103,11 @@ static int cobo_open_tree()
         have_parent = 1;
     }
 
+    /* we've got the connection to our parent, so close the listening socket */
+    close(sockfd);
+
     cobo_gettimeofday(&tree_start);
+    cobo_open_times.parent_accept = cobo_getsecs(&tree_start, &phase_start);
 
     /* TODO: exchange protocol version number */
 
@@ -917,6 +1123,12 @@ static int cobo_open_tree()
         exit(1);
     }
 
+    /* read the tree shape chosen by the server */
+    if (cobo_read_fd(cobo_parent_fd, &cobo_tree_fanout, sizeof(int)) < 0) {
+        err_printf("Receiving tree fanout from parent failed\n");
+        exit(1);
+    }
+
     /* read the size of the hostlist (in bytes) */
     if (cobo_read_fd(cobo_parent_fd, &cobo_hostlist_size, sizeof(int)) < 0) {
         err_printf("Receiving size of hostname table from parent failed\n");
@@ -929,6 +1141,8 @@ static int cobo_open_tree()
         err_printf("Receiving hostname table from parent failed\n");
         exit(1);
     }
+    cobo_gettimeofday(&phase_end);
+    cobo_open_times.hostlist_recv = cobo_getsecs(&phase_end, &tree_start);
 
 /*
     if (cobo_me == 0) {
@@ -951,29 +1165,32 @@ static int cobo_open_tree()
     }
 
     /* Spindle can register a pre-connect callback, which can be used to
-       spawn daemons */
-    if (preconnect_cb) {
-       for (i = 0; i < cobo_num_child; i++)
-          preconnect_cb(child_names[i]);
+       spawn daemons.  It gets all children at once so it can start them in parallel. */
+    if (preconnect_cb && cobo_num_child) {
+       if (preconnect_cb((const char **) child_names, cobo_num_child) != 0) {
+          err_printf("Failed to start children of rank %d\n", cobo_me);
+          exit(1);
+       }
     }
 
-    /* for each child, open socket connection and forward hostname table */
+    /* open socket connections to all children at once */
+    if (cobo_num_child) {
+        if (cobo_connect_hostnames(cobo_num_child, child_names, cobo_child, cobo_child_fd,
+                                   &cobo_open_times.child_connect, &cobo_open_times.child_handshake) != 0) {
+            err_printf("Failed to connect to children of rank %d\n", cobo_me);
+            exit(1);
+        }
+    }
+
+    /* tell each child what rank he is and forward the hostname table to him */
+    cobo_gettimeofday(&phase_start);
     for(i=0; i < cobo_num_child; i++) {
         /* get rank and hostname for this child */
         int c = cobo_child[i];
         char* child_hostname = child_names[i];
 
-        debug_printf3("%d: on COBO%02d: connect to child #%02d (%s)\n",i,cobo_me,c,child_hostname);
-
-        /* connect to child */
-        cobo_child_fd[i] = cobo_connect_hostname(child_hostname, c);
-        if (cobo_child_fd[i] == -1) {
-            err_printf("Failed to connect to child (rank %d) on %s failed\n",
-                       c, child_hostname);
-            exit(1);
-        }
+        debug_printf3("%d: on COBO%02d: forward hostlist to child #%02d (%s)\n",i,cobo_me,c,child_hostname);
 
-        /* tell child what rank he is and forward the hostname table to him */
         int forward = cobo_send_hostlist(cobo_child_fd[i], child_hostname, c,
                           cobo_nprocs, cobo_hostlist, cobo_hostlist_size);
         if (forward != COBO_SUCCESS) {
@@ -985,12 +1202,11 @@ static int cobo_open_tree()
         /* free the child hostname string */
         free(child_hostname);
     }
+    cobo_gettimeofday(&phase_end);
+    cobo_open_times.hostlist_send = cobo_getsecs(&phase_end, &phase_start);
 
     free(child_names);
 
-    /* we've got the connection to our parent, so close the listening socket */
-    close(sockfd);
-    
     return COBO_SUCCESS;
 }
 
@@ -1108,6 +1324,38 @@ static int cobo_allreduce_max_int_tree(int* sendbuf, int* recvbuf)
     return rc;
 }
 
+/* reduce the element-wise maximum of count doubles into vals on rank 0 */
+static int cobo_reduce_max_double_tree(double* vals, int count)
+{
+    double* child_vals = (double*) cobo_malloc(count * sizeof(double), "Child values in cobo_reduce_max_double_tree");
+
+    /* if i have any children, receive their data */
+    int i, j;
+    for(i=cobo_num_child-1; i>=0; i--) {
+        if (cobo_read_fd(cobo_child_fd[i], child_vals, count * sizeof(double)) < 0) {
+            err_printf("Reducing data from child (rank %d) failed\n",
+                       cobo_child[i]);
+            exit(1);
+        }
+        for (j=0; j<count; j++) {
+            if (child_vals[j] > vals[j]) {
+                vals[j] = child_vals[j];
+            }
+        }
+    }
+    cobo_free(child_vals);
+
+    /* forward data to parent if we're not rank 0 */
+    if (cobo_me != 0) {
+        if (cobo_write_fd(cobo_parent_fd, vals, count * sizeof(double)) < 0) {
+            err_printf("Sending reduced data to parent failed\n");
+            exit(1);
+        }
+    }
+
+    return COBO_SUCCESS;
+}
+
 /* gather sendcount bytes from sendbuf on each task into recvbuf on rank 0 */
 static int cobo_gather_tree(void* sendbuf, int sendcount, void* recvbuf)
 {
@@ -1207,6 +1455,13 @@ int cobo_get_num_childs(int* num_childs) {
   return COBO_SUCCESS;
 }
 
+/* fills in times with the per-phase cost of cobo_open.  On rank 0 these are the max over all tasks. */
+int cobo_get_open_times(cobo_open_times_t* times)
+{
+    *times = cobo_open_times;
+    return COBO_SUCCESS;
+}
+
 
 
 /* fills in fd with socket file desriptor to our parent */
@@ -1487,10 +1742,20 @@ int cobo_open(uint64_t sessionid, int* portlist, int num_ports, int* rank, int*
     cobo_open_tree();
 
     /* need to check that tree opened successfully before returning, so do a barrier */
+    struct timeval barrier_start, barrier_end;
+    cobo_gettimeofday(&barrier_start);
     if (cobo_barrier() != COBO_SUCCESS) {
         err_printf("Failed to open tree\n");
         exit(1);
     }
+    cobo_gettimeofday(&barrier_end);
+    cobo_open_times.barrier = cobo_getsecs(&barrier_end, &barrier_start);
+
+    debug_printf3("cobo_open phase times: parent_accept %f, hostlist_recv %f, child_connect %f, "
+                  "child_handshake %f, hostlist_send %f, barrier %f\n",
+                  cobo_open_times.parent_accept, cobo_open_times.hostlist_recv, cobo_open_times.child_connect,
+                  cobo_open_times.child_handshake, cobo_open_times.hostlist_send, cobo_open_times.barrier);
+    cobo_reduce_max_double_tree((double *) &cobo_open_times, sizeof(cobo_open_times) / sizeof(double));
 
     if (cobo_me == 0) {
         cobo_gettimeofday(&tree_end);
@@ -1562,6 +1827,11 @@ int cobo_server_open(uint64_t sessionid, char** hostlist, int num_hosts, int* po
         return (!COBO_SUCCESS);
     }
 
+    /* no task can have more children than there are other tasks */
+    if (cobo_tree_fanout > 1 && cobo_tree_fanout >= num_hosts) {
+        cobo_tree_fanout = (num_hosts > 1) ? num_hosts - 1 : 1;
+    }
+
     /* determine the total number of bytes to hold the strings including terminating NUL character */
     int i;
     int size = 0;
@@ -1588,8 +1858,12 @@ int cobo_server_open(uint64_t sessionid, char** hostlist, int num_hosts, int* po
 
     /* Spindle can register a pre-connect callback, which can be used to
        spawn daemons */
-    if (preconnect_cb)
-       preconnect_cb(hostlist[0]);
+    if (preconnect_cb) {
+       if (preconnect_cb((const char **) hostlist, 1) != 0) {
+          err_printf("Failed to start root task on %s\n", hostlist[0]);
+          return (!COBO_SUCCESS);
+       }
+    }
             
     /* copy the portlist */
     cobo_num_ports = num_ports;
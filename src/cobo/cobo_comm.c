@@ -31,6 +31,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include <arpa/inet.h>
 #include <poll.h>
 #include <assert.h>
+#include <sys/uio.h>
 #include "ldcs_cobo.h"
 #include "spindle_debug.h"
 #include "cobo_comm.h"
@@ -225,6 +226,53 @@ int ll_write(int fd, void *buf, size_t count)
    return 0;
 }
 
+int ll_writev(int fd, const struct iovec *iov, int iovcnt)
+{
+   struct iovec *cur, *iov_copy;
+   int result, error, remaining = iovcnt;
+   size_t count = 0;
+
+   iov_copy = (struct iovec *) malloc(sizeof(struct iovec) * iovcnt);
+   memcpy(iov_copy, iov, sizeof(struct iovec) * iovcnt);
+   cur = iov_copy;
+   for (result = 0; result < iovcnt; result++)
+      count += iov[result].iov_len;
+
+   debug_printf3("Have %lu bytes in %d segments to write to network\n", count, iovcnt);
+
+   while (remaining) {
+      result = writev(fd, cur, remaining);
+      if (result == -1) {
+         if (errno == EINTR || errno == EAGAIN)
+            continue;
+         error = errno;
+         err_printf("Error writing to cobo FD %d: %s\n", fd, strerror(error));
+         free(iov_copy);
+         return -1;
+      }
+      else if (result == 0 && count) {
+         err_printf("Unexpected exit from peer\n");
+         free(iov_copy);
+         return -1;
+      }
+      count -= result;
+
+      /* skip the fully written segments and advance into a partially written one */
+      while (remaining && (size_t) result >= cur->iov_len) {
+         result -= cur->iov_len;
+         cur++;
+         remaining--;
+      }
+      if (remaining) {
+         cur->iov_base = ((unsigned char *) cur->iov_base) + result;
+         cur->iov_len -= result;
+      }
+   }
+
+   free(iov_copy);
+   return 0;
+}
+
 int write_msg(int fd, ldcs_message_t *msg)
 {
    int result = ll_write(fd, msg, sizeof(*msg));
@@ -20,11 +20,13 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #define COBO_SUCCESS (0)
 
 #include "ldcs_api.h"
+#include <sys/uio.h>
 
 int ldcs_cobo_read_fd(int fd, void* buf, int size);
 int ldcs_cobo_write_fd(int fd, void* buf, int size);
 int ll_write(int fd, void *buf, size_t count);
 int ll_read(int fd, void *buf, size_t count);
+int ll_writev(int fd, const struct iovec *iov, int iovcnt);
 int write_msg(int fd, ldcs_message_t *msg);
 
 #endif /* _COBO_COMM_H */
@@ -100,6 +100,23 @@ typedef struct {
    struct sockaddr client_addr;
 } connection_info_t;
 
+typedef enum {
+   hs_wait_sig,
+   hs_wait_packet,
+   hs_wait_result
+} handshake_stage_t;
+
+struct handshake_session_t {
+   int sockfd;
+   int is_server;
+   handshake_protocol_t *hdata;
+   uint64_t session_id;
+   connection_info_t conninfo;
+   handshake_stage_t stage;
+   int num_timeouts;
+   int local_result;
+};
+
 
 static FILE *debug_file = NULL;
 static char *last_error_message = NULL;
@@ -145,16 +162,22 @@ static int compare_packets(handshake_packet_t *expected_packet,
 
 static int handshake_wrapper(int sockfd, handshake_protocol_t *hdata, uint64_t session_id,
                              int is_server);
-static int handshake_main(int sockfd, handshake_protocol_t *hdata, uint64_t session_id,
-                          int is_server);
+static int handshake_start_round(handshake_session_t *session);
+static int handshake_round_done(handshake_session_t *session, int result);
+static int handshake_send_result(handshake_session_t *session, int local_result);
+static int handshake_recv_sig_step(handshake_session_t *session);
+static int handshake_recv_packet_step(handshake_session_t *session);
+static int handshake_recv_result_step(handshake_session_t *session);
 static int reliable_write(int fd, const void *buf, size_t size);
 static int reliable_read(int fd, void *buf, size_t size);
 static int read_key(char *key_filepath, int key_length_bytes);
-static int share_result(int fd, int result);
+static int send_result(int fd, int result);
+static int recv_result(int fd);
 static int get_client_server_addrs(int sockfd, int i_am_server, connection_info_t *conninfo);
 static int send_packet(int sockfd, unsigned char *packet, unsigned int packet_size);
 static int recv_packet(int sockfd, unsigned char **packet, size_t *packet_size);
-static int exchange_sig(int sockfd);
+static int send_sig(int sockfd);
+static int recv_sig(int sockfd);
 static int log_security_error(const char *format, ...);
 static int log_error(const char *format, ...);
 
@@ -217,9 +240,21 @@ void spindle_handshake_enable_read_timeout(int timeout_sec)
 static int handshake_wrapper(int sockfd, handshake_protocol_t *hdata, uint64_t session_id,
                              int is_server)
 {
-   connection_info_t connection_info;
-   int num_timeouts = 0, result, return_result;
+   handshake_session_t *session;
+   int result;
+
+   result = spindle_handshake_begin(sockfd, hdata, session_id, is_server, &session);
+   while (result == HSHAKE_IN_PROGRESS)
+      result = spindle_handshake_step(session);
+   return result;
+}
+
+int spindle_handshake_begin(int sockfd, handshake_protocol_t *hdata, uint64_t session_id,
+                            int is_server, handshake_session_t **session_out)
+{
+   handshake_session_t *session;
    sighandler_t old_pipe_action;
+   int result;
 
    if (last_security_message)
       free(last_security_message);
@@ -227,75 +262,151 @@ static int handshake_wrapper(int sockfd, handshake_protocol_t *hdata, uint64_t s
       free(last_error_message);
    last_security_message = last_error_message = NULL;
 
+   session = (handshake_session_t *) malloc(sizeof(*session));
+   assert(session);
+   session->sockfd = sockfd;
+   session->is_server = is_server;
+   session->hdata = hdata;
+   session->session_id = session_id;
+   session->num_timeouts = 0;
+   session->local_result = 0;
+
    old_pipe_action = signal(SIGPIPE, SIG_IGN);
+   saved_conninfo = &session->conninfo;
 
    /**
     * Record connection info
     **/
-   saved_conninfo = &connection_info;
-   result = get_client_server_addrs(sockfd, is_server, &connection_info);
+   result = get_client_server_addrs(sockfd, is_server, &session->conninfo);
    if (result < 0) {
       debug_printf("Error getting socket addresses in get_client_server_addrs\n");
-      return_result = result;
-      goto done;
    }
-   
-   for (;;) {
-      result = handshake_main(sockfd, hdata, session_id, is_server);
-      if (result != HSHAKE_AGAIN) {
-         /* Typical case */
+   else {
+      result = handshake_start_round(session);
+   }
+
+   saved_conninfo = NULL;
+   signal(SIGPIPE, old_pipe_action);
+
+   if (result != HSHAKE_IN_PROGRESS) {
+      debug_printf("Completed handshake.  Result = %d\n", result);
+      free(session);
+      session = NULL;
+   }
+   *session_out = session;
+   return result;
+}
+
+int spindle_handshake_step(handshake_session_t *session)
+{
+   sighandler_t old_pipe_action;
+   int result = HSHAKE_INTERNAL_ERROR;
+
+   old_pipe_action = signal(SIGPIPE, SIG_IGN);
+   saved_conninfo = &session->conninfo;
+
+   switch (session->stage) {
+      case hs_wait_sig:
+         result = handshake_recv_sig_step(session);
          break;
-      }
-      /* We hit a timeout (perhaps a munge cert beyond its TTL).  Try again if num_timeouts < MAX_NUM_TIMEOUTS */
-      if (++num_timeouts == MAX_NUM_TIMEOUTS) {
-         security_error_printf("Peer could not produce a non-timed out certificate in %d attempts\n",
-                             num_timeouts);
-         result = HSHAKE_ABORT;
+      case hs_wait_packet:
+         result = handshake_recv_packet_step(session);
+         break;
+      case hs_wait_result:
+         result = handshake_recv_result_step(session);
          break;
-      }
    }
-   return_result = result;
-
-  done:
-   debug_printf("Completed server handshake.  Result = %d\n", result);
 
    saved_conninfo = NULL;
    signal(SIGPIPE, old_pipe_action);
 
-   return return_result;
+   if (result != HSHAKE_IN_PROGRESS) {
+      debug_printf("Completed handshake.  Result = %d\n", result);
+      free(session);
+   }
+   return result;
+}
+
+void spindle_handshake_cancel(handshake_session_t *session)
+{
+   free(session);
 }
 
-static int handshake_main(int sockfd, handshake_protocol_t *hdata, uint64_t session_id,
-                          int is_server)
+static int handshake_start_round(handshake_session_t *session)
 {
-   int result, return_result, peer_result, socket_error = 0;
-   handshake_packet_t packet, expected_packet;
-   unsigned char *packet_buffer = NULL, *recvd_packet_buffer = NULL;
-   size_t packet_buffer_size = 0, recvd_packet_buffer_size = 0;
+   int result;
 
    /**
     * Exchange a public signature as a handshake to make sure
-    * we're speaking the same protocol.
+    * we're speaking the same protocol.  We send ours now and
+    * check the peer's in handshake_recv_sig_step.
     **/
-   result = exchange_sig(sockfd);
+   result = send_sig(session->sockfd);
    if (result < 0) {
       debug_printf("Error exchanging signatures\n");
-      socket_error = 1;
-      return_result = result;
-      goto done;
+      return result;
+   }
+   session->stage = hs_wait_sig;
+   return HSHAKE_IN_PROGRESS;
+}
+
+static int handshake_round_done(handshake_session_t *session, int result)
+{
+   if (result != HSHAKE_AGAIN) {
+      /* Typical case */
+      return result;
+   }
+
+   /* We hit a timeout (perhaps a munge cert beyond its TTL).  Try again if num_timeouts < MAX_NUM_TIMEOUTS */
+   if (++session->num_timeouts == MAX_NUM_TIMEOUTS) {
+      security_error_printf("Peer could not produce a non-timed out certificate in %d attempts\n",
+                            session->num_timeouts);
+      return HSHAKE_ABORT;
+   }
+   return handshake_start_round(session);
+}
+
+static int handshake_send_result(handshake_session_t *session, int local_result)
+{
+   int result;
+
+   /** 
+    * Send to peer the result of our connection attempt.  Only share whether
+    * we're accepting, dropping, or asking for a re-try.  
+    **/
+   session->local_result = local_result;
+   result = send_result(session->sockfd, local_result);
+   if (result < 0) {
+      return handshake_round_done(session, local_result == 0 ? result : local_result);
+   }
+   session->stage = hs_wait_result;
+   return HSHAKE_IN_PROGRESS;
+}
+
+static int handshake_recv_sig_step(handshake_session_t *session)
+{
+   int result;
+   handshake_packet_t packet;
+   unsigned char *packet_buffer = NULL;
+   size_t packet_buffer_size = 0;
+   connection_info_t *conninfo = &session->conninfo;
+
+   result = recv_sig(session->sockfd);
+   if (result < 0) {
+      debug_printf("Error exchanging signatures\n");
+      return result;
    }
 
    /**
     * Encode socket names, session, gid, and uid into a handshake_packet_t
     **/
    debug_printf("Creating outgoing packet for handshake\n");
-   result = encode_packet(&packet, session_id, &saved_conninfo->server_addr, &saved_conninfo->client_addr);
+   result = encode_packet(&packet, session->session_id, &conninfo->server_addr, &conninfo->client_addr);
    if (result < 0) {
       debug_printf("Error encoding outgoing packet");
-      return_result = result;
-      goto done;
+      return handshake_send_result(session, result);
    }
-   packet.signature = is_server ? SERVER_TO_CLIENT_SIG : CLIENT_TO_SERVER_SIG;
+   packet.signature = session->is_server ? SERVER_TO_CLIENT_SIG : CLIENT_TO_SERVER_SIG;
    debug_printf("Encoded packet: server_port = %d, client_port = %d, "
                 "uid = %d, gid = %d, session_id = %llu, signature = %lx\n",
                 (int) packet.server_port, (int) packet.client_port, (int) packet.uid, (int) packet.gid, 
@@ -305,89 +416,91 @@ static int handshake_main(int sockfd, handshake_protocol_t *hdata, uint64_t sess
     * Encrypt/Sign the handshake_packet_t, producing a packet_buffer
     **/
    debug_printf("Encrypting outgoing packet\n");
-   result = encrypt_packet(hdata, &packet, &packet_buffer, &packet_buffer_size);
+   result = encrypt_packet(session->hdata, &packet, &packet_buffer, &packet_buffer_size);
    if (result < 0) {
       debug_printf("Error in server encrypting outgoing packet");
-      return_result = result;
-      goto done;
+      return handshake_send_result(session, result);
    }
    debug_printf("Encrypted packet to buffer of size %lu\n", (unsigned long) packet_buffer_size);
 
    /**
     * Send the packet_buffer on the network
     **/
-   result = send_packet(sockfd, packet_buffer, packet_buffer_size);
+   result = send_packet(session->sockfd, packet_buffer, packet_buffer_size);
+   free(packet_buffer);
    if (result < 0) {
       debug_printf("Problem sending packet on network: %s\n", strerror(errno));
-      return_result = result;
-      socket_error = 1;
-      goto done;
+      return result;
    }
 
+   session->stage = hs_wait_packet;
+   return HSHAKE_IN_PROGRESS;
+}
+
+static int handshake_recv_packet_step(handshake_session_t *session)
+{
+   int result;
+   handshake_packet_t expected_packet;
+   unsigned char *recvd_packet_buffer = NULL;
+   size_t recvd_packet_buffer_size = 0;
+   connection_info_t *conninfo = &session->conninfo;
+
    /**
     * Recieve a packet_buffer on the network
     **/
-   result = recv_packet(sockfd, &recvd_packet_buffer, &recvd_packet_buffer_size);
+   result = recv_packet(session->sockfd, &recvd_packet_buffer, &recvd_packet_buffer_size);
    if (result < 0) {
       debug_printf("Problem receiving packet\n");
-      return_result = result;
-      socket_error = 1;
-      goto done;
+      if (recvd_packet_buffer)
+         free(recvd_packet_buffer);
+      return result;
    }
 
    /**
     * Produce an expected handshake_packet_t
     **/
    debug_printf("Creating an expected packet\n");
-   result = encode_packet(&expected_packet, session_id, &saved_conninfo->server_addr, &saved_conninfo->client_addr);
+   result = encode_packet(&expected_packet, session->session_id, &conninfo->server_addr, &conninfo->client_addr);
    if (result < 0) {
       debug_printf("Error creating expected packet\n");
-      return_result = result;
-      goto done;
+      free(recvd_packet_buffer);
+      return handshake_send_result(session, result);
    }
-   expected_packet.signature = is_server ? CLIENT_TO_SERVER_SIG : SERVER_TO_CLIENT_SIG;
+   expected_packet.signature = session->is_server ? CLIENT_TO_SERVER_SIG : SERVER_TO_CLIENT_SIG;
   
    /**
     * Decrypt the packet recieved on the network and compare
     * it to the expected handshake_packet_t
     **/
    debug_printf("Decrypting and checking packet\n");
-   result = decrypt_packet(hdata, &expected_packet, recvd_packet_buffer, recvd_packet_buffer_size);
+   result = decrypt_packet(session->hdata, &expected_packet, recvd_packet_buffer, recvd_packet_buffer_size);
+   free(recvd_packet_buffer);
    if (result < 0) {
       debug_printf("Error decrypting and checking received packet\n");
-      return_result = result;
-      goto done;
+      return handshake_send_result(session, result);
    }
 
    debug_printf("Successfully completed initial handshake\n");
+   return handshake_send_result(session, 0);
+}
 
-   return_result = 0;
-
-  done:
+static int handshake_recv_result_step(handshake_session_t *session)
+{
+   int result, peer_result;
 
-   /** 
-    * Send to peer the result of our connection attempt.  Only share whether
-    * we're accepting, dropping, or asking for a re-try.  
-    **/
-   if (!socket_error) {
-      peer_result = share_result(sockfd, return_result);
-      if (return_result == 0 && peer_result != 0) {
-         /**
-          * Only return the peer's result if we think everything
-          * authenticated successfully on our end.  Otherwise we'll
-          * return our result.
-          **/
-         debug_printf("Setting handshake result to peer's result of %d\n", peer_result);
-         return_result = peer_result;
-      }
+   peer_result = recv_result(session->sockfd);
+   result = session->local_result;
+   if (result == 0 && peer_result != 0) {
+      /**
+       * Only return the peer's result if we think everything
+       * authenticated successfully on our end.  Otherwise we'll
+       * return our result.
+       **/
+      debug_printf("Setting handshake result to peer's result of %d\n", peer_result);
+      result = peer_result;
    }
 
-   if (packet_buffer)
-      free(packet_buffer);
-   if (recvd_packet_buffer)
-      free(recvd_packet_buffer);
-
-   return return_result;
+   return handshake_round_done(session, result);
 }
 
 static int encode_addr(struct sockaddr *addr, unsigned char *target_addr, uint16_t *port)
@@ -787,8 +900,8 @@ static int reliable_read(int fd, void *buf, size_t size)
       result = read(fd, ((unsigned char *) buf) + bytes_read, size - bytes_read);
       if (result <= 0) {
          int error = errno;
-         if (error == ECONNRESET) {
-            debug_printf("Connection reset during handshake read\n");
+         if (result == 0 || error == ECONNRESET) {
+            debug_printf("Connection closed or reset during handshake read\n");
             return HSHAKE_DROP_CONNECTION;
          }
          error_printf("Expected error return %d when reading from socket: %s\n", result,
@@ -1060,23 +1173,21 @@ static int compare_packets(handshake_packet_t *expected_packet,
    return 0;
 }
 
-static int share_result(int fd, int handshake_result)
+static int send_result(int fd, int handshake_result)
 {
-   int32_t result_to_send, peer_result;
+   int32_t result_to_send;
    int result;
 
    switch (handshake_result) {
       case HSHAKE_SUCCESS:
          result_to_send = HSHAKE_SUCCESS;
          break;
-      case HSHAKE_INTERNAL_ERROR:
-      case HSHAKE_DROP_CONNECTION:
-      case HSHAKE_ABORT:
-         result_to_send = HSHAKE_DROP_CONNECTION;
-         break;
       case HSHAKE_AGAIN:
          result_to_send = HSHAKE_AGAIN;
          break;
+      default:
+         result_to_send = HSHAKE_DROP_CONNECTION;
+         break;
    }
     
    debug_printf("Sharing handshake result %d with peer\n", result_to_send);
@@ -1086,7 +1197,14 @@ static int share_result(int fd, int handshake_result)
       error_printf("Failed to send result of connection\n");
       return HSHAKE_INTERNAL_ERROR;
    }
-   
+   return 0;
+}
+
+static int recv_result(int fd)
+{
+   int32_t peer_result;
+   int result;
+
    debug_printf("Reading peer result\n");
    result = reliable_read(fd, &peer_result, sizeof(peer_result));
    if (result != sizeof(peer_result)) {
@@ -1136,7 +1254,7 @@ static int get_client_server_addrs(int sockfd, int i_am_server,
    return 0;
 }
 
-static int exchange_sig(int sockfd) 
+static int send_sig(int sockfd)
 {
    uint32_t sig = SIG;
    int result;
@@ -1147,6 +1265,13 @@ static int exchange_sig(int sockfd)
       debug_printf("Problem writing sig on network\n");
       return HSHAKE_INTERNAL_ERROR;
    }
+   return 0;
+}
+
+static int recv_sig(int sockfd)
+{
+   uint32_t sig = 0;
+   int result;
 
    debug_printf("Receiving sig from network\n");
    result = reliable_read(sockfd, &sig, sizeof(sig));
@@ -31,6 +31,7 @@ extern "C" {
 #define HSHAKE_DROP_CONNECTION -2
 #define HSHAKE_CONNECTION_REFUSED -3
 #define HSHAKE_ABORT -4
+#define HSHAKE_IN_PROGRESS -5
 
 typedef enum {
    hs_none,         //No security validation in handshake
@@ -63,6 +64,18 @@ typedef struct {
 
 int spindle_handshake_server(int sockfd, handshake_protocol_t *hdata, uint64_t session_id);
 int spindle_handshake_client(int sockfd, handshake_protocol_t *hdata, uint64_t session_id);
+
+/* Resumable handshakes, for running several handshakes from one poll loop.
+ * spindle_handshake_begin sends our opening bytes and fills in session.
+ * spindle_handshake_step should then be called each time sockfd becomes
+ * readable.  Both return HSHAKE_IN_PROGRESS until the handshake completes
+ * with one of the results above, at which point the session is freed.
+ * hdata must stay valid until the handshake completes. */
+typedef struct handshake_session_t handshake_session_t;
+int spindle_handshake_begin(int sockfd, handshake_protocol_t *hdata, uint64_t session_id,
+                            int is_server, handshake_session_t **session);
+int spindle_handshake_step(handshake_session_t *session);
+void spindle_handshake_cancel(handshake_session_t *session);
 int spindle_handshake_is_security_type_enabled(handshake_security_t sectype);
 char *spindle_handshake_last_error_str();
 
@@ -40,6 +40,20 @@ extern "C" {
 
 #define COBO_SUCCESS (0)
 
+/* Seconds spent in each phase of cobo_open.  Children are connected and
+ * authenticated concurrently, so child_connect is the time until every
+ * child had a TCP connection and child_handshake the time from then until
+ * every child was authenticated.  All fields must stay doubles, as they are
+ * max-reduced across the tree as an array. */
+typedef struct {
+   double parent_accept;   /* waiting for and authenticating our parent's connection */
+   double hostlist_recv;   /* receiving our rank and the hostlist */
+   double child_connect;   /* connecting to children */
+   double child_handshake; /* authenticating children */
+   double hostlist_send;   /* forwarding the hostlist to children */
+   double barrier;         /* barrier confirming the tree is open */
+} cobo_open_times_t;
+
 #define COBO_NAMESPACE ldcs
 
 #if defined(COBO_NAMESPACE)
@@ -60,11 +74,13 @@ extern "C" {
 #define cobo_server_get_root_socket COMBINE(COBO_NAMESPACE, cobo_server_get_root_socket)
 #define __cobo_ts COMBINE(COBO_NAMESPACE, __cobo_ts)
 #define cobo_get_num_childs COMBINE(COBO_NAMESPACE, cobo_get_num_childs)
+#define cobo_get_open_times COMBINE(COBO_NAMESPACE, cobo_get_open_times)
 #define cobo_bcast_down COMBINE(COBO_NAMESPACE, cobo_bcast_down)
 #define cobo_get_child_socket COMBINE(COBO_NAMESPACE, cobo_get_child_socket)
 #define cobo_set_handshake COMBINE(COBO_NAMESPACE, cobo_set_handshake)
 #define cobo_preconnect_cb_t COMBINE(COBO_NAMESPACE, cobo_preconnect_cb_t)
 #define cobo_register_preconnect_cb COMBINE(COBO_NAMESPACE, cobo_register_preconnect_cb)
+#define cobo_set_tree_fanout COMBINE(COBO_NAMESPACE, cobo_set_tree_fanout)
 #endif
 
 /*
@@ -152,6 +168,9 @@ extern double __cobo_ts;
 
 int cobo_get_num_childs(int* num_childs);
 
+/* per-phase times of cobo_open, max-reduced over all tasks on rank 0 */
+int cobo_get_open_times(cobo_open_times_t* times);
+
 /* Methods to access child fds */
 int cobo_get_child_socket(int num, int *fd);
 
@@ -160,8 +179,14 @@ void cobo_set_handshake(handshake_protocol_t *hs);
 void handle_security_error(const char *msg);
 int initialize_handshake_security(handshake_protocol_t *protocol);
 
-typedef int (*cobo_preconnect_cb_t)(const char *);
+/* Called with the hostnames of a task's children before connecting to them.
+   All children are passed at once, so the callback can start them in parallel. */
+typedef int (*cobo_preconnect_cb_t)(const char **hostnames, int num_hosts);
 void cobo_register_preconnect_cb(cobo_preconnect_cb_t f);
+
+/* Set the number of children per task in the tree (server only, before cobo_server_open).
+   0 selects the default binomial tree.  The value is forwarded to all tasks with the hostlist. */
+void cobo_set_tree_fanout(int fanout);
    
 #if defined(__cplusplus)
 }
@@ -21,7 +21,18 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include "fe_comm.h"
 #include "config.h"
 #include <assert.h>
+#include <errno.h>
+#include <poll.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+static double get_time()
+{
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
 
 static int read_msg(int fd, ldcs_message_t *msg)
 {
@@ -46,6 +57,9 @@ static int read_msg(int fd, ldcs_message_t *msg)
    return 0;
 }
 
+/* The number of servers in the tree, which the drain timeout is measured against */
+static int num_servers;
+
 int ldcs_audit_server_fe_md_open ( char **hostlist, int numhosts, unsigned int port, unsigned int num_ports,
                                    unique_id_t unique_id, 
                                    void **data  ) {
@@ -53,6 +67,8 @@ int ldcs_audit_server_fe_md_open ( char **hostlist, int numhosts, unsigned int p
    int *portlist;
    int root_fd, ack;
    int i;
+   double start_time, connect_time, end_time;
+   cobo_open_times_t open_times;
 
    assert(num_ports >= 1);
    portlist = malloc(sizeof(int) * (num_ports+1));
@@ -62,35 +78,284 @@ int ldcs_audit_server_fe_md_open ( char **hostlist, int numhosts, unsigned int p
    portlist[num_ports] = 0;
 
    debug_printf2("Opening with port %d - %d\n", portlist[0], portlist[num_ports-1]);
+   start_time = get_time();
    cobo_server_open(unique_id, hostlist, numhosts, portlist, num_ports);
+   num_servers = numhosts;
    free(portlist);
+   connect_time = get_time();
 
    cobo_server_get_root_socket(&root_fd);
   
    ldcs_cobo_read_fd(root_fd, &ack, sizeof(ack));
+   ldcs_cobo_read_fd(root_fd, &open_times, sizeof(open_times));
+   end_time = get_time();
+
+   debug_printf("Server tree bootstrap took %.3fs (%.3fs connecting to root server). Slowest server phases: "
+                "parent accept %.3fs, hostlist receive %.3fs, child connect %.3fs, child handshake %.3fs, "
+                "hostlist send %.3fs, barrier %.3fs\n",
+                end_time - start_time, connect_time - start_time,
+                open_times.parent_accept, open_times.hostlist_recv, open_times.child_connect,
+                open_times.child_handshake, open_times.hostlist_send, open_times.barrier);
 
    return(rc);
 }
 
-int ldcs_audit_server_fe_md_waitfor_close()
+/* Reports the servers send just ahead of their exit ready, by message type */
+typedef struct {
+   ldcs_message_ids_t type;
+   void *data;
+   size_t len;
+} exit_data_t;
+
+static exit_data_t exit_data[] = {
+   { LDCS_MSG_TRACE_DATA, NULL, 0 },
+   { LDCS_MSG_FILESTATS, NULL, 0 }
+};
+#define NUM_EXIT_DATA (sizeof(exit_data) / sizeof(exit_data[0]))
+static int seen_exit_ready;
+
+static exit_data_t *get_exit_data_slot(int type)
 {
-   int root_fd, result;
+   unsigned int i;
+   for (i = 0; i < NUM_EXIT_DATA; i++) {
+      if (exit_data[i].type == type)
+         return exit_data + i;
+   }
+   return NULL;
+}
+
+/* Takes msg's data if it is one of the exit reports.  The servers send
+   another round of reports each time an exit is cancelled, and each round
+   only holds what's new, so later rounds are appended to earlier ones. */
+static int keep_exit_data(ldcs_message_t *msg)
+{
+   exit_data_t *slot = get_exit_data_slot(msg->header.type);
+   void *new_data;
+
+   if (!slot)
+      return 0;
+   if (!slot->data) {
+      slot->data = msg->data;
+      slot->len = msg->header.len;
+      msg->data = NULL;
+      return 1;
+   }
+   new_data = realloc(slot->data, slot->len + msg->header.len);
+   if (!new_data) {
+      err_printf("Could not allocate memory for a report from the servers.  Dropping it\n");
+      return 1;
+   }
+   memcpy((char *) new_data + slot->len, msg->data, msg->header.len);
+   slot->data = new_data;
+   slot->len += msg->header.len;
+   return 1;
+}
+
+/* How often stragglers are reported while draining with no timeout */
+#define STRAGGLER_REPORT_SECS 60
+/* How long to wait for the servers' exit status once the drain timeout hits */
+#define EXIT_STATUS_WAIT_SECS 10
+
+static void report_stragglers(exit_status_t *status)
+{
+   int i;
+   exit_straggler_t *s;
+
+   err_printf("%d spindle server(s) are holding up exit%s\n", (int) status->num_stragglers,
+              status->num_stragglers > status->num_listed ? ", including" : ":");
+   for (i = 0; i < status->num_listed && i < EXIT_STATUS_MAX_LISTED; i++) {
+      s = status->listed + i;
+      s->hostname[sizeof(s->hostname)-1] = '\0';
+      if (s->children_unanswered)
+         err_printf("  server %d on %s has %d child server(s) that did not answer\n", (int) s->md_rank, s->hostname,
+                    (int) s->children_unanswered);
+      if (s->clients_live)
+         err_printf("  server %d on %s has %d live processes\n", (int) s->md_rank, s->hostname, (int) s->clients_live);
+      else if (s->waiting_for_note)
+         err_printf("  server %d on %s is waiting for spindleExitBE\n", (int) s->md_rank, s->hostname);
+   }
+}
+
+static uint32_t exit_status_seq;
+
+static int request_exit_status(int root_fd)
+{
+   ldcs_message_t msg;
+   exit_status_seq++;
+   debug_printf("Requesting exit status %u from servers\n", exit_status_seq);
+   msg.header.type = LDCS_MSG_EXIT_STATUS_REQ;
+   msg.header.len = sizeof(exit_status_seq);
+   msg.data = (char *) &exit_status_seq;
+   return write_msg(root_fd, &msg);
+}
+
+/**
+ * Block until the servers are ready to exit.  The servers tell us each
+ * time one becomes drained, when all its clients have exited, or stops
+ * being drained because a new client started.  Once at least half are
+ * drained we periodically ask the tree which servers are holding up exit
+ * and report them, and once drain_timeout seconds pass we report them and
+ * return anyway, so one hung node can't hold up the whole job.  If the
+ * count falls back under half, the timeout starts over the next time it
+ * gets there.
+ **/
+int ldcs_audit_server_fe_md_waitfor_close(unsigned int drain_timeout)
+{
+   int root_fd, result, timeout_ms;
    ldcs_message_t out_msg;
+   double drain_start = 0.0, next_report = 0.0, status_deadline = 0.0, now;
+   int draining = 0, status_pending = 0, timed_out = 0;
+   int num_drained = 0;
+   int32_t change;
+   struct pollfd pfd;
 
    debug_printf2("Blocking while waiting for spindle exit\n");
 
    cobo_server_get_root_socket(&root_fd);
    for (;;) {
+      timeout_ms = -1;
+      if (draining) {
+         now = get_time();
+         if (status_pending && now >= status_deadline) {
+            err_printf("Servers did not send exit status within %d seconds\n", EXIT_STATUS_WAIT_SECS);
+            if (timed_out)
+               return 0;
+            status_pending = 0;
+            next_report = now + STRAGGLER_REPORT_SECS;
+         }
+         else if (!status_pending && now >= next_report) {
+            if (drain_timeout && now >= drain_start + drain_timeout) {
+               err_printf("Spindle servers did not exit within the %u second drain timeout.  Shutting down anyway\n",
+                          drain_timeout);
+               timed_out = 1;
+            }
+            if (request_exit_status(root_fd) == -1)
+               return timed_out ? 0 : -1;
+            status_pending = 1;
+            status_deadline = now + EXIT_STATUS_WAIT_SECS;
+         }
+         timeout_ms = (int) (((status_pending ? status_deadline : next_report) - now) * 1000.0) + 1;
+      }
+
+      pfd.fd = root_fd;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      result = poll(&pfd, 1, timeout_ms);
+      if (result == -1 && errno == EINTR)
+         continue;
+      if (result == -1) {
+         err_printf("ERROR polling while waiting for server close: %s\n", strerror(errno));
+         return -1;
+      }
+      if (result == 0)
+         continue;
+
       memset(&out_msg, 0, sizeof(out_msg));
       result = read_msg(root_fd, &out_msg);
       if (result == -1) {
          err_printf("ERROR reading message while waiting for server close\n");
          return -1;
       }
+      switch (out_msg.header.type) {
+         case LDCS_MSG_EXIT_READY:
+            seen_exit_ready = 1;
+            free(out_msg.data);
+            return 0;
+         case LDCS_MSG_EXIT_DRAINING:
+            if (out_msg.header.len != sizeof(change)) {
+               err_printf("Unexpected exit draining message\n");
+               break;
+            }
+            memcpy(&change, out_msg.data, sizeof(change));
+            num_drained += change;
+            debug_printf2("%d of %d servers are drained\n", num_drained, num_servers);
+            if (!draining && num_drained * 2 >= num_servers) {
+               debug_printf("Servers have started draining\n");
+               draining = 1;
+               drain_start = get_time();
+               next_report = drain_start + ((drain_timeout && drain_timeout < STRAGGLER_REPORT_SECS) ?
+                                            drain_timeout : STRAGGLER_REPORT_SECS);
+            }
+            else if (draining && !timed_out && num_drained * 2 < num_servers) {
+               debug_printf("Fewer than half the servers are drained.  Stopping the drain timeout\n");
+               draining = 0;
+               status_pending = 0;
+            }
+            break;
+         case LDCS_MSG_EXIT_STATUS:
+            if (out_msg.header.len != sizeof(exit_status_t) ||
+                ((exit_status_t *) out_msg.data)->seq != exit_status_seq) {
+               debug_printf("Dropping exit status for an earlier request\n");
+               break;
+            }
+            report_stragglers((exit_status_t *) out_msg.data);
+            status_pending = 0;
+            if (timed_out) {
+               free(out_msg.data);
+               return 0;
+            }
+            now = get_time();
+            next_report = now + STRAGGLER_REPORT_SECS;
+            if (drain_timeout && drain_start + drain_timeout < next_report)
+               next_report = drain_start + drain_timeout;
+            break;
+         default:
+            if (!keep_exit_data(&out_msg))
+               err_printf("Unexpected message of type %d\n", (int) out_msg.header.type);
+      }
+      free(out_msg.data);
+   }
+}
+
+/**
+ * Hand back the report of the given message type the servers sent at
+ * exit, reading it off the root socket if spindleWaitForCloseFE hasn't
+ * already.  Gives up when the servers close or send their exit ready
+ * without one, or after timeout seconds.
+ **/
+int ldcs_audit_server_fe_md_get_exit_data(int type, void **data, size_t *len, unsigned int timeout)
+{
+   int root_fd, result;
+   double deadline, now;
+   ldcs_message_t out_msg;
+   struct pollfd pfd;
+   exit_data_t *slot = get_exit_data_slot(type);
+
+   assert(slot);
+   cobo_server_get_root_socket(&root_fd);
+   deadline = get_time() + timeout;
+   while (!slot->data && !seen_exit_ready) {
+      now = get_time();
+      if (now >= deadline) {
+         debug_printf("Servers did not send a message of type %d within %u seconds\n", type, timeout);
+         break;
+      }
+      pfd.fd = root_fd;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      result = poll(&pfd, 1, (int) ((deadline - now) * 1000.0) + 1);
+      if (result == -1 && errno == EINTR)
+         continue;
+      if (result <= 0)
+         continue;
+
+      memset(&out_msg, 0, sizeof(out_msg));
+      if (read_msg(root_fd, &out_msg) == -1) {
+         debug_printf("Servers closed before sending a message of type %d\n", type);
+         break;
+      }
       if (out_msg.header.type == LDCS_MSG_EXIT_READY)
-         return 0;
-      err_printf("Unexpected message of type %d\n", (int) out_msg.header.type);
+         seen_exit_ready = 1;
+      else
+         keep_exit_data(&out_msg);
+      free(out_msg.data);
    }
+
+   *data = slot->data;
+   *len = slot->len;
+   slot->data = NULL;
+   slot->len = 0;
+   return *data ? 0 : -1;
 }
 
 int ldcs_audit_server_fe_md_close ( void *data  ) {
@@ -27,7 +27,8 @@ extern "C" {
 int ldcs_audit_server_fe_md_open(char **hostlist, int numhosts, unsigned int port, unsigned int num_ports,
                                  unique_id_t unique_id, void **data);
 int ldcs_audit_server_fe_md_close(void *data);
-int ldcs_audit_server_fe_md_waitfor_close();
+int ldcs_audit_server_fe_md_waitfor_close(unsigned int drain_timeout);
+int ldcs_audit_server_fe_md_get_exit_data(int type, void **data, size_t *len, unsigned int timeout);
 int ldcs_audit_server_fe_broadcast(ldcs_message_t *msg, void *data);
 
 #if defined(__cplusplus)
@@ -23,6 +23,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include <functional>
 
 #include <cassert>
+#include <climits>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -205,6 +206,10 @@ const list<SpindleOption> Options = {
      "End a persistent Spindle session with the given session-id." },
    { confRunSession, "run-in-session", shortRunSession, groupSession, cvString, {}, "",
      "Run a new job in the given session." },
+   { confSharedSession, "shared-session", shortSharedSession, groupSession, cvBool, {}, "",
+     "Run the job in a session shared by all spindle jobs in this allocation, starting it if needed." },
+   { confSharedSessionLinger, "shared-session-linger", shortSharedSessionLinger, groupSession, cvInteger, {}, "10",
+     "Seconds a shared session waits for a new job after its last job finishes." },
 
    { confCmdlineNewgroup, "", shortNone, groupNuma, cvBool, {}, "",
      "Options for controlling spindle's numa-centric optimizations, where it performs memory-aware library replication and placement." },
@@ -222,10 +227,16 @@ const list<SpindleOption> Options = {
      "Runs spindle in audit or subaudit mode. Subaudit is needed for certain glibc versions on PPC systems." },
    { confShmcacheSize, "shmcache-size", shortSharedCacheSize, groupMisc, cvInteger, {}, SHMCACHE_SIZE_STR,
      "Size of client shared memory cache in kb, which can be used to improve performance if multiple processes are running on each node." },
+   { confFdPassing, "fd-passing", shortFdPassing, groupMisc, cvInteger, {}, "0",
+     "If non-zero, the server hands clients an open descriptor with each relocated file they open, and this sets how many passed descriptors a client may hold at once.  Only available with the shmem client transport." },
    { confPythonPrefix, "python-prefix", shortPythonPrefix, groupMisc, cvList, {}, "",
      "Colon-seperated list of directories that contain the python install locations." },
    { confCachePrefix, "cache-prefix", shortCachePrefix, groupMisc, cvList, {}, "",
      "Alias for python-prefix" },
+   { confPackPython, "pack-python", shortPackPython, groupMisc, cvBool, {}, "false",
+     "Pack the python-prefix directories into one image and distribute it to every node at startup, rather than module by module." },
+   { confRelocCache, "reloc-cache", shortRelocCache, groupMisc, cvBool, {}, "false",
+     "Experimental.  Save the PLT bindings of the first process to run an executable on a node, and fill in the GOTs of later processes with the same libraries from them instead of resolving each symbol again." },
    { confDebug, "debug", shortDebug, groupMisc, cvBool, {}, "false",
      "If yes, hide spindle from debuggers so they think libraries come from the original locations.  May cause extra overhead." },
    { confPreload, "preload", shortPreload, groupMisc, cvString, {}, "",
@@ -248,10 +259,20 @@ const list<SpindleOption> Options = {
      "Enables message buffering if size is non-zero, and sets the buffering timeout in milliseconds." },
    { confCleanupProc, "cleanup-proc", shortCleanupProc, groupMisc, cvBool, {}, CLEANUP_PROC_STR,
      "Fork a dedicated process to clean-up files post-spindle.  Useful for high-fault situations." },
+   { confExitDrainTimeout, "exit-drain-timeout", shortExitDrainTimeout, groupMisc, cvInteger, {}, "0",
+     "When waiting for servers to exit, give up and shut spindle down this many seconds after the processes on at least half the servers have all exited, reporting the servers still holding live processes.  The timer restarts if new processes bring that under half again.  0 waits forever." },
+   { confTrace, "trace", shortTrace, groupMisc, cvString, {}, "",
+     "Record when the front-end, each server and each application process reaches each stage of start-up, and write the trace to this file in the Chrome trace event format when spindle exits." },
+   { confFileStats, "file-stats", shortFileStats, groupMisc, cvString, {}, "",
+     "Count how often each file was requested, how many bytes were moved for it, and how long processes waited for it, and write a report of the files to this file when spindle exits." },
    { confEnableRsh, "enable-rsh", shortRSHMode, groupMisc, cvBool, {}, RSHLAUNCH_STR,
      "Enable starting daemons with an rsh tree, if the startup mode supports it." },
    { confRshCommand, "rsh-command", shortRSHCmd, groupMisc, cvString, {}, RSHCMD_STR,
-     "The command to run rsh/ssh, when doing RSH startup mode." }
+     "The command to run rsh/ssh, when doing RSH startup mode." },
+   { confRshFanout, "rsh-fanout", shortRSHFanout, groupMisc, cvInteger, {}, "",
+     "The number of children each daemon starts in the rsh tree, at least 1.  If not set, a binomial tree is used." },
+   { confRshMaxProcs, "rsh-max-procs", shortRSHMaxProcs, groupMisc, cvInteger, {}, "8",
+     "The maximum number of rsh/ssh processes each daemon runs at once when starting its children." }
 };
 
 pair<bool, bool> strToBool(string s)
@@ -680,6 +701,12 @@ bool ConfigMap::toSpindleArgs(spindle_args_t &args, bool alloc_strs) const
          case confPythonPrefix:
             args.pythonprefix = getstr(strresult, alloc_strs);
             break;
+         case confPackPython:
+            setopt(args.opts, OPT_PACKPY, boolresult);
+            break;
+         case confRelocCache:
+            setopt(args.opts, OPT_RELOCCACHE, boolresult);
+            break;
          case confStrip:
             setopt(args.opts, OPT_STRIP, boolresult);
             break;
@@ -833,11 +860,16 @@ bool ConfigMap::toSpindleArgs(spindle_args_t &args, bool alloc_strs) const
          case confShmcacheSize:
             args.shm_cache_size = (unsigned int) numresult;
             break;
+         case confFdPassing:
+            setopt(args.opts, OPT_FDPASS, numresult != 0);
+            args.fdpass_limit = (unsigned int) numresult;
+            break;
          case confDebug:
             setopt(args.opts, OPT_DEBUG, boolresult);
             break;
          case confPreload:
             args.preloadfile = getstr(strresult, alloc_strs);
+            setopt(args.opts, OPT_PRELOAD, !strresult.empty());
             break;
          case confHostbin:
             if (!strresult.empty()) {
@@ -875,6 +907,17 @@ bool ConfigMap::toSpindleArgs(spindle_args_t &args, bool alloc_strs) const
                setopt(args.opts, OPT_MSGBUNDLE, false);
             }
             break;
+         case confExitDrainTimeout:
+            args.exit_drain_timeout = (unsigned int) numresult;
+            break;
+         case confTrace:
+            args.trace_file = strresult.empty() ? NULL : getstr(strresult, alloc_strs);
+            setopt(args.opts, OPT_TRACE, !strresult.empty());
+            break;
+         case confFileStats:
+            args.filestats_file = strresult.empty() ? NULL : getstr(strresult, alloc_strs);
+            setopt(args.opts, OPT_FILESTATS, !strresult.empty());
+            break;
          case confCleanupProc:
             setopt(args.opts, OPT_PROCCLEAN, boolresult);
             break;
@@ -884,6 +927,16 @@ bool ConfigMap::toSpindleArgs(spindle_args_t &args, bool alloc_strs) const
          case confRshCommand:
             args.rsh_command = getstr(strresult, alloc_strs);
             break;
+         case confRshFanout:
+            if (numresult < 1) {
+               err_printf("Invalid rsh fanout %ld, must be at least 1\n", numresult);
+               return false;
+            }
+            args.rsh_fanout = numresult > INT_MAX ? INT_MAX : (unsigned int) numresult;
+            break;
+         case confRshMaxProcs:
+            args.rsh_max_procs = numresult > 0 ? (unsigned int) numresult : 1;
+            break;
          case confStartSession:
             setopt(args.opts, OPT_SESSION, boolresult);
             break;
@@ -891,6 +944,12 @@ bool ConfigMap::toSpindleArgs(spindle_args_t &args, bool alloc_strs) const
          case confRunSession:
             setopt(args.opts, OPT_SESSION, !strresult.empty());
             
+            break;
+         case confSharedSession:
+            if (boolresult)
+               args.opts |= OPT_SESSION;
+            break;
+         case confSharedSessionLinger:
             break;
       }
    }
@@ -916,6 +975,8 @@ session_status_t ConfigMap::getSessionStatus() const
       return sstatus_end;
    else if (isSet(confRunSession))
       return sstatus_run;
+   else if (getValueBool(confSharedSession).second)
+      return sstatus_shared;
    else
       return sstatus_unused;
 }
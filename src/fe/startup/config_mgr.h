@@ -32,6 +32,8 @@ enum SpindleConfigID {
    confLocation,
    confCachePrefix,
    confPythonPrefix,
+   confPackPython,
+   confRelocCache,
    confStrip,
    confRelocAout,
    confRelocLibs,
@@ -49,6 +51,7 @@ enum SpindleConfigID {
    confNumaExcludes,
    confAuditType,
    confShmcacheSize,
+   confFdPassing,
    confDebug,
    confPreload,
    confHostbin,
@@ -59,11 +62,18 @@ enum SpindleConfigID {
    confMsgcacheBuffer,
    confMsgcacheTimeout,
    confCleanupProc,
+   confExitDrainTimeout,
+   confTrace,
+   confFileStats,
    confEnableRsh,
    confRshCommand,
+   confRshFanout,
+   confRshMaxProcs,
    confStartSession,
    confEndSession,
-   confRunSession
+   confRunSession,
+   confSharedSession,
+   confSharedSessionLinger
 };
 
 enum CmdlineShortOptions {
@@ -117,7 +127,17 @@ enum CmdlineShortOptions {
    shortLauncher = 292,
    shortNetwork = 293,
    shortHostbinEnable = 294,
-   shortSpindleLevel = 295
+   shortSpindleLevel = 295,
+   shortRSHFanout = 296,
+   shortRSHMaxProcs = 297,
+   shortPackPython = 298,
+   shortFdPassing = 299,
+   shortRelocCache = 300,
+   shortExitDrainTimeout = 301,
+   shortSharedSession = 302,
+   shortSharedSessionLinger = 303,
+   shortTrace = 304,
+   shortFileStats = 305
 };
 
 enum CmdlineGroups {
@@ -160,7 +180,8 @@ typedef enum {
    sstatus_unused,
    sstatus_start,
    sstatus_run,
-   sstatus_end
+   sstatus_end,
+   sstatus_shared
 } session_status_t;
 
 class ConfigMap
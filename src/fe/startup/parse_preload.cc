@@ -18,12 +18,22 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include <cstring>
 #include <set>
 #include <string>
+#include <vector>
+#include <deque>
 #include <cerrno>
 #include <cstdlib>
-#include <cassert>
+#include <dirent.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <glob.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "parse_preload.h"
 #include "pathfn.h"
+#include "pathcode.h"
 
 extern "C" {
 #include "ldcs_api.h"
@@ -31,70 +41,656 @@ extern "C" {
 
 using namespace std;
 
-#define STR2(X) #X
-#define STR(X) STR2(X)
+/**
+ * A preload file holds whitespace separated filenames, which may be
+ * globs, and lines with one of these directives:
+ *   tree: DIR [+GLOB ...] [-GLOB ...]   Every file under DIR.  If any +GLOB
+ *                                       is given a file must match one, and
+ *                                       it must not match any -GLOB.
+ *   deps: EXECUTABLE                    EXECUTABLE, its interpreter and every
+ *                                       library it will load.
+ *   python: PREFIX                      Every module under PREFIX's python
+ *                                       library directories.
+ * A '#' starts a comment.  A glob without a '/' is matched against file
+ * names, otherwise against the full path.
+ *
+ * Expanding a large tree is slow, so the expanded list is saved beside the
+ * preload file as a manifest and reused for as long as the preload file,
+ * the working directory and LD_LIBRARY_PATH are unchanged.
+ **/
+
+#define MANIFEST_SUFFIX ".manifest"
+#define MANIFEST_HEADER "# spindle preload manifest"
+#define MAX_WALK_THREADS 8
+
+static string absolutePath(const string &path)
+{
+   char dir[MAX_PATH_LEN+1];
+   if (path.empty())
+      return path;
+   if (path[0] == '/')
+      strncpy(dir, path.c_str(), MAX_PATH_LEN);
+   else {
+      (void)! getcwd(dir, MAX_PATH_LEN+1);
+      dir[MAX_PATH_LEN] = '\0';
+      strncat(dir, "/", MAX_PATH_LEN - strlen(dir));
+      strncat(dir, path.c_str(), MAX_PATH_LEN - strlen(dir));
+   }
+   dir[MAX_PATH_LEN] = '\0';
+   reducePath(dir);
+   return string(dir);
+}
+
+static bool hasGlobChars(const string &s)
+{
+   return s.find_first_of("*?[") != string::npos;
+}
+
+static bool matchGlob(const string &pattern, const string &path)
+{
+   if (pattern.find('/') != string::npos)
+      return fnmatch(pattern.c_str(), path.c_str(), 0) == 0;
+   size_t slash = path.rfind('/');
+   string name = (slash == string::npos) ? path : path.substr(slash + 1);
+   return fnmatch(pattern.c_str(), name.c_str(), 0) == 0;
+}
+
+/**
+ * Directory trees are walked by a few threads sharing a queue of
+ * directories, as walks of shared file systems spend most of their time
+ * waiting on metadata servers.
+ **/
+struct tree_walk_t {
+   vector<string> includes, excludes;
+   deque<string> pending;
+   int busy;
+   set<string> *files;
+   pthread_mutex_t lock;
+   pthread_cond_t cond;
+};
+
+static bool walkWants(tree_walk_t *walk, const string &path)
+{
+   vector<string>::iterator i;
+   bool included = walk->includes.empty();
+   for (i = walk->includes.begin(); i != walk->includes.end() && !included; i++)
+      included = matchGlob(*i, path);
+   if (!included)
+      return false;
+   for (i = walk->excludes.begin(); i != walk->excludes.end(); i++) {
+      if (matchGlob(*i, path))
+         return false;
+   }
+   return true;
+}
+
+static void walkDir(tree_walk_t *walk, const string &dirname, vector<string> &subdirs, vector<string> &files)
+{
+   DIR *d = opendir(dirname.c_str());
+   if (!d) {
+      debug_printf("Could not open preload directory %s: %s\n", dirname.c_str(), strerror(errno));
+      return;
+   }
+   struct dirent *ent;
+   while ((ent = readdir(d))) {
+      if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+         continue;
+      string path = dirname + "/" + ent->d_name;
+      unsigned char type = ent->d_type;
+      if (type == DT_UNKNOWN || type == DT_LNK) {
+         /* Symlinked files are preloaded, but we don't walk into
+            symlinked directories, which may loop. */
+         struct stat buf;
+         if (lstat(path.c_str(), &buf) == -1)
+            continue;
+         if (S_ISDIR(buf.st_mode))
+            type = DT_DIR;
+         else if (S_ISLNK(buf.st_mode))
+            type = (stat(path.c_str(), &buf) == 0 && S_ISREG(buf.st_mode)) ? DT_REG : DT_UNKNOWN;
+         else
+            type = S_ISREG(buf.st_mode) ? DT_REG : DT_UNKNOWN;
+      }
+      if (type == DT_DIR)
+         subdirs.push_back(path);
+      else if (type == DT_REG && walkWants(walk, path))
+         files.push_back(path);
+   }
+   closedir(d);
+}
+
+static void *walkThread(void *arg)
+{
+   tree_walk_t *walk = (tree_walk_t *) arg;
+   vector<string> subdirs, files;
+
+   pthread_mutex_lock(&walk->lock);
+   for (;;) {
+      while (walk->pending.empty() && walk->busy)
+         pthread_cond_wait(&walk->cond, &walk->lock);
+      if (walk->pending.empty())
+         break;
+      string dirname = walk->pending.front();
+      walk->pending.pop_front();
+      walk->busy++;
+      pthread_mutex_unlock(&walk->lock);
+
+      subdirs.clear();
+      files.clear();
+      walkDir(walk, dirname, subdirs, files);
+
+      pthread_mutex_lock(&walk->lock);
+      walk->pending.insert(walk->pending.end(), subdirs.begin(), subdirs.end());
+      walk->files->insert(files.begin(), files.end());
+      walk->busy--;
+      pthread_cond_broadcast(&walk->cond);
+   }
+   pthread_mutex_unlock(&walk->lock);
+   return NULL;
+}
+
+static void expandTree(const vector<string> &roots, const vector<string> &includes,
+                       const vector<string> &excludes, set<string> &files)
+{
+   tree_walk_t walk;
+   walk.includes = includes;
+   walk.excludes = excludes;
+   walk.pending.insert(walk.pending.end(), roots.begin(), roots.end());
+   walk.busy = 0;
+   walk.files = &files;
+   pthread_mutex_init(&walk.lock, NULL);
+   pthread_cond_init(&walk.cond, NULL);
+
+   long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+   if (num_threads < 1)
+      num_threads = 1;
+   if (num_threads > MAX_WALK_THREADS)
+      num_threads = MAX_WALK_THREADS;
+
+   vector<pthread_t> threads;
+   for (long i = 1; i < num_threads; i++) {
+      pthread_t thrd;
+      if (pthread_create(&thrd, NULL, walkThread, &walk) == 0)
+         threads.push_back(thrd);
+   }
+   walkThread(&walk);
+   for (vector<pthread_t>::iterator i = threads.begin(); i != threads.end(); i++)
+      pthread_join(*i, NULL);
+
+   pthread_mutex_destroy(&walk.lock);
+   pthread_cond_destroy(&walk.cond);
+}
+
+/**
+ * The library search path ld.so uses after LD_LIBRARY_PATH and DT_RUNPATH.
+ **/
+static void readLdSoConf(const string &filename, vector<string> &dirs, int depth)
+{
+   FILE *f = fopen(filename.c_str(), "r");
+   if (!f || depth > 8) {
+      if (f)
+         fclose(f);
+      return;
+   }
+   char line[MAX_PATH_LEN+1], *saveptr;
+   while (fgets(line, sizeof(line), f)) {
+      char *hash = strchr(line, '#');
+      if (hash)
+         *hash = '\0';
+      char *tok = strtok_r(line, " \t\n:,", &saveptr);
+      if (!tok)
+         continue;
+      if (strcmp(tok, "include") == 0) {
+         while ((tok = strtok_r(NULL, " \t\n", &saveptr))) {
+            string pattern = tok;
+            if (pattern[0] != '/')
+               pattern = filename.substr(0, filename.rfind('/') + 1) + pattern;
+            glob_t g;
+            if (glob(pattern.c_str(), 0, NULL, &g) == 0) {
+               for (size_t i = 0; i < g.gl_pathc; i++)
+                  readLdSoConf(g.gl_pathv[i], dirs, depth + 1);
+            }
+            globfree(&g);
+         }
+         continue;
+      }
+      do {
+         dirs.push_back(tok);
+      } while ((tok = strtok_r(NULL, " \t\n:,", &saveptr)));
+   }
+   fclose(f);
+}
+
+static const vector<string> &systemLibDirs()
+{
+   static vector<string> dirs;
+   static bool init = false;
+   if (!init) {
+      readLdSoConf("/etc/ld.so.conf", dirs, 0);
+      dirs.push_back("/lib64");
+      dirs.push_back("/usr/lib64");
+      dirs.push_back("/lib");
+      dirs.push_back("/usr/lib");
+      init = true;
+   }
+   return dirs;
+}
+
+struct elf_info_t {
+   unsigned char elfclass;
+   uint16_t machine;
+   string interp;
+   vector<string> needed;
+   vector<string> rpath;
+   vector<string> runpath;
+};
+
+static void splitSearchPath(const string &path, const string &origin, vector<string> &dirs)
+{
+   size_t start = 0;
+   while (start <= path.length()) {
+      size_t end = path.find(':', start);
+      if (end == string::npos)
+         end = path.length();
+      string dir = path.substr(start, end - start);
+      start = end + 1;
+      size_t pos;
+      while ((pos = dir.find("${ORIGIN}")) != string::npos)
+         dir.replace(pos, 9, origin);
+      while ((pos = dir.find("$ORIGIN")) != string::npos)
+         dir.replace(pos, 7, origin);
+      if (!dir.empty() && dir.find('$') == string::npos)
+         dirs.push_back(dir);
+   }
+}
+
+template<typename Ehdr, typename Phdr, typename Dyn>
+static bool readElfDynamic(int fd, const string &filename, elf_info_t &info)
+{
+   Ehdr ehdr;
+   if (pread(fd, &ehdr, sizeof(ehdr), 0) != (ssize_t) sizeof(ehdr))
+      return false;
+   info.machine = ehdr.e_machine;
+
+   if (!ehdr.e_phnum || ehdr.e_phentsize != sizeof(Phdr))
+      return false;
+   vector<Phdr> phdrs(ehdr.e_phnum);
+   size_t phsize = ehdr.e_phnum * sizeof(Phdr);
+   if (pread(fd, &phdrs[0], phsize, ehdr.e_phoff) != (ssize_t) phsize)
+      return false;
+
+   vector<Dyn> dyns;
+   for (size_t i = 0; i < phdrs.size(); i++) {
+      if (phdrs[i].p_type == PT_INTERP) {
+         vector<char> interp(phdrs[i].p_filesz + 1, '\0');
+         if (pread(fd, &interp[0], phdrs[i].p_filesz, phdrs[i].p_offset) == (ssize_t) phdrs[i].p_filesz)
+            info.interp = &interp[0];
+      }
+      else if (phdrs[i].p_type == PT_DYNAMIC) {
+         dyns.resize(phdrs[i].p_filesz / sizeof(Dyn));
+         if (dyns.empty() || pread(fd, &dyns[0], dyns.size() * sizeof(Dyn), phdrs[i].p_offset) != (ssize_t) (dyns.size() * sizeof(Dyn)))
+            dyns.clear();
+      }
+   }
+
+   /* DT_STRTAB is an address, which we map back to a file offset */
+   uint64_t strtab_addr = 0, strtab_size = 0, strtab_off = 0;
+   bool found_strtab = false;
+   for (size_t i = 0; i < dyns.size() && dyns[i].d_tag != DT_NULL; i++) {
+      if (dyns[i].d_tag == DT_STRTAB)
+         strtab_addr = dyns[i].d_un.d_ptr;
+      else if (dyns[i].d_tag == DT_STRSZ)
+         strtab_size = dyns[i].d_un.d_val;
+   }
+   for (size_t i = 0; i < phdrs.size() && strtab_addr; i++) {
+      if (phdrs[i].p_type == PT_LOAD && strtab_addr >= phdrs[i].p_vaddr &&
+          strtab_addr < phdrs[i].p_vaddr + phdrs[i].p_filesz) {
+         strtab_off = strtab_addr - phdrs[i].p_vaddr + phdrs[i].p_offset;
+         found_strtab = true;
+      }
+   }
+   if (!found_strtab || !strtab_size)
+      return true;
+
+   vector<char> strtab(strtab_size + 1, '\0');
+   if (pread(fd, &strtab[0], strtab_size, strtab_off) != (ssize_t) strtab_size)
+      return true;
+
+   string origin = filename.substr(0, filename.rfind('/'));
+   for (size_t i = 0; i < dyns.size() && dyns[i].d_tag != DT_NULL; i++) {
+      if (dyns[i].d_un.d_val >= strtab_size)
+         continue;
+      const char *str = &strtab[0] + dyns[i].d_un.d_val;
+      if (dyns[i].d_tag == DT_NEEDED)
+         info.needed.push_back(str);
+      else if (dyns[i].d_tag == DT_RPATH)
+         splitSearchPath(str, origin, info.rpath);
+      else if (dyns[i].d_tag == DT_RUNPATH)
+         splitSearchPath(str, origin, info.runpath);
+   }
+   return true;
+}
+
+static bool readElf(const string &filename, elf_info_t &info)
+{
+   unsigned char ident[EI_NIDENT];
+   bool result = false;
+   int fd = open(filename.c_str(), O_RDONLY);
+   if (fd == -1)
+      return false;
+   if (pread(fd, ident, EI_NIDENT, 0) == EI_NIDENT && memcmp(ident, ELFMAG, SELFMAG) == 0) {
+      info.elfclass = ident[EI_CLASS];
+      if (info.elfclass == ELFCLASS64)
+         result = readElfDynamic<Elf64_Ehdr, Elf64_Phdr, Elf64_Dyn>(fd, filename, info);
+      else if (info.elfclass == ELFCLASS32)
+         result = readElfDynamic<Elf32_Ehdr, Elf32_Phdr, Elf32_Dyn>(fd, filename, info);
+   }
+   close(fd);
+   return result;
+}
+
+/**
+ * Find the library name that an object needs, using ld.so's search order.
+ * Libraries built for another ELF class or machine are passed over, as
+ * ld.so would.
+ **/
+static string findLibrary(const string &name, const elf_info_t &from, const elf_info_t &exe)
+{
+   if (name.find('/') != string::npos)
+      return absolutePath(name);
+
+   vector<string> dirs;
+   if (from.runpath.empty()) {
+      dirs.insert(dirs.end(), from.rpath.begin(), from.rpath.end());
+      if (&from != &exe)
+         dirs.insert(dirs.end(), exe.rpath.begin(), exe.rpath.end());
+   }
+   const char *ld_library_path = getenv("LD_LIBRARY_PATH");
+   if (ld_library_path)
+      splitSearchPath(ld_library_path, "", dirs);
+   dirs.insert(dirs.end(), from.runpath.begin(), from.runpath.end());
+   dirs.insert(dirs.end(), systemLibDirs().begin(), systemLibDirs().end());
+
+   for (vector<string>::iterator i = dirs.begin(); i != dirs.end(); i++) {
+      string candidate = absolutePath(*i + "/" + name);
+      elf_info_t info;
+      if (access(candidate.c_str(), R_OK) == 0 && readElf(candidate, info) &&
+          info.elfclass == from.elfclass && info.machine == from.machine)
+         return candidate;
+   }
+   return string();
+}
+
+static void expandDeps(const string &exe_path, set<string> &files)
+{
+   elf_info_t exe;
+   if (!readElf(exe_path, exe)) {
+      err_printf("Could not read dependencies of %s, which is not a readable ELF file\n", exe_path.c_str());
+      return;
+   }
+   files.insert(exe_path);
+   if (!exe.interp.empty())
+      files.insert(absolutePath(exe.interp));
+
+   set<string> seen;
+   deque<pair<string, elf_info_t> > queue;
+   queue.push_back(make_pair(exe_path, exe));
+   while (!queue.empty()) {
+      elf_info_t obj = queue.front().second;
+      string obj_path = queue.front().first;
+      queue.pop_front();
+      for (vector<string>::iterator i = obj.needed.begin(); i != obj.needed.end(); i++) {
+         string lib = findLibrary(*i, obj, exe);
+         if (lib.empty()) {
+            debug_printf("Could not find library %s, needed by %s, to preload\n", i->c_str(), obj_path.c_str());
+            continue;
+         }
+         if (!seen.insert(lib).second)
+            continue;
+         files.insert(lib);
+         elf_info_t info;
+         if (readElf(lib, info))
+            queue.push_back(make_pair(lib, info));
+      }
+   }
+}
+
+static void expandPython(const string &prefix, set<string> &files)
+{
+   vector<string> roots, includes, excludes;
+   glob_t g;
+   string pattern = prefix + "/lib*/python*";
+   if (glob(pattern.c_str(), GLOB_ONLYDIR, NULL, &g) == 0) {
+      for (size_t i = 0; i < g.gl_pathc; i++)
+         roots.push_back(g.gl_pathv[i]);
+   }
+   globfree(&g);
+   if (roots.empty()) {
+      err_printf("No python library directories under preload prefix %s\n", prefix.c_str());
+      return;
+   }
+   includes.push_back("*.py");
+   includes.push_back("*.pyc");
+   includes.push_back("*.so");
+   includes.push_back("*.pth");
+   expandTree(roots, includes, excludes, files);
+}
+
+static void expandPath(const string &path, set<string> &files)
+{
+   if (!hasGlobChars(path)) {
+      files.insert(absolutePath(path));
+      return;
+   }
+   glob_t g;
+   if (glob(absolutePath(path).c_str(), 0, NULL, &g) == 0) {
+      for (size_t i = 0; i < g.gl_pathc; i++)
+         files.insert(g.gl_pathv[i]);
+   }
+   else
+      debug_printf("Preload glob %s matched nothing\n", path.c_str());
+   globfree(&g);
+}
+
+/**
+ * Expand each line of the preload file.  Sets expanded if anything more
+ * than a plain file list was given.
+ **/
+static bool expandPreloadFile(FILE *f, const string &filename, set<string> &files, bool &expanded)
+{
+   char *line = NULL;
+   size_t line_size = 0;
+   int lineno = 0;
+   bool result = true;
+
+   expanded = false;
+   while (getline(&line, &line_size, f) != -1) {
+      lineno++;
+      vector<string> tokens;
+      for (char *tok = strtok(line, " \t\r\n"); tok; tok = strtok(NULL, " \t\r\n")) {
+         if (tok[0] == '#')
+            break;
+         tokens.push_back(tok);
+      }
+      if (tokens.empty())
+         continue;
+
+      const string &directive = tokens[0];
+      if (directive == "tree:" || directive == "deps:" || directive == "python:") {
+         expanded = true;
+         if (tokens.size() < 2 || (directive != "tree:" && tokens.size() != 2)) {
+            err_printf("Bad '%s' line %d in preload file %s\n", directive.c_str(), lineno, filename.c_str());
+            result = false;
+            break;
+         }
+         string path = absolutePath(tokens[1]);
+         if (directive == "deps:")
+            expandDeps(path, files);
+         else if (directive == "python:")
+            expandPython(path, files);
+         else {
+            vector<string> roots(1, path), includes, excludes;
+            for (size_t i = 2; i < tokens.size(); i++) {
+               if (tokens[i][0] == '+')
+                  includes.push_back(tokens[i].substr(1));
+               else if (tokens[i][0] == '-')
+                  excludes.push_back(tokens[i].substr(1));
+               else {
+                  err_printf("Bad glob '%s' on line %d of preload file %s.  Globs start with + or -\n",
+                             tokens[i].c_str(), lineno, filename.c_str());
+                  result = false;
+               }
+            }
+            expandTree(roots, includes, excludes, files);
+         }
+         continue;
+      }
+
+      for (vector<string>::iterator i = tokens.begin(); i != tokens.end(); i++) {
+         if (hasGlobChars(*i))
+            expanded = true;
+         expandPath(*i, files);
+      }
+   }
+   free(line);
+   return result;
+}
+
+/**
+ * Relative paths expand against the working directory and deps: searches
+ * LD_LIBRARY_PATH, so both are part of the key along with the preload file.
+ **/
+static string manifestKey(const struct stat &buf)
+{
+   char key[128];
+   snprintf(key, sizeof(key), "%lu %lu %ld.%09ld %ld", (unsigned long) buf.st_dev, (unsigned long) buf.st_ino,
+            (long) buf.st_mtim.tv_sec, (long) buf.st_mtim.tv_nsec, (long) buf.st_size);
+   string result(key);
+
+   char *cwd = getcwd(NULL, 0);
+   const char *ld_library_path = getenv("LD_LIBRARY_PATH");
+   result += string(" cwd=") + (cwd ? cwd : "");
+   result += string(" LD_LIBRARY_PATH=") + (ld_library_path ? ld_library_path : "");
+   free(cwd);
+   return result;
+}
+
+static bool readManifest(const string &filename, const string &key, set<string> &files)
+{
+   string manifest = filename + MANIFEST_SUFFIX;
+   FILE *f = fopen(manifest.c_str(), "r");
+   if (!f)
+      return false;
+
+   char *line = NULL;
+   size_t line_size = 0;
+   ssize_t len;
+   int lineno = 0;
+   bool valid = true;
+   while (valid && (len = getline(&line, &line_size, f)) != -1) {
+      if (len && line[len-1] == '\n')
+         line[--len] = '\0';
+      lineno++;
+      if (lineno == 1)
+         valid = (strcmp(line, MANIFEST_HEADER) == 0);
+      else if (lineno == 2)
+         valid = (key == line);
+      else
+         files.insert(line);
+   }
+   free(line);
+   fclose(f);
+
+   if (!valid || lineno < 2) {
+      debug_printf("Preload manifest %s is out of date\n", manifest.c_str());
+      files.clear();
+      return false;
+   }
+   debug_printf("Read %lu files from preload manifest %s\n", (unsigned long) files.size(), manifest.c_str());
+   return true;
+}
+
+static void writeManifest(const string &filename, const string &key, const set<string> &files)
+{
+   string manifest = filename + MANIFEST_SUFFIX;
+   char pidstr[32];
+   snprintf(pidstr, sizeof(pidstr), ".%d", getpid());
+   string tmpname = manifest + pidstr;
+
+   FILE *f = fopen(tmpname.c_str(), "w");
+   if (!f) {
+      debug_printf("Not saving preload manifest %s: %s\n", manifest.c_str(), strerror(errno));
+      return;
+   }
+   fprintf(f, "%s\n%s\n", MANIFEST_HEADER, key.c_str());
+   for (set<string>::const_iterator i = files.begin(); i != files.end(); i++)
+      fprintf(f, "%s\n", i->c_str());
+   if (fclose(f) != 0 || rename(tmpname.c_str(), manifest.c_str()) == -1) {
+      debug_printf("Could not save preload manifest %s: %s\n", manifest.c_str(), strerror(errno));
+      unlink(tmpname.c_str());
+      return;
+   }
+   debug_printf("Saved %lu files to preload manifest %s\n", (unsigned long) files.size(), manifest.c_str());
+}
 
 ldcs_message_t *parsePreloadFile(string filename)
 {
-   char pathname[MAX_PATH_LEN+1], cwd[MAX_PATH_LEN+1], dir[MAX_PATH_LEN+1], file[MAX_PATH_LEN+1];
-   set<string> all_dirs, all_files;
+   char dir[MAX_PATH_LEN+1], file[MAX_PATH_LEN+1];
+   set<string> all_dirs, all_files, expanded_files;
+   struct stat buf;
+   bool expanded;
 
    debug_printf("Parsing preload file: %s\n", filename.c_str());
    FILE *f = fopen(filename.c_str(), "r");
-   if (!f) {
+   if (!f || fstat(fileno(f), &buf) == -1) {
       err_printf("Error opening preload file %s: %s\n", filename.c_str(), strerror(errno));
+      if (f)
+         fclose(f);
       return NULL;
    }
 
-   (void)! getcwd(cwd, MAX_PATH_LEN+1);
-   cwd[MAX_PATH_LEN] = '\0';
+   string key = manifestKey(buf);
+   if (!readManifest(filename, key, expanded_files)) {
+      bool result = expandPreloadFile(f, filename, expanded_files, expanded);
+      if (!result) {
+         fclose(f);
+         return NULL;
+      }
+      if (expanded)
+         writeManifest(filename, key, expanded_files);
+   }
+   fclose(f);
 
-   for (;;) {
-      int result = fscanf(f, "%" STR(MAX_PATH_LEN) "s", pathname);
-      if (result == EOF)
-         break;
-      pathname[MAX_PATH_LEN] = '\0';
-      
-      parseFilenameNoAlloc(pathname, file, dir, MAX_PATH_LEN);
+   for (set<string>::iterator i = expanded_files.begin(); i != expanded_files.end(); i++) {
+      parseFilenameNoAlloc(i->c_str(), file, dir, MAX_PATH_LEN);
       file[MAX_PATH_LEN] = '\0';
       dir[MAX_PATH_LEN] = '\0';
-      addCWDToDir(getpid(), dir, MAX_PATH_LEN);
       reducePath(dir);
    
       all_dirs.insert(string(dir));
       all_files.insert(string(dir) + string("/") + string(file));      
    }
 
-   size_t size = 0;
-   size += sizeof(int); //Num dirs as int
-   size += sizeof(int); //Num files as int
-   for (set<string>::iterator i = all_dirs.begin(); i != all_dirs.end(); i++)
-      size += i->length() + 1; //String + 0-terminated character
-   for (set<string>::iterator i = all_files.begin(); i != all_files.end(); i++)
-      size += i->length() + 1; //String + 0-terminated character
-
-   char *buffer = (char *) malloc(size);
-   assert(buffer);
-   
-   size_t cur = 0;
-   *((int *) (buffer+cur)) = (int) all_dirs.size();
-   cur += sizeof(int);
-   *((int *) (buffer+cur)) = (int) all_files.size();
-   cur += sizeof(int);
-
+   vector<const char *> dirs, files;
    for (set<string>::iterator i = all_dirs.begin(); i != all_dirs.end(); i++) {
       debug_printf3("Adding directory %s to preload list\n", i->c_str());
-      int length = i->length() + 1;
-      memcpy(buffer + cur, i->c_str(), length);
-      cur += length;
+      dirs.push_back(i->c_str());
    }
    for (set<string>::iterator i = all_files.begin(); i != all_files.end(); i++) {
       debug_printf3("Adding file %s to preload list\n", i->c_str());
-      int length = i->length() + 1;
-      memcpy(buffer + cur, i->c_str(), length);
-      cur += length;
+      files.push_back(i->c_str());
+   }
+
+   char *buffer;
+   size_t size;
+   int result = pathcode_encode_list(dirs.empty() ? NULL : &dirs[0], (int) dirs.size(),
+                                     files.empty() ? NULL : &files[0], (int) files.size(),
+                                     &buffer, &size);
+   if (result == -1) {
+      err_printf("Could not encode preload list from %s\n", filename.c_str());
+      return NULL;
    }
-   assert(cur == size);
+   debug_printf("Encoded %lu directories and %lu files to preload in %lu bytes\n",
+                (unsigned long) dirs.size(), (unsigned long) files.size(), (unsigned long) size);
 
    ldcs_message_t *msg = (ldcs_message_t *) malloc(sizeof(ldcs_message_t));
    msg->header.type = LDCS_MSG_PRELOAD_FILELIST;
@@ -24,6 +24,8 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include "ldcs_cobo.h"
 #include "rshlaunch.h"
 #include "config_mgr.h"
+#include "spindle_trace.h"
+#include "spindle_filestats.h"
 
 #include <string>
 #include <cassert>
@@ -63,7 +65,7 @@ void pack_param<char*>(char *value, char *buffer, unsigned int &pos)
 
 static int pack_data(spindle_args_t *args, void* &buffer, unsigned &buffer_size)
 {  
-   buffer_size = sizeof(unsigned int) * 8;
+   buffer_size = sizeof(unsigned int) * 9;
    buffer_size += sizeof(opt_t);
    buffer_size += sizeof(unique_id_t);
    buffer_size += args->location ? strlen(args->location) + 1 : 1;
@@ -91,6 +93,7 @@ static int pack_data(spindle_args_t *args, void* &buffer, unsigned &buffer_size)
    pack_param(args->numa_files, buf, pos);
    pack_param(args->numa_excludes, buf, pos);
    pack_param(args->rsh_command, buf, pos);
+   pack_param(args->fdpass_limit, buf, pos);
    assert(pos == buffer_size);
 
    buffer = (void *) buf;
@@ -336,6 +339,11 @@ static void printSpindleFlags(opt_t opts) {
    printFlag(opts, OPT_STOPRELOC, "OPT_STOPRELOC", ss);
    printFlag(opts, OPT_NUMA, "OPT_NUMA", ss);
    printFlag(opts, OPT_OFF, "OPT_OFF", ss);
+   printFlag(opts, OPT_PACKPY, "OPT_PACKPY", ss);
+   printFlag(opts, OPT_FDPASS, "OPT_FDPASS", ss);
+   printFlag(opts, OPT_RELOCCACHE, "OPT_RELOCCACHE", ss);
+   printFlag(opts, OPT_TRACE, "OPT_TRACE", ss);
+   printFlag(opts, OPT_FILESTATS, "OPT_FILESTATS", ss);
    ss << ", ";
    if (OPT_GET_SEC(opts) == OPT_SEC_MUNGE) ss << "OPT_SEC_MUNGE";
    if (OPT_GET_SEC(opts) == OPT_SEC_KEYLMON) ss << "OPT_SEC_KEYLMON";
@@ -355,6 +363,7 @@ int spindleInitFE(const char **hosts, spindle_args_t *params)
    
    LOGGING_INIT(const_cast<char *>("FE"));
    debug_printf("Called spindleInitFE\n");
+   traceFE(TRACE_FE_INIT, TRACE_BEGIN);
 
    if (params->opts & OPT_LOGUSAGE)
       logUser();
@@ -365,7 +374,9 @@ int spindleInitFE(const char **hosts, spindle_args_t *params)
    ldcs_message_t *preload_msg = NULL;
    if (params->opts & OPT_PRELOAD) {
       string preload_file = string(params->preloadfile);
+      traceFE(TRACE_FE_PRELOAD, TRACE_BEGIN);
       preload_msg = parsePreloadFile(preload_file);
+      traceFE(TRACE_FE_PRELOAD, TRACE_END);
       if (!preload_msg) {
          fprintf(stderr, "Failed to parse preload file %s\n", preload_file.c_str());
          return -1;
@@ -391,12 +402,15 @@ int spindleInitFE(const char **hosts, spindle_args_t *params)
                 params->bundle_cachesize_kb);
    printSpindleFlags(params->opts);
    debug_printf("Starting FE servers with hostlist of size %u on port %u\n", hosts_size, params->port);
+   traceFE(TRACE_FE_NETWORK, TRACE_BEGIN);
    ldcs_audit_server_fe_md_open(const_cast<char **>(hosts), hosts_size, 
                                 params->port, params->num_ports, params->unique_id,
                                 &md_data_ptr);
+   traceFE(TRACE_FE_NETWORK, TRACE_END);
 
    /* Broadcast parameters */
    debug_printf("Sending parameters to servers\n");
+   traceFE(TRACE_FE_SETTINGS, TRACE_BEGIN);
    void *param_buffer;
    unsigned int param_buffer_size;
    pack_data(params, param_buffer, param_buffer_size);
@@ -413,6 +427,8 @@ int spindleInitFE(const char **hosts, spindle_args_t *params)
       ldcs_audit_server_fe_broadcast(preload_msg, md_data_ptr);
       cleanPreloadMsg(preload_msg);
    }
+   traceFE(TRACE_FE_SETTINGS, TRACE_END);
+   traceFE(TRACE_FE_INIT, TRACE_END);
 
    return 0;   
 }
@@ -426,7 +442,35 @@ int spindleWaitForCloseFE(spindle_args_t *params)
    if (params->opts & OPT_PERSIST) {
       debug_printf("Warning: blocking for close on a spindle network marked as persistant.  This may permanently hang\n");
    }
-   return ldcs_audit_server_fe_md_waitfor_close();
+   return ldcs_audit_server_fe_md_waitfor_close(params->exit_drain_timeout);
+}
+
+/* How long spindleCloseFE waits for the servers to send their exit reports */
+#define EXIT_REPORT_SECS 30
+
+static void collectTrace(spindle_args_t *params)
+{
+   void *data = NULL;
+   size_t len = 0;
+
+   traceFE(TRACE_FE_CLOSE, TRACE_INSTANT);
+   if (ldcs_audit_server_fe_md_get_exit_data(LDCS_MSG_TRACE_DATA, &data, &len, EXIT_REPORT_SECS) == -1)
+      fprintf(stderr, "Spindle did not receive a launch trace from its servers.  Writing only the front-end's.\n");
+   writeTrace(params->trace_file, data, len);
+   free(data);
+}
+
+static void collectFileStats(spindle_args_t *params)
+{
+   void *data = NULL;
+   size_t len = 0;
+
+   if (ldcs_audit_server_fe_md_get_exit_data(LDCS_MSG_FILESTATS, &data, &len, EXIT_REPORT_SECS) == -1) {
+      fprintf(stderr, "Spindle did not receive file statistics from its servers\n");
+      return;
+   }
+   writeFileStats(params->filestats_file, data, len);
+   free(data);
 }
 
 int spindleCloseFE(spindle_args_t *params)
@@ -438,6 +482,14 @@ int spindleCloseFE(spindle_args_t *params)
    LOGGING_INIT(const_cast<char *>("FE"));
 
    debug_printf("Called spindleCloseFE\n");
+
+   /* Persistent servers never send exit ready, so they have no reports for us */
+   if (!(params->opts & OPT_PERSIST)) {
+      if (params->opts & OPT_TRACE)
+         collectTrace(params);
+      if (params->opts & OPT_FILESTATS)
+         collectFileStats(params);
+   }
    
    ldcs_audit_server_fe_md_close(md_data_ptr);
 
@@ -37,6 +37,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include "parse_launcher.h"
 #include "spindle_session.h"
 #include "config_mgr.h"
+#include "spindle_trace.h"
 
 using namespace std;
 
@@ -125,7 +126,9 @@ int main(int argc, char *argv[])
    }
 
    debug_printf("Spawning spindle daemons\n");
+   traceFE(TRACE_FE_LAUNCHER, TRACE_BEGIN);
    result = launcher->setupDaemons();
+   traceFE(TRACE_FE_LAUNCHER, TRACE_END);
    if (!result) {
       fprintf(stderr, "Internal error while spawning spindle daemons\n");
       return -1;
@@ -198,6 +201,7 @@ int main(int argc, char *argv[])
                }
                else {
                   debug_printf("Spawning application for session-id %lu\n", id);
+                  traceFE(TRACE_FE_JOB_START, TRACE_INSTANT);
                   result = launcher->spawnJob(id, app_argc, app_argv);
                   num_live_jobs++;
                   num_run_jobs++;
@@ -293,17 +297,20 @@ static bool getNextTask(Launcher *launcher, spindle_args_t *params, vector<JobTa
    int launcher_fd = launcher->getJobFinishFD();
    int session_fd = get_session_fd();
    int max_fd = session_fd > launcher_fd ? session_fd : launcher_fd;
+   struct timeval timeout_tv, *timeout;
    
    fd_set readset;
-   FD_ZERO(&readset);
-   if (launcher_fd != -1)
-      FD_SET(launcher_fd, &readset);
-   if (session_fd != -1)
-      FD_SET(session_fd, &readset);
-   assert(max_fd != -1);
    int result;
    do {
-      result = select(max_fd+1, &readset, NULL, NULL, NULL);
+      FD_ZERO(&readset);
+      if (launcher_fd != -1)
+         FD_SET(launcher_fd, &readset);
+      if (session_fd != -1)
+         FD_SET(session_fd, &readset);
+      max_fd = add_session_job_fds(&readset, max_fd);
+      assert(max_fd != -1);
+      timeout = get_session_timeout(&timeout_tv);
+      result = select(max_fd+1, &readset, NULL, NULL, timeout);
    } while (result == -1 && errno == EINTR);
    if (result == -1) {
       int error = errno;
@@ -363,5 +370,11 @@ static bool getNextTask(Launcher *launcher, spindle_args_t *params, vector<JobTa
       }
    }
 
+   if (check_session_jobs(&readset)) {
+      JobTask *task = new JobTask();
+      task->setSessionShutdown();
+      tasks.push_back(task);
+   }
+
    return true;
 }
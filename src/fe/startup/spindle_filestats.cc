@@ -0,0 +1,117 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT 
+file in the top level directory, or at 
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms 
+and conditions of the GNU Lesser General Public License for more details.  You should 
+have received a copy of the GNU Lesser General Public License along with this 
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include "spindle_filestats.h"
+#include "ldcs_api.h"
+#include "spindle_debug.h"
+
+using namespace std;
+
+struct FileStats {
+   filestats_record_t record;
+   string path;
+};
+
+/* Files that kept processes waiting longest come first, then the biggest */
+static bool heavierFile(const FileStats &a, const FileStats &b)
+{
+   if (a.record.client_wait != b.record.client_wait)
+      return a.record.client_wait > b.record.client_wait;
+   if (a.record.bytes != b.record.bytes)
+      return a.record.bytes > b.record.bytes;
+   return a.path < b.path;
+}
+
+bool writeFileStats(const char *filename, const void *data, size_t len)
+{
+   const char *cur = (const char *) data, *end = cur + len;
+   vector<FileStats> files;
+   map<string, size_t> file_index;
+   map<string, size_t>::iterator existing;
+   FileStats f;
+   double total_wait = 0.0;
+   unsigned long long total_bytes = 0;
+
+   while (cur + sizeof(filestats_record_t) <= end) {
+      memcpy(&f.record, cur, sizeof(f.record));
+      cur += sizeof(f.record);
+      if (!f.record.path_len || f.record.path_len > (size_t) (end - cur) || cur[f.record.path_len-1] != '\0') {
+         err_printf("File statistics from servers were malformed\n");
+         break;
+      }
+      f.path = cur;
+      cur += f.record.path_len;
+      total_wait += f.record.client_wait;
+      total_bytes += f.record.bytes;
+
+      /* A file appears again for each round of reports the servers sent */
+      existing = file_index.find(f.path);
+      if (existing == file_index.end()) {
+         file_index[f.path] = files.size();
+         files.push_back(f);
+         continue;
+      }
+      filestats_record_t &r = files[existing->second].record;
+      r.bytes += f.record.bytes;
+      r.client_wait += f.record.client_wait;
+      if (f.record.max_latency > r.max_latency)
+         r.max_latency = f.record.max_latency;
+      r.requests += f.record.requests;
+      r.cache_hits += f.record.cache_hits;
+      r.nodes_requested += f.record.nodes_requested;
+      r.nodes_disk += f.record.nodes_disk;
+      r.nodes_tree += f.record.nodes_tree;
+      r.nodes_pushed += f.record.nodes_pushed;
+   }
+   sort(files.begin(), files.end(), heavierFile);
+
+   FILE *out = fopen(filename, "w");
+   if (!out) {
+      fprintf(stderr, "Spindle could not open file statistics report %s: %s\n", filename, strerror(errno));
+      return false;
+   }
+   fprintf(out, "# Spindle per-file statistics for %lu files, sorted by wait.  Columns:\n"
+           "#   wait: seconds processes spent waiting for the file, summed over all processes\n"
+           "#   latency: most seconds any node took from its first request to having the file\n"
+           "#   bytes: bytes read off disk or moved between servers\n"
+           "#   requests, hits: requests the servers answered, and how many of those found the file already on the node\n"
+           "#   nodes, disk, tree, pushed: nodes that requested it, read it off disk, asked their parent for it, and were sent it unasked\n",
+           (unsigned long) files.size());
+   fprintf(out, "%12s %10s %14s %9s %9s %7s %7s %7s %7s  %s\n",
+           "wait", "latency", "bytes", "requests", "hits", "nodes", "disk", "tree", "pushed", "path");
+   for (vector<FileStats>::iterator i = files.begin(); i != files.end(); i++) {
+      const filestats_record_t &r = i->record;
+      fprintf(out, "%12.6f %10.6f %14llu %9u %9u %7u %7u %7u %7u  %s\n",
+              r.client_wait, r.max_latency, (unsigned long long) r.bytes, r.requests, r.cache_hits,
+              r.nodes_requested, r.nodes_disk, r.nodes_tree, r.nodes_pushed, i->path.c_str());
+   }
+   if (fclose(out) != 0) {
+      fprintf(stderr, "Spindle could not write file statistics report %s: %s\n", filename, strerror(errno));
+      return false;
+   }
+
+   fprintf(stderr, "Spindle wrote statistics for %lu files (%.3fs of waiting, %llu bytes) to %s\n",
+           (unsigned long) files.size(), total_wait, total_bytes, filename);
+   return true;
+}
@@ -21,6 +21,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include <fcntl.h>
 #include <unistd.h>
 #include <cstring>
+#include <ctype.h>
 #include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -33,9 +34,12 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/file.h>
+#include <time.h>
 
 #include <string>
 #include <map>
+#include <set>
 
 #include "spindle_session.h"
 #include "spindle_debug.h"
@@ -55,6 +59,24 @@ static int sock = -1;
 #define RET_RUN_CMD 2
 #define RET_END_SESSION 3
 
+/* How long a new shared session waits for its first job */
+#define SHARED_SESSION_STARTUP_WAIT 60
+#define SHARED_SESSION_ATTEMPTS 5
+
+/**
+ * A shared session is started by whichever spindle job in an allocation
+ * gets there first, and every later job in the allocation runs in it
+ * rather than starting its own daemons.  Each job keeps its connection to
+ * the session open while it runs, so the session counts its jobs by their
+ * open sockets.  Once the last one closes and no new job shows up within
+ * the linger time, the session ends.
+ **/
+static bool shared_session = false;
+static unsigned int shared_linger = 0;
+static bool shared_ever_attached = false;
+static time_t shared_idle_since;
+static std::set<int> attached_jobs;
+
 extern bool getRandom(void *bytes, size_t bytes_size);
 
 static string getTmpdir()
@@ -199,10 +221,27 @@ static int connect_to_session()
    int result = connect(sock, (const struct sockaddr *) &server, len);
    if (result == -1) {
       int error = errno;
-      err_printf("Failed to connect to unix socket %s for session: %s\n", session_socket.c_str(), strerror(error));
+      debug_printf("Failed to connect to unix socket %s for session: %s\n", session_socket.c_str(), strerror(error));
+      close(sock);
+      sock = -1;
+      errno = error;
       return -1;
    }
 
+   if (shared_session) {
+      //Shared session names are predictable, so make sure we are talking to our own daemon
+      struct ucred cred;
+      socklen_t cred_len = sizeof(cred);
+      result = getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len);
+      if (result == -1 || cred.uid != getuid()) {
+         err_printf("Shared session socket %s is not owned by us.  Not using it\n", session_socket.c_str());
+         close(sock);
+         sock = -1;
+         errno = EACCES;
+         return -1;
+      }
+   }
+
    return 0;
 }
 
@@ -212,7 +251,7 @@ static int safe_send(int fd, void *buf, size_t buffer_size)
    unsigned char *buffer = (unsigned char *) buf;
    size_t cur = 0;
    do {
-      int result = send(fd, buffer+cur, buffer_size - cur, 0);
+      int result = send(fd, buffer+cur, buffer_size - cur, MSG_NOSIGNAL);
       if (result == -1 && errno == EINTR) {
          continue;
       }
@@ -241,7 +280,11 @@ static int safe_recv(int fd, void *buf, size_t buffer_size)
          err_printf("Failed to recv message from client: %s\n", strerror(errno));
          return -1;
       }
-      else if (result >= 0) {
+      else if (result == 0) {
+         debug_printf("Session connection on fd %d closed\n", fd);
+         return -1;
+      }
+      else {
          cur += result;
       }
    } while (cur < buffer_size);
@@ -428,6 +471,195 @@ int get_session_runcmds(app_id_t &appid, int &app_argc, char** &app_argv, bool &
    return 0;
 }
 
+/**
+ * Send our command line to the session and run the one it sends back.
+ * A job in a shared session runs as our child, and we keep our connection
+ * to the session until it exits.  Returns -1 if the session went away
+ * before taking the job; otherwise does not return.
+ **/
+static int run_in_session(const ConfigMap &config)
+{
+   int app_argc;
+   char **app_argv;
+   int cmd = RET_RUN_CMD;
+   int rc, result;
+
+   config.getApplicationCmdline(app_argc, app_argv);
+   result = safe_send(sock, &cmd, sizeof(cmd));
+   if (result == -1) {
+      debug_printf("Error sending RET_RUN_CMD\n");
+      goto done;
+   }
+   result = send_msg(sock, app_argc, app_argv);
+   if (result == -1) {
+      debug_printf("Error sending app cmdline\n");
+      goto done;
+   }
+
+   result = safe_recv(sock, &cmd, sizeof(cmd));
+   if (result == -1) {
+      debug_printf("Error receiving app cmd\n");
+      goto done;
+   }
+
+   if (cmd == RET_RUN_CMD) {
+      result = get_msg(sock, app_argc, app_argv);
+      if (result == -1) {
+         debug_printf("Error receiving app cmdline\n");
+         goto done;
+      }
+      if (!shared_session) {
+         close(sock);
+         execvp(app_argv[0], app_argv);
+         int error = errno;
+         fprintf(stderr, "Error running %s: %s\n", app_argv[0], strerror(error));
+         exit(-1);
+      }
+
+      fcntl(sock, F_SETFD, FD_CLOEXEC);
+      pid_t pid = fork();
+      if (pid == -1) {
+         int error = errno;
+         fprintf(stderr, "Spindle error forking job in shared session: %s\n", strerror(error));
+         exit(-1);
+      }
+      if (pid == 0) {
+         execvp(app_argv[0], app_argv);
+         int error = errno;
+         fprintf(stderr, "Error running %s: %s\n", app_argv[0], strerror(error));
+         _exit(-1);
+      }
+      int status = 0;
+      do {
+         result = waitpid(pid, &status, 0);
+      } while (result == -1 && errno == EINTR);
+      close(sock);
+      if (result == -1)
+         rc = -1;
+      else if (WIFEXITED(status))
+         rc = WEXITSTATUS(status);
+      else
+         rc = 128 + WTERMSIG(status);
+      debug_printf("Application in shared session exiting with code %d\n", rc);
+      exit(rc);
+   }
+   else if (cmd == RET_JOB_DONE) {
+      result = safe_recv(sock, &rc, sizeof(rc));
+      if (result == -1) {
+         debug_printf("Error receiving app return code\n");
+         goto done;
+      }
+      debug_printf("Application exiting with code %d\n", rc);
+      close(sock);
+      exit(rc);
+   }
+  done:
+   close(sock);
+   sock = -1;
+   return -1;
+}
+
+/**
+ * Shared sessions are named by user and allocation, so every job in the
+ * allocation finds the same one.  Outside a recognized allocation, jobs
+ * launched from the same login or batch session share.
+ **/
+static void set_shared_session_id()
+{
+   static const char *alloc_vars[] = { "SLURM_JOB_ID", "LSB_JOBID", "PBS_JOBID", "COBALT_JOBID", NULL };
+   char uid_str[32];
+   string alloc;
+
+   for (const char **var = alloc_vars; *var && alloc.empty(); var++) {
+      const char *val = getenv(*var);
+      if (val && *val)
+         alloc = val;
+   }
+   if (alloc.empty()) {
+      char sid_str[32];
+      snprintf(sid_str, sizeof(sid_str), "sid%d", (int) getsid(0));
+      alloc = sid_str;
+   }
+   for (string::iterator i = alloc.begin(); i != alloc.end(); i++) {
+      if (!isalnum(*i) && *i != '.' && *i != '-')
+         *i = '_';
+   }
+
+   snprintf(uid_str, sizeof(uid_str), "%d", (int) getuid());
+   set_session_id(string("shared.") + uid_str + "." + alloc);
+}
+
+/**
+ * Find our allocation's shared session, starting it if there isn't one,
+ * and run the job in it.  Starting is serialized by a per-user lock file,
+ * so that two jobs starting at once agree on which of them creates the
+ * session.  Returns 0 in the new session daemon, which goes on to start
+ * spindle.
+ **/
+static int init_shared_session(const ConfigMap &config)
+{
+   shared_session = true;
+   set_shared_session_id();
+   debug_printf("Using shared session %s\n", session_id.c_str());
+
+   char uid_str[32];
+   snprintf(uid_str, sizeof(uid_str), "%d", (int) getuid());
+   string lockpath = getTmpdir() + "/" + SOCKET_PREFIX + "shared." + uid_str + ".lock";
+
+   for (int i = 0; i < SHARED_SESSION_ATTEMPTS; i++) {
+      if (connect_to_session() == 0) {
+         debug_printf("Running job in existing shared session %s\n", session_id.c_str());
+         run_in_session(config);
+         debug_printf("Shared session %s went away before running our job.  Retrying\n", session_id.c_str());
+         continue;
+      }
+
+      int lockfd = open(lockpath.c_str(), O_RDWR | O_CREAT, 0600);
+      if (lockfd == -1 || flock(lockfd, LOCK_EX) == -1) {
+         int error = errno;
+         err_printf("Could not lock %s: %s\n", lockpath.c_str(), strerror(error));
+         if (lockfd != -1)
+            close(lockfd);
+         break;
+      }
+      if (connect_to_session() == 0) {
+         //Someone else started it while we waited for the lock
+         close(lockfd);
+         run_in_session(config);
+         continue;
+      }
+      if (errno == ECONNREFUSED) {
+         debug_printf("Removing stale shared session socket %s\n", session_socket.c_str());
+         unlink(session_socket.c_str());
+      }
+
+      debug_printf("Starting shared session %s\n", session_id.c_str());
+      pid_t pid = grandchild_fork();
+      if (pid == 0) {
+         close(lockfd);
+         close(0);
+         open("/dev/null", O_RDONLY);
+         close(1);
+         open("/dev/null", O_WRONLY);
+         if (create_unixsocket() == -1) {
+            finish_session_startup(true);
+            exit(-1);
+         }
+         finish_session_startup(false);
+         shared_linger = (unsigned int) config.getValueIntegral(confSharedSessionLinger).second;
+         shared_idle_since = time(NULL);
+         return 0;
+      }
+      flock(lockfd, LOCK_UN);
+      close(lockfd);
+      if (pid == -1)
+         debug_printf("Failed to start shared session daemon\n");
+   }
+
+   fprintf(stderr, "ERROR: Spindle could not start or join shared session %s\n", session_id.c_str());
+   exit(-1);
+}
+
 int init_session(spindle_args_t *args, const ConfigMap &config)
 {
    int result;
@@ -437,6 +669,9 @@ int init_session(spindle_args_t *args, const ConfigMap &config)
       return 0;
    }
 
+   if (sstatus == sstatus_shared)
+      return init_shared_session(config);
+
    if (sstatus == sstatus_start) {
       debug_printf("Starting new spindle session\n");
 
@@ -482,60 +717,16 @@ int init_session(spindle_args_t *args, const ConfigMap &config)
    debug_printf("Connecting to existing spindle session-id %s\n", session_id.c_str());
    result = connect_to_session();
    if (result == -1) {
+      int error = errno;
+      err_printf("Failed to connect to unix socket %s for session: %s\n", session_socket.c_str(), strerror(error));
       fprintf(stderr, "ERROR: Spindle could not connect to session %s\n", session_id.c_str());
       exit(-1);
    }
 
    if (sstatus == sstatus_run) {
       debug_printf("New run in spindle session-id %s\n", session_id.c_str());
-      int app_argc;
-      char **app_argv;
-      int cmd = RET_RUN_CMD;
-      int rc;
-      config.getApplicationCmdline(app_argc, app_argv);
-      result = safe_send(sock, &cmd, sizeof(cmd));
-      if (result == -1) {
-         debug_printf("Error sending RET_RUN_CMD\n");
-         goto done;
-      }
-      result = send_msg(sock, app_argc, app_argv);
-      if (result == -1) {
-         debug_printf("Error sending app cmdline\n");
-         goto done;
-      }
-
-      result = safe_recv(sock, &cmd, sizeof(cmd));
-      if (result == -1) {
-         debug_printf("Error receiving app cmd\n");
-         goto done;
-      }
-
-      if (cmd == RET_RUN_CMD) {
-         result = get_msg(sock, app_argc, app_argv);
-         if (result == -1) {
-            debug_printf("Error receiving app cmdline\n");
-            goto done;
-         }
-         close(sock);
-         
-         execvp(app_argv[0], app_argv);
-         int error = errno;
-         fprintf(stderr, "Error running %s: %s\n", app_argv[0], strerror(error));
-         exit(-1);
-      }
-      else if (cmd == RET_JOB_DONE) {
-         result = safe_recv(sock, &rc, sizeof(rc));
-         if (result == -1) {
-            debug_printf("Error receiving app return code\n");
-            goto done;
-         }
-         debug_printf("Application exiting with code %d\n", rc);
-         close(sock);
-         exit(rc);
-      }
-     done:
+      run_in_session(config);
       fprintf(stderr, "Spindle error while communicating with session %s\n", session_id.c_str());
-      close(sock);
       exit(-1);
    }
    
@@ -584,6 +775,84 @@ int return_session_cmd(app_id_t appid, int app_argc, char **app_argv)
       debug_printf("safe_send returned error communicating on socket %d for session-id %lu\n", client, appid);
    }
    socket_ids.erase(i);
-   close(client);
+   if (shared_session && result != -1) {
+      attached_jobs.insert(client);
+      shared_ever_attached = true;
+      debug_printf("Job %lu attached to shared session.  %lu jobs attached\n", appid, (unsigned long) attached_jobs.size());
+   }
+   else
+      close(client);
    return result;
 }
+
+int add_session_job_fds(fd_set *readset, int max_fd)
+{
+   for (std::set<int>::iterator i = attached_jobs.begin(); i != attached_jobs.end(); i++) {
+      FD_SET(*i, readset);
+      if (*i > max_fd)
+         max_fd = *i;
+   }
+   return max_fd;
+}
+
+static time_t shared_session_deadline()
+{
+   unsigned int wait = shared_linger;
+   if (!shared_ever_attached && wait < SHARED_SESSION_STARTUP_WAIT)
+      wait = SHARED_SESSION_STARTUP_WAIT;
+   return shared_idle_since + wait;
+}
+
+static bool shared_session_idle()
+{
+   return shared_session && sock != -1 && attached_jobs.empty() && socket_ids.empty();
+}
+
+struct timeval *get_session_timeout(struct timeval *tv)
+{
+   if (!shared_session_idle())
+      return NULL;
+   time_t now = time(NULL), deadline = shared_session_deadline();
+   tv->tv_sec = deadline > now ? deadline - now : 0;
+   tv->tv_usec = 0;
+   return tv;
+}
+
+/**
+ * Drop jobs whose connections closed.  Returns true once a shared session
+ * has sat idle past its linger time, after which it takes no more jobs.
+ **/
+bool check_session_jobs(fd_set *readset)
+{
+   for (std::set<int>::iterator i = attached_jobs.begin(); i != attached_jobs.end(); ) {
+      int fd = *i;
+      if (!FD_ISSET(fd, readset)) {
+         i++;
+         continue;
+      }
+      char c;
+      int result;
+      do {
+         result = read(fd, &c, sizeof(c));
+      } while (result == -1 && errno == EINTR);
+      if (result > 0) {
+         i++;
+         continue;
+      }
+      close(fd);
+      attached_jobs.erase(i++);
+      debug_printf("Job detached from shared session.  %lu jobs attached\n", (unsigned long) attached_jobs.size());
+      if (attached_jobs.empty())
+         shared_idle_since = time(NULL);
+   }
+
+   if (!shared_session_idle() || time(NULL) < shared_session_deadline())
+      return false;
+
+   debug_printf("Shared session %s is idle.  Shutting it down\n", session_id.c_str());
+   //Unlink before closing, so a new job never finds our socket refusing connections
+   unlink(session_socket.c_str());
+   close(sock);
+   sock = -1;
+   return true;
+}
@@ -17,6 +17,9 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #if !defined(SPINDLE_SESSION_H_)
 #define SPINDLE_SESSION_H_
 
+#include <sys/select.h>
+#include <sys/time.h>
+
 #include "spindle_launch.h"
 #include "launcher.h"
 #include "config_mgr.h"
@@ -26,5 +29,8 @@ int get_session_runcmds(app_id_t &appid, int &app_argc, char** &app_argv, bool &
 int get_session_fd();
 int return_session_cmd(app_id_t appid, int app_argc, char **app_argv);
 void mark_session_job_done(app_id_t appid, int rc);
+int add_session_job_fds(fd_set *readset, int max_fd);
+struct timeval *get_session_timeout(struct timeval *tv);
+bool check_session_jobs(fd_set *readset);
 
 #endif
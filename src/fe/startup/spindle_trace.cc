@@ -0,0 +1,183 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT 
+file in the top level directory, or at 
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms 
+and conditions of the GNU Lesser General Public License for more details.  You should 
+have received a copy of the GNU Lesser General Public License along with this 
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <set>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "spindle_trace.h"
+#include "spindle_debug.h"
+
+using namespace std;
+
+static vector<trace_event_t> fe_events;
+
+static const char *phase_names[TRACE_NUM_PHASES] = {
+   "launcher", "init", "preload", "network", "settings", "job start", "close",
+   "start", "network", "settings", "setup", "preload", "client connect", "exit ready",
+   "bootstrap", "init", "load", "library", "relocate", "main"
+};
+
+void traceFE(trace_phase_t phase, int kind)
+{
+   struct timeval tv;
+   trace_event_t event;
+
+   gettimeofday(&tv, NULL);
+   event.time_us = ((uint64_t) tv.tv_sec) * 1000000 + tv.tv_usec;
+   event.pid = (int32_t) getpid();
+   event.phase = (uint16_t) phase;
+   event.kind = (uint16_t) kind;
+   fe_events.push_back(event);
+}
+
+struct trace_proc_t {
+   int id;
+   string name;
+   unsigned int num_dropped;
+   const trace_event_t *events;
+   unsigned int num_events;
+};
+
+/**
+ * Splits the servers' data into its blocks.  Returns false if it is cut
+ * short, keeping the blocks before that.
+ **/
+static bool parseBlocks(const void *data, size_t len, vector<trace_proc_t> &procs)
+{
+   const char *cur = (const char *) data, *end = cur + len;
+   trace_block_t block;
+   trace_proc_t proc;
+   char name[128];
+
+   while (cur < end) {
+      if ((size_t) (end - cur) < sizeof(block))
+         return false;
+      memcpy(&block, cur, sizeof(block));
+      cur += sizeof(block);
+      if ((size_t) (end - cur) / sizeof(trace_event_t) < block.num_events)
+         return false;
+      block.hostname[sizeof(block.hostname)-1] = '\0';
+
+      proc.id = block.md_rank + 1;
+      snprintf(name, sizeof(name), "server %d on %s", (int) block.md_rank, block.hostname);
+      proc.name = name;
+      proc.num_dropped = block.num_dropped;
+      proc.events = (const trace_event_t *) cur;
+      proc.num_events = block.num_events;
+      procs.push_back(proc);
+      cur += block.num_events * sizeof(trace_event_t);
+   }
+   return true;
+}
+
+static const char *phaseCategory(unsigned int phase)
+{
+   if (phase < TRACE_BE_START)
+      return "fe";
+   if (phase < TRACE_CL_BOOTSTRAP)
+      return "server";
+   return "client";
+}
+
+bool writeTrace(const char *filename, const void *server_data, size_t server_data_len)
+{
+   vector<trace_proc_t> procs;
+   trace_proc_t fe;
+   char hostname[256];
+   uint64_t start = 0, last_main = 0;
+   int32_t last_main_pid = 0;
+   const trace_proc_t *last_main_proc = NULL;
+   unsigned long total_dropped = 0;
+   bool first = true;
+
+   gethostname(hostname, sizeof(hostname));
+   hostname[sizeof(hostname)-1] = '\0';
+   fe.id = 0;
+   fe.name = string("spindle FE on ") + hostname;
+   fe.num_dropped = 0;
+   fe.events = fe_events.empty() ? NULL : &fe_events[0];
+   fe.num_events = fe_events.size();
+   procs.push_back(fe);
+
+   if (server_data && !parseBlocks(server_data, server_data_len, procs))
+      err_printf("Launch trace from servers was truncated\n");
+
+   for (vector<trace_proc_t>::iterator p = procs.begin(); p != procs.end(); p++) {
+      total_dropped += p->num_dropped;
+      for (unsigned int i = 0; i < p->num_events; i++) {
+         const trace_event_t &e = p->events[i];
+         if (!start || e.time_us < start)
+            start = e.time_us;
+         if (e.phase == TRACE_CL_MAIN && e.time_us >= last_main) {
+            last_main = e.time_us;
+            last_main_pid = e.pid;
+            last_main_proc = &*p;
+         }
+      }
+   }
+
+   FILE *f = fopen(filename, "w");
+   if (!f) {
+      fprintf(stderr, "Spindle could not open launch trace file %s: %s\n", filename, strerror(errno));
+      return false;
+   }
+
+   fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+   for (vector<trace_proc_t>::iterator p = procs.begin(); p != procs.end(); p++) {
+      set<int32_t> named_threads;
+      fprintf(f, "%s{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": \"%s\"}}",
+              first ? "" : ",\n", p->id, p->name.c_str());
+      first = false;
+      if (p->num_dropped)
+         fprintf(f, ",\n{\"name\": \"process_labels\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"labels\": \"%u events dropped\"}}",
+                 p->id, p->num_dropped);
+      for (unsigned int i = 0; i < p->num_events; i++) {
+         const trace_event_t &e = p->events[i];
+         if (e.phase >= TRACE_NUM_PHASES || e.kind > TRACE_INSTANT)
+            continue;
+         if (named_threads.insert(e.pid).second)
+            fprintf(f, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"%s %d\"}}",
+                    p->id, (int) e.pid, phaseCategory(e.phase), (int) e.pid);
+         fprintf(f, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"%s\", \"pid\": %d, \"tid\": %d, \"ts\": %llu%s}",
+                 phase_names[e.phase], phaseCategory(e.phase),
+                 e.kind == TRACE_BEGIN ? "B" : (e.kind == TRACE_END ? "E" : "i"),
+                 p->id, (int) e.pid, (unsigned long long) (e.time_us - start),
+                 e.kind == TRACE_INSTANT ? ", \"s\": \"t\"" : "");
+      }
+   }
+   fprintf(f, "\n]}\n");
+   if (fclose(f) != 0) {
+      fprintf(stderr, "Spindle could not write launch trace file %s: %s\n", filename, strerror(errno));
+      return false;
+   }
+
+   if (last_main_proc)
+      fprintf(stderr, "Spindle wrote launch trace to %s.  The last process reached main %.3fs in (pid %d, %s)\n",
+              filename, (last_main - start) / 1000000.0, (int) last_main_pid, last_main_proc->name.c_str());
+   else
+      fprintf(stderr, "Spindle wrote launch trace to %s.  No process reported reaching main\n", filename);
+   if (total_dropped)
+      fprintf(stderr, "Spindle dropped %lu launch trace events that did not fit in client or server buffers\n", total_dropped);
+
+   fe_events.clear();
+   return true;
+}
@@ -0,0 +1,31 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT 
+file in the top level directory, or at 
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms 
+and conditions of the GNU Lesser General Public License for more details.  You should 
+have received a copy of the GNU Lesser General Public License along with this 
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#if !defined(SPINDLE_TRACE_H_)
+#define SPINDLE_TRACE_H_
+
+#include <cstddef>
+#include "ldcs_api.h"
+
+/**
+ * The FE's part of the launch trace (OPT_TRACE).  writeTrace merges it with
+ * the blocks the servers sent up and writes the lot in the Chrome trace
+ * event format, which chrome://tracing and Perfetto both load.
+ **/
+void traceFE(trace_phase_t phase, int kind);
+bool writeTrace(const char *filename, const void *server_data, size_t server_data_len);
+
+#endif
@@ -230,9 +230,10 @@ static int sp_getopts (flux_shell_t *shell, struct spindle_ctx *ctx)
     int pull = 0;
     int had_error = 0;
     int numa = 0;
+    int fdpassing = 0;
     const char *relocaout = NULL, *reloclibs = NULL, *relocexec = NULL, *relocpython = NULL;
     const char *followfork = NULL, *preload = NULL, *level = NULL;
-    const char *pyprefix = NULL;
+    const char *pyprefix = NULL, *packpython = NULL, *reloccache = NULL;
     char *numafiles = NULL;
 
     if (flux_shell_getopt_unpack (shell, "spindle", "o", &opts) < 0)
@@ -255,7 +256,7 @@ static int sp_getopts (flux_shell_t *shell, struct spindle_ctx *ctx)
      *  supplied by the user, but not unpacked (This handles typos, etc).
      */
     if (json_unpack_ex (opts, &error, JSON_STRICT,
-                        "{s?i s?i s?i s?i s?s s?s s?s s?s s?s s?s s?i s?s s?s s?s}",
+                        "{s?i s?i s?i s?i s?s s?s s?s s?s s?s s?s s?s s?s s?i s?s s?s s?s s?i}",
                         "noclean", &noclean,
                         "nostrip", &nostrip,
                         "push", &push,
@@ -266,10 +267,13 @@ static int sp_getopts (flux_shell_t *shell, struct spindle_ctx *ctx)
                         "reloc-exec", &relocexec,
                         "reloc-python", &relocpython,
                         "python-prefix", &pyprefix,
+                        "pack-python", &packpython,
+                        "reloc-cache", &reloccache,
                         "numa", &numa,
                         "numa-files", &numafiles,
                         "preload", &preload,
-                        "level", &level) < 0)
+                        "level", &level,
+                        "fd-passing", &fdpassing) < 0)
         return shell_log_errno ("Error in spindle option: %s", error.text);
 
     if (noclean)
@@ -296,8 +300,16 @@ static int sp_getopts (flux_shell_t *shell, struct spindle_ctx *ctx)
        had_error |= parse_yesno(&ctx->params.opts, OPT_RELOCEXEC, relocexec);
     if (relocpython)
        had_error |= parse_yesno(&ctx->params.opts, OPT_RELOCPY, relocpython);
+    if (packpython)
+       had_error |= parse_yesno(&ctx->params.opts, OPT_PACKPY, packpython);
+    if (reloccache)
+       had_error |= parse_yesno(&ctx->params.opts, OPT_RELOCCACHE, reloccache);
     if (preload)
        ctx->params.preloadfile = (char *) preload;
+    if (fdpassing > 0) {
+       ctx->params.opts |= OPT_FDPASS;
+       ctx->params.fdpass_limit = (unsigned int) fdpassing;
+    }
     if (numa) {
        ctx->params.opts |= OPT_NUMA;
     }
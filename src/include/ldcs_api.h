@@ -38,6 +38,10 @@ typedef enum {
    LDCS_MSG_EXISTS_ANSWER,
    LDCS_MSG_ORIGPATH_QUERY,
    LDCS_MSG_ORIGPATH_ANSWER,   
+   LDCS_MSG_SONAME_QUERY,
+   LDCS_MSG_SONAME_ANSWER,
+   LDCS_MSG_EXECPATH_QUERY,
+   LDCS_MSG_EXECPATH_ANSWER,
    LDCS_MSG_END,
    LDCS_MSG_CWD,
    LDCS_MSG_PID,
@@ -73,6 +77,14 @@ typedef enum {
    LDCS_MSG_EXIT,
    LDCS_MSG_BUNDLE,
    LDCS_MSG_ALIAS,
+   LDCS_MSG_PYPACK,
+   LDCS_MSG_FILE_QUERY_FD,
+   LDCS_MSG_EXIT_DRAINING,
+   LDCS_MSG_EXIT_STATUS_REQ,
+   LDCS_MSG_EXIT_STATUS,
+   LDCS_MSG_TRACE,
+   LDCS_MSG_TRACE_DATA,
+   LDCS_MSG_FILESTATS,
    LDCS_MSG_UNKNOWN
 } ldcs_message_ids_t;
 
@@ -112,7 +124,12 @@ struct ldcs_message_struct
 };
 typedef struct ldcs_message_struct ldcs_message_t;
 
+/* Leading int of a FILE_QUERY_ANSWER that carries a path, when the server
+   also passes an open descriptor for it (see ldcs_send_fd) */
+#define LDCS_ANSWER_PASSED_FD 1
+
 int ldcs_send_msg(int connid, ldcs_message_t * msg);
+int ldcs_send_fd(int connid, int fd);
 ldcs_message_t * ldcs_recv_msg(int fd, ldcs_read_block_t block);
 int ldcs_recv_msg_static(int fd, ldcs_message_t *msg, ldcs_read_block_t block);
 int ldcs_get_aux_fd();
@@ -148,6 +165,101 @@ typedef struct {
    int64_t binding_offset;
 } ldso_info_t;
 
+/* Payload of LDCS_MSG_EXIT_STATUS, which is reduced up the server tree to
+   tell the FE which servers are holding up exit.  Only the first few are
+   named, so the message size doesn't grow with the job.  Each
+   LDCS_MSG_EXIT_STATUS_REQ carries a uint32_t sequence number, which the
+   replies echo.  A newer request replaces a reduction that is still
+   waiting, and children that never answered it aren't waited for again,
+   but counted in their parent's children_unanswered. */
+#define EXIT_STATUS_MAX_LISTED 16
+typedef struct {
+   int32_t md_rank;
+   int32_t clients_live;
+   int32_t waiting_for_note;
+   int32_t children_unanswered;
+   char hostname[64];
+} exit_straggler_t;
+
+typedef struct {
+   uint32_t seq;
+   int32_t num_stragglers;
+   int32_t num_listed;
+   exit_straggler_t listed[EXIT_STATUS_MAX_LISTED];
+} exit_status_t;
+
+/* Launch tracing (OPT_TRACE).  Clients send their events to their server in
+   LDCS_MSG_TRACE.  At exit each server sends a trace_block_t of its own and
+   its clients' events, followed by its children's blocks, in one
+   LDCS_MSG_TRACE_DATA to its parent, so the FE gets every node's events in
+   a single message.  Times are wall-clock microseconds. */
+typedef enum {
+   TRACE_FE_LAUNCHER,
+   TRACE_FE_INIT,
+   TRACE_FE_PRELOAD,
+   TRACE_FE_NETWORK,
+   TRACE_FE_SETTINGS,
+   TRACE_FE_JOB_START,
+   TRACE_FE_CLOSE,
+   TRACE_BE_START,
+   TRACE_BE_NETWORK,
+   TRACE_BE_SETTINGS,
+   TRACE_BE_SETUP,
+   TRACE_BE_PRELOAD,
+   TRACE_BE_CLIENT_CONNECT,
+   TRACE_BE_EXIT_READY,
+   TRACE_CL_BOOTSTRAP,
+   TRACE_CL_INIT,
+   TRACE_CL_LOAD,
+   TRACE_CL_LIBRARY,
+   TRACE_CL_RELOCATE,
+   TRACE_CL_MAIN,
+   TRACE_NUM_PHASES
+} trace_phase_t;
+
+#define TRACE_BEGIN 0
+#define TRACE_END 1
+#define TRACE_INSTANT 2
+/* Only sent by clients: time_us holds how many events they dropped */
+#define TRACE_DROPPED 3
+
+/* Servers receive client messages into a MAX_PATH_LEN buffer, so clients
+   send their events in LDCS_MSG_TRACE messages of at most this many */
+#define TRACE_EVENTS_PER_MSG (MAX_PATH_LEN / sizeof(trace_event_t))
+
+typedef struct {
+   uint64_t time_us;
+   int32_t pid;
+   uint16_t phase;
+   uint16_t kind;
+} trace_event_t;
+
+typedef struct {
+   int32_t md_rank;
+   uint32_t num_events;
+   uint32_t num_dropped;
+   char hostname[64];
+} trace_block_t;
+
+/* Per-file distribution statistics (OPT_FILESTATS).  At exit each server
+   merges its own counters with those its children sent, by path, and sends
+   the result to its parent in one LDCS_MSG_FILESTATS.  That holds a
+   filestats_record_t per file, each followed by its path, NUL-terminated
+   and padded out to path_len bytes. */
+typedef struct {
+   uint64_t bytes;              /* Read off disk or received, over all nodes */
+   double client_wait;          /* Seconds clients spent waiting for the file */
+   double max_latency;          /* Longest any node took from first request to delivery */
+   uint32_t requests;           /* Client requests the servers answered */
+   uint32_t cache_hits;         /* Requests for a file that was already on the node */
+   uint32_t nodes_requested;    /* Nodes where a client asked for it */
+   uint32_t nodes_disk;         /* Nodes that read it off disk */
+   uint32_t nodes_tree;         /* Nodes that asked their parent for it */
+   uint32_t nodes_pushed;       /* Nodes it was sent to without asking, by preload or broadcast */
+   uint32_t path_len;
+   uint32_t pad;
+} filestats_record_t;
+
 #define MAX_PATH_LEN 4096
 #define MAX_NAME_LEN 255
 #endif
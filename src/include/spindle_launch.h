@@ -59,6 +59,11 @@ extern "C" {
 #define OPT_STOPRELOC  (1 << 28)            /* Stops spindle from relocating file contents, but still allow it to intercept file-not-found attempts */
 #define OPT_NUMA       (1 << 29)            /* Enables file replication across NUMA domains */
 #define OPT_OFF        (1 << 30)            /* Turns spindle off, disabling everything */
+#define OPT_PACKPY     ((opt_t) 1 << 31)    /* Distribute the python prefixes as a packed image at startup */
+#define OPT_FDPASS     ((opt_t) 1 << 32)    /* Server passes clients open file descriptors for relocated files */
+#define OPT_RELOCCACHE ((opt_t) 1 << 33)    /* Share resolved PLT bindings between processes on a node */
+#define OPT_TRACE      ((opt_t) 1 << 34)    /* Record a trace of launch events across the FE, servers and clients */
+#define OPT_FILESTATS  ((opt_t) 1 << 35)    /* Count per-file requests, bytes and delays and report them at exit */
    
 #define OPT_SET_SEC(OPT, X) OPT |= (X << 19)
 #define OPT_GET_SEC(OPT) ((OPT >> 19) & 7)
@@ -143,6 +148,27 @@ typedef struct {
 
    /* Path to rsh command, used if OPT_RSHLAUNCH */
    char *rsh_command;
+
+   /* Number of children each daemon launches in the rsh tree, or 0 for a binomial tree.
+      FE only; daemons get it from cobo as they join the tree. */
+   unsigned int rsh_fanout;
+
+   /* Max number of concurrent rsh processes each daemon runs while launching its children.
+      FE only; daemons get it on their command line. */
+   unsigned int rsh_max_procs;
+
+   /* Max number of passed file descriptors each client may hold open, used if OPT_FDPASS */
+   unsigned int fdpass_limit;
+
+   /* Seconds spindleWaitForCloseFE waits after the first servers' clients exit for the
+      rest to exit, or 0 to wait forever */
+   unsigned int exit_drain_timeout;
+
+   /* File the FE writes the launch trace to, used if OPT_TRACE */
+   char *trace_file;
+
+   /* File the FE writes the per-file statistics report to, used if OPT_FILESTATS */
+   char *filestats_file;
 } spindle_args_t;
 
 /* Functions used to startup Spindle on the front-end. Init returns after finishing start-up,
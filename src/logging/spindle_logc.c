@@ -33,6 +33,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include <errno.h>
 #include <execinfo.h>
 #include <stdarg.h>
+#include <time.h>
 
 #if !defined(LIBEXEC)
 #error Expected to have LIBEXEC defined
@@ -49,6 +50,17 @@ static char *tempdir;
 static char *debug_location;
 static char *test_location;
 
+/* Binary log ring shared with the daemon, see spindle_logring.h */
+static logring_t *log_ring;
+static int log_ring_fd = -1;
+static int log_ring_conn = -1;
+static int log_ring_stalled;
+static unsigned int log_ring_gen;
+static int log_ring_pid;
+static unsigned int log_next_site;
+static char *log_ring_name;
+static unsigned int log_ring_name_gen;
+
 FILE *spindle_test_output_f;
 FILE *spindle_debug_output_f;
 char *spindle_debug_name = "UNKNOWN";
@@ -59,6 +71,10 @@ int run_tests;
 #define SPAWN_TIMEOUT 300
 #define CONNECT_TIMEOUT 100
 
+//Milliseconds to wait on spindle_logd for ring space or a flush
+#define RING_FULL_TIMEOUT 100
+#define RING_FLUSH_TIMEOUT 1000
+
 extern int spindle_mkdir(char *orig_path);
 
 int fileExists(char *name) 
@@ -266,6 +282,209 @@ static int setup_connection(char *connection_name)
    return fd;
 }
 
+/**
+ * Wake spindle_logd so it drains our ring now rather than at its next
+ * poll.  The daemon strips NUL bytes from the text stream.
+ **/
+static void nudge_log_daemon()
+{
+   char nul = '\0';
+   (void)! send(debug_fd, &nul, 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+/**
+ * Create a log ring and hand it to the daemon over the debug connection.
+ * A process forked while sharing its parent's connection keeps appending
+ * to the parent's ring, its records are told apart by pid.  If anything
+ * fails we keep logging as text.
+ **/
+static void setup_log_ring()
+{
+   struct msghdr msg;
+   struct iovec iov;
+   struct cmsghdr *cmsg;
+   char cmsg_buf[CMSG_SPACE(sizeof(int))];
+   char nul = '\0';
+   int fd, result;
+   logring_t *ring;
+
+   if (debug_fd == -1 || (log_ring && log_ring_conn == debug_fd))
+      return;
+   if (log_ring) {
+      logring_unmap(log_ring);
+      close(log_ring_fd);
+      log_ring = NULL;
+      log_ring_fd = -1;
+   }
+
+   ring = logring_create(&fd);
+   if (!ring)
+      return;
+
+   memset(&msg, 0, sizeof(msg));
+   memset(cmsg_buf, 0, sizeof(cmsg_buf));
+   iov.iov_base = &nul;
+   iov.iov_len = 1;
+   msg.msg_iov = &iov;
+   msg.msg_iovlen = 1;
+   msg.msg_control = cmsg_buf;
+   msg.msg_controllen = sizeof(cmsg_buf);
+   cmsg = CMSG_FIRSTHDR(&msg);
+   cmsg->cmsg_level = SOL_SOCKET;
+   cmsg->cmsg_type = SCM_RIGHTS;
+   cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+   memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+   do {
+      result = sendmsg(debug_fd, &msg, MSG_NOSIGNAL);
+   } while (result == -1 && errno == EINTR);
+   if (result != 1) {
+      logring_unmap(ring);
+      close(fd);
+      return;
+   }
+
+   log_ring_fd = fd;
+   log_ring_conn = debug_fd;
+   log_ring_stalled = 0;
+   log_ring_gen++;
+   log_ring = ring;
+}
+
+static int append_record(logrec_type_t type, uint32_t site, const void *payload, uint32_t payload_len)
+{
+   int i;
+   uint64_t pending;
+
+   for (i = 0; ; i++) {
+      if (logring_append(log_ring, type, site, (uint32_t) log_ring_pid, payload, payload_len) == 0)
+         break;
+      if (log_ring_stalled || i == RING_FULL_TIMEOUT) {
+         /* The daemon isn't keeping up (or is gone).  Drop rather than hang the process. */
+         __atomic_add_fetch(&log_ring->dropped, 1, __ATOMIC_RELAXED);
+         log_ring_stalled = 1;
+         return -1;
+      }
+      nudge_log_daemon();
+      usleep(1000);
+   }
+   log_ring_stalled = 0;
+
+   pending = logring_pending(log_ring);
+   if (pending > LOGRING_SIZE/2 && pending - payload_len - sizeof(logrec_hdr_t) <= LOGRING_SIZE/2)
+      nudge_log_daemon();
+   return 0;
+}
+
+static void append_string(char *buf, uint32_t bufsize, uint32_t *pos, const char *str)
+{
+   uint32_t len = strlen(str) + 1;
+   if (*pos >= bufsize)
+      return;
+   if (*pos + len > bufsize)
+      len = bufsize - *pos;
+   memcpy(buf + *pos, str, len);
+   *pos += len;
+   buf[*pos - 1] = '\0';
+}
+
+/**
+ * Refresh per-process state after a fork or a new ring, so that the
+ * daemon has our name and site definitions before it sees our messages.
+ **/
+static void check_ring_process()
+{
+   int pid = getpid();
+   char *name = spindle_debug_name;
+
+   if (pid != log_ring_pid) {
+      log_ring_pid = pid;
+      log_ring_gen++;
+   }
+   if (log_ring_name != name || log_ring_name_gen != log_ring_gen) {
+      append_record(LOGREC_NAME, 0, name, strlen(name) + 1);
+      log_ring_name = name;
+      log_ring_name_gen = log_ring_gen;
+   }
+}
+
+void spindle_log_record(spindle_log_site_t *site, int style, const char *file, unsigned int line,
+                        const char *func, const char *format, ...)
+{
+   char buffer[LOGREC_MAX];
+   uint32_t pos, id, gen;
+   va_list ap;
+
+   if (!log_ring) {
+      const char *last_slash = strrchr(file, '/');
+      if (last_slash)
+         file = last_slash+1;
+      if (style == LOGSTYLE_DEBUG)
+         fprintf(spindle_debug_output_f, "[%s.%d@%s:%u] %s - ", spindle_debug_name, getpid(), file, line, func);
+      else if (style == LOGSTYLE_ERROR)
+         fprintf(spindle_debug_output_f, "[%s.%d@%s:%u] - ERROR: ", spindle_debug_name, getpid(), file, line);
+      va_start(ap, format);
+      vfprintf(spindle_debug_output_f, format, ap);
+      va_end(ap);
+      if (style != LOGSTYLE_ERROR)
+         fflush(spindle_debug_output_f);
+      return;
+   }
+
+   check_ring_process();
+
+   gen = __atomic_load_n(&site->gen, __ATOMIC_ACQUIRE);
+   if (gen == log_ring_gen) {
+      id = site->id;
+   }
+   else {
+      id = __atomic_add_fetch(&log_next_site, 1, __ATOMIC_RELAXED);
+      pos = 0;
+      memcpy(buffer + pos, &style, sizeof(uint32_t));
+      pos += sizeof(uint32_t);
+      memcpy(buffer + pos, &line, sizeof(uint32_t));
+      pos += sizeof(uint32_t);
+      append_string(buffer, sizeof(buffer), &pos, file);
+      append_string(buffer, sizeof(buffer), &pos, func);
+      append_string(buffer, sizeof(buffer), &pos, format);
+      if (append_record(LOGREC_SITE, id, buffer, pos) == -1)
+         return;
+      site->id = id;
+      __atomic_store_n(&site->gen, log_ring_gen, __ATOMIC_RELEASE);
+   }
+
+   va_start(ap, format);
+   pos = logring_encode_args(buffer, sizeof(buffer), format, ap);
+   va_end(ap);
+   append_record(LOGREC_MSG, id, buffer, pos);
+}
+
+static void log_text(const char *text, uint32_t len)
+{
+   check_ring_process();
+   append_record(LOGREC_TEXT, 0, text, len);
+}
+
+/**
+ * Wait for the daemon to drain everything logged so far, so that messages
+ * preceding an error survive the process dying right after.
+ **/
+static void flush_log_ring()
+{
+   uint64_t target;
+   int i;
+
+   target = __atomic_load_n(&log_ring->reserved, __ATOMIC_ACQUIRE);
+   if ((int64_t) (target - __atomic_load_n(&log_ring->consumed, __ATOMIC_ACQUIRE)) <= 0)
+      return;
+   nudge_log_daemon();
+   for (i = 0; i < RING_FLUSH_TIMEOUT * 10; i++) {
+      if ((int64_t) (target - __atomic_load_n(&log_ring->consumed, __ATOMIC_ACQUIRE)) <= 0)
+         return;
+      usleep(100);
+   }
+}
+
 void reset_spindle_debugging()
 {
    spindle_debug_prints = 0;
@@ -324,6 +543,8 @@ void init_spindle_debugging(char *name, int survive_exec)
       spindle_debug_output_f = fdopen(debug_fd, "w");
    if (test_fd != -1)
       spindle_test_output_f = fdopen(test_fd, "w");      
+
+   setup_log_ring();
 }
 
 void spindle_dump_on_error()
@@ -332,26 +553,41 @@ void spindle_dump_on_error()
    char **syms;
    int size, i;
 
-   if (strstr(spindle_debug_name, "Client")) {
-      return;
-   }
+   if (strstr(spindle_debug_name, "Client"))
+      goto flush;
 
    size = backtrace(stacktrace, 256);
    if (size <= 0)
-      return;
+      goto flush;
    syms = backtrace_symbols(stacktrace, size);
    
    for (i = 0; i<size; i++) {
-      fprintf(spindle_debug_output_f, "%p - %s\n", stacktrace[i], syms && syms[i] ? syms[i] : "<NO NAME>");
+      if (log_ring) {
+         char line[1024];
+         int len = snprintf(line, sizeof(line), "%p - %s\n", stacktrace[i], syms && syms[i] ? syms[i] : "<NO NAME>");
+         if (len >= (int) sizeof(line))
+            len = sizeof(line) - 1;
+         log_text(line, len);
+      }
+      else
+         fprintf(spindle_debug_output_f, "%p - %s\n", stacktrace[i], syms && syms[i] ? syms[i] : "<NO NAME>");
    }
    
    if (syms)
       free(syms);
+
+  flush:
+   if (log_ring)
+      flush_log_ring();
+   else
+      fflush(spindle_debug_output_f);
 }
 
 void fini_spindle_debugging()
 {
    static unsigned char exitcode[8] = { 0x01, 0xff, 0x03, 0xdf, 0x05, 0xbf, 0x07, '\n' };
+   if (log_ring)
+      flush_log_ring();
    if (debug_fd != -1)
       (void)! write(debug_fd, &exitcode, sizeof(exitcode));
    if (test_fd != -1)
@@ -398,6 +634,13 @@ int spindle_debug_printf_impl(int priority, const char *file, unsigned int line,
    if (result < 0)
       return -1;
    pos += result;
+   if (pos >= (int) sizeof(buffer))
+      pos = sizeof(buffer) - 1;
+
+   if (log_ring) {
+      log_text(buffer, pos);
+      return pos;
+   }
 
    result = fwrite(buffer, 1, pos, spindle_debug_output_f);
    fflush(spindle_debug_output_f);
@@ -29,70 +29,67 @@ extern int run_tests;
 
 extern void spindle_dump_on_error();
 
+#include "spindle_logring.h"
+
 #define BASE_FILE (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/')+1 : __FILE__)
 
+/* Each call site keeps an id that spindle_logd uses to find its format */
+typedef struct {
+   unsigned int id;
+   unsigned int gen;
+} spindle_log_site_t;
+
+extern void spindle_log_record(spindle_log_site_t *site, int style, const char *file, unsigned int line,
+                               const char *func, const char *format, ...) __attribute__((format(printf, 6, 7)));
+
+#define spindle_log_at_site(style, format, ...)                         \
+   do {                                                                 \
+      static spindle_log_site_t spindle_log_site_;                      \
+      spindle_log_record(&spindle_log_site_, style, __FILE__, __LINE__, \
+                         __func__, format, ## __VA_ARGS__);             \
+   } while (0)
+
 #define debug_printf(format, ...)                                       \
    do {                                                                 \
-      if (spindle_debug_prints && spindle_debug_output_f) {             \
-         fprintf(spindle_debug_output_f, "[%s.%d@%s:%u] %s - " format,  \
-                 spindle_debug_name, getpid(),                          \
-                 BASE_FILE, __LINE__, __func__, ## __VA_ARGS__);        \
-         fflush(spindle_debug_output_f);                                \
-      }                                                                 \
+      if (spindle_debug_prints && spindle_debug_output_f)               \
+         spindle_log_at_site(LOGSTYLE_DEBUG, format, ## __VA_ARGS__);  \
    } while (0)
 
 #define debug_printf2(format, ...)                                      \
    do {                                                                 \
-      if (spindle_debug_prints > 1 && spindle_debug_output_f) {         \
-         fprintf(spindle_debug_output_f, "[%s.%d@%s:%u] %s - " format,  \
-                 spindle_debug_name, getpid(),                          \
-                 BASE_FILE, __LINE__, __func__, ## __VA_ARGS__);        \
-         fflush(spindle_debug_output_f);                                \
-      }                                                                 \
+      if (spindle_debug_prints > 1 && spindle_debug_output_f)           \
+         spindle_log_at_site(LOGSTYLE_DEBUG, format, ## __VA_ARGS__);  \
    } while (0)
 
 #define debug_printf3(format, ...)                                      \
    do {                                                                 \
-      if (spindle_debug_prints > 2 && spindle_debug_output_f) {         \
-         fprintf(spindle_debug_output_f, "[%s.%d@%s:%u] %s - " format,  \
-                 spindle_debug_name, getpid(),                          \
-                 BASE_FILE, __LINE__, __func__, ## __VA_ARGS__);        \
-         fflush(spindle_debug_output_f);                                \
-      }                                                                 \
+      if (spindle_debug_prints > 2 && spindle_debug_output_f)           \
+         spindle_log_at_site(LOGSTYLE_DEBUG, format, ## __VA_ARGS__);  \
    } while (0)
 
 #define bare_printf(format, ...)                                        \
    do {                                                                 \
-      if (spindle_debug_prints && spindle_debug_output_f) {             \
-         fprintf(spindle_debug_output_f, format, ## __VA_ARGS__);       \
-         fflush(spindle_debug_output_f);                                \
-      }                                                                 \
+      if (spindle_debug_prints && spindle_debug_output_f)               \
+         spindle_log_at_site(LOGSTYLE_BARE, format, ## __VA_ARGS__);   \
    } while (0)
 
 #define bare_printf2(format, ...)                                       \
    do {                                                                 \
-      if (spindle_debug_prints > 1 && spindle_debug_output_f) {         \
-         fprintf(spindle_debug_output_f, format, ## __VA_ARGS__);       \
-         fflush(spindle_debug_output_f);                                \
-      }                                                                 \
+      if (spindle_debug_prints > 1 && spindle_debug_output_f)           \
+         spindle_log_at_site(LOGSTYLE_BARE, format, ## __VA_ARGS__);   \
    } while (0)
 
 #define bare_printf3(format, ...)                                       \
    do {                                                                 \
-      if (spindle_debug_prints > 2 && spindle_debug_output_f) {         \
-         fprintf(spindle_debug_output_f, format, ## __VA_ARGS__);       \
-         fflush(spindle_debug_output_f);                                \
-      }                                                                 \
+      if (spindle_debug_prints > 2 && spindle_debug_output_f)           \
+         spindle_log_at_site(LOGSTYLE_BARE, format, ## __VA_ARGS__);   \
    } while (0)
 
 #define err_printf(format, ...)                                         \
    do {                                                                 \
       if (spindle_debug_prints && spindle_debug_output_f) {             \
-         fprintf(spindle_debug_output_f, "[%s.%d@%s:%u] - ERROR: "      \
-                 format, spindle_debug_name, getpid(),                  \
-                 BASE_FILE, __LINE__, ## __VA_ARGS__);                  \
+         spindle_log_at_site(LOGSTYLE_ERROR, format, ## __VA_ARGS__);  \
          spindle_dump_on_error();                                       \
-         fflush(spindle_debug_output_f);                                \
       }                                                                 \
    } while (0)
 
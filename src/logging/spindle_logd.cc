@@ -21,6 +21,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include <cstring>
 #include <cassert>
 #include <utility>
+#include <algorithm>
 
 #include <strings.h>
 #include <unistd.h>
@@ -36,9 +37,14 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include <signal.h>
 #include <pthread.h>
 
+#include "spindle_logring.h"
+
 //Seconds to live without a child
 #define TIMEOUT 10
 
+//Microseconds between drains of the log rings
+#define RING_POLL 10000
+
 std::string tmpdir;
 std::string debug_fname;
 std::string test_fname;
@@ -373,6 +379,146 @@ public:
    }
 };
 
+class RingReader
+{
+public:
+   struct Line {
+      uint64_t timestamp;
+      unsigned int seq;
+      std::string text;
+      bool operator<(const Line &other) const {
+         return timestamp != other.timestamp ? timestamp < other.timestamp : seq < other.seq;
+      }
+   };
+
+private:
+   struct Site {
+      uint32_t style;
+      uint32_t line;
+      std::string file;
+      std::string func;
+      std::string format;
+   };
+
+   logring_t *ring;
+   std::map<std::pair<uint32_t, uint32_t>, Site> sites;
+   std::map<uint32_t, std::string> names;
+   uint32_t reported_drops;
+
+   static const char *payloadString(const char *&cur, const char *end)
+   {
+      const char *str = cur;
+      while (cur < end && *cur)
+         cur++;
+      if (cur == end)
+         return "";
+      cur++;
+      return str;
+   }
+
+   void addSite(uint32_t pid, uint32_t id, const char *payload, uint32_t len)
+   {
+      Site site;
+      const char *cur = payload + 2*sizeof(uint32_t), *end = payload + len;
+      if (len < 2*sizeof(uint32_t))
+         return;
+      memcpy(&site.style, payload, sizeof(uint32_t));
+      memcpy(&site.line, payload + sizeof(uint32_t), sizeof(uint32_t));
+      site.file = payloadString(cur, end);
+      site.func = payloadString(cur, end);
+      site.format = payloadString(cur, end);
+      std::string::size_type last_slash = site.file.rfind('/');
+      if (last_slash != std::string::npos)
+         site.file = site.file.substr(last_slash+1);
+      sites[std::make_pair(pid, id)] = site;
+   }
+
+   void formatMessage(logrec_hdr_t *hdr, const char *payload, uint32_t len, std::string &out)
+   {
+      char buffer[LOGREC_MAX*2];
+      std::map<std::pair<uint32_t, uint32_t>, Site>::iterator i = sites.find(std::make_pair(hdr->pid, hdr->site));
+      if (i == sites.end()) {
+         snprintf(buffer, sizeof(buffer), "[spindle_logd] - Message from unknown site %u in process %u\n",
+                  hdr->site, hdr->pid);
+         out = buffer;
+         return;
+      }
+      Site &site = i->second;
+
+      std::map<uint32_t, std::string>::iterator n = names.find(hdr->pid);
+      const char *name = (n != names.end()) ? n->second.c_str() : "UNKNOWN";
+
+      int prefix = 0;
+      if (site.style == LOGSTYLE_DEBUG)
+         prefix = snprintf(buffer, sizeof(buffer), "[%s.%u@%s:%u] %s - ", name, hdr->pid,
+                           site.file.c_str(), site.line, site.func.c_str());
+      else if (site.style == LOGSTYLE_ERROR)
+         prefix = snprintf(buffer, sizeof(buffer), "[%s.%u@%s:%u] - ERROR: ", name, hdr->pid,
+                           site.file.c_str(), site.line);
+      if (prefix < 0 || prefix >= (int) sizeof(buffer))
+         prefix = 0;
+      int msg = logring_format_args(site.format.c_str(), payload, len, buffer + prefix, sizeof(buffer) - prefix);
+      out.assign(buffer, prefix + msg);
+   }
+
+public:
+   RingReader(logring_t *ring_) :
+      ring(ring_),
+      reported_drops(0)
+   {
+   }
+
+   ~RingReader()
+   {
+      logring_unmap(ring);
+   }
+
+   void drain(std::vector<Line> &lines)
+   {
+      static char buffer[sizeof(logrec_hdr_t) + LOGREC_MAX];
+      logrec_hdr_t *hdr = (logrec_hdr_t *) buffer;
+      const char *payload = buffer + sizeof(logrec_hdr_t);
+      uint32_t len;
+
+      while ((len = logring_read(ring, buffer, sizeof(buffer))) != 0) {
+         uint32_t payload_len = len - sizeof(logrec_hdr_t);
+         switch (hdr->type) {
+            case LOGREC_SITE:
+               addSite(hdr->pid, hdr->site, payload, payload_len);
+               break;
+            case LOGREC_NAME:
+               names[hdr->pid] = std::string(payload, strnlen(payload, payload_len));
+               break;
+            case LOGREC_MSG:
+            case LOGREC_TEXT: {
+               Line line;
+               line.timestamp = hdr->timestamp;
+               line.seq = lines.size();
+               if (hdr->type == LOGREC_MSG)
+                  formatMessage(hdr, payload, payload_len, line.text);
+               else
+                  line.text.assign(payload, strnlen(payload, payload_len));
+               lines.push_back(line);
+               break;
+            }
+         }
+      }
+
+      uint32_t drops = ring->dropped;
+      if (drops != reported_drops) {
+         char msg[128];
+         Line line;
+         snprintf(msg, sizeof(msg), "[spindle_logd] - Dropped %u log records while the ring was full\n",
+                  drops - reported_drops);
+         line.timestamp = lines.empty() ? 0 : lines.back().timestamp;
+         line.seq = lines.size();
+         line.text = msg;
+         lines.push_back(line);
+         reported_drops = drops;
+      }
+   }
+};
+
 class MsgReader
 {
 private:
@@ -384,6 +530,7 @@ private:
       struct sockaddr_un remote_addr;
       bool shutdown;
       char unfinished_msg[MAX_MESSAGE];
+      std::vector<RingReader *> rings;
    };
 
    int sockfd;
@@ -393,6 +540,7 @@ private:
    std::string socket_path;
    pthread_t thrd;
    OutputInterface *log;
+   unsigned int num_rings;
 
    bool addNewConnection() {
       Connection *con = new Connection();
@@ -440,10 +588,18 @@ private:
             return false;
          }
 
-         int result = select(max_fd+1, &rset, NULL, NULL, conns.empty() ? &timeout : NULL);
-         if (result == 0) {
+         struct timeval ring_poll;
+         ring_poll.tv_sec = 0;
+         ring_poll.tv_usec = RING_POLL;
+
+         int result = select(max_fd+1, &rset, NULL, NULL, conns.empty() ? &timeout : (num_rings ? &ring_poll : NULL));
+         if (result == 0 && conns.empty()) {
             return false;
          }
+         if (result == 0) {
+            drainRings();
+            continue;
+         }
          if (result == -1) {
             fprintf(stderr, "[%s:%u] - Error calling select: %s\n", __FILE__, __LINE__, strerror(errno));
             return false;
@@ -459,6 +615,7 @@ private:
                readMessage(i->second);
             }
          }
+         drainRings();
          
          bool foundShutdownProc;
          do {
@@ -478,27 +635,109 @@ private:
       }
    }
 
+   /**
+    * Drain every ring and write their records as one batch, in timestamp
+    * order across processes.
+    **/
+   void drainRings(Connection *only = NULL)
+   {
+      std::vector<RingReader::Line> lines;
+      if (!num_rings)
+         return;
+
+      for (std::map<int, Connection *>::iterator i = conns.begin(); i != conns.end(); i++) {
+         if (only && i->second != only)
+            continue;
+         std::vector<RingReader *> &rings = i->second->rings;
+         for (std::vector<RingReader *>::iterator j = rings.begin(); j != rings.end(); j++)
+            (*j)->drain(lines);
+      }
+      if (lines.empty())
+         return;
+
+      std::stable_sort(lines.begin(), lines.end());
+      std::string batch;
+      for (std::vector<RingReader::Line>::iterator i = lines.begin(); i != lines.end(); i++)
+         batch += i->text;
+      log->writeMessage(0, batch.c_str(), batch.size(), NULL, 0);
+   }
+
+   void addRings(Connection *con, struct msghdr *msg)
+   {
+      for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+         if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+         int num_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+         for (int i = 0; i < num_fds; i++) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(cmsg) + i*sizeof(int), sizeof(int));
+            logring_t *ring = logring_map(fd);
+            close(fd);
+            if (!ring) {
+               fprintf(stderr, "[%s:%u] - Received an invalid log ring\n", __FILE__, __LINE__);
+               continue;
+            }
+            con->rings.push_back(new RingReader(ring));
+            num_rings++;
+         }
+      }
+   }
+
+   void closeRings(Connection *con)
+   {
+      drainRings(con);
+      for (std::vector<RingReader *>::iterator i = con->rings.begin(); i != con->rings.end(); i++)
+         delete *i;
+      num_rings -= con->rings.size();
+      con->rings.clear();
+   }
+
    bool readMessage(Connection *con)
    {
-      int result = recv(con->fd, recv_buffer, MAX_MESSAGE, 0);
+      struct msghdr msg;
+      struct iovec iov;
+      char cmsg_buf[CMSG_SPACE(4*sizeof(int))];
+
+      memset(&msg, 0, sizeof(msg));
+      iov.iov_base = recv_buffer;
+      iov.iov_len = MAX_MESSAGE;
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = cmsg_buf;
+      msg.msg_controllen = sizeof(cmsg_buf);
+
+      int result = recvmsg(con->fd, &msg, MSG_CMSG_CLOEXEC);
       if (result == -1) {
          fprintf(stderr, "[%s:%u] - Error calling recv: %s\n", __FILE__, __LINE__, strerror(errno));
+         closeRings(con);
          close(con->fd);
          return false;
       }
+      if (msg.msg_controllen)
+         addRings(con, &msg);
 
       if (result == 0) {
          //A client shutdown
          std::map<int, Connection *>::iterator i = conns.find(con->fd);
          assert(i != conns.end());
          i->second->shutdown = true;
+         closeRings(con);
          if (con->unfinished_msg[0] != '\0')
             processMessage(con, "\n", 1);
          close(con->fd);
          return true;
       }
 
-      return processMessage(con, recv_buffer, result);
+      //NUL bytes carry ring fds or ask for an early drain, they aren't text
+      int len = 0;
+      for (int i = 0; i < result; i++) {
+         if (recv_buffer[i] != '\0')
+            recv_buffer[len++] = recv_buffer[i];
+      }
+      if (!len)
+         return true;
+
+      return processMessage(con, recv_buffer, len);
    }
 
    bool processMessage(Connection *con, const char *msg, int msg_size) {
@@ -542,7 +781,8 @@ private:
 public:
    
    MsgReader(std::string socket_suffix, OutputInterface *log_) :
-      log(log_)
+      log(log_),
+      num_rings(0)
    {
       error = true;
 
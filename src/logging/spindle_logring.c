@@ -0,0 +1,582 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT
+file in the top level directory, or at
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms
+and conditions of the GNU Lesser General Public License for more details.  You should
+have received a copy of the GNU Lesser General Public License along with this
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "spindle_logring.h"
+
+#define RING_MASK (LOGRING_SIZE - 1)
+#define REC_ALIGN(x) (((x) + 7) & ~((uint32_t) 7))
+
+/* Argument classes, as stored in a LOGREC_MSG payload */
+typedef enum {
+   ARG_NONE,
+   ARG_INT,
+   ARG_UINT,
+   ARG_DOUBLE,
+   ARG_STR,
+   ARG_PTR,
+   ARG_ERRNO
+} arg_class_t;
+
+typedef enum {
+   LEN_NONE,
+   LEN_HH,
+   LEN_H,
+   LEN_L,
+   LEN_LL,
+   LEN_LD,
+   LEN_Z,
+   LEN_T,
+   LEN_J
+} arg_len_t;
+
+typedef struct {
+   unsigned int spec_len;  /* characters from the '%' through the conversion */
+   unsigned int stars;     /* '*' widths/precisions, each an int argument */
+   arg_len_t length;
+   arg_class_t cls;
+   char conv;
+} conv_spec_t;
+
+/**
+ * Parse the conversion that starts at the '%' in format.  The writer and
+ * spindle_logd both walk formats with this, so they agree on how each
+ * argument was encoded.
+ **/
+static void parse_spec(const char *format, conv_spec_t *spec)
+{
+   const char *c = format + 1;
+
+   spec->stars = 0;
+   spec->length = LEN_NONE;
+
+   while (*c && strchr("-+ #0'I", *c))
+      c++;
+   if (*c == '*') {
+      spec->stars++;
+      c++;
+   }
+   while (*c >= '0' && *c <= '9')
+      c++;
+   if (*c == '.') {
+      c++;
+      if (*c == '*') {
+         spec->stars++;
+         c++;
+      }
+      while (*c >= '0' && *c <= '9')
+         c++;
+   }
+
+   switch (*c) {
+      case 'h':
+         c++;
+         spec->length = LEN_H;
+         if (*c == 'h') {
+            c++;
+            spec->length = LEN_HH;
+         }
+         break;
+      case 'l':
+         c++;
+         spec->length = LEN_L;
+         if (*c == 'l') {
+            c++;
+            spec->length = LEN_LL;
+         }
+         break;
+      case 'q':
+         c++;
+         spec->length = LEN_LL;
+         break;
+      case 'L':
+         c++;
+         spec->length = LEN_LD;
+         break;
+      case 'z':
+      case 'Z':
+         c++;
+         spec->length = LEN_Z;
+         break;
+      case 't':
+         c++;
+         spec->length = LEN_T;
+         break;
+      case 'j':
+         c++;
+         spec->length = LEN_J;
+         break;
+   }
+
+   spec->conv = *c;
+   switch (*c) {
+      case 'd': case 'i': case 'c':
+         spec->cls = ARG_INT;
+         break;
+      case 'u': case 'o': case 'x': case 'X':
+         spec->cls = ARG_UINT;
+         break;
+      case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+         spec->cls = ARG_DOUBLE;
+         break;
+      case 's':
+         spec->cls = ARG_STR;
+         break;
+      case 'p':
+         spec->cls = ARG_PTR;
+         break;
+      case 'm':
+         spec->cls = ARG_ERRNO;
+         break;
+      default:
+         spec->cls = ARG_NONE;
+         break;
+   }
+   if (*c)
+      c++;
+   spec->spec_len = (unsigned int) (c - format);
+}
+
+static int put_bytes(char *buf, uint32_t bufsize, uint32_t *pos, const void *src, uint32_t len)
+{
+   if (*pos + len > bufsize)
+      return -1;
+   memcpy(buf + *pos, src, len);
+   *pos += len;
+   return 0;
+}
+
+static int put_string(char *buf, uint32_t bufsize, uint32_t *pos, const char *str)
+{
+   uint32_t len;
+   if (!str)
+      str = "(null)";
+   len = strlen(str);
+   if (*pos + sizeof(len) > bufsize)
+      return -1;
+   if (*pos + sizeof(len) + len > bufsize)
+      len = bufsize - *pos - sizeof(len);
+   put_bytes(buf, bufsize, pos, &len, sizeof(len));
+   return put_bytes(buf, bufsize, pos, str, len);
+}
+
+/**
+ * Encode the arguments in ap as described by format.  Integers are widened
+ * to 64 bits with their C type's sign and width applied, floating point
+ * values become doubles and strings are copied, truncated if the record
+ * fills up.  Returns the number of bytes used.
+ **/
+uint32_t logring_encode_args(char *buf, uint32_t bufsize, const char *format, va_list ap)
+{
+   const char *c;
+   conv_spec_t spec;
+   uint32_t pos = 0;
+   unsigned int i;
+   int64_t ival;
+   uint64_t uval;
+   double dval;
+   int saved_errno = errno;
+
+   for (c = strchr(format, '%'); c; c = strchr(c, '%')) {
+      parse_spec(c, &spec);
+      c += spec.spec_len;
+      if (spec.conv == '%' || spec.conv == '\0')
+         continue;
+
+      for (i = 0; i < spec.stars; i++) {
+         ival = va_arg(ap, int);
+         if (put_bytes(buf, bufsize, &pos, &ival, sizeof(ival)) == -1)
+            return pos;
+      }
+
+      switch (spec.cls) {
+         case ARG_INT:
+            switch (spec.length) {
+               case LEN_HH: ival = (signed char) va_arg(ap, int); break;
+               case LEN_H: ival = (short) va_arg(ap, int); break;
+               case LEN_L: ival = va_arg(ap, long); break;
+               case LEN_LL: ival = va_arg(ap, long long); break;
+               case LEN_Z: ival = va_arg(ap, ssize_t); break;
+               case LEN_T: ival = va_arg(ap, ptrdiff_t); break;
+               case LEN_J: ival = va_arg(ap, intmax_t); break;
+               default: ival = va_arg(ap, int); break;
+            }
+            if (put_bytes(buf, bufsize, &pos, &ival, sizeof(ival)) == -1)
+               return pos;
+            break;
+         case ARG_UINT:
+            switch (spec.length) {
+               case LEN_HH: uval = (unsigned char) va_arg(ap, unsigned int); break;
+               case LEN_H: uval = (unsigned short) va_arg(ap, unsigned int); break;
+               case LEN_L: uval = va_arg(ap, unsigned long); break;
+               case LEN_LL: uval = va_arg(ap, unsigned long long); break;
+               case LEN_Z: uval = va_arg(ap, size_t); break;
+               case LEN_T: uval = (uint64_t) va_arg(ap, ptrdiff_t); break;
+               case LEN_J: uval = va_arg(ap, uintmax_t); break;
+               default: uval = va_arg(ap, unsigned int); break;
+            }
+            if (put_bytes(buf, bufsize, &pos, &uval, sizeof(uval)) == -1)
+               return pos;
+            break;
+         case ARG_DOUBLE:
+            if (spec.length == LEN_LD)
+               dval = (double) va_arg(ap, long double);
+            else
+               dval = va_arg(ap, double);
+            if (put_bytes(buf, bufsize, &pos, &dval, sizeof(dval)) == -1)
+               return pos;
+            break;
+         case ARG_PTR:
+            uval = (uint64_t) (uintptr_t) va_arg(ap, void *);
+            if (put_bytes(buf, bufsize, &pos, &uval, sizeof(uval)) == -1)
+               return pos;
+            break;
+         case ARG_STR:
+            if (put_string(buf, bufsize, &pos, va_arg(ap, char *)) == -1)
+               return pos;
+            break;
+         case ARG_ERRNO:
+            if (put_string(buf, bufsize, &pos, strerror(saved_errno)) == -1)
+               return pos;
+            break;
+         case ARG_NONE:
+            /* %n and anything we don't know still consume a pointer */
+            (void) va_arg(ap, void *);
+            break;
+      }
+   }
+   return pos;
+}
+
+static int get_bytes(const char *args, uint32_t args_len, uint32_t *pos, void *dst, uint32_t len)
+{
+   if (*pos + len > args_len)
+      return -1;
+   memcpy(dst, args + *pos, len);
+   *pos += len;
+   return 0;
+}
+
+/**
+ * Rebuild the text for a LOGREC_MSG record.  Each conversion is handed to
+ * snprintf individually, with its length modifier rewritten to match how
+ * the argument was encoded.  Returns the number of characters written to
+ * out (which is always terminated).
+ **/
+int logring_format_args(const char *format, const char *args, uint32_t args_len, char *out, uint32_t outsize)
+{
+   const char *c = format, *pct;
+   char spec_str[64], *s;
+   conv_spec_t spec;
+   uint32_t pos = 0, slen, n = 0, copy, i;
+   int64_t stars[2] = { 0, 0 };
+   int64_t ival;
+   uint64_t uval;
+   double dval;
+   int result;
+
+   if (!outsize)
+      return 0;
+   out[0] = '\0';
+
+#define APPEND_RESULT                                                 \
+   do {                                                               \
+      if (result > 0)                                                 \
+         n += ((uint32_t) result < outsize - n) ? (uint32_t) result : outsize - n - 1; \
+   } while (0)
+
+   while (*c && n < outsize - 1) {
+      pct = strchr(c, '%');
+      copy = pct ? (uint32_t) (pct - c) : strlen(c);
+      if (copy > outsize - 1 - n)
+         copy = outsize - 1 - n;
+      memcpy(out + n, c, copy);
+      n += copy;
+      out[n] = '\0';
+      if (!pct)
+         break;
+      c = pct;
+
+      parse_spec(c, &spec);
+      if (spec.conv == '%' || spec.conv == '\0') {
+         if (spec.conv == '%' && n < outsize - 1) {
+            out[n++] = '%';
+            out[n] = '\0';
+         }
+         c += spec.spec_len;
+         continue;
+      }
+
+      for (i = 0; i < spec.stars; i++) {
+         if (get_bytes(args, args_len, &pos, stars + i, sizeof(int64_t)) == -1)
+            return n;
+      }
+
+      /* Copy flags, width and precision; drop the length modifier and conversion */
+      s = spec_str;
+      for (i = 0; i < spec.spec_len - 1 && s < spec_str + sizeof(spec_str) - 4; i++) {
+         if (strchr("hlqLzZtj", c[i]))
+            continue;
+         *s++ = c[i];
+      }
+      *s = '\0';
+      c += spec.spec_len;
+
+      switch (spec.cls) {
+         case ARG_INT:
+         case ARG_UINT:
+            if (spec.conv == 'c') {
+               s[0] = 'c';
+               s[1] = '\0';
+            }
+            else {
+               s[0] = 'l';
+               s[1] = 'l';
+               s[2] = spec.conv;
+               s[3] = '\0';
+            }
+            if (spec.cls == ARG_INT) {
+               if (get_bytes(args, args_len, &pos, &ival, sizeof(ival)) == -1)
+                  return n;
+               if (spec.conv == 'c') {
+                  if (spec.stars == 2)
+                     result = snprintf(out + n, outsize - n, spec_str, (int) stars[0], (int) stars[1], (int) ival);
+                  else if (spec.stars == 1)
+                     result = snprintf(out + n, outsize - n, spec_str, (int) stars[0], (int) ival);
+                  else
+                     result = snprintf(out + n, outsize - n, spec_str, (int) ival);
+               }
+               else if (spec.stars == 2)
+                  result = snprintf(out + n, outsize - n, spec_str, (int) stars[0], (int) stars[1], (long long) ival);
+               else if (spec.stars == 1)
+                  result = snprintf(out + n, outsize - n, spec_str, (int) stars[0], (long long) ival);
+               else
+                  result = snprintf(out + n, outsize - n, spec_str, (long long) ival);
+            }
+            else {
+               if (get_bytes(args, args_len, &pos, &uval, sizeof(uval)) == -1)
+                  return n;
+               if (spec.stars == 2)
+                  result = snprintf(out + n, outsize - n, spec_str, (int) stars[0], (int) stars[1], (unsigned long long) uval);
+               else if (spec.stars == 1)
+                  result = snprintf(out + n, outsize - n, spec_str, (int) stars[0], (unsigned long long) uval);
+               else
+                  result = snprintf(out + n, outsize - n, spec_str, (unsigned long long) uval);
+            }
+            APPEND_RESULT;
+            break;
+         case ARG_DOUBLE:
+            s[0] = spec.conv;
+            s[1] = '\0';
+            if (get_bytes(args, args_len, &pos, &dval, sizeof(dval)) == -1)
+               return n;
+            if (spec.stars == 2)
+               result = snprintf(out + n, outsize - n, spec_str, (int) stars[0], (int) stars[1], dval);
+            else if (spec.stars == 1)
+               result = snprintf(out + n, outsize - n, spec_str, (int) stars[0], dval);
+            else
+               result = snprintf(out + n, outsize - n, spec_str, dval);
+            APPEND_RESULT;
+            break;
+         case ARG_PTR:
+            s[0] = 'p';
+            s[1] = '\0';
+            if (get_bytes(args, args_len, &pos, &uval, sizeof(uval)) == -1)
+               return n;
+            if (spec.stars == 1)
+               result = snprintf(out + n, outsize - n, spec_str, (int) stars[0], (void *) (uintptr_t) uval);
+            else
+               result = snprintf(out + n, outsize - n, spec_str, (void *) (uintptr_t) uval);
+            APPEND_RESULT;
+            break;
+         case ARG_STR:
+         case ARG_ERRNO: {
+            char str[LOGREC_MAX];
+            if (get_bytes(args, args_len, &pos, &slen, sizeof(slen)) == -1)
+               return n;
+            if (slen >= sizeof(str) || pos + slen > args_len)
+               return n;
+            memcpy(str, args + pos, slen);
+            str[slen] = '\0';
+            pos += slen;
+            s[0] = 's';
+            s[1] = '\0';
+            if (spec.stars == 2)
+               result = snprintf(out + n, outsize - n, spec_str, (int) stars[0], (int) stars[1], str);
+            else if (spec.stars == 1)
+               result = snprintf(out + n, outsize - n, spec_str, (int) stars[0], str);
+            else
+               result = snprintf(out + n, outsize - n, spec_str, str);
+            APPEND_RESULT;
+            break;
+         }
+         case ARG_NONE:
+            break;
+      }
+   }
+#undef APPEND_RESULT
+   return n;
+}
+
+static void ring_copy_in(logring_t *ring, uint64_t pos, const void *src, uint32_t len)
+{
+   uint32_t off = (uint32_t) (pos & RING_MASK);
+   uint32_t first = len < LOGRING_SIZE - off ? len : LOGRING_SIZE - off;
+   memcpy(ring->data + off, src, first);
+   if (first < len)
+      memcpy(ring->data, ((const char *) src) + first, len - first);
+}
+
+static void ring_copy_out(logring_t *ring, uint64_t pos, void *dst, uint32_t len)
+{
+   uint32_t off = (uint32_t) (pos & RING_MASK);
+   uint32_t first = len < LOGRING_SIZE - off ? len : LOGRING_SIZE - off;
+   memcpy(dst, ring->data + off, first);
+   memset(ring->data + off, 0, first);
+   if (first < len) {
+      memcpy(((char *) dst) + first, ring->data, len - first);
+      memset(ring->data, 0, len - first);
+   }
+}
+
+logring_t *logring_create(int *fd)
+{
+   logring_t *ring;
+
+   *fd = -1;
+#if defined(SYS_memfd_create)
+   *fd = syscall(SYS_memfd_create, "spindle_log", 1 /* MFD_CLOEXEC */);
+#endif
+   if (*fd == -1)
+      return NULL;
+   if (ftruncate(*fd, sizeof(logring_t)) == -1) {
+      close(*fd);
+      *fd = -1;
+      return NULL;
+   }
+   ring = (logring_t *) mmap(NULL, sizeof(logring_t), PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+   if (ring == MAP_FAILED) {
+      close(*fd);
+      *fd = -1;
+      return NULL;
+   }
+   ring->size = LOGRING_SIZE;
+   ring->reserved = 0;
+   ring->consumed = 0;
+   ring->dropped = 0;
+   __atomic_store_n(&ring->magic, LOGRING_MAGIC, __ATOMIC_RELEASE);
+   return ring;
+}
+
+/**
+ * Append a record.  Returns 0 on success or -1 if the ring doesn't have
+ * room, in which case the caller decides whether to wait for spindle_logd.
+ **/
+int logring_append(logring_t *ring, logrec_type_t type, uint32_t site, uint32_t pid,
+                   const void *payload, uint32_t payload_len)
+{
+   logrec_hdr_t hdr;
+   struct timespec ts;
+   uint32_t len = REC_ALIGN(sizeof(hdr) + payload_len);
+   uint64_t pos;
+
+   pos = __atomic_load_n(&ring->reserved, __ATOMIC_RELAXED);
+   do {
+      if (pos + len - __atomic_load_n(&ring->consumed, __ATOMIC_ACQUIRE) > LOGRING_SIZE)
+         return -1;
+   } while (!__atomic_compare_exchange_n(&ring->reserved, &pos, pos + len, 1,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   hdr.len = 0;
+   hdr.type = type;
+   hdr.pid = pid;
+   hdr.site = site;
+   hdr.timestamp = ((uint64_t) ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+   ring_copy_in(ring, pos + sizeof(hdr.len), ((char *) &hdr) + sizeof(hdr.len), sizeof(hdr) - sizeof(hdr.len));
+   if (payload_len)
+      ring_copy_in(ring, pos + sizeof(hdr), payload, payload_len);
+
+   /* Records are 8-byte aligned, so the length word never wraps */
+   __atomic_store_n((uint32_t *) (ring->data + (pos & RING_MASK)), len | LOGRING_COMMITTED, __ATOMIC_RELEASE);
+   return 0;
+}
+
+uint64_t logring_pending(logring_t *ring)
+{
+   return __atomic_load_n(&ring->reserved, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->consumed, __ATOMIC_ACQUIRE);
+}
+
+logring_t *logring_map(int fd)
+{
+   logring_t *ring;
+
+   ring = (logring_t *) mmap(NULL, sizeof(logring_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   if (ring == MAP_FAILED)
+      return NULL;
+   if (__atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != LOGRING_MAGIC || ring->size != LOGRING_SIZE) {
+      munmap(ring, sizeof(logring_t));
+      return NULL;
+   }
+   return ring;
+}
+
+void logring_unmap(logring_t *ring)
+{
+   munmap(ring, sizeof(logring_t));
+}
+
+/**
+ * Copy the next committed record (header included) into buf and release its
+ * space.  Returns the record's length, or 0 if the next record hasn't been
+ * committed yet.
+ **/
+uint32_t logring_read(logring_t *ring, void *buf, uint32_t bufsize)
+{
+   uint64_t pos = ring->consumed;
+   uint32_t len, copy;
+   char discard[256];
+
+   if (pos == __atomic_load_n(&ring->reserved, __ATOMIC_ACQUIRE))
+      return 0;
+   len = __atomic_load_n((uint32_t *) (ring->data + (pos & RING_MASK)), __ATOMIC_ACQUIRE);
+   if (!(len & LOGRING_COMMITTED))
+      return 0;
+   len &= ~LOGRING_COMMITTED;
+   if (len < sizeof(logrec_hdr_t) || len > LOGRING_SIZE)
+      return 0;
+
+   copy = len < bufsize ? len : bufsize;
+   ring_copy_out(ring, pos, buf, copy);
+   for (; copy < len; copy += sizeof(discard))
+      ring_copy_out(ring, pos + copy, discard, len - copy < sizeof(discard) ? len - copy : sizeof(discard));
+   ((logrec_hdr_t *) buf)->len = len;
+
+   __atomic_store_n(&ring->consumed, pos + len, __ATOMIC_RELEASE);
+   return len < bufsize ? len : bufsize;
+}
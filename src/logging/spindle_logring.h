@@ -0,0 +1,95 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT
+file in the top level directory, or at
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms
+and conditions of the GNU Lesser General Public License for more details.  You should
+have received a copy of the GNU Lesser General Public License along with this
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#if !defined(SPINDLE_LOGRING_H_)
+#define SPINDLE_LOGRING_H_
+
+#include <stdint.h>
+#include <stdarg.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * Binary debug log ring.  Each logging process shares one of these with
+ * spindle_logd (the fd is passed over the debug socket).  Any thread may
+ * append a record by claiming space with a CAS on reserved, filling it in,
+ * and then publishing the record's length word.  spindle_logd drains
+ * committed records in order, zeroes them, and advances consumed.  Since
+ * the daemon reads the memory directly, records survive the writer crashing.
+ *
+ * Records carry a site id rather than a format string.  The first use of a
+ * call site in a process emits a LOGREC_SITE record with the file, line,
+ * function and format, and spindle_logd does all formatting.
+ **/
+
+#define LOGRING_MAGIC 0x53504c52
+#define LOGRING_SIZE (256*1024)
+#define LOGRING_COMMITTED 0x80000000u
+#define LOGREC_MAX 4608
+
+typedef struct {
+   uint32_t magic;
+   uint32_t size;
+   char pad0[56];
+   volatile uint64_t reserved;
+   char pad1[56];
+   volatile uint64_t consumed;
+   volatile uint32_t dropped;
+   char pad2[52];
+   unsigned char data[LOGRING_SIZE];
+} logring_t;
+
+typedef enum {
+   LOGREC_SITE = 1,    /* payload: style, line, then file, func, format strings */
+   LOGREC_NAME = 2,    /* payload: the process' spindle_debug_name */
+   LOGREC_MSG = 3,     /* payload: arguments encoded by logring_encode_args */
+   LOGREC_TEXT = 4     /* payload: an already formatted line */
+} logrec_type_t;
+
+typedef enum {
+   LOGSTYLE_DEBUG = 0,
+   LOGSTYLE_ERROR = 1,
+   LOGSTYLE_BARE = 2
+} logrec_style_t;
+
+typedef struct {
+   volatile uint32_t len;
+   uint32_t type;
+   uint32_t pid;
+   uint32_t site;
+   uint64_t timestamp;
+} logrec_hdr_t;
+
+/* Writer side */
+logring_t *logring_create(int *fd);
+int logring_append(logring_t *ring, logrec_type_t type, uint32_t site, uint32_t pid,
+                   const void *payload, uint32_t payload_len);
+uint32_t logring_encode_args(char *buf, uint32_t bufsize, const char *format, va_list ap);
+uint64_t logring_pending(logring_t *ring);
+
+/* spindle_logd side */
+logring_t *logring_map(int fd);
+void logring_unmap(logring_t *ring);
+uint32_t logring_read(logring_t *ring, void *buf, uint32_t bufsize);
+int logring_format_args(const char *format, const char *args, uint32_t args_len, char *out, uint32_t outsize);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
@@ -23,6 +23,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include <set>
 #include <string>
 #include <cstring>
+#include <cstdlib>
 #include <cassert>
 #include <vector>
 #include <algorithm>
@@ -40,6 +41,15 @@ using namespace std;
 
 static bool hit_sigterm = false;
 
+/* Starts a cleanup process message naming a tree to remove, rather than a
+   directory to empty.  Directories are absolute paths, so can't start
+   with it. */
+static const char TREE_MARKER = '*';
+
+/* Trash trees are named after the tree they replaced, this suffix and
+   the pid of the server that trashed them */
+#define TRASH_SUFFIX ".spindle_trash."
+
 static void on_sigterm(int sig)
 {
    hit_sigterm = true;   
@@ -89,11 +99,138 @@ static void rmDirSet(const set<string> &dirs, const char *prefix_dir)
    }   
 }
 
+/**
+ * Remove everything under and including the directory path.  Symlinks are
+ * removed, not followed.
+ **/
+static void rmTreeAt(int parent_fd, const char *name)
+{
+   int fd = openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+   if (fd == -1) {
+      unlinkat(parent_fd, name, 0);
+      return;
+   }
+   DIR *dir = fdopendir(fd);
+   if (!dir) {
+      close(fd);
+      return;
+   }
+   struct dirent *dp;
+   while ((dp = readdir(dir))) {
+      if (dp->d_name[0] == '.' && dp->d_name[1] == '\0')
+         continue;
+      if (dp->d_name[0] == '.' && dp->d_name[1] == '.' && dp->d_name[2] == '\0')
+         continue;
+      if (dp->d_type == DT_DIR) {
+         rmTreeAt(fd, dp->d_name);
+      }
+      else if (dp->d_type == DT_UNKNOWN) {
+         if (unlinkat(fd, dp->d_name, 0) == 0)
+            continue;
+         rmTreeAt(fd, dp->d_name);
+      }
+      else {
+         unlinkat(fd, dp->d_name, 0);
+      }
+   }
+   closedir(dir);
+   unlinkat(parent_fd, name, AT_REMOVEDIR);
+}
+
+static void rmTrees(const vector<string> &trees)
+{
+   for (vector<string>::const_iterator i = trees.begin(); i != trees.end(); i++) {
+      debug_printf("Removing trashed cache directory %s\n", i->c_str());
+      rmTreeAt(AT_FDCWD, i->c_str());
+   }
+}
+
+static bool inPrefix(const string &path, const string &prefix)
+{
+   return path == prefix ||
+      (path.compare(0, prefix.size(), prefix) == 0 && path[prefix.size()] == '/');
+}
+
+static void dropTree(set<string> &dirs, const string &root)
+{
+   for (set<string>::iterator i = dirs.begin(); i != dirs.end(); ) {
+      if (inPrefix(*i, root))
+         dirs.erase(i++);
+      else
+         i++;
+   }
+}
+
+/**
+ * Tearing down a cache of many files one unlink at a time can take long
+ * enough to hold up the next job on the node.  Instead we rename each
+ * directory tree we created under the prefix (normally just the prefix
+ * itself) to a trash name beside it, which is instant, and remove the
+ * trash in the background.  The renamed dirs are dropped from dirs, and
+ * any we couldn't rename are left there to clean the slow way.
+ **/
+static void trashDirSet(set<string> &dirs, const char *prefix_dir, vector<pair<string, string> > &trash)
+{
+   string prefix(prefix_dir);
+   while (prefix.size() > 1 && prefix[prefix.size()-1] == '/')
+      prefix.erase(prefix.size()-1);
+
+   vector<string> roots;
+   for (set<string>::iterator i = dirs.begin(); i != dirs.end(); i++) {
+      if (!inPrefix(*i, prefix))
+         continue;
+      size_t slash = i->rfind('/');
+      string parent = (slash == string::npos || slash == 0) ? string("/") : i->substr(0, slash);
+      if (*i != prefix && inPrefix(parent, prefix) && dirs.find(parent) != dirs.end())
+         continue;
+      roots.push_back(*i);
+   }
+
+   char suffix[64];
+   snprintf(suffix, sizeof(suffix), "%s%d", TRASH_SUFFIX, (int) getpid());
+   for (vector<string>::iterator i = roots.begin(); i != roots.end(); i++) {
+      string trash_name = *i + suffix;
+      if (rename(i->c_str(), trash_name.c_str()) == -1) {
+         debug_printf("Could not move %s to trash, removing it in place: %s\n", i->c_str(), strerror(errno));
+         continue;
+      }
+      debug_printf("Moved cache directory %s to %s for removal\n", i->c_str(), trash_name.c_str());
+      trash.push_back(make_pair(*i, trash_name));
+      dropTree(dirs, *i);
+   }
+}
+
+/**
+ * Remove trees from a grandchild process, so we neither wait for it nor
+ * leave a zombie.
+ **/
+static void rmTreesInBackground(const vector<pair<string, string> > &trash)
+{
+   vector<string> trees;
+   for (vector<pair<string, string> >::const_iterator i = trash.begin(); i != trash.end(); i++)
+      trees.push_back(i->second);
+
+   pid_t pid = fork();
+   if (pid == -1) {
+      rmTrees(trees);
+      return;
+   }
+   if (pid == 0) {
+      setsid();
+      if (fork() == 0)
+         rmTrees(trees);
+      _exit(0);
+   }
+   int status;
+   while (waitpid(pid, &status, 0) == -1 && errno == EINTR);
+}
+
 class CleanupProc
 {
    friend void init_cleanup_proc(const char *);
 private:
    set<string> dirs;
+   vector<string> trees;
    int write_dir_fd;
    int read_dir_fd;
    bool has_error;
@@ -105,7 +242,8 @@ private:
    void cleanupMain();
 public:
    void addDir(const char *dir);
-   void triggerCleanup();
+   void addTree(const char *orig, const char *tree);
+   void triggerCleanup(bool wait);
    bool hadError();
 };
 
@@ -158,10 +296,12 @@ CleanupProc::CleanupProc(const char *pd) :
    cleanupMain();
 }
 
-void CleanupProc::triggerCleanup()
+void CleanupProc::triggerCleanup(bool wait)
 {
    debug_printf("Cleaning up BE files using dedicated cleanup process\n");
    close(write_dir_fd);
+   if (!wait)
+      return;
 
    int status, result;
    for (;;) {
@@ -184,19 +324,31 @@ bool CleanupProc::hadError()
 
 void CleanupProc::rmDirs()
 {
+   rmTrees(trees);
    rmDirSet(dirs, prefix_dir);
 }
 
 void CleanupProc::cleanupMain()
 {
    ssize_t result;
-   char buffer[MAX_PATH_LEN+1];
+   char buffer[MAX_PATH_LEN+64];
    int cur = 0;
+   bool in_tree = false;
    for (;;) {
       result = read(read_dir_fd, buffer+cur, 1);
       if (result == 1) {
          if (buffer[cur] == '\0') {
-            dirs.insert(buffer);
+            if (buffer[0] == TREE_MARKER) {
+               /* A tree is sent as its original name, then its trash name */
+               dropTree(dirs, buffer+1);
+               in_tree = true;
+            }
+            else if (in_tree) {
+               trees.push_back(buffer);
+               in_tree = false;
+            }
+            else
+               dirs.insert(buffer);
             cur = 0;
          }
          else {
@@ -216,6 +368,13 @@ void CleanupProc::cleanupMain()
    _exit(0);
 }
 
+void CleanupProc::addTree(const char *orig, const char *tree)
+{
+   string msg = string(1, TREE_MARKER) + orig;
+   addDir(msg.c_str());
+   addDir(tree);
+}
+
 void CleanupProc::addDir(const char *dir)
 {
    if (!dir || dir[0] == '\0')
@@ -268,12 +427,59 @@ int lookup_prev_mkdir(const char *dir)
    return (i != local_dircache.end()) ? 1 : 0;
 }
 
+/**
+ * Trash is removed in the background, by a process that can be killed
+ * along with the job before it's done.  Remove any trash left beside
+ * location_dir by servers that are gone, in the background again.
+ **/
+void cleanup_stale_trash(const char *location_dir)
+{
+   string parent(location_dir);
+   while (parent.size() > 1 && parent[parent.size()-1] == '/')
+      parent.erase(parent.size()-1);
+   size_t slash = parent.rfind('/');
+   if (slash == string::npos)
+      return;
+   parent = (slash == 0) ? string("/") : parent.substr(0, slash);
+
+   DIR *dir = opendir(parent.c_str());
+   if (!dir)
+      return;
+   vector<pair<string, string> > trash;
+   struct dirent *dp;
+   while ((dp = readdir(dir))) {
+      const char *suffix = strstr(dp->d_name, TRASH_SUFFIX);
+      if (!suffix)
+         continue;
+      char *end;
+      long pid = strtol(suffix + strlen(TRASH_SUFFIX), &end, 10);
+      if (*end != '\0' || pid <= 0)
+         continue;
+      if (kill((pid_t) pid, 0) == 0 || errno != ESRCH)
+         continue;
+      string path = (parent == "/" ? string("") : parent) + "/" + dp->d_name;
+      debug_printf("Found trash %s from exited server %ld\n", path.c_str(), pid);
+      trash.push_back(make_pair(string(), path));
+   }
+   closedir(dir);
+
+   if (!trash.empty())
+      rmTreesInBackground(trash);
+}
+
 void cleanup_created_dirs(const char *prefix_dir)
 {
+   vector<pair<string, string> > trash;
+   trashDirSet(local_dircache, prefix_dir, trash);
+
    if (proc) {
-      proc->triggerCleanup();
+      for (vector<pair<string, string> >::iterator i = trash.begin(); i != trash.end(); i++)
+         proc->addTree(i->first.c_str(), i->second.c_str());
+      proc->triggerCleanup(!local_dircache.empty());
    }
    else {
+      if (!trash.empty())
+         rmTreesInBackground(trash);
       debug_printf("Cleaning files with local unlink/rmdirs.\n");
       rmDirSet(local_dircache, prefix_dir);
    }      
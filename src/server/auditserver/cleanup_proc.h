@@ -22,6 +22,7 @@ void init_cleanup_proc(const char *location_dir);
 void track_mkdir(const char *dir);
 int lookup_prev_mkdir(const char *dir);   
 void cleanup_created_dirs(const char *location_dir);
+void cleanup_stale_trash(const char *location_dir);
    
 #if defined(__cplusplus)
 }
@@ -0,0 +1,166 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT
+file in the top level directory, or at
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms
+and conditions of the GNU Lesser General Public License for more details.  You should
+have received a copy of the GNU Lesser General Public License along with this
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ldcs_audit_server_filestats.h"
+#include "ldcs_cache.h"
+#include "ldcs_hash.h"
+#include "spindle_debug.h"
+
+#define FILESTATS_BUCKETS 4096
+#define FILESTATS_PATH_LEN(LEN) (((LEN) + 1 + 7) & ~((size_t) 7))
+
+typedef struct filestats_t {
+   filestats_record_t record;
+   char *path;
+   ldcs_hash_key_t hash;
+   struct filestats_t *next;
+} filestats_t;
+
+static filestats_t *buckets[FILESTATS_BUCKETS];
+static unsigned int num_files;
+static size_t paths_size;
+
+static filestats_t *get_filestats(const char *path)
+{
+   ldcs_hash_key_t hash = ldcs_hash_Val(path);
+   filestats_t **bucket = buckets + (hash % FILESTATS_BUCKETS), *f;
+
+   for (f = *bucket; f; f = f->next) {
+      if (f->hash == hash && strcmp(f->path, path) == 0)
+         return f;
+   }
+   f = (filestats_t *) calloc(1, sizeof(filestats_t));
+   if (!f)
+      return NULL;
+   f->path = strdup(path);
+   f->hash = hash;
+   f->next = *bucket;
+   *bucket = f;
+   num_files++;
+   paths_size += FILESTATS_PATH_LEN(strlen(path));
+   return f;
+}
+
+static void merge_record(const char *path, const filestats_record_t *rec)
+{
+   filestats_t *f = get_filestats(path);
+   if (!f) {
+      err_printf("Could not allocate file statistics for %s\n", path);
+      return;
+   }
+   f->record.bytes += rec->bytes;
+   f->record.client_wait += rec->client_wait;
+   if (rec->max_latency > f->record.max_latency)
+      f->record.max_latency = rec->max_latency;
+   f->record.requests += rec->requests;
+   f->record.cache_hits += rec->cache_hits;
+   f->record.nodes_requested += rec->nodes_requested;
+   f->record.nodes_disk += rec->nodes_disk;
+   f->record.nodes_tree += rec->nodes_tree;
+   f->record.nodes_pushed += rec->nodes_pushed;
+}
+
+void filestats_add_child_data(ldcs_message_t *msg)
+{
+   char *cur = msg->data, *end = msg->data + msg->header.len;
+   filestats_record_t rec;
+
+   while (cur + sizeof(rec) <= end) {
+      memcpy(&rec, cur, sizeof(rec));
+      cur += sizeof(rec);
+      if (!rec.path_len || rec.path_len > (size_t) (end - cur) || cur[rec.path_len-1] != '\0') {
+         err_printf("Malformed file statistics from child server\n");
+         return;
+      }
+      merge_record(cur, &rec);
+      cur += rec.path_len;
+   }
+}
+
+static void add_own_stats(const char *path, ldcs_file_stats_t *stats, void *arg)
+{
+   filestats_record_t rec;
+
+   memset(&rec, 0, sizeof(rec));
+   rec.bytes = stats->bytes;
+   rec.client_wait = stats->client_wait;
+   if (stats->first_request && stats->delivered > stats->first_request)
+      rec.max_latency = stats->delivered - stats->first_request;
+   rec.requests = stats->requests;
+   rec.cache_hits = stats->cache_hits;
+   if (stats->requests && !stats->reported_request) {
+      rec.nodes_requested = 1;
+      stats->reported_request = 1;
+   }
+   if (stats->source != FILE_SOURCE_NONE && !stats->reported_source) {
+      rec.nodes_disk = stats->source == FILE_SOURCE_DISK ? 1 : 0;
+      rec.nodes_tree = stats->source == FILE_SOURCE_TREE ? 1 : 0;
+      rec.nodes_pushed = stats->source == FILE_SOURCE_PUSHED ? 1 : 0;
+      stats->reported_source = 1;
+   }
+   merge_record(path, &rec);
+
+   /* Sent now, so a later report only counts what happens from here on */
+   stats->requests = 0;
+   stats->cache_hits = 0;
+   stats->bytes = 0;
+   stats->client_wait = 0.0;
+   stats->first_request = 0.0;
+   stats->delivered = 0.0;
+}
+
+/**
+ * Returns our statistics merged with our children's, and frees what we
+ * had merged.  Our own counters are reset, as servers can report more than
+ * once if clients arrive after an exit was cancelled.
+ **/
+void *filestats_pack(size_t *size)
+{
+   filestats_t *f, *next;
+   char *data, *cur;
+   size_t path_len;
+   int i;
+
+   ldcs_cache_forEachFileStats(add_own_stats, NULL);
+
+   *size = num_files * sizeof(filestats_record_t) + paths_size;
+   data = (char *) malloc(*size ? *size : 1);
+   cur = data;
+   for (i = 0; i < FILESTATS_BUCKETS; i++) {
+      for (f = buckets[i]; f; f = next) {
+         next = f->next;
+         if (data) {
+            path_len = strlen(f->path);
+            f->record.path_len = (uint32_t) FILESTATS_PATH_LEN(path_len);
+            memcpy(cur, &f->record, sizeof(f->record));
+            cur += sizeof(f->record);
+            memset(cur, 0, f->record.path_len);
+            memcpy(cur, f->path, path_len);
+            cur += f->record.path_len;
+         }
+         free(f->path);
+         free(f);
+      }
+      buckets[i] = NULL;
+   }
+   debug_printf("Packed file statistics for %u files\n", num_files);
+   num_files = 0;
+   paths_size = 0;
+   return data;
+}
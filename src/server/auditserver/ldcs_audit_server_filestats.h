@@ -0,0 +1,39 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT
+file in the top level directory, or at
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms
+and conditions of the GNU Lesser General Public License for more details.  You should
+have received a copy of the GNU Lesser General Public License along with this
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#if !defined(LDCS_AUDIT_SERVER_FILESTATS_H_)
+#define LDCS_AUDIT_SERVER_FILESTATS_H_
+
+#include <stddef.h>
+#include "ldcs_api.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * Reduces the per-file statistics in the cache and those sent up by child
+ * servers to one filestats_record_t per path.
+ **/
+
+void filestats_add_child_data(ldcs_message_t *msg);
+void *filestats_pack(size_t *size);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
@@ -21,6 +21,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include <sys/inotify.h>
 #include <errno.h>
 #include <assert.h>
+#include <fcntl.h>
 
 #include "ldcs_api.h"
 #include "ldcs_api_listen.h"
@@ -39,6 +40,12 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include "ccwarns.h"
 #include "parse_mounts.h"
 #include "exitnote.h"
+#include "dirindex.h"
+#include "warmcache.h"
+#include "pathcode.h"
+#include "ldcs_audit_server_pypack.h"
+#include "ldcs_audit_server_trace.h"
+#include "ldcs_audit_server_filestats.h"
 
 /** 
  * This file contains the "brains" of Spindle.  It's public interface,
@@ -120,6 +127,7 @@ static int handle_finish_buffer_setup(ldcs_process_data_t *procdata,
 
 static int handle_client_originalfile_query(ldcs_process_data_t *procdata, int nc);
 static int handle_client_fulfilled_query(ldcs_process_data_t *procdata, int nc);
+static void note_file_answer(ldcs_process_data_t *procdata, ldcs_client_t *client);
 static int handle_client_return_numa_replication(ldcs_process_data_t *procdata, int nc);
 static int handle_client_rejected_query(ldcs_process_data_t *procdata, int nc, int errcode);
 
@@ -142,13 +150,22 @@ static int handle_send_msg_to_keys(ldcs_process_data_t *procdata, ldcs_message_t
                                    metadata_t mdtype);
 static int handle_preload_filelist(ldcs_process_data_t *procdata, ldcs_message_t *msg);
 static int handle_preload_done(ldcs_process_data_t *procdata);
+static int handle_preload_idle(void *data);
 static int handle_create_selfload_file(ldcs_process_data_t *procdata, char *filename);
 static int handle_recv_selfload_file(ldcs_process_data_t *procdata, ldcs_message_t *msg);
+static int handle_pypack_chunk(char *image, size_t size, void *arg);
+static int handle_pypack_unpack(ldcs_process_data_t *procdata, char *image, size_t size, int *last);
+static int handle_pypack_recv(ldcs_process_data_t *procdata, ldcs_message_t *msg);
 static int handle_report_fileexist_result(ldcs_process_data_t *procdata, int nc, exist_t res);
 
 static int handle_fileexist_test(ldcs_process_data_t *procdata, int nc);
 static int handle_client_fileexist_msg(ldcs_process_data_t *procdata, int nc, ldcs_message_t *msg);
 static int handle_client_origpath_msg(ldcs_process_data_t *procdata, int nc, ldcs_message_t *msg);
+static int handle_client_search_msg(ldcs_process_data_t *procdata, int nc, ldcs_message_t *msg);
+static int handle_soname_search(ldcs_process_data_t *procdata, int nc);
+static int handle_execpath_search(ldcs_process_data_t *procdata, int nc);
+static void handle_index_dir(ldcs_process_data_t *procdata, char *dir);
+static int handle_report_search_result(ldcs_process_data_t *procdata, int nc, int errcode, char *path);
 static int handle_stat_file(ldcs_process_data_t *procdata, char *pathname, metadata_t mdtype, char **localname, struct stat *buf);
 static int handle_metadata_and_broadcast_file(ldcs_process_data_t *procdata, char *pathname, metadata_t mdtype, broadcast_t bcast);
 static int handle_cache_metadata(ldcs_process_data_t *procdata, char *pathname, int file_exists, metadata_t mdtype,
@@ -164,7 +181,13 @@ static int handle_metadata_request_recv(ldcs_process_data_t *procdata, ldcs_mess
 static int handle_load_and_broadcast_metadata(ldcs_process_data_t *procdata, char *pathname, metadata_t mdtype);
 static int handle_send_exit_ready_if_done(ldcs_process_data_t *procdata);
 static int handle_exit_ready_msg(ldcs_process_data_t *procdata, ldcs_message_t *msg);
+static int handle_send_exit_draining(ldcs_process_data_t *procdata, int32_t change);
+static int handle_exit_draining_msg(ldcs_process_data_t *procdata, ldcs_message_t *msg);
+static int handle_exit_status_req(ldcs_process_data_t *procdata, ldcs_message_t *msg);
+static int handle_exit_status_msg(ldcs_process_data_t *procdata, ldcs_message_t *msg, node_peer_t peer);
 static int handle_exit_cancel_msg(ldcs_process_data_t *procdata, ldcs_message_t *msg);
+static int handle_send_trace(ldcs_process_data_t *procdata);
+static int handle_send_filestats(ldcs_process_data_t *procdata);
 static int handle_send_exit_cancel(ldcs_process_data_t *procdata);
 static int handle_read_ldso_metadata(ldcs_process_data_t *procdata, char *pathname, ldso_info_t *ldsoinfo, char **result_file);
 static int handle_cache_ldso(ldcs_process_data_t *procdata, char *pathname, int file_exists,
@@ -172,6 +195,8 @@ static int handle_cache_ldso(ldcs_process_data_t *procdata, char *pathname, int
 static int handle_msgbundle(ldcs_process_data_t *procdata, node_peer_t peer, ldcs_message_t *msg);
 static int handle_setup_alias(ldcs_process_data_t *procdata, char *pathname, char *alias_to);
 static int handle_close_client_query(ldcs_process_data_t *procdata, int nc);
+static void set_query_rawpath(ldcs_process_data_t *procdata, ldcs_client_t *client, const char *pathname);
+static void log_warm_answer(ldcs_process_data_t *procdata, ldcs_client_t *client, const char *prefix, const char *value);
 
 /**
  * Query from client to server.  Returns info about client's rank in server data structures. 
@@ -270,13 +295,23 @@ static int handle_client_file_request(ldcs_process_data_t *procdata, int nc, ldc
    char file[MAX_PATH_LEN];
    char dir[MAX_PATH_LEN];
    int is_stat, is_lstat;
-   int is_loader;
+   int is_loader, wants_fd;
 
    file[0] = '\0'; dir[0] = '\0';
    pathname = msg->data;
    is_stat = (msg->header.type == LDCS_MSG_STAT_QUERY) || (msg->header.type == LDCS_MSG_LSTAT_QUERY);
    is_lstat = (msg->header.type == LDCS_MSG_LSTAT_QUERY);
    is_loader = (msg->header.type == LDCS_MSG_LOADER_DATA_REQ);
+   wants_fd = 0;
+   if (msg->header.type == LDCS_MSG_FILE_QUERY_FD && (procdata->opts & OPT_FDPASS)) {
+      /* The path is followed by the number of passed fds the client still holds */
+      size_t path_size = strlen(msg->data) + 1;
+      int held;
+      if (msg->header.len >= path_size + sizeof(int)) {
+         memcpy(&held, msg->data + path_size, sizeof(int));
+         wants_fd = (held < procdata->fdpass_limit);
+      }
+   }
 
    /* check to see if pathname is a local name (possibly from fstat()) and switch to global name if needed */
    char *globalname = lookup_global_name(pathname);
@@ -308,6 +343,8 @@ static int handle_client_file_request(ldcs_process_data_t *procdata, int nc, ldc
    client->is_stat = is_stat;
    client->is_lstat = is_lstat;
    client->is_loader = is_loader;   
+   client->query_wants_fd = wants_fd;
+   set_query_rawpath(procdata, client, globalname ? NULL : msg->data);
    
    debug_printf("Server recvd query %s%s for %s.  Dir = %s, File = %s\n", 
                  is_loader ? "loader " : "",
@@ -426,13 +463,16 @@ static int handle_client_progress(ldcs_process_data_t *procdata, int nc)
    char *alias_to;
 
    ldcs_client_t *client = procdata->client_table + nc;
-   if ((procdata->opts & OPT_PRELOAD) && !procdata->preload_done) {
-      /* Postpone client requests until preload is complete */
-      debug_printf3("Postpone client requests until preload is complete\n");
+   if (procdata->pypack_pending) {
+      debug_printf3("Postpone client requests until the python pack has arrived\n");
       return 0;
    }
    if (!client->query_open)
       return 0;
+   if (client->soname_query)
+      return handle_soname_search(procdata, nc);
+   if (client->execpath_query && !client->execpath_found)
+      return handle_execpath_search(procdata, nc);
    if (client->existance_query)
       return handle_fileexist_test(procdata, nc);
    if (client->is_stat || client->is_loader)
@@ -541,6 +581,7 @@ static int handle_read_directory(ldcs_process_data_t *procdata, char *dir)
 	
    if (cache_dir_result == LDCS_CACHE_DIR_PARSED_AND_EXISTS ||
        cache_dir_result == LDCS_CACHE_DIR_PARSED_AND_NOT_EXISTS) {
+      handle_index_dir(procdata, dir);
       return 0;
    }
    else {
@@ -549,6 +590,29 @@ static int handle_read_directory(ldcs_process_data_t *procdata, char *dir)
    }
 }
 
+/**
+ * Publish the entries of a directory we've just learned about, so clients
+ * can answer probes for files that aren't in it themselves.
+ **/
+static void handle_index_dir(ldcs_process_data_t *procdata, char *dir)
+{
+   ldcs_cache_result_t cache_dir_result;
+   char **names = NULL;
+   int num_names = 0;
+
+   if (!procdata->dirindex)
+      return;
+
+   cache_dir_result = ldcs_cache_findDirInCache(dir);
+   if (cache_dir_result == LDCS_CACHE_DIR_PARSED_AND_EXISTS)
+      ldcs_cache_getNamesForDir(dir, &names, &num_names);
+   else if (cache_dir_result != LDCS_CACHE_DIR_PARSED_AND_NOT_EXISTS)
+      return;
+
+   dirindex_add_dir(procdata->dirindex, dir, names, num_names);
+   free(names);
+}
+
 /**
  * Broadcast a directory contents to the specified client (if any),
  * and on the network.
@@ -638,6 +702,8 @@ static void *handle_setup_file_buffer(ldcs_process_data_t *procdata, char *pathn
    else if (cresult == LDCS_CACHE_FILE_NOT_FOUND) {
       debug_printf3("File %s wasn't in cache\n", pathname);
       ldcs_cache_addFileDir(dirname, filename);
+      if (procdata->dirindex && dirindex_lookup(procdata->dirindex, pathname) == DIRINDEX_MISSING)
+         handle_index_dir(procdata, dirname);
       *already_loaded = 0;
    }
    else {
@@ -905,6 +971,11 @@ static int handle_read_and_broadcast_file(ldcs_process_data_t *procdata, char *p
       global_result = -1;
       goto done;
    }
+   if (procdata->opts & OPT_FILESTATS) {
+      char filename[MAX_PATH_LEN], dirname[MAX_PATH_LEN];
+      parseFilenameNoAlloc(pathname, filename, dirname, MAX_PATH_LEN);
+      ldcs_cache_noteDelivery(filename, dirname, FILE_SOURCE_DISK, errcode ? 0 : newsize, ldcs_get_time());
+   }
 
   do_broadcast:
    if (bcast == suppress_broadcast)
@@ -1087,11 +1158,13 @@ static int handle_client_return_numa_replication(ldcs_process_data_t *procdata,
 
 /**
  * Sends a message to a client with the local path for a sucessfully read file.
+ * If the client asked for it, we first pass it the file already opened, which
+ * saves it walking the path itself.
  **/
 static int handle_client_fulfilled_query(ldcs_process_data_t *procdata, int nc)
 {
    ldcs_message_t out_msg;
-   int connid, zero = 0;
+   int connid, answer = 0, passfd;
    char buffer_out[MAX_PATH_LEN+1+sizeof(int)];
    char *outfile;
    ldcs_client_t *client = procdata->client_table + nc;
@@ -1104,7 +1177,6 @@ static int handle_client_fulfilled_query(ldcs_process_data_t *procdata, int nc)
 
    out_msg.header.type = LDCS_MSG_FILE_QUERY_ANSWER;
    out_msg.data = (void *) buffer_out;
-   memcpy(out_msg.data, &zero, sizeof(int));
 
    outfile = out_msg.data + sizeof(int);
    strncpy(outfile, client->query_localpath, MAX_PATH_LEN);
@@ -1113,15 +1185,29 @@ static int handle_client_fulfilled_query(ldcs_process_data_t *procdata, int nc)
       debug_printf3("Updating local file %s with numa domain %d before sending to client\n", outfile, client->numa_node);
       numa_update_local_filename(outfile, client->numa_node);
    }
+   if (client->execpath_query)
+      return handle_report_search_result(procdata, nc, 0, outfile);
+   if (!client->query_is_numa_replicated)
+      log_warm_answer(procdata, client, "", outfile);
+
+   if (client->query_wants_fd) {
+      passfd = open(outfile, O_RDONLY | O_CLOEXEC);
+      if (passfd == -1)
+         debug_printf("Could not open %s to pass to client: %s\n", outfile, strerror(errno));
+      else {
+         if (ldcs_send_fd(connid, passfd) == 0)
+            answer = LDCS_ANSWER_PASSED_FD;
+         close(passfd);
+      }
+   }
+   memcpy(out_msg.data, &answer, sizeof(int));
    
    out_msg.header.len = strlen(client->query_localpath) + 1 + sizeof(int);
 
    ldcs_send_msg(connid, &out_msg);
 
    /* statistic */
-   procdata->server_stat.clientmsg.cnt++;
-   procdata->server_stat.clientmsg.time += ldcs_get_time() -
-      client->query_arrival_time;
+   note_file_answer(procdata, client);
 
    debug_printf("Server answering query: %s\n", outfile);
    
@@ -1129,6 +1215,21 @@ static int handle_client_fulfilled_query(ldcs_process_data_t *procdata, int nc)
    return 0;
 }
 
+/**
+ * Count a client query answered with a file from our cache, and note the
+ * request in the file statistics if they're kept.
+ **/
+static void note_file_answer(ldcs_process_data_t *procdata, ldcs_client_t *client)
+{
+   double now = ldcs_get_time();
+
+   procdata->server_stat.clientmsg.cnt++;
+   procdata->server_stat.clientmsg.time += now - client->query_arrival_time;
+   if (procdata->opts & OPT_FILESTATS)
+      ldcs_cache_noteRequest(client->query_filename, client->query_dirname,
+                             client->query_arrival_time, now);
+}
+
 /**
  * Sends a message to a client that shows a file wasn't found.
  **/
@@ -1136,17 +1237,31 @@ static int handle_client_rejected_query(ldcs_process_data_t *procdata, int nc, i
 {
    ldcs_message_t out_msg;
    int buffer_out;
+   char errstr[32];
 
    out_msg.header.type = LDCS_MSG_FILE_QUERY_ANSWER;
    out_msg.data = (void *) &buffer_out;
    buffer_out = errcode;
    ldcs_client_t *client = procdata->client_table + nc;
    int connid = client->connid;
+
+   if (client->execpath_query) {
+      /* Run an executable we can't or shouldn't relocate from its original
+         path.  If it vanished, keep searching the rest of PATH. */
+      if (errcode == EACCES || errcode == 0)
+         return handle_report_search_result(procdata, nc, errcode, client->query_globalpath);
+      client->execpath_found = 0;
+      client->search_pos += strlen(client->search_dirs + client->search_pos) + 1;
+      return handle_client_progress(procdata, nc);
+   }
    
    /* send answer only to active client not to pseudo client */
    if (client->state != LDCS_CLIENT_STATUS_ACTIVE || connid < 0)
       return 0;
 
+   snprintf(errstr, sizeof(errstr), "ERRNO:%d", errcode);
+   log_warm_answer(procdata, client, "", errstr);
+
    out_msg.header.len = sizeof(buffer_out);
       
    ldcs_send_msg(connid, &out_msg);
@@ -1508,6 +1623,13 @@ static int handle_file_recv(ldcs_process_data_t *procdata, ldcs_message_t *msg,
       global_error = -1;
       goto done;
    }
+   if (procdata->opts & OPT_FILESTATS) {
+      char filename[MAX_PATH_LEN], dirname[MAX_PATH_LEN];
+      int requested = (bcast != preload_broadcast && been_requested(procdata->pending_requests, pathname));
+      parseFilenameNoAlloc(pathname, filename, dirname, MAX_PATH_LEN);
+      ldcs_cache_noteDelivery(filename, dirname, requested ? FILE_SOURCE_TREE : FILE_SOURCE_PUSHED,
+                              size, ldcs_get_time());
+   }
 
    /* Notify other servers and clients of file read */
    result = handle_broadcast_file(procdata, pathname, buffer, size, bcast);
@@ -1530,24 +1652,19 @@ static int handle_file_recv(ldcs_process_data_t *procdata, ldcs_message_t *msg,
  **/
 static int handle_directory_recv(ldcs_process_data_t *procdata, ldcs_message_t *msg, broadcast_t bcast)
 {
-   dirbuffer_iterator_t pos;
-   char *filename, *dirname, *dir = NULL;;
+   char dir[MAX_PATH_LEN];
    double starttime = ldcs_get_time();
 
    debug_printf2("New directory cache entries received from %s\n",
                  bcast == preload_broadcast ? "preload" : "request");
 
-   /* For each directory/file in packet add it to the cache. */
-   foreach_filedir(msg->data, msg->header.len, pos, filename, dirname) {
-      assert(dir == NULL || dir == dirname); /* One directory per packet for now */
-      dir = dirname;
-      if (dirname && !filename) {
-         addEmptyDirectory(dirname);
-         continue;
-      }
-      ldcs_cache_addFileDir(dirname, filename);
+   /* The packet's entries are decoded straight into the cache */
+   if (ldcs_cache_storeEncodedDir(msg->data, msg->header.len, dir, sizeof(dir)) == -1) {
+      err_printf("Received a malformed directory packet\n");
+      return -1;
    }
 
+   handle_index_dir(procdata, dir);
    handle_broadcast_dir(procdata, dir, bcast);
    
    procdata->server_stat.distdir.cnt++;
@@ -1664,6 +1781,7 @@ int handle_client_message(ldcs_process_data_t *procdata, int nc, ldcs_message_t
          return handle_client_myrankinfo_msg(procdata, nc, msg);
       case LDCS_MSG_FILE_QUERY:
       case LDCS_MSG_FILE_QUERY_EXACT_PATH:
+      case LDCS_MSG_FILE_QUERY_FD:
       case LDCS_MSG_STAT_QUERY:
       case LDCS_MSG_LSTAT_QUERY:
       case LDCS_MSG_LOADER_DATA_REQ:
@@ -1672,8 +1790,14 @@ int handle_client_message(ldcs_process_data_t *procdata, int nc, ldcs_message_t
          return handle_client_fileexist_msg(procdata, nc, msg);
       case LDCS_MSG_ORIGPATH_QUERY:
          return handle_client_origpath_msg(procdata, nc, msg);
+      case LDCS_MSG_SONAME_QUERY:
+      case LDCS_MSG_EXECPATH_QUERY:
+         return handle_client_search_msg(procdata, nc, msg);
       case LDCS_MSG_END:
          return handle_client_end(procdata, nc);
+      case LDCS_MSG_TRACE:
+         trace_add_client_events(msg);
+         return 0;
       default:
          err_printf("Received unexpected message from client %d: %d\n", nc, (int) msg->header.type);
          assert(0);
@@ -1736,6 +1860,8 @@ int handle_server_message(ldcs_process_data_t *procdata, node_peer_t peer, ldcs_
          return handle_preload_done(procdata);
       case LDCS_MSG_SELFLOAD_FILE:
          return handle_recv_selfload_file(procdata, msg);
+      case LDCS_MSG_PYPACK:
+         return handle_pypack_recv(procdata, msg);
       case LDCS_MSG_STAT_NET_RESULT:
          return handle_metadata_recv(procdata, msg, metadata_stat, peer);
       case LDCS_MSG_LSTAT_NET_RESULT:
@@ -1750,8 +1876,20 @@ int handle_server_message(ldcs_process_data_t *procdata, node_peer_t peer, ldcs_
          return handle_metadata_request_recv(procdata, msg, metadata_loader, peer);
       case LDCS_MSG_EXIT_READY:
          return handle_exit_ready_msg(procdata, msg);
+      case LDCS_MSG_EXIT_DRAINING:
+         return handle_exit_draining_msg(procdata, msg);
+      case LDCS_MSG_EXIT_STATUS_REQ:
+         return handle_exit_status_req(procdata, msg);
+      case LDCS_MSG_EXIT_STATUS:
+         return handle_exit_status_msg(procdata, msg, peer);
       case LDCS_MSG_EXIT_CANCEL:
          return handle_exit_cancel_msg(procdata, msg);
+      case LDCS_MSG_TRACE_DATA:
+         trace_add_child_data(msg);
+         return 0;
+      case LDCS_MSG_FILESTATS:
+         filestats_add_child_data(msg);
+         return 0;
       case LDCS_MSG_BUNDLE:
          return handle_msgbundle(procdata, peer, msg);
       case LDCS_MSG_ALIAS:
@@ -1768,8 +1906,19 @@ int handle_server_message(ldcs_process_data_t *procdata, node_peer_t peer, ldcs_
  **/
 int handle_client_start(ldcs_process_data_t *procdata, int nc)
 {
+   int result;
+   if (procdata->exit_drained) {
+      procdata->exit_drained = 0;
+      if (handle_send_exit_draining(procdata, -1) == -1)
+         return -1;
+   }
    if (procdata->sent_exit_ready) {
-      return handle_send_exit_cancel(procdata);
+      /* A client forked after our last one exited.  Our parent must see
+         a new exit ready once it's done, so clear sent_exit_ready just as
+         handle_exit_cancel_msg does. */
+      result = handle_send_exit_cancel(procdata);
+      procdata->sent_exit_ready = 0;
+      return result;
    }
    return 0;
 }
@@ -1789,81 +1938,162 @@ int handle_client_end(ldcs_process_data_t *procdata, int nc)
    
    ldcs_listen_unregister_fd(ldcs_get_fd(connid)); 
    ldcs_close_server_connection(connid);
+   if (client->search_dirs) {
+      free(client->search_dirs);
+      client->search_dirs = NULL;
+   }
    client->state = LDCS_CLIENT_STATUS_FREE;
    debug_printf("Closed client %d\n", nc);
 
    assert(procdata->clients_live > 0);
    procdata->clients_live--;
+   if (!procdata->clients_live && procdata->warmcache)
+      warmcache_publish(procdata->warmcache, procdata->location);
+   if (!procdata->clients_live && !procdata->exit_drained && !(procdata->opts & OPT_PERSIST)) {
+      procdata->exit_drained = 1;
+      if (handle_send_exit_draining(procdata, 1) == -1)
+         return -1;
+   }
    return handle_send_exit_ready_if_done(procdata);
 }
 
+/**
+ * A preload list from the FE.  It's worked through in the background, one
+ * directory or file each time the server has nothing else to do, so client
+ * requests are never queued behind it.
+ **/
+typedef struct preload_list_t {
+   char *data;
+   pathcode_list_t paths;
+   struct preload_list_t *next;
+} preload_list_t;
+
 static int handle_preload_filelist(ldcs_process_data_t *procdata, ldcs_message_t *msg)
 {
-   int cur = 0, global_result = 0, result;
-   int num_dirs, num_files, i;
-   char *data = (char *) msg->data;
-   char *pathname;
-   
+   static int registered_idle = 0;
+   preload_list_t *list, **tail;
+
    debug_printf2("At top of handle_preload_filelist\n");
+   trace_server_event(TRACE_BE_PRELOAD, TRACE_BEGIN);
+
+   list = (preload_list_t *) malloc(sizeof(preload_list_t));
+   list->data = (char *) malloc(msg->header.len);
+   memcpy(list->data, msg->data, msg->header.len);
+   list->next = NULL;
+   if (pathcode_list_open(&list->paths, list->data, msg->header.len) == -1) {
+      err_printf("Received a malformed preload list\n");
+      free(list->data);
+      free(list);
+      return -1;
+   }
 
-   memcpy(&num_dirs, data + cur, sizeof(int));
-   cur += sizeof(int);
-   
-   memcpy(&num_files, data + cur, sizeof(int));
-   cur += sizeof(int);
+   for (tail = &procdata->preload_lists; *tail; tail = &(*tail)->next);
+   *tail = list;
+   debug_printf("Queued preload of %d directories and %d files\n", list->paths.num_dirs, list->paths.num_files);
+
+   if (!registered_idle) {
+      ldcs_listen_register_idle_cb(handle_preload_idle, (void *) procdata);
+      registered_idle = 1;
+   }
+   ldcs_listen_request_idle_cb(handle_preload_idle);
+   return 0;
+}
 
-   for (i = 0; i<num_dirs; i++) {
-      assert(cur < msg->header.len);
-      pathname = data + cur;
-      cur += strlen(pathname)+1;
+/**
+ * Whether a demand request already brought a preload entry into the cache,
+ * in which case preloading it again is skipped.
+ **/
+static int preload_is_cached(char *pathname, int is_dir)
+{
+   char file[MAX_PATH_LEN], dir[MAX_PATH_LEN];
+   char *localpath = NULL, *alias_to = NULL;
+   ldcs_cache_result_t result;
+   int errcode = 0;
 
-      if (!ldcs_audit_server_md_is_responsible(procdata, pathname)) {
-         debug_printf3("I am not responsible for preloading directory %s\n", pathname);
+   if (is_dir) {
+      result = ldcs_cache_findDirInCache(pathname);
+      return (result == LDCS_CACHE_DIR_PARSED_AND_EXISTS || result == LDCS_CACHE_DIR_PARSED_AND_NOT_EXISTS);
+   }
+
+   parseFilenameNoAlloc(pathname, file, dir, MAX_PATH_LEN);
+   if (ldcs_cache_findFileDirInCache(file, dir, &localpath, &errcode) != LDCS_CACHE_FILE_FOUND)
+      return 0;
+   if (localpath || errcode)
+      return 1;
+   ldcs_cache_getAlias(file, dir, &alias_to);
+   return alias_to != NULL;
+}
+
+/**
+ * Read and broadcast the next preload entry we're responsible for.
+ **/
+static int handle_preload_next(ldcs_process_data_t *procdata)
+{
+   preload_list_t *list;
+   char pathname[MAX_PATH_LEN+1];
+   int is_dir, result;
+
+   while ((list = procdata->preload_lists)) {
+      result = pathcode_list_next(&list->paths, pathname, sizeof(pathname), &is_dir);
+      if (result == -1)
+         err_printf("Preload list is malformed.  Stopping preload early\n");
+      if (result != 1) {
+         procdata->preload_lists = list->next;
+         pathcode_list_close(&list->paths);
+         free(list->data);
+         free(list);
+         result = handle_preload_done(procdata);
+         if (result == -1) {
+            err_printf("Error from handle_preload_done\n");
+            return -1;
+         }
          continue;
       }
 
-      debug_printf2("Preload read of directory %s\n", pathname);
-      result = handle_read_directory(procdata, pathname);
-      if (result == -1) {
-         err_printf("Error reading directory during preload\n");
-         global_result = -1;
+      if (!ldcs_audit_server_md_is_responsible(procdata, pathname)) {
+         debug_printf3("I am not responsible for preloading %s\n", pathname);
          continue;
       }
-      
-      result = handle_broadcast_dir(procdata, pathname, preload_broadcast);
-      if (result == -1) {
-         err_printf("Error broadcasting directory during preload\n");
-         global_result = -1;
+      if (preload_is_cached(pathname, is_dir)) {
+         debug_printf2("Skipping preload of %s, which is already cached\n", pathname);
          continue;
       }
-   }
-
-   for (i = 0; i<num_files; i++) {
-      assert(cur < msg->header.len);
-      pathname = data + cur;
-      cur += strlen(pathname)+1;
 
-      if (!ldcs_audit_server_md_is_responsible(procdata, pathname)) {
-         debug_printf3("I am not responsible for preloading file %s\n", pathname);
-         continue;
+      if (is_dir) {
+         debug_printf2("Preload read of directory %s\n", pathname);
+         result = handle_read_directory(procdata, pathname);
+         if (result == -1) {
+            err_printf("Error reading directory during preload\n");
+            return -1;
+         }
+         result = handle_broadcast_dir(procdata, pathname, preload_broadcast);
+         if (result == -1) {
+            err_printf("Error broadcasting directory during preload\n");
+            return -1;
+         }
       }
-
-      debug_printf2("Preload read of file %s\n", pathname);
-      result = handle_read_and_broadcast_file(procdata, pathname, preload_broadcast);
-      if (result == -1) {
-         err_printf("Error broadcasting file data during preload\n");
-         global_result = -1;
-         continue;
+      else {
+         debug_printf2("Preload read of file %s\n", pathname);
+         result = handle_read_and_broadcast_file(procdata, pathname, preload_broadcast);
+         if (result == -1) {
+            err_printf("Error broadcasting file data during preload\n");
+            return -1;
+         }
       }
+      return 0;
    }
+   return 0;
+}
 
-   result = handle_preload_done(procdata);
-   if (result == -1) {
-      err_printf("Error from handle_preload_done");
-      global_result = -1;
-   }
+static int handle_preload_idle(void *data)
+{
+   ldcs_process_data_t *procdata = (ldcs_process_data_t *) data;
+   int result;
 
-   return global_result;
+   result = handle_preload_next(procdata);
+   if (procdata->preload_lists)
+      ldcs_listen_request_idle_cb(handle_preload_idle);
+   return result;
 }
 
 static int handle_preload_done(ldcs_process_data_t *procdata)
@@ -1873,6 +2103,7 @@ static int handle_preload_done(ldcs_process_data_t *procdata)
 
    debug_printf2("Handle preload done\n");
    procdata->preload_done = 1;
+   trace_server_event(TRACE_BE_PRELOAD, TRACE_END);
 
    done_msg.header.type = LDCS_MSG_PRELOAD_DONE;
    done_msg.header.len = 0;
@@ -1940,6 +2171,151 @@ static int handle_recv_selfload_file(ldcs_process_data_t *procdata, ldcs_message
    return global_result;
 }
 
+/**
+ * Called on the root server at startup.  Pack the trees under the python
+ * prefixes and push them to every server, so python imports never have to
+ * request modules one at a time.
+ **/
+int handle_pack_python(ldcs_process_data_t *procdata)
+{
+   double starttime = ldcs_get_time();
+   int result;
+
+   debug_printf("Packing python prefixes %s\n", procdata->pythonprefix);
+   result = pypack_build(procdata->pythonprefix, handle_pypack_chunk, procdata);
+   if (result == -1)
+      err_printf("Error packing python prefixes %s\n", procdata->pythonprefix);
+   debug_printf("Packed python prefixes in %.3f seconds\n", ldcs_get_time() - starttime);
+   if (procdata->pypack_pending) {
+      /* The last image never made it out.  Stop holding back requests. */
+      procdata->pypack_pending = 0;
+      if (handle_progress(procdata) == -1)
+         result = -1;
+   }
+   return result;
+}
+
+static int handle_pypack_chunk(char *image, size_t size, void *arg)
+{
+   ldcs_process_data_t *procdata = (ldcs_process_data_t *) arg;
+   ldcs_message_t msg;
+   double starttime;
+   int result, last;
+
+   msg.header.type = LDCS_MSG_PYPACK;
+   msg.header.len = (int) size;
+   msg.data = image;
+
+   starttime = ldcs_get_time();
+   result = spindle_broadcast(procdata, &msg);
+   if (result == -1) {
+      err_printf("Error broadcasting python pack\n");
+      return -1;
+   }
+   procdata->server_stat.libdist.cnt++;
+   procdata->server_stat.libdist.bytes += size;
+   procdata->server_stat.libdist.time += (ldcs_get_time() - starttime);
+
+   /* Files we couldn't store are read on request as usual, so keep packing */
+   handle_pypack_unpack(procdata, image, size, &last);
+   return 0;
+}
+
+/**
+ * Add a python pack's directory listings and files to our cache.  Files
+ * become ordinary local files, since an open() from the application has to
+ * end up with a file of its own.
+ **/
+static int handle_pypack_unpack(ldcs_process_data_t *procdata, char *image, size_t size, int *last)
+{
+   pypack_iter_t iter;
+   char *dir, **names, *pathname, *contents, *localname, *buffer;
+   size_t file_size;
+   int num_names, i, fd, already_loaded, replicate, result, global_result = 0;
+   int num_dirs = 0, num_files = 0;
+   double starttime = ldcs_get_time();
+
+   result = pypack_open(&iter, image, size, last);
+   if (result == -1) {
+      /* We can't tell whether this was the last image, so stop waiting */
+      procdata->pypack_pending = 0;
+      return -1;
+   }
+
+   while (pypack_next_dir(&iter, &dir, &names, &num_names)) {
+      if (ldcs_cache_findDirInCache(dir) == LDCS_CACHE_DIR_NOT_PARSED) {
+         ldcs_cache_addFileDir(dir, dir);
+         for (i = 0; i < num_names; i++)
+            ldcs_cache_addFileDir(dir, names[i]);
+         handle_index_dir(procdata, dir);
+         num_dirs++;
+      }
+      free(names);
+   }
+   procdata->server_stat.distdir.cnt += num_dirs;
+   procdata->server_stat.distdir.time += ldcs_get_time() - starttime;
+
+   starttime = ldcs_get_time();
+   while (pypack_next_file(&iter, &pathname, &contents, &file_size)) {
+      fd = -1;
+      buffer = handle_setup_file_buffer(procdata, pathname, file_size, &fd, &localname,
+                                        &already_loaded, &replicate, is_elf_no);
+      if (!buffer) {
+         if (!already_loaded) {
+            err_printf("Could not allocate space for %s from python pack\n", pathname);
+            global_result = -1;
+         }
+         continue;
+      }
+      memcpy(buffer, contents, file_size);
+      result = handle_finish_buffer_setup(procdata, localname, pathname, &fd, &buffer, file_size,
+                                          file_size, &replicate, 0);
+      if (fd != -1)
+         close(fd);
+      if (result == -1) {
+         global_result = -1;
+         continue;
+      }
+      procdata->server_stat.libstore.bytes += file_size;
+      num_files++;
+   }
+   procdata->server_stat.libstore.cnt += num_files;
+   procdata->server_stat.libstore.time += ldcs_get_time() - starttime;
+
+   debug_printf2("Unpacked %d python directories and %d files%s\n", num_dirs, num_files,
+                 *last ? ", which completes the python pack" : "");
+   if (*last)
+      procdata->pypack_pending = 0;
+   return global_result;
+}
+
+/**
+ * A parent server sent part of the python pack.  Pass it on before
+ * unpacking, so our children can work on it at the same time.
+ **/
+static int handle_pypack_recv(ldcs_process_data_t *procdata, ldcs_message_t *msg)
+{
+   int result, global_result = 0, last = 0, was_pending = procdata->pypack_pending;
+
+   debug_printf("Receiving python pack of %d bytes\n", msg->header.len);
+   result = spindle_broadcast(procdata, msg);
+   if (result == -1) {
+      err_printf("Error forwarding python pack\n");
+      global_result = -1;
+   }
+
+   result = handle_pypack_unpack(procdata, msg->data, msg->header.len, &last);
+   if (result == -1)
+      global_result = -1;
+
+   if (was_pending && !procdata->pypack_pending) {
+      result = handle_progress(procdata);
+      if (result == -1)
+         global_result = -1;
+   }
+   return global_result;
+}
+
 static int handle_report_fileexist_result(ldcs_process_data_t *procdata, int nc, exist_t res)
 {
    ldcs_message_t out_msg;
@@ -1952,6 +2328,7 @@ static int handle_report_fileexist_result(ldcs_process_data_t *procdata, int nc,
       return 0;
 
    query_result = (res == exists ? 1 : 0);
+   log_warm_answer(procdata, client, "&", query_result ? "y" : "n");
 
    out_msg.header.type = LDCS_MSG_EXISTS_ANSWER;
    out_msg.header.len = sizeof(query_result);
@@ -2045,6 +2422,7 @@ static int handle_client_fileexist_msg(ldcs_process_data_t *procdata, int nc, ld
 
    client->query_open = 1;
    client->existance_query = 1;
+   set_query_rawpath(procdata, client, msg->data);
    
    debug_printf("Server recvd existance query for %s.", client->query_globalpath);
    return handle_client_progress(procdata, nc);
@@ -2095,6 +2473,243 @@ static int handle_client_origpath_msg(ldcs_process_data_t *procdata, int nc, ldc
    return result;
 }
 
+/**
+ * Client wants to search an ordered list of directories for a file: a bare
+ * soname the way ld.so would (LDCS_MSG_SONAME_QUERY), or an executable the
+ * way execvp would (LDCS_MSG_EXECPATH_QUERY).  The message holds the name
+ * followed by the NUL-separated directories.
+ **/
+static int handle_client_search_msg(ldcs_process_data_t *procdata, int nc, ldcs_message_t *msg)
+{
+   ldcs_client_t *client;
+   int name_len;
+
+   assert(nc != -1);
+   client = procdata->client_table + nc;
+   client->soname_query = (msg->header.type == LDCS_MSG_SONAME_QUERY);
+   client->execpath_query = (msg->header.type == LDCS_MSG_EXECPATH_QUERY);
+   client->execpath_found = 0;
+   client->search_denied = 0;
+
+   name_len = strnlen(msg->data, msg->header.len) + 1;
+   if (name_len > msg->header.len || name_len > MAX_NAME_LEN+1) {
+      err_printf("Malformed search query from client %d\n", nc);
+      return handle_report_search_result(procdata, nc, ENOTSUP, NULL);
+   }
+
+   strncpy(client->query_filename, msg->data, MAX_PATH_LEN);
+   client->search_dirs_len = msg->header.len - name_len;
+   client->search_dirs = (char *) malloc(client->search_dirs_len + 1);
+   memcpy(client->search_dirs, msg->data + name_len, client->search_dirs_len);
+   client->search_dirs[client->search_dirs_len] = '\0';
+   client->search_pos = 0;
+
+   client->query_open = 1;
+
+   debug_printf("Server recvd %s query for %s\n", client->soname_query ? "soname" : "execpath",
+                client->query_filename);
+   return handle_client_progress(procdata, nc);
+}
+
+/**
+ * Walk a soname query's directories in order, reading or requesting their
+ * listings as needed, and answer with the first directory holding the
+ * library.  ld.so also probes hardware-capability subdirectories of each
+ * search directory; if one exists we can't predict which it would pick,
+ * so we decline and let the client fall back to ld.so's own search.
+ *
+ * The subdirectory names are x86_64's (the glibc-hwcaps root, and the
+ * legacy tls and platform directories).  Other architectures have their
+ * own, so there every search is declined.
+ **/
+static int handle_soname_search(ldcs_process_data_t *procdata, int nc)
+{
+#if !defined(__x86_64__)
+   return handle_report_search_result(procdata, nc, ENOTSUP, NULL);
+#else
+   static char *hwcap_subdirs[] = { "glibc-hwcaps", "tls", "haswell", "xeon_phi", "x86_64", "avx512_1", NULL };
+   ldcs_client_t *client = procdata->client_table + nc;
+   char dir[MAX_PATH_LEN+1];
+   char path[MAX_PATH_LEN+1];
+   char *localpath;
+   int errcode, result, i;
+   ldcs_cache_result_t cache_result;
+
+   while (client->search_pos < client->search_dirs_len) {
+      strncpy(dir, client->search_dirs + client->search_pos, MAX_PATH_LEN);
+      dir[MAX_PATH_LEN] = '\0';
+      reducePath(dir);
+
+      switch (dir[0] ? handle_howto_directory(procdata, dir) : NO_FILE) {
+         case READ_DIRECTORY:
+            result = handle_read_and_broadcast_dir(procdata, dir);
+            if (result == -1) {
+               err_printf("Error reading and broadcasting directory %s\n", dir);
+               return -1;
+            }
+            continue;
+         case REQ_DIRECTORY:
+            result = handle_send_query(procdata, dir, 1);
+            add_requestor(procdata->pending_requests, dir, NODE_PEER_CLIENT);
+            return result;
+         case FOUND_FILE:
+            for (i = 0; hwcap_subdirs[i]; i++) {
+               localpath = NULL;
+               if (ldcs_cache_findFileDirInCache(hwcap_subdirs[i], dir, &localpath, &errcode) == LDCS_CACHE_FILE_FOUND) {
+                  debug_printf2("Search directory %s has a %s subdirectory.  Declining soname search\n",
+                                dir, hwcap_subdirs[i]);
+                  return handle_report_search_result(procdata, nc, ENOTSUP, NULL);
+               }
+            }
+            localpath = NULL;
+            errcode = 0;
+            cache_result = ldcs_cache_findFileDirInCache(client->query_filename, dir, &localpath, &errcode);
+            if (cache_result == LDCS_CACHE_FILE_FOUND && !errcode) {
+               GCC7_DISABLE_WARNING("-Wformat-truncation");
+               snprintf(path, sizeof(path), "%s/%s", dir, client->query_filename);
+               GCC7_ENABLE_WARNING;
+               return handle_report_search_result(procdata, nc, 0, path);
+            }
+            break;
+         default:
+            break;
+      }
+      client->search_pos += strlen(client->search_dirs + client->search_pos) + 1;
+   }
+   return handle_report_search_result(procdata, nc, ENOENT, NULL);
+#endif
+}
+
+/**
+ * Walk an execpath query's directories in order, like execvp, and pick the
+ * first one holding an executable regular file with the query's name.  The
+ * hit is then fetched like a normal file query, and the client is answered
+ * with its local path.  Directory listings and stats are read or requested
+ * as needed, resuming here when they arrive.
+ **/
+static int handle_execpath_search(ldcs_process_data_t *procdata, int nc)
+{
+   ldcs_client_t *client = procdata->client_table + nc;
+   char dir[MAX_PATH_LEN+1];
+   char path[MAX_PATH_LEN+1];
+   char *localpath, *statfile;
+   struct stat buf;
+   int errcode, result;
+
+   while (client->search_pos < client->search_dirs_len) {
+      strncpy(dir, client->search_dirs + client->search_pos, MAX_PATH_LEN);
+      dir[MAX_PATH_LEN] = '\0';
+      reducePath(dir);
+
+      switch (dir[0] ? handle_howto_directory(procdata, dir) : NO_FILE) {
+         case READ_DIRECTORY:
+            result = handle_read_and_broadcast_dir(procdata, dir);
+            if (result == -1) {
+               err_printf("Error reading and broadcasting directory %s\n", dir);
+               return -1;
+            }
+            continue;
+         case REQ_DIRECTORY:
+            result = handle_send_query(procdata, dir, 1);
+            add_requestor(procdata->pending_requests, dir, NODE_PEER_CLIENT);
+            return result;
+         case FOUND_FILE:
+            localpath = NULL;
+            errcode = 0;
+            if (ldcs_cache_findFileDirInCache(client->query_filename, dir, &localpath, &errcode) != LDCS_CACHE_FILE_FOUND)
+               break;
+
+            GCC7_DISABLE_WARNING("-Wformat-truncation");
+            snprintf(path, sizeof(path), "%s/%s", dir, client->query_filename);
+            GCC7_ENABLE_WARNING;
+            switch (handle_howto_metadata(procdata, path, metadata_stat)) {
+               case REQUEST_METADATA:
+                  return handle_metadata_request(procdata, path, metadata_stat, NODE_PEER_CLIENT);
+               case METADATA_IN_PROGRESS:
+                  add_requestor(metadata_pending_requests(procdata, metadata_stat), path, NODE_PEER_CLIENT);
+                  return 0;
+               case METADATA_FILE:
+                  add_requestor(metadata_pending_requests(procdata, metadata_stat), path, NODE_PEER_CLIENT);
+                  result = handle_metadata_and_broadcast_file(procdata, path, metadata_stat, request_broadcast);
+                  if (result == -1)
+                     return -1;
+                  continue;
+               case REPORT_METADATA:
+                  break;
+            }
+
+            lookup_stat_cache(path, &statfile, metadata_stat);
+            if (!statfile || filemngt_read_stat(statfile, &buf) == -1)
+               break;
+            if (S_ISDIR(buf.st_mode) || !(buf.st_mode & 0111)) {
+               debug_printf3("Skipping %s in execpath search: not an executable file\n", path);
+               client->search_denied = 1;
+               break;
+            }
+
+            debug_printf2("Execpath search for %s found %s\n", client->query_filename, path);
+            strncpy(client->query_dirname, dir, MAX_PATH_LEN+1);
+            strncpy(client->query_globalpath, path, MAX_PATH_LEN+1);
+            client->query_localpath = NULL;
+            client->execpath_found = 1;
+            return handle_client_progress(procdata, nc);
+         default:
+            break;
+      }
+      client->search_pos += strlen(client->search_dirs + client->search_pos) + 1;
+   }
+   return handle_report_search_result(procdata, nc, client->search_denied ? EACCES : ENOENT, NULL);
+}
+
+/**
+ * Answer a soname or execpath query with an errcode and the path that was
+ * found, if any.  An execpath answer can carry both a path and EACCES for a
+ * file that has to be run from its original location.
+ **/
+static int handle_report_search_result(ldcs_process_data_t *procdata, int nc, int errcode, char *path)
+{
+   ldcs_message_t out_msg;
+   char buffer[MAX_PATH_LEN+1];
+   int result, len = sizeof(int);
+   ldcs_client_t *client = procdata->client_table + nc;
+   int connid = client->connid;
+
+   if (path) {
+      len += strlen(path) + 1;
+      if (len > (int) sizeof(buffer)) {
+         errcode = ENOTSUP;
+         len = sizeof(int);
+         path = NULL;
+      }
+      else
+         strcpy(buffer + sizeof(int), path);
+   }
+   memcpy(buffer, &errcode, sizeof(int));
+   debug_printf("Responding to %s query for %s with %s (errcode %d)\n",
+                client->execpath_query ? "execpath" : "soname", client->query_filename,
+                path ? path : "no file", errcode);
+
+   result = 0;
+   if (client->state == LDCS_CLIENT_STATUS_ACTIVE && connid >= 0) {
+      out_msg.header.type = client->execpath_query ? LDCS_MSG_EXECPATH_ANSWER : LDCS_MSG_SONAME_ANSWER;
+      out_msg.header.len = len;
+      out_msg.data = buffer;
+      result = ldcs_send_msg(connid, &out_msg);
+
+      if (client->execpath_found && !errcode && path) {
+         /* An execpath hit was fetched like a file query, so count it as one */
+         note_file_answer(procdata, client);
+      }
+      else {
+         procdata->server_stat.clientmsg.cnt++;
+         procdata->server_stat.clientmsg.time += ldcs_get_time() - client->query_arrival_time;
+      }
+   }
+
+   handle_close_client_query(procdata, nc);
+   return result;
+}
+
 /**
  * Stats a file and put into file cache.  Distribute on network if necessary
  **/
@@ -2458,6 +3073,11 @@ static int handle_client_metadata_result(ldcs_process_data_t *procdata, int nc,
       return 0;
    }
    
+   if (mdtype == metadata_stat || mdtype == metadata_lstat)
+      log_warm_answer(procdata, client, mdtype == metadata_lstat ? "**" : "*", localpath ? localpath : "");
+   else if (localpath)
+      log_warm_answer(procdata, client, "LDSOINFO:", localpath);
+
    msg.header.type = (mdtype == metadata_stat || mdtype == metadata_lstat) ? LDCS_MSG_STAT_ANSWER : LDCS_MSG_LOADER_DATA_RESP;
    msg.header.len = localpath ? strlen(localpath)+1 : 0;
    msg.data = localpath;
@@ -2630,6 +3250,12 @@ static int handle_send_exit_ready_if_done(ldcs_process_data_t *procdata)
    msg.data = NULL;
    procdata->sent_exit_ready = 1;
 
+   trace_server_event(TRACE_BE_EXIT_READY, TRACE_INSTANT);
+   if (procdata->opts & OPT_TRACE)
+      handle_send_trace(procdata);
+   if (procdata->opts & OPT_FILESTATS)
+      handle_send_filestats(procdata);
+
    if (ldcs_audit_server_md_is_responsible(procdata, "")) {
       debug_printf2("Messaging FE that we're ready to exit\n");
       ldcs_audit_server_md_to_frontend(procdata, &msg);
@@ -2644,6 +3270,67 @@ static int handle_send_exit_ready_if_done(ldcs_process_data_t *procdata)
    }
 }
 
+/**
+ * Send our trace and our children's up toward the FE.  This goes just
+ * ahead of our exit ready, by which time all our clients and children have
+ * sent theirs.
+ **/
+static int handle_send_trace(ldcs_process_data_t *procdata)
+{
+   ldcs_message_t msg;
+   size_t size;
+   int result;
+
+   msg.data = (char *) trace_pack(procdata->md_rank, procdata->hostname, &size);
+   if (!msg.data) {
+      err_printf("Could not allocate trace message\n");
+      return -1;
+   }
+   msg.header.type = LDCS_MSG_TRACE_DATA;
+   msg.header.len = (int) size;
+
+   if (ldcs_audit_server_md_is_responsible(procdata, "")) {
+      debug_printf("Sending %lu bytes of trace data to FE\n", (unsigned long) size);
+      result = ldcs_audit_server_md_to_frontend(procdata, &msg);
+   }
+   else {
+      debug_printf2("Sending %lu bytes of trace data to parent\n", (unsigned long) size);
+      result = spindle_forward_query(procdata, &msg);
+   }
+   free(msg.data);
+   return result;
+}
+
+/**
+ * Send the file statistics of our subtree up toward the FE, just ahead
+ * of our exit ready like the trace.
+ **/
+static int handle_send_filestats(ldcs_process_data_t *procdata)
+{
+   ldcs_message_t msg;
+   size_t size;
+   int result;
+
+   msg.data = (char *) filestats_pack(&size);
+   if (!msg.data) {
+      err_printf("Could not allocate file statistics message\n");
+      return -1;
+   }
+   msg.header.type = LDCS_MSG_FILESTATS;
+   msg.header.len = (int) size;
+
+   if (ldcs_audit_server_md_is_responsible(procdata, "")) {
+      debug_printf("Sending %lu bytes of file statistics to FE\n", (unsigned long) size);
+      result = ldcs_audit_server_md_to_frontend(procdata, &msg);
+   }
+   else {
+      debug_printf2("Sending %lu bytes of file statistics to parent\n", (unsigned long) size);
+      result = spindle_forward_query(procdata, &msg);
+   }
+   free(msg.data);
+   return result;
+}
+
 /** 
  * We've recvd an exit ready message from a child.  Update our count
  * and trigger see if that makes us exit ready.
@@ -2698,17 +3385,234 @@ static int handle_send_exit_cancel(ldcs_process_data_t *procdata)
    return spindle_forward_query(procdata, &msg);
 }
 
+/**
+ * Pass a change in the number of drained servers, those whose clients
+ * have all exited, up toward the FE.  A server is drained when its last
+ * client exits and undrained if a new one starts.  The FE adds up the
+ * changes and starts its drain timeout once at least half the servers are
+ * drained.
+ **/
+static int handle_send_exit_draining(ldcs_process_data_t *procdata, int32_t change)
+{
+   ldcs_message_t msg;
+   int result;
+
+   msg.header.type = LDCS_MSG_EXIT_DRAINING;
+   msg.header.len = sizeof(change);
+   msg.data = (char *) &change;
+
+   if (ldcs_audit_server_md_is_responsible(procdata, "")) {
+      debug_printf2("Telling FE that %d servers changed their draining state\n", (int) change);
+      return ldcs_audit_server_md_to_frontend(procdata, &msg);
+   }
+   debug_printf2("Sending exit draining change of %d to parent\n", (int) change);
+   result = spindle_forward_query(procdata, &msg);
+   msgbundle_force_flush(procdata);
+   return result;
+}
+
+static int handle_exit_draining_msg(ldcs_process_data_t *procdata, ldcs_message_t *msg)
+{
+   int32_t change;
+
+   if (msg->header.len != sizeof(change)) {
+      err_printf("Unexpected exit draining message\n");
+      return 0;
+   }
+   memcpy(&change, msg->data, sizeof(change));
+   return handle_send_exit_draining(procdata, change);
+}
+
+/**
+ * Add the stragglers in from to the exit status in to.
+ **/
+static void merge_exit_status(exit_status_t *to, const exit_status_t *from)
+{
+   int i;
+   to->num_stragglers += from->num_stragglers;
+   for (i = 0; i < from->num_listed && to->num_listed < EXIT_STATUS_MAX_LISTED; i++)
+      to->listed[to->num_listed++] = from->listed[i];
+}
+
+static int handle_send_exit_status(ldcs_process_data_t *procdata)
+{
+   ldcs_message_t msg;
+   int result;
+
+   msg.header.type = LDCS_MSG_EXIT_STATUS;
+   msg.header.len = sizeof(exit_status_t);
+   msg.data = (char *) procdata->exit_status;
+
+   if (ldcs_audit_server_md_is_responsible(procdata, "")) {
+      debug_printf("Sending exit status with %d stragglers to FE\n", procdata->exit_status->num_stragglers);
+      result = ldcs_audit_server_md_to_frontend(procdata, &msg);
+   }
+   else {
+      debug_printf2("Sending exit status with %d stragglers to parent\n", procdata->exit_status->num_stragglers);
+      result = spindle_forward_query(procdata, &msg);
+      msgbundle_force_flush(procdata);
+   }
+   free(procdata->exit_status);
+   procdata->exit_status = NULL;
+   return result;
+}
+
+/* Bitmaps over our children, by their index from the md layer */
+#define CHILD_BITMAP_BYTES(NUM) (((NUM) + 7) / 8)
+#define CHILD_BIT_TEST(BITS, I) ((BITS)[(I) / 8] & (1 << ((I) % 8)))
+#define CHILD_BIT_SET(BITS, I) ((BITS)[(I) / 8] |= (unsigned char) (1 << ((I) % 8)))
+
+/**
+ * The FE wants to know which servers are holding up exit.  Start a
+ * reduction of exit status over our subtree with our own.
+ *
+ * A hung server never answers, so children that hadn't answered the
+ * previous request by the time this one arrives are not waited for this
+ * time, whether that reduction finished without them or is abandoned now.
+ * They're reported as unanswered under our own entry, which points the FE
+ * at the subtree with the hung server.  One that answers after all is
+ * waited for again next time.
+ **/
+static int handle_exit_status_req(ldcs_process_data_t *procdata, ldcs_message_t *msg)
+{
+   exit_straggler_t *self;
+   uint32_t seq = 0;
+   int num_children, unanswered, i, result;
+
+   if (msg->header.len == sizeof(uint32_t))
+      memcpy(&seq, msg->data, sizeof(seq));
+
+   if (procdata->exit_status) {
+      debug_printf("Exit status request %u replaces %u, which %d children did not answer\n",
+                   seq, procdata->exit_status_seq, procdata->exit_status_pending);
+      free(procdata->exit_status);
+      procdata->exit_status = NULL;
+   }
+
+   num_children = ldcs_audit_server_md_get_num_children(procdata);
+   if (num_children && !procdata->exit_status_answered) {
+      /* Nobody is skipped on the first request */
+      procdata->exit_status_answered = (unsigned char *) malloc(CHILD_BITMAP_BYTES(num_children));
+      procdata->exit_status_skipped = (unsigned char *) malloc(CHILD_BITMAP_BYTES(num_children));
+      memset(procdata->exit_status_answered, 0xff, CHILD_BITMAP_BYTES(num_children));
+   }
+   unanswered = 0;
+   if (num_children) {
+      memset(procdata->exit_status_skipped, 0, CHILD_BITMAP_BYTES(num_children));
+      for (i = 0; i < num_children; i++) {
+         if (!CHILD_BIT_TEST(procdata->exit_status_answered, i)) {
+            CHILD_BIT_SET(procdata->exit_status_skipped, i);
+            unanswered++;
+         }
+      }
+      memset(procdata->exit_status_answered, 0, CHILD_BITMAP_BYTES(num_children));
+   }
+
+   procdata->exit_status_seq = seq;
+   procdata->exit_status = (exit_status_t *) calloc(1, sizeof(exit_status_t));
+   procdata->exit_status->seq = seq;
+   if (procdata->clients_live || unanswered ||
+       ((procdata->opts & OPT_BEEXIT) && !procdata->exit_note_done)) {
+      self = procdata->exit_status->listed;
+      self->md_rank = procdata->md_rank;
+      self->clients_live = procdata->clients_live;
+      self->waiting_for_note = (procdata->opts & OPT_BEEXIT) && !procdata->exit_note_done;
+      self->children_unanswered = unanswered;
+      strncpy(self->hostname, procdata->hostname ? procdata->hostname : "", sizeof(self->hostname) - 1);
+      procdata->exit_status->num_stragglers = 1 + unanswered;
+      procdata->exit_status->num_listed = 1;
+   }
+
+   result = 0;
+   if (num_children) {
+      result = spindle_broadcast(procdata, msg);
+      msgbundle_force_flush(procdata);
+   }
+   procdata->exit_status_pending = num_children - unanswered;
+   if (!procdata->exit_status_pending)
+      return handle_send_exit_status(procdata) == -1 ? -1 : result;
+   return result;
+}
+
+static int handle_exit_status_msg(ldcs_process_data_t *procdata, ldcs_message_t *msg, node_peer_t peer)
+{
+   exit_status_t *status = (exit_status_t *) msg->data;
+   int child;
+
+   if (msg->header.len != sizeof(exit_status_t)) {
+      err_printf("Unexpected exit status message\n");
+      return 0;
+   }
+   if (status->seq != procdata->exit_status_seq) {
+      debug_printf2("Dropping exit status for old request %u\n", status->seq);
+      return 0;
+   }
+   child = ldcs_audit_server_md_get_child_index(procdata, peer);
+   if (child == -1 || !procdata->exit_status_answered) {
+      err_printf("Exit status for request %u from a server that isn't our child\n", status->seq);
+      return 0;
+   }
+   if (CHILD_BIT_TEST(procdata->exit_status_answered, child)) {
+      debug_printf2("Dropping repeated exit status from child %d\n", child);
+      return 0;
+   }
+   CHILD_BIT_SET(procdata->exit_status_answered, child);
+   if (CHILD_BIT_TEST(procdata->exit_status_skipped, child) || !procdata->exit_status) {
+      /* A child we stopped waiting for answered after all */
+      debug_printf2("Late exit status for request %u from child %d\n", status->seq, child);
+      return 0;
+   }
+   merge_exit_status(procdata->exit_status, status);
+   if (--procdata->exit_status_pending > 0)
+      return 0;
+   return handle_send_exit_status(procdata);
+}
+
 static int handle_close_client_query(ldcs_process_data_t *procdata, int nc)
 {
    ldcs_client_t *client = procdata->client_table + nc;
    client->query_open = 0;
    client->existance_query = 0;
+   client->soname_query = 0;
+   client->execpath_query = 0;
+   client->execpath_found = 0;
+   if (client->search_dirs) {
+      free(client->search_dirs);
+      client->search_dirs = NULL;
+   }
    client->query_is_numa_replicated = 0;
+   client->query_wants_fd = 0;
+   client->query_rawpath[0] = '\0';
    client->is_stat = 0;
    client->query_globalpath[0] = client->query_filename[0] = client->query_dirname[0] = client->query_aliasfrom[0] = '\0';   
    return 0;   
 }
 
+/**
+ * Remember the path a client asked about if its answer can go in the
+ * warm cache.  Relative paths depend on the client's cwd, and local names
+ * remapped to global ones only make sense to this job.
+ **/
+static void set_query_rawpath(ldcs_process_data_t *procdata, ldcs_client_t *client, const char *pathname)
+{
+   client->query_rawpath[0] = '\0';
+   if (!procdata->warmcache || !pathname || pathname[0] != '/' || strlen(pathname) > MAX_PATH_LEN)
+      return;
+   strcpy(client->query_rawpath, pathname);
+}
+
+/**
+ * Log an answer sent to a client, under the key the client would use in
+ * its shmcache, so the next job in this session can find it without us.
+ **/
+static void log_warm_answer(ldcs_process_data_t *procdata, ldcs_client_t *client, const char *prefix, const char *value)
+{
+   if (!procdata->warmcache || !client->query_rawpath[0])
+      return;
+   if (warmcache_log_add(procdata->warmcache, prefix, client->query_rawpath, value) == -1)
+      debug_printf3("Warm cache is full.  Not logging %s%s\n", prefix, client->query_rawpath);
+}
+
 /**
  * We got pinged via the spindleExitBE launch API call.
  **/
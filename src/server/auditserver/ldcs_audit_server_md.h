@@ -48,6 +48,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 extern "C" {
 #endif
 
+#include <sys/uio.h>
 #include "ldcs_api.h"
 #include "ldcs_audit_server_process.h"
 
@@ -55,6 +56,7 @@ typedef void* node_peer_t;
 #define NODE_PEER_CLIENT ((node_peer_t) 1)
 #define NODE_PEER_ALL ((node_peer_t) 2)
 #define NODE_PEER_NULL NULL
+#define NODE_PEER_PARENT ((node_peer_t) (long) -3)
 
 /* Any initialization can be done here. */
 int ldcs_audit_server_md_init(unsigned int port, unsigned int num_ports, unique_id_t unique_id, ldcs_process_data_t *data);
@@ -105,6 +107,19 @@ int ldcs_audit_server_md_broadcast_noncontig(ldcs_process_data_t *ldcs_process_d
                                              void *secondary_data, size_t secondary_size);
 
 int ldcs_audit_server_md_get_num_children(ldcs_process_data_t *procdata);
+/* Returns which of our children, from 0 to get_num_children - 1, peer is, or -1 if
+   it isn't one of them. */
+int ldcs_audit_server_md_get_child_index(ldcs_process_data_t *procdata, node_peer_t peer);
+
+/* Used by message bundling.  peer may be a child, NODE_PEER_ALL for every child,
+   or NODE_PEER_PARENT.  send_iov sends msg's header followed by the gathered iov
+   segments as its body, which must add up to msg->header.len.  send_would_block
+   returns true if any of peer's sockets has a full send buffer.  get_rtt returns
+   the transport's smoothed round-trip time to peer in seconds, or -1 if unknown. */
+int ldcs_audit_server_md_send_iov(ldcs_process_data_t *ldcs_process_data, ldcs_message_t *msg,
+                                  node_peer_t peer, struct iovec *iov, int iovcnt);
+int ldcs_audit_server_md_send_would_block(ldcs_process_data_t *ldcs_process_data, node_peer_t peer);
+int ldcs_audit_server_md_get_rtt(ldcs_process_data_t *ldcs_process_data, node_peer_t peer, double *rtt);
 
 #if defined(__cplusplus)
 }
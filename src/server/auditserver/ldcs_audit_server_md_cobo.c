@@ -21,6 +21,11 @@
 #include <sys/inotify.h>
 #include <errno.h>
 #include <assert.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 
 #include "ldcs_api.h"
 #include "ldcs_api_listen.h"
@@ -118,6 +123,11 @@ int ldcs_audit_server_md_init(unsigned int port, unsigned int num_ports,
     
       ldcs_cobo_write_fd(root_fd, &ack, sizeof(ack));
       debug_printf3("sent FE client signal that server are ready %d\n",ack);
+
+      /* and where the tree's bootstrap time went */
+      cobo_open_times_t open_times;
+      cobo_get_open_times(&open_times);
+      ldcs_cobo_write_fd(root_fd, &open_times, sizeof(open_times));
    }
   
    return(rc);
@@ -381,3 +391,97 @@ int ldcs_audit_server_md_get_num_children(ldcs_process_data_t *procdata)
    cobo_get_num_childs(&num_childs);
    return num_childs;
 }
+
+int ldcs_audit_server_md_get_child_index(ldcs_process_data_t *procdata, node_peer_t peer)
+{
+   int i, fd, num_childs = 0;
+
+   cobo_get_num_childs(&num_childs);
+   for (i = 0; i < num_childs; i++) {
+      if (cobo_get_child_socket(i, &fd) == COBO_SUCCESS && fd == (int) (long) peer)
+         return i;
+   }
+   return -1;
+}
+
+/* Returns the i-th socket that a message to peer goes out on, or -1 after the last one */
+static int peer_socket(ldcs_process_data_t *procdata, node_peer_t peer, int i)
+{
+   int fd = -1, num_childs = 0;
+
+   if (peer == NODE_PEER_ALL) {
+      cobo_get_num_childs(&num_childs);
+      if (i < num_childs)
+         cobo_get_child_socket(i, &fd);
+   }
+   else if (peer == NODE_PEER_PARENT) {
+      if (i == 0 && procdata->md_rank != 0)
+         cobo_get_parent_socket(&fd);
+   }
+   else if (i == 0) {
+      fd = (int) (long) peer;
+   }
+   return fd;
+}
+
+int ldcs_audit_server_md_send_iov(ldcs_process_data_t *ldcs_process_data, ldcs_message_t *msg,
+                                  node_peer_t peer, struct iovec *iov, int iovcnt)
+{
+   int fd, i, result, global_result = 0;
+   struct iovec *full_iov;
+
+   full_iov = (struct iovec *) malloc(sizeof(struct iovec) * (iovcnt + 1));
+   full_iov[0].iov_base = msg;
+   full_iov[0].iov_len = sizeof(*msg);
+   memcpy(full_iov + 1, iov, sizeof(struct iovec) * iovcnt);
+
+   for (i = 0; (fd = peer_socket(ldcs_process_data, peer, i)) != -1; i++) {
+      result = ll_writev(fd, full_iov, iovcnt + 1);
+      if (result == -1)
+         global_result = -1;
+   }
+
+   free(full_iov);
+   return global_result;
+}
+
+int ldcs_audit_server_md_send_would_block(ldcs_process_data_t *ldcs_process_data, node_peer_t peer)
+{
+   struct pollfd pfd;
+   int i, result;
+
+   for (i = 0; (pfd.fd = peer_socket(ldcs_process_data, peer, i)) != -1; i++) {
+      pfd.events = POLLOUT;
+      pfd.revents = 0;
+      do {
+         result = poll(&pfd, 1, 0);
+      } while (result == -1 && errno == EINTR);
+      if (result == 0)
+         return 1;
+   }
+   return 0;
+}
+
+int ldcs_audit_server_md_get_rtt(ldcs_process_data_t *ldcs_process_data, node_peer_t peer, double *rtt)
+{
+#if defined(TCP_INFO)
+   struct tcp_info info;
+   socklen_t info_len;
+   int fd, i;
+   unsigned int max_rtt_us = 0;
+
+   for (i = 0; (fd = peer_socket(ldcs_process_data, peer, i)) != -1; i++) {
+      info_len = sizeof(info);
+      if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &info_len) == -1)
+         return -1;
+      if (info.tcpi_rtt > max_rtt_us)
+         max_rtt_us = info.tcpi_rtt;
+   }
+   if (!max_rtt_us)
+      return -1;
+   *rtt = max_rtt_us / 1000000.0;
+   return 0;
+#else
+   return -1;
+#endif
+}
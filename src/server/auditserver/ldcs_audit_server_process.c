@@ -37,6 +37,9 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include "msgbundle.h"
 #include "exitnote.h"
 #include "cleanup_proc.h"
+#include "dirindex.h"
+#include "warmcache.h"
+#include "ldcs_audit_server_trace.h"
 
 //#define GPERFTOOLS
 #if defined(GPERFTOOLS)
@@ -78,7 +81,9 @@ int ldcs_audit_server_network_setup(unsigned int port, unsigned int num_ports, u
    memset(&ldcs_process_data, 0, sizeof(ldcs_process_data));
 
    /* Initialize server->server network */
+   trace_server_event(TRACE_BE_NETWORK, TRACE_BEGIN);
    ldcs_audit_server_md_init(port, num_ports, unique_id, &ldcs_process_data);
+   trace_server_event(TRACE_BE_NETWORK, TRACE_END);
 
    /* Use network to broadcast configuration parameters */
    ldcs_message_t msg;
@@ -86,6 +91,7 @@ int ldcs_audit_server_network_setup(unsigned int port, unsigned int num_ports, u
    msg.header.len = 0;
    msg.data = NULL;
    debug_printf2("Reading setup message from parent\n");
+   trace_server_event(TRACE_BE_SETTINGS, TRACE_BEGIN);
    result = ldcs_audit_server_md_recv_from_parent(&msg);
    if (result == -1) {
       err_printf("Error reading setup message from parent\n");
@@ -97,6 +103,7 @@ int ldcs_audit_server_network_setup(unsigned int port, unsigned int num_ports, u
       err_printf("Error broadcast setup message to children\n");
       return -1;
    }
+   trace_server_event(TRACE_BE_SETTINGS, TRACE_END);
 
    *packed_setup_data = msg.data;
    *data_size = msg.header.len;
@@ -138,6 +145,7 @@ int ldcs_audit_server_process(spindle_args_t *args)
    int serverid, fd;
 
    startprofile(args);
+   trace_server_event(TRACE_BE_SETUP, TRACE_BEGIN);
 
    debug_printf3("Initializing server data structures\n");
    ldcs_process_data.location = args->location;
@@ -149,6 +157,7 @@ int ldcs_audit_server_process(spindle_args_t *args)
    ldcs_process_data.opts = args->opts;
    ldcs_process_data.msgbundle_cache_size_kb = args->bundle_cachesize_kb;
    ldcs_process_data.msgbundle_timeout_ms = args->bundle_timeout_ms;
+   ldcs_process_data.fdpass_limit = (int) args->fdpass_limit;
    ldcs_process_data.pending_requests = new_requestor_list();
    ldcs_process_data.completed_requests = new_requestor_list();
    ldcs_process_data.pending_stat_requests = new_requestor_list();
@@ -159,6 +168,11 @@ int ldcs_audit_server_process(spindle_args_t *args)
    ldcs_process_data.completed_ldso_requests = new_requestor_list();
    ldcs_process_data.handling_bundle = 0;
    ldcs_process_data.exit_note_done = 0;
+   ldcs_process_data.exit_drained = 0;
+   ldcs_process_data.exit_status = NULL;
+   ldcs_process_data.exit_status_seq = 0;
+   ldcs_process_data.exit_status_answered = NULL;
+   ldcs_process_data.exit_status_skipped = NULL;
    
    if (ldcs_process_data.opts & OPT_PULL) {
       debug_printf("Using PULL model\n");
@@ -184,6 +198,7 @@ int ldcs_audit_server_process(spindle_args_t *args)
 
    debug_printf3("Initializing file cache location %s\n", ldcs_process_data.location);
    ldcs_audit_server_filemngt_init(ldcs_process_data.location);
+   cleanup_stale_trash(ldcs_process_data.location);
    if (ldcs_process_data.opts & OPT_PROCCLEAN)
       init_cleanup_proc(ldcs_process_data.location);
 
@@ -214,8 +229,22 @@ int ldcs_audit_server_process(spindle_args_t *args)
    debug_printf3("Initializing cache\n");
    ldcs_cache_init();
 
+   ldcs_process_data.dirindex = dirindex_create(ldcs_process_data.location);
+   if (ldcs_process_data.opts & OPT_PERSIST)
+      ldcs_process_data.warmcache = warmcache_log_create();
+
    msgbundle_init(&ldcs_process_data);
 
+   ldcs_process_data.pypack_pending = ((ldcs_process_data.opts & OPT_PACKPY) &&
+                                       (ldcs_process_data.opts & OPT_RELOCPY) &&
+                                       ldcs_process_data.pythonprefix &&
+                                       ldcs_process_data.pythonprefix[0]);
+   if (ldcs_process_data.pypack_pending && ldcs_process_data.md_rank == 0) {
+      if (handle_pack_python(&ldcs_process_data) == -1)
+         err_printf("Could not distribute the python pack.  Python files will be loaded on request\n");
+   }
+
+   trace_server_event(TRACE_BE_SETUP, TRACE_END);
    return 0;
 }  
 
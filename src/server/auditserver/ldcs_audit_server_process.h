@@ -21,6 +21,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 extern "C" {
 #endif
 
+#include <sys/uio.h>
 #include "ldcs_api.h"
 #include "spindle_launch.h"
 #include "stat_cache.h"   
@@ -88,6 +89,9 @@ struct ldcs_client_struct
   char                 remote_cwd[MAX_PATH_LEN+1];
   int                  query_open;
   int                  existance_query;
+  int                  soname_query;
+  int                  execpath_query;
+  int                  execpath_found;                  /* execpath query is now fetching its hit */
   int                  is_stat;
   int                  is_lstat;   
   int                  is_loader;
@@ -98,13 +102,24 @@ struct ldcs_client_struct
   char                 *query_localpath;                /* path to file in local temporary fs (dirname+filename) */
   char                 query_aliasfrom[MAX_PATH_LEN+2];
   int                  query_is_numa_replicated;
+  int                  query_wants_fd;                  /* pass the client an open fd with the answer */
+  char                 query_rawpath[MAX_PATH_LEN+1];     /* absolute path as the client sent it, for the warm cache */
   double               query_arrival_time;
+  char                 *search_dirs;                    /* NUL-separated dirs for a soname or execpath query */
+  int                  search_dirs_len;
+  int                  search_pos;
+  int                  search_denied;                   /* execpath query saw a non-executable match */
 };
 typedef struct ldcs_client_struct ldcs_client_t;
 
 typedef struct msgbundle_entry_t {
    unsigned char *cache;
-   int position;
+   int position;         /* bytes in the bundle, including file contents not copied into cache */
+   int cache_position;   /* bytes used in cache */
+   struct iovec *iov;    /* segments of the bundle, pointing into cache or at file contents */
+   int iov_count;
+   int target_size;      /* size at which the bundle is sent, adapted from the link's rtt and throughput */
+   double throughput;    /* smoothed bytes per second seen when sending bundles */
    void* node;
    struct msgbundle_entry_t *next;
    char name[16];
@@ -121,11 +136,19 @@ struct ldcs_process_data_struct
   int serverfd;
   int sent_exit_ready;
   int exit_readys_recvd;
+  int exit_drained;
+  int exit_status_pending;
+  unsigned char *exit_status_answered;
+  unsigned char *exit_status_skipped;
+  uint32_t exit_status_seq;
+  exit_status_t *exit_status;
   ldcs_dist_model_t dist_model;
   ldcs_client_t* client_table;
   char *location;
   char *hostname;
   char *pythonprefix;
+  struct dirindex_t *dirindex;
+  struct warmcache_log_t *warmcache;
   char *numa_substrs;
   char *numa_excludes;   
   msgbundle_entry_t *msgbundle_entries;
@@ -134,6 +157,9 @@ struct ldcs_process_data_struct
   int handling_bundle;
   int number;
   int preload_done;
+  struct preload_list_t *preload_lists;
+  int pypack_pending;
+  int fdpass_limit;
   int exit_note_done;
   opt_t opts;
   requestor_list_t pending_requests;
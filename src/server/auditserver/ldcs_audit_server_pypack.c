@@ -0,0 +1,515 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT
+file in the top level directory, or at
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms
+and conditions of the GNU Lesser General Public License for more details.  You should
+have received a copy of the GNU Lesser General Public License along with this
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "ldcs_api.h"
+#include "ldcs_audit_server_pypack.h"
+#include "spindle_debug.h"
+
+#define ALIGN8(X) (((X) + 7) & ~((size_t) 7))
+
+typedef struct {
+   char *path;
+   size_t size;
+} pack_member_t;
+
+typedef struct {
+   char *dirs;
+   size_t dirs_used, dirs_size;
+   uint32_t num_dirs;
+   pack_member_t *files;
+   uint32_t num_files, files_size;
+   size_t paths_size, contents_size;
+   char **tops;
+   int num_tops;
+   pypack_cb_t cb;
+   void *arg;
+} pack_builder_t;
+
+static size_t chunk_size(pack_builder_t *b)
+{
+   return sizeof(pypack_header_t) + b->num_files * sizeof(pypack_file_t) +
+      b->dirs_used + b->paths_size + 8 + b->contents_size;
+}
+
+static int read_member(char *path, char *buffer, size_t size, size_t *bytes_read)
+{
+   ssize_t result;
+   int fd;
+
+   fd = open(path, O_RDONLY);
+   if (fd == -1) {
+      debug_printf("Could not open %s for python pack: %s\n", path, strerror(errno));
+      return -1;
+   }
+   *bytes_read = 0;
+   while (*bytes_read < size) {
+      result = read(fd, buffer + *bytes_read, size - *bytes_read);
+      if (result == -1 && errno == EINTR)
+         continue;
+      if (result == -1) {
+         debug_printf("Could not read %s for python pack: %s\n", path, strerror(errno));
+         close(fd);
+         return -1;
+      }
+      if (result == 0)
+         break;
+      *bytes_read += result;
+   }
+   close(fd);
+   return 0;
+}
+
+/**
+ * Lay out everything collected so far as one image, read the file
+ * contents into it, and hand it to the callback.
+ **/
+static int flush_chunk(pack_builder_t *b, int last)
+{
+   pypack_header_t *header;
+   pypack_file_t *table;
+   char *image;
+   size_t size, pos, data_pos, bytes_read;
+   uint32_t i;
+   int result;
+
+   size = sizeof(pypack_header_t) + b->num_files * sizeof(pypack_file_t);
+   size += b->dirs_used + b->paths_size;
+   data_pos = size = ALIGN8(size);
+   size += b->contents_size;
+
+   image = (char *) malloc(size);
+   if (!image) {
+      err_printf("Could not allocate %lu bytes for python pack\n", (unsigned long) size);
+      return -1;
+   }
+   header = (pypack_header_t *) image;
+   header->magic = PYPACK_MAGIC;
+   header->flags = last ? PYPACK_LAST : 0;
+   header->num_dirs = b->num_dirs;
+   header->num_files = b->num_files;
+   header->dirs_offset = sizeof(pypack_header_t) + b->num_files * sizeof(pypack_file_t);
+   header->image_size = size;
+   table = (pypack_file_t *) (header + 1);
+
+   pos = header->dirs_offset;
+   memcpy(image + pos, b->dirs, b->dirs_used);
+   pos += b->dirs_used;
+
+   for (i = 0; i < b->num_files; i++) {
+      size_t path_len = strlen(b->files[i].path) + 1;
+      memcpy(image + pos, b->files[i].path, path_len);
+      table[i].path = pos;
+      pos += path_len;
+
+      result = read_member(b->files[i].path, image + data_pos, b->files[i].size, &bytes_read);
+      table[i].offset = result == -1 ? 0 : data_pos;
+      table[i].size = result == -1 ? 0 : bytes_read;
+      data_pos += ALIGN8(b->files[i].size);
+      free(b->files[i].path);
+   }
+
+   debug_printf2("Packed %u python directories and %u files into %lu bytes\n",
+                 b->num_dirs, b->num_files, (unsigned long) size);
+   result = b->cb(image, size, b->arg);
+   free(image);
+
+   b->dirs_used = 0;
+   b->num_dirs = 0;
+   b->num_files = 0;
+   b->paths_size = 0;
+   b->contents_size = 0;
+   return result;
+}
+
+static int make_room(pack_builder_t *b, size_t needed)
+{
+   if ((b->num_dirs || b->num_files) && chunk_size(b) + needed > PYPACK_CHUNK_SIZE)
+      return flush_chunk(b, 0);
+   return 0;
+}
+
+static int add_listing(pack_builder_t *b, char *dir, char **names, int num_names)
+{
+   size_t len = strlen(dir) + 2;
+   int i;
+
+   for (i = 0; i < num_names; i++)
+      len += strlen(names[i]) + 1;
+   if (make_room(b, len) == -1)
+      return -1;
+
+   if (b->dirs_used + len > b->dirs_size) {
+      while (b->dirs_used + len > b->dirs_size)
+         b->dirs_size = b->dirs_size ? b->dirs_size * 2 : 64*1024;
+      b->dirs = (char *) realloc(b->dirs, b->dirs_size);
+   }
+   strcpy(b->dirs + b->dirs_used, dir);
+   b->dirs_used += strlen(dir) + 1;
+   for (i = 0; i < num_names; i++) {
+      strcpy(b->dirs + b->dirs_used, names[i]);
+      b->dirs_used += strlen(names[i]) + 1;
+   }
+   b->dirs[b->dirs_used++] = '\0';
+   b->num_dirs++;
+   return 0;
+}
+
+static int add_file(pack_builder_t *b, char *path, size_t size)
+{
+   size_t path_len = strlen(path) + 1;
+
+   if (make_room(b, sizeof(pypack_file_t) + path_len + ALIGN8(size)) == -1)
+      return -1;
+   if (b->num_files == b->files_size) {
+      b->files_size = b->files_size ? b->files_size * 2 : 1024;
+      b->files = (pack_member_t *) realloc(b->files, b->files_size * sizeof(pack_member_t));
+   }
+   b->files[b->num_files].path = strdup(path);
+   b->files[b->num_files].size = size;
+   b->num_files++;
+   b->paths_size += path_len;
+   b->contents_size += ALIGN8(size);
+   return 0;
+}
+
+static int is_python_file(const char *name)
+{
+   const char *last_dot = strrchr(name, '.');
+   return last_dot && (strcmp(last_dot, ".py") == 0 ||
+                       strcmp(last_dot, ".pyc") == 0 ||
+                       strcmp(last_dot, ".pyo") == 0);
+}
+
+static int pack_dir(pack_builder_t *b, char *dir)
+{
+   char path[MAX_PATH_LEN+1];
+   char **names = NULL;
+   unsigned char *types = NULL;
+   int num_names = 0, names_size = 0, i, result = 0;
+   struct dirent *dent;
+   struct stat buf;
+   DIR *d;
+
+   d = opendir(dir);
+   if (!d) {
+      debug_printf2("Could not open %s for python pack: %s\n", dir, strerror(errno));
+      return 0;
+   }
+   while ((dent = readdir(d)) != NULL) {
+      if (strcmp(dent->d_name, ".") == 0 || strcmp(dent->d_name, "..") == 0)
+         continue;
+      if (num_names == names_size) {
+         names_size = names_size ? names_size * 2 : 64;
+         names = (char **) realloc(names, names_size * sizeof(char *));
+         types = (unsigned char *) realloc(types, names_size);
+      }
+      names[num_names] = strdup(dent->d_name);
+      types[num_names] = dent->d_type;
+      num_names++;
+   }
+   closedir(d);
+
+   if (add_listing(b, dir, names, num_names) == -1) {
+      result = -1;
+      goto done;
+   }
+
+   for (i = 0; i < num_names; i++) {
+      if (snprintf(path, sizeof(path), "%s/%s", dir, names[i]) >= (int) sizeof(path))
+         continue;
+      if (types[i] == DT_UNKNOWN) {
+         if (lstat(path, &buf) == -1)
+            continue;
+         types[i] = S_ISDIR(buf.st_mode) ? DT_DIR : (S_ISREG(buf.st_mode) ? DT_REG : DT_LNK);
+      }
+
+      if (types[i] == DT_DIR) {
+         result = pack_dir(b, path);
+      }
+      else if (types[i] == DT_REG && is_python_file(names[i])) {
+         /* Symlinks are left for the regular path, which records them as aliases */
+         if (stat(path, &buf) == -1 || buf.st_size > PYPACK_MAX_FILE)
+            continue;
+         result = add_file(b, path, buf.st_size);
+      }
+      if (result == -1)
+         goto done;
+   }
+
+  done:
+   for (i = 0; i < num_names; i++)
+      free(names[i]);
+   free(names);
+   free(types);
+   return result;
+}
+
+static int already_packed(pack_builder_t *b, char *dir)
+{
+   size_t len;
+   int i;
+   for (i = 0; i < b->num_tops; i++) {
+      len = strlen(b->tops[i]);
+      if (strncmp(dir, b->tops[i], len) == 0 && (dir[len] == '/' || dir[len] == '\0'))
+         return 1;
+   }
+   return 0;
+}
+
+/**
+ * A python prefix is a string prefix of paths, so /usr/lib/python3 covers
+ * /usr/lib/python3.11.  Pack every directory in the prefix's parent that
+ * matches it.
+ **/
+static int pack_prefix(pack_builder_t *b, char *prefix)
+{
+   char parent[MAX_PATH_LEN+1], path[MAX_PATH_LEN+1];
+   char *last_slash, *base;
+   size_t base_len;
+   struct dirent *dent;
+   struct stat buf;
+   DIR *d;
+   int result = 0;
+
+   last_slash = strrchr(prefix, '/');
+   if (prefix[0] != '/' || !last_slash || strlen(prefix) == 1) {
+      debug_printf("Not packing python prefix %s, which isn't an absolute directory\n", prefix);
+      return 0;
+   }
+   if (last_slash == prefix)
+      strcpy(parent, "/");
+   else {
+      memcpy(parent, prefix, last_slash - prefix);
+      parent[last_slash - prefix] = '\0';
+   }
+   base = last_slash + 1;
+   base_len = strlen(base);
+
+   d = opendir(parent);
+   if (!d) {
+      debug_printf("Could not open %s to find python prefix %s\n", parent, prefix);
+      return 0;
+   }
+   while ((dent = readdir(d)) != NULL && result != -1) {
+      if (strncmp(dent->d_name, base, base_len) != 0 || dent->d_name[0] == '.')
+         continue;
+      snprintf(path, sizeof(path), "%s%s%s", parent, strcmp(parent, "/") == 0 ? "" : "/", dent->d_name);
+      if (lstat(path, &buf) == -1 || !S_ISDIR(buf.st_mode) || already_packed(b, path))
+         continue;
+      debug_printf("Packing python tree %s\n", path);
+      b->tops = (char **) realloc(b->tops, (b->num_tops + 1) * sizeof(char *));
+      b->tops[b->num_tops++] = strdup(path);
+      result = pack_dir(b, path);
+   }
+   closedir(d);
+   return result;
+}
+
+/**
+ * Walk the directories under the colon-separated python prefixes and pass
+ * each finished image to cb.  cb is always called at least once, with the
+ * last image marked PYPACK_LAST.  That holds on errors too, so receivers
+ * stop waiting for the pack: whatever wasn't sent is dropped and an empty
+ * last image goes out instead.
+ **/
+int pypack_build(char *prefixes, pypack_cb_t cb, void *arg)
+{
+   pack_builder_t b;
+   char prefix[MAX_PATH_LEN+1];
+   char *cur, *end;
+   size_t len;
+   int i, result = 0;
+
+   memset(&b, 0, sizeof(b));
+   b.cb = cb;
+   b.arg = arg;
+
+   for (cur = prefixes; *cur && result != -1; cur = *end ? end + 1 : end) {
+      end = strchr(cur, ':');
+      if (!end)
+         end = cur + strlen(cur);
+      len = end - cur;
+      if (!len || len > MAX_PATH_LEN)
+         continue;
+      memcpy(prefix, cur, len);
+      prefix[len] = '\0';
+      while (len > 1 && prefix[len-1] == '/')
+         prefix[--len] = '\0';
+      result = pack_prefix(&b, prefix);
+   }
+   if (result != -1) {
+      result = flush_chunk(&b, 1);
+   }
+   else {
+      err_printf("Error building python pack.  Sending an empty last image\n");
+      for (i = 0; i < (int) b.num_files; i++)
+         free(b.files[i].path);
+      b.dirs_used = 0;
+      b.num_dirs = 0;
+      b.num_files = 0;
+      b.paths_size = 0;
+      b.contents_size = 0;
+      flush_chunk(&b, 1);
+   }
+
+   free(b.files);
+   for (i = 0; i < b.num_tops; i++)
+      free(b.tops[i]);
+   free(b.tops);
+   free(b.dirs);
+   return result;
+}
+
+/**
+ * Returns the offset just past the NUL ending the string at pos, or 0 if
+ * the string runs off the end of the image.
+ **/
+static size_t string_end(const char *image, size_t size, size_t pos)
+{
+   const char *nul;
+   if (pos >= size)
+      return 0;
+   nul = (const char *) memchr(image + pos, 0, size - pos);
+   return nul ? (size_t) (nul - image) + 1 : 0;
+}
+
+/**
+ * Check that every listing and file entry lies inside the image, so the
+ * iterators below never read past it.
+ **/
+static int check_image(const char *image, size_t size)
+{
+   const pypack_header_t *header = (const pypack_header_t *) image;
+   const pypack_file_t *table = (const pypack_file_t *) (header + 1);
+   size_t pos, tables_end;
+   uint32_t i;
+
+   tables_end = sizeof(pypack_header_t) + header->num_files * sizeof(pypack_file_t);
+   if (header->dirs_offset < tables_end || header->dirs_offset > size)
+      return -1;
+   if (header->num_dirs > size - header->dirs_offset)
+      return -1;
+
+   pos = header->dirs_offset;
+   for (i = 0; i < header->num_dirs; i++) {
+      pos = string_end(image, size, pos);
+      if (!pos)
+         return -1;
+      while (pos < size && image[pos]) {
+         pos = string_end(image, size, pos);
+         if (!pos)
+            return -1;
+      }
+      if (pos >= size)
+         return -1;
+      pos++;
+   }
+
+   for (i = 0; i < header->num_files; i++) {
+      if (!string_end(image, size, table[i].path))
+         return -1;
+      if (table[i].offset && (table[i].offset > size || table[i].size > size - table[i].offset))
+         return -1;
+   }
+   return 0;
+}
+
+/**
+ * Check an image received off the network and set up to walk its
+ * directories and then its files.
+ **/
+int pypack_open(pypack_iter_t *iter, char *image, size_t size, int *last)
+{
+   pypack_header_t *header = (pypack_header_t *) image;
+
+   if (size < sizeof(pypack_header_t) || header->magic != PYPACK_MAGIC ||
+       header->image_size != size ||
+       header->num_files > (size - sizeof(pypack_header_t)) / sizeof(pypack_file_t) ||
+       check_image(image, size) == -1) {
+      err_printf("Received a malformed python pack of size %lu\n", (unsigned long) size);
+      return -1;
+   }
+   iter->image = image;
+   iter->size = size;
+   iter->cur_dir = 0;
+   iter->cur_file = 0;
+   iter->pos = header->dirs_offset;
+   *last = (header->flags & PYPACK_LAST) ? 1 : 0;
+   return 0;
+}
+
+/**
+ * Return the next directory listing, with names in a malloc'd array that
+ * points into the image.  Returns 0 after the last one.
+ **/
+int pypack_next_dir(pypack_iter_t *iter, char **dir, char ***names, int *num_names)
+{
+   pypack_header_t *header = (pypack_header_t *) iter->image;
+   size_t pos, count = 0;
+
+   if (iter->cur_dir == header->num_dirs)
+      return 0;
+   *dir = iter->image + iter->pos;
+   pos = iter->pos + strlen(*dir) + 1;
+   while (iter->image[pos]) {
+      pos += strlen(iter->image + pos) + 1;
+      count++;
+   }
+
+   *names = count ? (char **) malloc(count * sizeof(char *)) : NULL;
+   *num_names = 0;
+   pos = iter->pos + strlen(*dir) + 1;
+   while (iter->image[pos]) {
+      (*names)[(*num_names)++] = iter->image + pos;
+      pos += strlen(iter->image + pos) + 1;
+   }
+   iter->pos = pos + 1;
+   iter->cur_dir++;
+   return 1;
+}
+
+/**
+ * Return the next file and its contents in the image.  Files that couldn't
+ * be read when the image was built are skipped.  Returns 0 after the last one.
+ **/
+int pypack_next_file(pypack_iter_t *iter, char **path, char **contents, size_t *size)
+{
+   pypack_header_t *header = (pypack_header_t *) iter->image;
+   pypack_file_t *table = (pypack_file_t *) (header + 1);
+   pypack_file_t *f;
+
+   while (iter->cur_file < header->num_files) {
+      f = table + iter->cur_file++;
+      if (!f->offset)
+         continue;
+      *path = iter->image + f->path;
+      *contents = iter->image + f->offset;
+      *size = f->size;
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,75 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT
+file in the top level directory, or at
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms
+and conditions of the GNU Lesser General Public License for more details.  You should
+have received a copy of the GNU Lesser General Public License along with this
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#if !defined(LDCS_AUDIT_SERVER_PYPACK_H_)
+#define LDCS_AUDIT_SERVER_PYPACK_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * A python pack is an image of the directory trees under the python
+ * prefixes: the complete listing of every directory, and the contents of
+ * every .py/.pyc/.pyo file.  The root server builds it once at startup and
+ * it moves down the tree as a few large messages, rather than one cache
+ * entry, request and file packet per module.
+ *
+ * An image is a pypack_header_t, then num_files pypack_file_t, then the
+ * directory listings, then the file contents.  Each listing is the
+ * directory name followed by its entries, all NUL-terminated, and ends
+ * with an empty string.  Trees bigger than PYPACK_CHUNK_SIZE are split
+ * into several images, and a directory's listing is never in a later image
+ * than its files.  The last image has PYPACK_LAST set.
+ **/
+
+#define PYPACK_MAGIC 0x5059504b
+#define PYPACK_CHUNK_SIZE (32*1024*1024)
+#define PYPACK_MAX_FILE (PYPACK_CHUNK_SIZE / 8)
+#define PYPACK_LAST 1
+
+typedef struct {
+   uint32_t magic;
+   uint32_t flags;
+   uint32_t num_dirs;
+   uint32_t num_files;
+   uint64_t dirs_offset;
+   uint64_t image_size;
+} pypack_header_t;
+
+typedef struct {
+   uint64_t offset;   /* of the contents in the image, or 0 if it couldn't be read */
+   uint64_t size;
+   uint64_t path;     /* offset of the path in the image */
+} pypack_file_t;
+
+typedef struct {
+   char *image;
+   size_t size;
+   uint32_t cur_dir, cur_file;
+   size_t pos;
+} pypack_iter_t;
+
+/* Called with each finished image, which is freed when the callback returns.
+   Returns -1 on error. */
+typedef int (*pypack_cb_t)(char *image, size_t size, void *arg);
+
+int pypack_build(char *prefixes, pypack_cb_t cb, void *arg);
+
+int pypack_open(pypack_iter_t *iter, char *image, size_t size, int *last);
+int pypack_next_dir(pypack_iter_t *iter, char **dir, char ***names, int *num_names);
+int pypack_next_file(pypack_iter_t *iter, char **path, char **contents, size_t *size);
+
+#endif
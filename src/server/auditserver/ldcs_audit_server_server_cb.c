@@ -25,6 +25,7 @@
 #include "ldcs_api_listen.h"
 #include "ldcs_audit_server_process.h"
 #include "ldcs_audit_server_handlers.h"
+#include "ldcs_audit_server_trace.h"
 
 int _ldcs_server_CB ( int infd, int serverid, void *data ) {
    int rc=0;
@@ -56,6 +57,10 @@ int _ldcs_server_CB ( int infd, int serverid, void *data ) {
       ldcs_process_data->client_table[nc].null_msg_cnt = 0;    
       ldcs_process_data->client_table[nc].query_open   = 0;
       ldcs_process_data->client_table[nc].existance_query = 0;
+      ldcs_process_data->client_table[nc].soname_query = 0;
+      ldcs_process_data->client_table[nc].execpath_query = 0;
+      ldcs_process_data->client_table[nc].execpath_found = 0;
+      ldcs_process_data->client_table[nc].search_dirs = NULL;
       ldcs_process_data->client_table[nc].is_stat      = 0;
       ldcs_process_data->client_table[nc].is_loader    = 0;
       ldcs_process_data->client_table[nc].numa_node    = 0;      
@@ -66,6 +71,7 @@ int _ldcs_server_CB ( int infd, int serverid, void *data ) {
       ldcs_process_data->client_counter++;
       ldcs_process_data->clients_live++;
       debug_printf("Adding new client %d\n", nc);
+      trace_server_event(TRACE_BE_CLIENT_CONNECT, TRACE_INSTANT);
     
       /* register client fd to listener */
       fd=ldcs_get_fd(ldcs_process_data->client_table[nc].connid);
@@ -0,0 +1,148 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT
+file in the top level directory, or at
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms
+and conditions of the GNU Lesser General Public License for more details.  You should
+have received a copy of the GNU Lesser General Public License along with this
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "ldcs_audit_server_trace.h"
+#include "spindle_debug.h"
+
+/* Each server keeps at most this many events of its own and its clients' */
+#define TRACE_MAX_EVENTS 4096
+/* Clients whose every library load is kept.  Others only keep their
+   coarse phases, so a node with many processes doesn't flood the trace. */
+#define TRACE_DETAILED_CLIENTS 2
+
+static trace_event_t *events;
+static uint32_t num_events, events_size, num_dropped;
+static int32_t detailed_pids[TRACE_DETAILED_CLIENTS];
+static int num_detailed;
+static char *child_data;
+static size_t child_data_size;
+
+static void add_event(uint64_t time_us, int32_t pid, uint16_t phase, uint16_t kind)
+{
+   trace_event_t *new_events;
+   uint32_t new_size;
+
+   if (num_events == events_size) {
+      new_size = events_size ? events_size * 2 : 64;
+      if (new_size > TRACE_MAX_EVENTS)
+         new_size = TRACE_MAX_EVENTS;
+      new_events = num_events < new_size ? (trace_event_t *) realloc(events, new_size * sizeof(*events)) : NULL;
+      if (!new_events) {
+         num_dropped++;
+         return;
+      }
+      events = new_events;
+      events_size = new_size;
+   }
+   events[num_events].time_us = time_us;
+   events[num_events].pid = pid;
+   events[num_events].phase = phase;
+   events[num_events].kind = kind;
+   num_events++;
+}
+
+void trace_server_event(trace_phase_t phase, int kind)
+{
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   add_event(((uint64_t) tv.tv_sec) * 1000000 + tv.tv_usec, (int32_t) getpid(), (uint16_t) phase, (uint16_t) kind);
+}
+
+static int is_detailed(int32_t pid)
+{
+   int i;
+   for (i = 0; i < num_detailed; i++) {
+      if (detailed_pids[i] == pid)
+         return 1;
+   }
+   if (num_detailed == TRACE_DETAILED_CLIENTS)
+      return 0;
+   detailed_pids[num_detailed++] = pid;
+   return 1;
+}
+
+void trace_add_client_events(ldcs_message_t *msg)
+{
+   trace_event_t *client_events = (trace_event_t *) msg->data;
+   size_t i, num = msg->header.len / sizeof(trace_event_t);
+   int detailed;
+
+   if (!num)
+      return;
+   detailed = is_detailed(client_events[0].pid);
+   for (i = 0; i < num; i++) {
+      if (client_events[i].kind == TRACE_DROPPED) {
+         num_dropped += (uint32_t) client_events[i].time_us;
+         continue;
+      }
+      if (!detailed && client_events[i].phase == TRACE_CL_LIBRARY)
+         continue;
+      add_event(client_events[i].time_us, client_events[i].pid, client_events[i].phase, client_events[i].kind);
+   }
+}
+
+void trace_add_child_data(ldcs_message_t *msg)
+{
+   char *new_data;
+
+   new_data = (char *) realloc(child_data, child_data_size + msg->header.len);
+   if (!new_data) {
+      err_printf("Could not allocate %d bytes for child trace data.  Dropping it\n", msg->header.len);
+      return;
+   }
+   child_data = new_data;
+   memcpy(child_data + child_data_size, msg->data, msg->header.len);
+   child_data_size += msg->header.len;
+}
+
+/**
+ * Returns our block followed by our children's, and frees what we had
+ * recorded.
+ **/
+void *trace_pack(int md_rank, const char *hostname, size_t *size)
+{
+   trace_block_t block;
+   char *data;
+
+   memset(&block, 0, sizeof(block));
+   block.md_rank = md_rank;
+   block.num_events = num_events;
+   block.num_dropped = num_dropped;
+   strncpy(block.hostname, hostname ? hostname : "", sizeof(block.hostname) - 1);
+
+   *size = sizeof(block) + num_events * sizeof(trace_event_t) + child_data_size;
+   data = (char *) malloc(*size);
+   if (data) {
+      memcpy(data, &block, sizeof(block));
+      memcpy(data + sizeof(block), events, num_events * sizeof(trace_event_t));
+      memcpy(data + sizeof(block) + num_events * sizeof(trace_event_t), child_data, child_data_size);
+      debug_printf("Packed %u trace events and %lu bytes of child trace data\n", num_events,
+                   (unsigned long) child_data_size);
+   }
+
+   free(events);
+   free(child_data);
+   events = NULL;
+   child_data = NULL;
+   num_events = events_size = num_dropped = 0;
+   child_data_size = 0;
+   return data;
+}
@@ -0,0 +1,43 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT
+file in the top level directory, or at
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms
+and conditions of the GNU Lesser General Public License for more details.  You should
+have received a copy of the GNU Lesser General Public License along with this
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#if !defined(LDCS_AUDIT_SERVER_TRACE_H_)
+#define LDCS_AUDIT_SERVER_TRACE_H_
+
+#include <stddef.h>
+#include "ldcs_api.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * A server's share of the launch trace: its own events, its clients'
+ * events, and the blocks its child servers sent up.  Events are recorded
+ * from the start, before the settings say whether tracing is on, and are
+ * only sent anywhere with OPT_TRACE.
+ **/
+
+void trace_server_event(trace_phase_t phase, int kind);
+void trace_add_client_events(ldcs_message_t *msg);
+void trace_add_child_data(ldcs_message_t *msg);
+void *trace_pack(int md_rank, const char *hostname, size_t *size);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
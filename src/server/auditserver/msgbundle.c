@@ -20,14 +20,24 @@ static int flush_pipe[2];
 static int initialized = 0;
 
 static int flush_msgbuffer_cb(int fd, int serverid, void *data);
+static int flush_idle_cb(void *data);
 static void *thrd_main(void *timeout);
 int spindle_send_worker(ldcs_process_data_t *procdata, ldcs_message_t *msg, node_peer_t node,
                         void *secondary_data, size_t secondary_size);
 
 #define BROADCAST ((node_peer_t) (long) -2)
-#define PARENT ((node_peer_t) (long) -3)
+#define PARENT NODE_PEER_PARENT
 #define PASSTHROUGH -3
 
+/* Max segments in a bundle before it is sent */
+#define MSGBUNDLE_MAX_IOV 64
+/* File contents at least this large are sent from their own buffer rather than copied into the bundle */
+#define MSGBUNDLE_GATHER_MIN 4096
+/* Smallest size the adaptive bundle target will shrink to */
+#define MSGBUNDLE_MIN_TARGET (16*1024)
+
+#define MD_PEER(mb) ((mb)->node == BROADCAST ? NODE_PEER_ALL : (mb)->node)
+
 void msgbundle_init(ldcs_process_data_t *procdata)
 {
    if (!(procdata->opts & OPT_MSGBUNDLE)) {
@@ -42,6 +52,10 @@ void msgbundle_init(ldcs_process_data_t *procdata)
                 "send timeout of %u ms\n", procdata->msgbundle_cache_size_kb,
                 procdata->msgbundle_timeout_ms);
 
+   /* Bundles are sent as soon as the server has nothing else to do, so the timeout
+      only bounds latency while the server is busy. */
+   ldcs_listen_register_idle_cb(&flush_idle_cb, (void *) procdata);
+
    debug_printf2("Spawning timeout monitoring thread for cache buffers\n");
    (void)! pipe(flush_pipe);
    ldcs_listen_register_fd(flush_pipe[0], procdata->serverid, &flush_msgbuffer_cb, (void *) procdata);
@@ -63,6 +77,7 @@ void msgbundle_done(ldcs_process_data_t *procdata)
    pthread_cond_broadcast(&timeout_sync);
    pthread_mutex_unlock(&mut);
 
+   ldcs_listen_unregister_idle_cb(&flush_idle_cb);
    ldcs_listen_unregister_fd(flush_pipe[0]);
    close(flush_pipe[0]);
    close(flush_pipe[1]);
@@ -148,29 +163,90 @@ static void *thrd_main(void *timeout)
    }
 }
 
+/* Size the bundle to about one bandwidth-delay product of its link, so a
+   bundle is in flight while the next one fills.  Throughput is measured from
+   how long sends block, so it stays high, and bundles stay at full size, until
+   the link rather than the local socket buffer is the limit. */
+static void update_target_size(msgbundle_entry_t *mb, ldcs_process_data_t *procdata,
+                               size_t bytes, double elapsed)
+{
+   int capacity = procdata->msgbundle_cache_size_kb*1024;
+   int min_target = capacity < MSGBUNDLE_MIN_TARGET ? capacity : MSGBUNDLE_MIN_TARGET;
+   double rtt, target;
+
+   if (elapsed > 0.0) {
+      double sample = bytes / elapsed;
+      mb->throughput = mb->throughput ? (mb->throughput * 3.0 + sample) / 4.0 : sample;
+   }
+   if (!mb->throughput || ldcs_audit_server_md_get_rtt(procdata, MD_PEER(mb), &rtt) == -1)
+      return;
+
+   target = mb->throughput * rtt;
+   if (target < min_target)
+      target = min_target;
+   if (target > capacity)
+      target = capacity;
+   if ((int) target != mb->target_size) {
+      debug_printf3("Message bundle target for node %s now %d bytes (throughput %.0f bytes/s, rtt %.6fs)\n",
+                    mb->name, (int) target, mb->throughput, rtt);
+      mb->target_size = (int) target;
+   }
+}
+
 static int flush_msgbuffer(msgbundle_entry_t *mb, ldcs_process_data_t *procdata)
 {
    ldcs_message_t msg;
    int result;
+   double starttime;
 
    if (!mb->position)
       return 0;
 
    msg.header.type = LDCS_MSG_BUNDLE;
    msg.header.len = mb->position;
-   msg.data = (char *) mb->cache;
-
-   debug_printf2("Flushing message buffer for node %s\n", mb->name);
-   if (mb->node == BROADCAST)
-      result = ldcs_audit_server_md_broadcast(procdata, &msg);
-   else if (mb->node == PARENT)
-      result = ldcs_audit_server_md_forward_query(procdata, &msg);
-   else
-      result = ldcs_audit_server_md_send(procdata, &msg, mb->node);
+   msg.data = NULL;
+
+   debug_printf2("Flushing message buffer for node %s with %d bytes in %d segments\n",
+                 mb->name, mb->position, mb->iov_count);
+   starttime = ldcs_get_time();
+   result = ldcs_audit_server_md_send_iov(procdata, &msg, MD_PEER(mb), mb->iov, mb->iov_count);
+   update_target_size(mb, procdata, sizeof(msg) + mb->position, ldcs_get_time() - starttime);
+
    mb->position = 0;
+   mb->cache_position = 0;
+   mb->iov_count = 0;
    return result;
 }
 
+/* Add data to the bundle, either copied into its cache or by reference */
+static void append_msgbuffer(msgbundle_entry_t *mb, void *data, size_t size, int copy)
+{
+   struct iovec *last = mb->iov_count ? mb->iov + mb->iov_count - 1 : NULL;
+
+   if (!size)
+      return;
+
+   if (copy) {
+      unsigned char *dest = mb->cache + mb->cache_position;
+      memcpy(dest, data, size);
+      mb->cache_position += size;
+      if (last && ((unsigned char *) last->iov_base) + last->iov_len == dest) {
+         last->iov_len += size;
+      }
+      else {
+         mb->iov[mb->iov_count].iov_base = dest;
+         mb->iov[mb->iov_count].iov_len = size;
+         mb->iov_count++;
+      }
+   }
+   else {
+      mb->iov[mb->iov_count].iov_base = data;
+      mb->iov[mb->iov_count].iov_len = size;
+      mb->iov_count++;
+   }
+   mb->position += size;
+}
+
 static int flush_msgbuffer_cb(int fd, int serverid, void *data)
 {
    msgbundle_entry_t *mb;
@@ -192,6 +268,23 @@ static int flush_msgbuffer_cb(int fd, int serverid, void *data)
    return 0;
 }
 
+static int flush_idle_cb(void *data)
+{
+   msgbundle_entry_t *mb;
+   ldcs_process_data_t *procdata = (ldcs_process_data_t *) data;
+
+   for (mb = procdata->msgbundle_entries; mb; mb = mb->next) {
+      if (!mb->position)
+         continue;
+      if (ldcs_audit_server_md_send_would_block(procdata, MD_PEER(mb))) {
+         debug_printf3("Holding message bundle for node %s while its link is backed up\n", mb->name);
+         continue;
+      }
+      flush_msgbuffer(mb, procdata);
+   }
+   return 0;
+}
+
 void msgbundle_force_flush(ldcs_process_data_t *procdata)
 {
    if (!procdata || !(procdata->opts & OPT_MSGBUNDLE))
@@ -246,7 +339,12 @@ int spindle_send_worker(ldcs_process_data_t *procdata, ldcs_message_t *msg, node
       debug_printf2("Creating new message bundle cache for node %p\n", node);
       mb = (msgbundle_entry_t *) malloc(sizeof(msgbundle_entry_t));
       mb->cache = (unsigned char *) malloc(procdata->msgbundle_cache_size_kb*1024);
+      mb->iov = (struct iovec *) malloc(sizeof(struct iovec) * MSGBUNDLE_MAX_IOV);
       mb->position = 0;
+      mb->cache_position = 0;
+      mb->iov_count = 0;
+      mb->target_size = procdata->msgbundle_cache_size_kb*1024;
+      mb->throughput = 0.0;
       mb->node = node;
       mb->next = procdata->msgbundle_entries;
       if (mb->node == BROADCAST)
@@ -266,7 +364,8 @@ int spindle_send_worker(ldcs_process_data_t *procdata, ldcs_message_t *msg, node
    
 
    if (sizeof(msg->header) + msg->header.len + mb->position >=
-       procdata->msgbundle_cache_size_kb*1024)
+       procdata->msgbundle_cache_size_kb*1024 ||
+       mb->iov_count + 3 > MSGBUNDLE_MAX_IOV)
    {
       debug_printf2("Flushing message buffer due to no space for adding new message."
                     "Current size = %u, new message size = %lu, capacity = %u\n",
@@ -283,17 +382,22 @@ int spindle_send_worker(ldcs_process_data_t *procdata, ldcs_message_t *msg, node
       debug_printf2("Appending message at position %d\n", mb->position);
    }
 
-   memcpy(mb->cache + mb->position, &msg->header, sizeof(ldcs_message_header_t));
-   mb->position += sizeof(ldcs_message_header_t);
-   memcpy(mb->cache + mb->position, msg->data, (msg->header.len - secondary_size));
-   mb->position += (msg->header.len - secondary_size);
-   if (secondary_size) {
-      memcpy(mb->cache + mb->position, secondary_data, secondary_size);
-      mb->position += secondary_size;
-   }
+   /* File contents stay mapped in the local cache for the life of the server, so larger
+      ones are gathered from there when the bundle is sent instead of being copied. */
+   append_msgbuffer(mb, &msg->header, sizeof(ldcs_message_header_t), 1);
+   append_msgbuffer(mb, msg->data, msg->header.len - secondary_size, 1);
+   append_msgbuffer(mb, secondary_data, secondary_size, secondary_size < MSGBUNDLE_GATHER_MIN);
    debug_printf2("Cached data in message buffer to node %s, which is %u of %u bytes full.\n",
                  mb->name, (int) mb->position, procdata->msgbundle_cache_size_kb*1024);
 
+   if (mb->position >= mb->target_size) {
+      if (!ldcs_audit_server_md_send_would_block(procdata, MD_PEER(mb)))
+         return flush_msgbuffer(mb, procdata);
+      debug_printf3("Coalescing past target size of %d for node %s while its link is backed up\n",
+                    mb->target_size, mb->name);
+   }
+
+   ldcs_listen_request_idle_cb(&flush_idle_cb);
    start_cache_timeout(procdata->msgbundle_timeout_ms, procdata);
    return 0;
 }
@@ -27,6 +27,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include "ldcs_api.h"
 #include "ldcs_cache.h"
 #include "ldcs_hash.h"
+#include "pathcode.h"
 #include "ccwarns.h"
 
 ldcs_cache_result_t ldcs_cache_findDirInCache(char *dirname) {
@@ -121,6 +122,65 @@ ldcs_cache_result_t ldcs_cache_updateBuffer(char *filename, char *dirname, char
    return LDCS_CACHE_FILE_FOUND;
 }
 
+/**
+ * Count a client request for a file, answered at time answered.  It was a
+ * cache hit if the file was already here when the request arrived.
+ **/
+ldcs_cache_result_t ldcs_cache_noteRequest(char *filename, char *dirname, double arrival, double answered)
+{
+   struct ldcs_hash_entry_t *e = ldcs_hash_Lookup_FN_and_DIR(filename, dirname);
+   if (!e)
+      return LDCS_CACHE_FILE_NOT_FOUND;
+   e->stats.requests++;
+   if (e->stats.delivered <= arrival)
+      e->stats.cache_hits++;
+   if (!e->stats.first_request || arrival < e->stats.first_request)
+      e->stats.first_request = arrival;
+   e->stats.client_wait += answered - arrival;
+   return LDCS_CACHE_FILE_FOUND;
+}
+
+ldcs_cache_result_t ldcs_cache_noteDelivery(char *filename, char *dirname, ldcs_file_source_t source, size_t bytes, double time)
+{
+   struct ldcs_hash_entry_t *e = ldcs_hash_Lookup_FN_and_DIR(filename, dirname);
+   if (!e)
+      return LDCS_CACHE_FILE_NOT_FOUND;
+   e->stats.source = source;
+   e->stats.bytes += bytes;
+   e->stats.delivered = time;
+   return LDCS_CACHE_FILE_FOUND;
+}
+
+struct file_stats_iter_t {
+   void (*fn)(const char *path, ldcs_file_stats_t *stats, void *arg);
+   void *arg;
+};
+
+static void file_stats_entry(struct ldcs_hash_entry_t *e, void *arg)
+{
+   struct file_stats_iter_t *iter = (struct file_stats_iter_t *) arg;
+   char path[MAX_PATH_LEN+1];
+
+   if (!e->filename || !e->dirname || e->filename == e->dirname || strcmp(e->filename, e->dirname) == 0)
+      return;
+   if (!e->stats.requests && !e->stats.bytes)
+      return;
+   snprintf(path, sizeof(path), "%s/%s", e->dirname, e->filename);
+   iter->fn(path, &e->stats, iter->arg);
+}
+
+/**
+ * Call fn on the statistics of every file that was requested or delivered
+ * here.
+ **/
+void ldcs_cache_forEachFileStats(void (*fn)(const char *path, ldcs_file_stats_t *stats, void *arg), void *arg)
+{
+   struct file_stats_iter_t iter;
+   iter.fn = fn;
+   iter.arg = arg;
+   ldcs_hash_forEachEntry(file_stats_entry, &iter);
+}
+
 ldcs_cache_result_t ldcs_cache_updateReplication(char *filename, char *dirname, int replication)
 {
    struct ldcs_hash_entry_t *e = ldcs_hash_Lookup_FN_and_DIR(filename, dirname);
@@ -179,149 +239,89 @@ int ldcs_cache_get_buffer(char *dirname, char *filename, void **buffer, size_t *
    return 0;
 }
 
-#define INITIAL_BUFFER_SIZE 4096
+/**
+ * Encode the cached entries for dir as a pathcode directory listing, for
+ * sending to other servers.
+ **/
 int ldcs_cache_getNewEntriesForDir(char *dir, char **data, int *len)
 {
-   char *buffer = NULL;
-   size_t buffer_size = 0;
-   size_t cur_pos = 0;
-   int first_pass = 1;
-   int num_entries = 0;
    struct ldcs_hash_entry_t *i;
-   
-   for (i = ldcs_hash_getFirstEntryForDir(dir); i != NULL; i = ldcs_hash_getNextEntryForDir(i)) {
-      int length_fn = i->filename ? strlen(i->filename)+1 : 0;
-      int length_dir = first_pass ? strlen(dir)+1 : 0;
-      unsigned int space_needed = length_fn + length_dir + sizeof(int)*2;
-      if (cur_pos + space_needed >= buffer_size) {
-         while (cur_pos + space_needed >= buffer_size)
-            buffer_size = !buffer_size ? INITIAL_BUFFER_SIZE : (buffer_size*2);
-         buffer = realloc(buffer, buffer_size);
-      }
-
-      memcpy(buffer + cur_pos, &length_fn, sizeof(int));
-      cur_pos += sizeof(int);
-      if (length_fn)
-         strncpy(buffer + cur_pos, i->filename, length_fn);
-      cur_pos += length_fn;
-
-      memcpy(buffer + cur_pos, &length_dir, sizeof(int));
-      cur_pos += sizeof(int);
-      if (length_dir)
-         strncpy(buffer + cur_pos, dir, length_dir);
-      cur_pos += length_dir;
+   const char **names = NULL;
+   int num_names = 0, num_entries = 0, result;
+   size_t data_len;
 
-      first_pass = 0;
+   for (i = ldcs_hash_getFirstEntryForDir(dir); i != NULL; i = ldcs_hash_getNextEntryForDir(i))
       num_entries++;
+   if (num_entries) {
+      names = (const char **) malloc(num_entries * sizeof(char *));
+      for (i = ldcs_hash_getFirstEntryForDir(dir); i != NULL; i = ldcs_hash_getNextEntryForDir(i)) {
+         if (i->filename)
+            names[num_names++] = i->filename;
+      }
    }
 
-   if (!buffer) {
-      debug_printf3("Encoded packet for non-existant directory: %s\n", dir);
-      /* Directory does not exist, or contains 0 files */
-      int len = strlen(dir) + 1;
-      int neg_one = -1;
-      buffer = (char *) malloc(sizeof(len) + len + sizeof(neg_one));
-
-      memcpy(buffer + cur_pos, &len, sizeof(len));
-      cur_pos += sizeof(len);
-      
-      memcpy(buffer + cur_pos, dir, len);
-      cur_pos += len;
-
-      memcpy(buffer + cur_pos, &neg_one, sizeof(neg_one));
-      cur_pos += sizeof(neg_one);
-   }
-   else {
-      debug_printf3("Encoded packet for directory with %d entries: %s\n", num_entries, dir);
+   result = pathcode_encode_dir(dir, names, num_names, num_entries > 0, data, &data_len);
+   free(names);
+   if (result == -1) {
+      err_printf("Could not encode entries for directory %s\n", dir);
+      return -1;
    }
-
-   *data = buffer;
-   *len = cur_pos;
-
+   debug_printf3("Encoded packet for directory with %d entries in %lu bytes: %s\n", num_names,
+                 (unsigned long) data_len, dir);
+   *len = (int) data_len;
    return 0;
 }
 
-void ldcs_cache_getFirstDir(char *buffer, int size, dirbuffer_iterator_t *dpos, char **fname, char **dname)
+/**
+ * Return the names of the files cached for dir in a malloc'd array whose
+ * strings belong to the cache.
+ **/
+int ldcs_cache_getNamesForDir(char *dir, char ***names, int *num_names)
 {
-   dpos->buffer = buffer;
-   dpos->buffer_size = size;
-   dpos->last_dirname = NULL;
-   dpos->pos = 0;
-   dpos->done = 0;
-   if (!dpos->buffer_size) {
-      *fname = NULL;
-      *dname = NULL;
-      return;
-   }
-   ldcs_cache_parseDir(dpos, fname, dname);
-}
-
-void ldcs_cache_getNextDir(dirbuffer_iterator_t *dpos, char **fname, char **dname)
-{
-   int length;
-
-   if (dpos->pos == dpos->buffer_size) {
-      dpos->done = 1;
-      return;
-   }
+   struct ldcs_hash_entry_t *i;
+   int count = 0;
 
-   assert(dpos->pos < dpos->buffer_size);
-   memcpy(&length, dpos->buffer + dpos->pos, sizeof(int));
-   dpos->pos += sizeof(int);
-   dpos->pos += length;
-
-   assert(dpos->pos < dpos->buffer_size);
-   memcpy(&length, dpos->buffer + dpos->pos, sizeof(int));
-   dpos->pos += sizeof(int);
-   if (length != -1)
-      dpos->pos += length;
-
-   if (dpos->pos >= dpos->buffer_size) {
-      *fname = NULL;
-      *dname = NULL;
-      dpos->done = 1;
-      return;
+   for (i = ldcs_hash_getFirstEntryForDir(dir); i != NULL; i = ldcs_hash_getNextEntryForDir(i))
+      count++;
+   *names = count ? (char **) malloc(count * sizeof(char *)) : NULL;
+   *num_names = 0;
+   for (i = ldcs_hash_getFirstEntryForDir(dir); i != NULL; i = ldcs_hash_getNextEntryForDir(i)) {
+      if (i->filename)
+         (*names)[(*num_names)++] = i->filename;
    }
-   ldcs_cache_parseDir(dpos, fname, dname);
+   return 0;
 }
 
-int ldcs_cache_lastDir(dirbuffer_iterator_t *dpos)
-{
-   return (dpos->pos > dpos->buffer_size) || dpos->done;
-}
+typedef struct {
+   char *dir;
+   size_t dir_size;
+} stored_dir_t;
 
-void ldcs_cache_parseDir(dirbuffer_iterator_t *dpos, char **fname, char **dname)
+static void store_entry(const char *dir, const char *name, void *arg)
 {
-   int length;
-   int pos = dpos->pos;
-
-   if (pos >= dpos->buffer_size) {
-      dpos->done = 1;
-      return;
+   stored_dir_t *stored = (stored_dir_t *) arg;
+   if (!stored->dir[0]) {
+      strncpy(stored->dir, dir, stored->dir_size - 1);
+      stored->dir[stored->dir_size - 1] = '\0';
    }
+   if (!name)
+      addEmptyDirectory(stored->dir);
+   else
+      ldcs_cache_addFileDir(stored->dir, (char *) name);
+}
 
-   memcpy(&length, dpos->buffer + pos, sizeof(int));
-   pos += sizeof(int);
-   *fname = dpos->buffer + pos;
-   pos += length;
-
-   memcpy(&length, dpos->buffer + pos, sizeof(int));
-   pos += sizeof(int);
-   if (length == 0 && dpos->last_dirname) {
-      *dname = dpos->last_dirname;
-   }
-   else if (length == 0) {
-      *dname = NULL;
-   }
-   else if (length == -1) {
-      *dname = *fname;
-      *fname = NULL;
-   }
-   else {
-      *dname = dpos->buffer + pos;
-      dpos->last_dirname = *dname;
-      pos += length;
-   }
+/**
+ * Add the entries from a directory listing made by
+ * ldcs_cache_getNewEntriesForDir to the cache, and return its directory
+ * in dir.
+ **/
+int ldcs_cache_storeEncodedDir(char *data, size_t len, char *dir, size_t dir_size)
+{
+   stored_dir_t stored;
+   stored.dir = dir;
+   stored.dir_size = dir_size;
+   dir[0] = '\0';
+   return pathcode_decode_dir(data, len, store_entry, &stored);
 }
 
 void ldcs_cache_addFileDir(char *dname, char *fname)
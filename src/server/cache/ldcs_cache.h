@@ -17,6 +17,9 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #ifndef LDCS_CACHE_H
 #define LDCS_CACHE_H
 
+#include <stddef.h>
+#include "ldcs_hash.h"
+
 typedef enum {
   LDCS_CACHE_DIR_PARSED_AND_EXISTS,
   LDCS_CACHE_DIR_PARSED_AND_NOT_EXISTS,
@@ -52,6 +55,11 @@ ldcs_cache_result_t ldcs_cache_updateStatus(char *filename, char *dirname, ldcs_
 ldcs_hash_object_status_t ldcs_cache_getStatus(char *filename);
 
 int ldcs_cache_getNewEntriesForDir(char *dir, char **data, int *len);
+int ldcs_cache_getNamesForDir(char *dir, char ***names, int *num_names);
+
+ldcs_cache_result_t ldcs_cache_noteRequest(char *filename, char *dirname, double arrival, double answered);
+ldcs_cache_result_t ldcs_cache_noteDelivery(char *filename, char *dirname, ldcs_file_source_t source, size_t bytes, double time);
+void ldcs_cache_forEachFileStats(void (*fn)(const char *path, ldcs_file_stats_t *stats, void *arg), void *arg);
 
 int ldcs_cache_init();
 int ldcs_cache_dump(char *filename);
@@ -59,26 +67,9 @@ int ldcs_cache_dump(char *filename);
 int ldcs_cache_get_buffer(char *dirname, char *filename, void **buffer, size_t *size, char **alias_to);
 
 char *ldcs_cache_result_to_str(ldcs_cache_result_t res);
-/* Parse directory content packets */
-typedef struct {
-   char *buffer;
-   int buffer_size;
-   char *last_dirname;
-   int pos;
-   int done;
-} dirbuffer_iterator_t;
-void ldcs_cache_getFirstDir(char *buffer, int size, dirbuffer_iterator_t *dpos, char **fname, char **dname);
-void ldcs_cache_getNextDir(dirbuffer_iterator_t *dpos, char **fname, char **dname);
-int ldcs_cache_lastDir(dirbuffer_iterator_t *dpos);
-void ldcs_cache_parseDir(dirbuffer_iterator_t *dpos, char **fname, char **dname);
+int ldcs_cache_storeEncodedDir(char *data, size_t len, char *dir, size_t dir_size);
 void ldcs_cache_addFileDir(char *dname, char *fname);
 void addEmptyDirectory(char *dirname);
-#define foreach_filedir(BUFFER, SIZE, POS, FNAME, DNAME)                \
-   for (ldcs_cache_getFirstDir(BUFFER, SIZE, &POS, &FNAME, &DNAME);     \
-        !ldcs_cache_lastDir(&POS);                                      \
-        ldcs_cache_getNextDir(&POS, &FNAME, &DNAME))
-
-
 
 /* internal */
 int directoryParsed(char *dirname);
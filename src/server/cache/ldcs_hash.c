@@ -60,6 +60,7 @@ struct ldcs_hash_entry_t *ldcs_hash_addEntry(char *dirname, char *filename) {
    newentry->replication = 0;
    newentry->buffer = NULL;
    newentry->buffer_size = 0;
+   memset(&newentry->stats, 0, sizeof(newentry->stats));
    newentry->next = NULL;
 
    if (is_dir) {
@@ -181,6 +182,19 @@ void ldcs_hash_dump(char *tofile) {
   fclose(dumpfile);
 }
 
+void ldcs_hash_forEachEntry(void (*fn)(struct ldcs_hash_entry_t *entry, void *arg), void *arg)
+{
+   struct ldcs_hash_entry_t *entry;
+   int index;
+
+   for (index = 0; index < HASH_SIZE; index++) {
+      if (ldcs_hash_table[index].dirname == NULL)
+         continue;
+      for (entry = ldcs_hash_table + index; entry != NULL; entry = entry->next)
+         fn(entry, arg);
+   }
+}
+
 int ldcs_hash_init() {
   int rc=0;
   int index;
@@ -27,6 +27,28 @@ typedef enum {
    HASH_ENTRY_STATUS_UNKNOWN
 } ldcs_hash_entry_status_t;
 
+/* How a server came to hold a file */
+typedef enum {
+   FILE_SOURCE_NONE,
+   FILE_SOURCE_DISK,
+   FILE_SOURCE_TREE,
+   FILE_SOURCE_PUSHED
+} ldcs_file_source_t;
+
+/* Per-file distribution statistics, counted with OPT_FILESTATS.  Times
+   are from ldcs_get_time and only compared on this node. */
+typedef struct {
+   unsigned int requests;
+   unsigned int cache_hits;
+   ldcs_file_source_t source;
+   size_t bytes;
+   double first_request;
+   double delivered;
+   double client_wait;
+   int reported_request;
+   int reported_source;
+} ldcs_file_stats_t;
+
 struct ldcs_hash_entry_t
 {
   ldcs_hash_entry_status_t  state;
@@ -40,6 +62,7 @@ struct ldcs_hash_entry_t
   size_t buffer_size;
   ldcs_hash_key_t hash_val;
   int errcode;
+  ldcs_file_stats_t stats;
   struct ldcs_hash_entry_t *next;
   struct ldcs_hash_entry_t *dir_next;
 };
@@ -56,6 +79,7 @@ struct ldcs_hash_entry_t *ldcs_hash_Lookup(const char *filename);
 struct ldcs_hash_entry_t *ldcs_hash_Lookup_FN_and_DIR(const char *filename, const char *dirname);
 
 void ldcs_hash_dump(char *tofile);
+void ldcs_hash_forEachEntry(void (*fn)(struct ldcs_hash_entry_t *entry, void *arg), void *arg);
 
 struct ldcs_hash_entry_t *ldcs_hash_getFirstEntryForDir(char *dirname);
 struct ldcs_hash_entry_t *ldcs_hash_getNextEntryForDir(struct ldcs_hash_entry_t *prev_entry);
@@ -206,6 +206,11 @@ int ldcs_get_fd_biter(int connid)
    return biterd_get_fd(session);
 }
 
+int ldcs_send_fd_biter(int connid, int passfd)
+{
+   return -1;
+}
+
 int ldcs_get_aux_fd_biter()
 {
    return biterd_get_aux_fd();
@@ -277,6 +282,14 @@ int ldcs_recv_msg_static_biter(int connid, ldcs_message_t *msg, ldcs_read_block_
       msg->data = NULL;
       return 0;
    }
+   if (msg->header.len > MAX_PATH_LEN) {
+      err_printf("Message of size %d from session %d, proc %d is larger than the receive buffer.  "
+                 "Dropping client\n", msg->header.len, session, proc);
+      msg->header.type = LDCS_MSG_END;
+      msg->header.len = 0;
+      msg->data = NULL;
+      return 0;
+   }
 
    result = biterd_read(session, proc, msg->data, msg->header.len);
    if (result == -1) {
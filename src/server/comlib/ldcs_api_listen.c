@@ -57,6 +57,17 @@ static ldcs_listen_data_t ldcs_listen_data = {0, 0, 0, NULL, 0};
 static int (*loop_exit_cb) ( int num_fds, void *data ) = NULL;
 static void *loop_exit_cb_data = NULL;
 
+#define MAX_IDLE_CBS 4
+typedef struct {
+   int (*cb_func) ( void *data );
+   void *data;
+   int requested;
+} ldcs_listen_idle_cb_t;
+
+static ldcs_listen_idle_cb_t idle_cbs[MAX_IDLE_CBS];
+static int num_idle_cbs = 0;
+static int idle_requested = 0;
+
 static int do_exit = 0;
 
 int ldcs_listen_register_exit_loop_cb( int cb_func ( int num_fds, void *data ), 
@@ -67,6 +78,51 @@ int ldcs_listen_register_exit_loop_cb( int cb_func ( int num_fds, void *data ),
    return(rc);
 }
 
+int ldcs_listen_register_idle_cb( int cb_func ( void *data ),
+                                  void * data) {
+   if (num_idle_cbs == MAX_IDLE_CBS) {
+      err_printf("Too many idle callbacks registered\n");
+      return(-1);
+   }
+   idle_cbs[num_idle_cbs].cb_func = cb_func;
+   idle_cbs[num_idle_cbs].data = data;
+   idle_cbs[num_idle_cbs].requested = 0;
+   num_idle_cbs++;
+   return(0);
+}
+
+int ldcs_listen_unregister_idle_cb( int cb_func ( void *data ) ) {
+   int c;
+   for (c = 0; c < num_idle_cbs; c++) {
+      if (idle_cbs[c].cb_func == cb_func) {
+         idle_cbs[c] = idle_cbs[--num_idle_cbs];
+         return(0);
+      }
+   }
+   return(-1);
+}
+
+void ldcs_listen_request_idle_cb( int cb_func ( void *data ) ) {
+   int c;
+   for (c = 0; c < num_idle_cbs; c++) {
+      if (idle_cbs[c].cb_func == cb_func) {
+         idle_cbs[c].requested = 1;
+         idle_requested = 1;
+      }
+   }
+}
+
+static void run_idle_cbs( ) {
+   int c;
+   idle_requested = 0;
+   for (c = 0; c < num_idle_cbs; c++) {
+      if (!idle_cbs[c].requested)
+         continue;
+      idle_cbs[c].requested = 0;
+      idle_cbs[c].cb_func(idle_cbs[c].data);
+   }
+}
+
 int ldcs_listen_register_fd( int fd, 
                              int id, 
                              int cb_func ( int fd, int id, void *data ), 
@@ -136,6 +192,7 @@ int ldcs_listen() {
    int r, nfds, fd, c;
    fd_set rd, wr, er;
    int do_listen=0;
+   struct timeval no_wait;
 
    debug_printf2("Listening for data\n");
    do_listen=(ldcs_listen_data.item_table_used>0);
@@ -156,8 +213,21 @@ int ldcs_listen() {
     
       /* do select if sckets avail */
       if(nfds>0) {
-         debug_printf3("Blocking for new messages in select\n");
-         r = select(nfds + 1, &rd, &wr, &er, NULL);
+         if (idle_requested) {
+            /* only poll, so the idle callbacks can run if nothing is ready */
+            no_wait.tv_sec = 0;
+            no_wait.tv_usec = 0;
+            r = select(nfds + 1, &rd, &wr, &er, &no_wait);
+            if (r == 0) {
+               debug_printf3("No messages ready.  Calling idle callbacks\n");
+               run_idle_cbs();
+               continue;
+            }
+         }
+         else {
+            debug_printf3("Blocking for new messages in select\n");
+            r = select(nfds + 1, &rd, &wr, &er, NULL);
+         }
       
          /* signal caught, do nothing */
          if (r == -1 && errno == EINTR) {
@@ -27,6 +27,15 @@ int ldcs_listen_register_exit_loop_cb( int cb_func ( int num_fds, void *data ),
 
 int ldcs_listen_unregister_fd( int fd );
 
+/* An idle callback runs once no registered fd has data ready, after
+   ldcs_listen_request_idle_cb has been called for it since its last run. */
+int ldcs_listen_register_idle_cb( int cb_func ( void *data ),
+                                  void * data);
+
+int ldcs_listen_unregister_idle_cb( int cb_func ( void *data ) );
+
+void ldcs_listen_request_idle_cb( int cb_func ( void *data ) );
+
 int ldcs_listen_signal_end_listen_loop( );
 
 int ldcs_listen();
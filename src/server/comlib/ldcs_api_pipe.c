@@ -342,6 +342,13 @@ int ldcs_recv_msg_static_pipe(int fd, ldcs_message_t *msg, ldcs_read_block_t blo
      return(rc);
   }
   if (n < 0) _error("ERROR reading header from connection");
+  if (msg->header.len > MAX_PATH_LEN) {
+     err_printf("Client message of type %d has length %d, larger than the receive buffer.  Dropping client\n",
+                (int) msg->header.type, msg->header.len);
+     msg->header.type = LDCS_MSG_END;
+     msg->header.len = 0;
+     return(rc);
+  }
 
   if(msg->header.len>0) {
     n = _ldcs_read_pipe(fdlist_pipe[fd].in_fd,msg->data,msg->header.len, LDCS_READ_BLOCK);
@@ -432,6 +439,11 @@ int _ldcs_write_pipe(int fd, const void *data, int bytes ) {
   return (bsumwrote);
 }
 
+int ldcs_send_fd_pipe(int fd, int passfd)
+{
+   return -1;
+}
+
 int ldcs_get_aux_fd_pipe()
 {
    return -1;
@@ -0,0 +1,513 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT
+file in the top level directory, or at
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms
+and conditions of the GNU Lesser General Public License for more details.  You should
+have received a copy of the GNU Lesser General Public License along with this
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <assert.h>
+
+#include "ldcs_api.h"
+#include "ldcs_audit_server_process.h"
+#include "shmem_ring.h"
+
+/**
+ * Server side of the shared-memory transport (see client_api_shmem.c).
+ * Clients connect to a unix socket under location/spindle_comm and pass us
+ * the fd of their shared region.  We select on the connection's socket, which
+ * carries one doorbell byte per request and EOF when the client goes away.
+ **/
+
+typedef enum {
+   LDCS_SHMEM_FD_TYPE_SERVER,
+   LDCS_SHMEM_FD_TYPE_CONN
+} fd_list_entry_type_t;
+
+struct fdlist_entry_t
+{
+   int inuse;
+   fd_list_entry_type_t type;
+   int fd;
+
+   /* server part */
+   char *path;
+
+   /* connection part */
+   shmem_region_t *region;
+   pid_t pid;
+};
+
+#define FDLIST_INITIAL_SIZE 32
+static struct fdlist_entry_t *fdlist_shmem = NULL;
+static int fdlist_shmem_cnt = 0;
+static int fdlist_shmem_size = 0;
+
+static int get_new_fd_shmem()
+{
+   int i;
+   if (fdlist_shmem_cnt == fdlist_shmem_size) {
+      fdlist_shmem_size = fdlist_shmem_size ? fdlist_shmem_size * 2 : FDLIST_INITIAL_SIZE;
+      fdlist_shmem = realloc(fdlist_shmem, fdlist_shmem_size * sizeof(struct fdlist_entry_t));
+      if (!fdlist_shmem) {
+         err_printf("Failed to allocate fdlist_shmem of size %d\n", fdlist_shmem_size);
+         assert(0);
+      }
+      for (i = fdlist_shmem_cnt; i < fdlist_shmem_size; i++) {
+         fdlist_shmem[i].inuse = 0;
+      }
+   }
+   for (i = 0; i < fdlist_shmem_size; i++) {
+      if (!fdlist_shmem[i].inuse) {
+         memset(fdlist_shmem + i, 0, sizeof(*fdlist_shmem));
+         fdlist_shmem[i].inuse = 1;
+         fdlist_shmem[i].fd = -1;
+         fdlist_shmem_cnt++;
+         return i;
+      }
+   }
+   err_printf("Should have found empty fd, but didn't.");
+   assert(0);
+   return -1;
+}
+
+static void free_fd_shmem(int fd)
+{
+   fdlist_shmem[fd].inuse = 0;
+   fdlist_shmem_cnt--;
+   if (fdlist_shmem[fd].path)
+      free(fdlist_shmem[fd].path);
+   fdlist_shmem[fd].path = NULL;
+}
+
+int ldcs_get_fd_shmem(int fd)
+{
+   if ((fd<0) || (fd>=fdlist_shmem_size))  _error("wrong fd");
+   if (!fdlist_shmem[fd].inuse)
+      return -1;
+   return fdlist_shmem[fd].fd;
+}
+
+extern int spindle_mkdir(char *orig_path);
+
+int ldcs_create_server_shmem(char* location, int number)
+{
+   int fd, sock_fd, dir_fd, result;
+   struct sockaddr_un addr;
+   char readypath[MAX_PATH_LEN];
+
+   fd = get_new_fd_shmem();
+   if (fd < 0)
+      return -1;
+
+   int len = strlen(location) + 32;
+   char *staging_dir = (char *) malloc(len);
+   snprintf(staging_dir, len, "%s/spindle_comm", location);
+
+   if (-1 == spindle_mkdir(staging_dir)) {
+      err_printf("mkdir: ERROR during mkdir %s\n", staging_dir);
+      _error("mkdir failed");
+   }
+
+   sock_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (sock_fd == -1) {
+      err_printf("Could not create unix socket: %s\n", strerror(errno));
+      return -1;
+   }
+   fcntl(sock_fd, F_SETFD, FD_CLOEXEC);
+
+   if (shmem_socket_addr(location, &addr, &dir_fd) == -1) {
+      err_printf("Could not open %s: %s\n", staging_dir, strerror(errno));
+      close(sock_fd);
+      return -1;
+   }
+   unlink(addr.sun_path);
+   result = bind(sock_fd, (struct sockaddr *) &addr, sizeof(addr));
+   if (dir_fd != -1)
+      close(dir_fd);
+   if (result == -1) {
+      err_printf("Could not bind unix socket in %s: %s\n", staging_dir, strerror(errno));
+      close(sock_fd);
+      return -1;
+   }
+   if (listen(sock_fd, 128) == -1) {
+      err_printf("Could not listen on unix socket in %s: %s\n", staging_dir, strerror(errno));
+      close(sock_fd);
+      return -1;
+   }
+   fcntl(sock_fd, F_SETFL, O_NONBLOCK);
+
+   snprintf(readypath, MAX_PATH_LEN, "%s/ready", staging_dir);
+   int readyfd = creat(readypath, 0000);
+   close(readyfd);
+
+   fdlist_shmem[fd].type = LDCS_SHMEM_FD_TYPE_SERVER;
+   fdlist_shmem[fd].fd = sock_fd;
+   fdlist_shmem[fd].path = staging_dir;
+
+   chmod(readypath, S_IRUSR | S_IWUSR);
+
+   return fd;
+}
+
+int ldcs_open_server_connection_shmem(int fd)
+{
+   return -1;
+}
+
+static int recv_region_fd(int conn_fd, pid_t *pid)
+{
+   struct msghdr hdr;
+   struct iovec iov;
+   struct cmsghdr *cmsg;
+   int mem_fd = -1;
+   ssize_t result;
+   union {
+      char buf[CMSG_SPACE(sizeof(int))];
+      struct cmsghdr align;
+   } control;
+
+   memset(&hdr, 0, sizeof(hdr));
+   iov.iov_base = pid;
+   iov.iov_len = sizeof(*pid);
+   hdr.msg_iov = &iov;
+   hdr.msg_iovlen = 1;
+   hdr.msg_control = control.buf;
+   hdr.msg_controllen = sizeof(control.buf);
+
+   do {
+      result = recvmsg(conn_fd, &hdr, MSG_CMSG_CLOEXEC);
+   } while (result == -1 && errno == EINTR);
+   if (result != sizeof(*pid)) {
+      err_printf("Failed to receive shared memory region from client: %s\n",
+                 result == -1 ? strerror(errno) : "short message");
+      return -1;
+   }
+
+   for (cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+         memcpy(&mem_fd, CMSG_DATA(cmsg), sizeof(int));
+         break;
+      }
+   }
+   if (mem_fd == -1)
+      err_printf("Client %d did not send a shared memory region\n", (int) *pid);
+   return mem_fd;
+}
+
+int ldcs_open_server_connections_shmem(int fd, int nc, int *more_avail)
+{
+   int connfd, conn_sock, mem_fd;
+   pid_t pid = 0;
+   void *mem;
+   struct pollfd pfd;
+   shmem_region_t *region = NULL;
+
+   if ((fd<0) || (fd>=fdlist_shmem_size))  _error("wrong fd");
+
+   do {
+      conn_sock = accept(fdlist_shmem[fd].fd, NULL, NULL);
+   } while (conn_sock == -1 && errno == EINTR);
+   if (conn_sock == -1)
+      _error("accept on shared memory socket failed");
+   fcntl(conn_sock, F_SETFD, FD_CLOEXEC);
+
+   mem_fd = recv_region_fd(conn_sock, &pid);
+   if (mem_fd != -1) {
+      mem = mmap(NULL, sizeof(shmem_region_t), PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd, 0);
+      close(mem_fd);
+      if (mem == MAP_FAILED)
+         err_printf("Could not map shared memory region from client %d: %s\n", (int) pid, strerror(errno));
+      else
+         region = (shmem_region_t *) mem;
+   }
+   if (region && (region->magic != SHMEM_REGION_MAGIC || region->size != sizeof(shmem_region_t))) {
+      err_printf("Client %d sent a malformed shared memory region\n", (int) pid);
+      munmap(region, sizeof(shmem_region_t));
+      region = NULL;
+   }
+   if (!region) {
+      /* Keep the connection so the client's hangup gets processed normally,
+         but any request it makes will be answered with an END. */
+      debug_printf("Shared memory setup failed for client %d\n", (int) pid);
+   }
+
+   connfd = get_new_fd_shmem();
+   fdlist_shmem[connfd].type = LDCS_SHMEM_FD_TYPE_CONN;
+   fdlist_shmem[connfd].fd = conn_sock;
+   fdlist_shmem[connfd].region = region;
+   fdlist_shmem[connfd].pid = pid;
+   debug_printf3("Opened shared memory connection %d to client %d on socket %d\n", connfd, (int) pid, conn_sock);
+
+   pfd.fd = fdlist_shmem[fd].fd;
+   pfd.events = POLLIN;
+   pfd.revents = 0;
+   *more_avail = (poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN));
+
+   return connfd;
+}
+
+int ldcs_close_server_connection_shmem(int fd)
+{
+   if ((fd<0) || (fd>=fdlist_shmem_size))  _error("wrong fd");
+
+   debug_printf3("closing socket %d for conn %d, closing connection\n", fdlist_shmem[fd].fd, fd);
+   if (fdlist_shmem[fd].region)
+      munmap(fdlist_shmem[fd].region, sizeof(shmem_region_t));
+   fdlist_shmem[fd].region = NULL;
+   close(fdlist_shmem[fd].fd);
+
+   free_fd_shmem(fd);
+   return 0;
+}
+
+int ldcs_destroy_server_shmem(int fd)
+{
+   char path[MAX_PATH_LEN];
+
+   if ((fd<0) || (fd>=fdlist_shmem_size))  _error("wrong fd");
+
+   close(fdlist_shmem[fd].fd);
+   snprintf(path, MAX_PATH_LEN, "%s/%s", fdlist_shmem[fd].path, SHMEM_SOCKET_NAME);
+   unlink(path);
+   snprintf(path, MAX_PATH_LEN, "%s/ready", fdlist_shmem[fd].path);
+   unlink(path);
+   rmdir(fdlist_shmem[fd].path);
+   free_fd_shmem(fd);
+
+   return 0;
+}
+
+/* ************************************************************** */
+/* message transfer functions                                     */
+/* ************************************************************** */
+
+/* How long the server sleeps on a stalled ring before checking on the
+   client, and how long a client may make no progress at all before it's
+   dropped.  The server is single-threaded, so while it waits here every
+   other client waits too. */
+#define SHMEM_WAIT_SLICE_MS 10
+#define SHMEM_STALL_MS 2000
+
+typedef struct {
+   int fd;
+   int stalled_ms;
+} wait_state_t;
+
+/**
+ * Only reached if a client stopped reading its replies or stopped partway
+ * through writing a request.  Sleep on the ring rather than spinning, and
+ * give up if the client hangs up or makes no progress for SHMEM_STALL_MS.
+ **/
+static int wait_client(shmem_ring_t *ring, wait_state_t *state, int for_space)
+{
+   int fd = state->fd;
+   struct pollfd pfd;
+   int result;
+
+   if (for_space)
+      result = shmem_ring_wait_space(ring, SHMEM_WAIT_SLICE_MS);
+   else
+      result = shmem_ring_wait_data(ring, 0, SHMEM_WAIT_SLICE_MS);
+   if (result == 0) {
+      state->stalled_ms = 0;
+      return 0;
+   }
+
+   pfd.fd = fdlist_shmem[fd].fd;
+   pfd.events = POLLRDHUP;
+   pfd.revents = 0;
+   if (poll(&pfd, 1, 0) == 1 && (pfd.revents & (POLLRDHUP | POLLHUP | POLLERR))) {
+      err_printf("Client %d hung up during a shared memory transfer\n", (int) fdlist_shmem[fd].pid);
+      return -1;
+   }
+   state->stalled_ms += SHMEM_WAIT_SLICE_MS;
+   if (state->stalled_ms >= SHMEM_STALL_MS) {
+      err_printf("Client %d made no progress on its shared memory ring for %d ms.  Dropping it\n",
+                 (int) fdlist_shmem[fd].pid, SHMEM_STALL_MS);
+      return -1;
+   }
+   return 0;
+}
+
+static int wait_client_space(shmem_ring_t *ring, void *arg)
+{
+   return wait_client(ring, (wait_state_t *) arg, 1);
+}
+
+static int wait_client_data(shmem_ring_t *ring, void *arg)
+{
+   return wait_client(ring, (wait_state_t *) arg, 0);
+}
+
+/**
+ * A transfer was abandoned partway, so the ring no longer holds whole
+ * messages.  Stop using the region and shut the socket down, so the
+ * listen loop sees the client hang up and cleans it up as usual.
+ **/
+static void drop_client(int fd)
+{
+   if (fdlist_shmem[fd].region)
+      munmap(fdlist_shmem[fd].region, sizeof(shmem_region_t));
+   fdlist_shmem[fd].region = NULL;
+   shutdown(fdlist_shmem[fd].fd, SHUT_RDWR);
+}
+
+int ldcs_send_msg_shmem(int fd, ldcs_message_t * msg)
+{
+   struct iovec iov[2];
+   wait_state_t state;
+
+   if ((fd<0) || (fd>=fdlist_shmem_size))  _error("wrong fd");
+
+   debug_printf3("sending message of type: %s len=%d data=%s ...\n",
+                 _message_type_to_str(msg->header.type),
+                 msg->header.len, msg->data);
+
+   if (!fdlist_shmem[fd].region)
+      return -1;
+
+   iov[0].iov_base = &msg->header;
+   iov[0].iov_len = sizeof(msg->header);
+   iov[1].iov_base = msg->data;
+   iov[1].iov_len = msg->header.len;
+   state.fd = fd;
+   state.stalled_ms = 0;
+   if (shmem_ring_write(&fdlist_shmem[fd].region->to_client, iov, msg->header.len > 0 ? 2 : 1,
+                        wait_client_space, &state) == -1) {
+      err_printf("Failed to send message to client %d\n", (int) fdlist_shmem[fd].pid);
+      drop_client(fd);
+      return -1;
+   }
+   return 0;
+}
+
+int ldcs_recv_msg_static_shmem(int fd, ldcs_message_t *msg, ldcs_read_block_t block)
+{
+   shmem_ring_t *ring;
+   ssize_t n;
+   char doorbell;
+   wait_state_t state;
+
+   msg->header.type = LDCS_MSG_UNKNOWN;
+   msg->header.len = 0;
+   if ((fd<0) || (fd>=fdlist_shmem_size))  _error("wrong fd");
+
+   do {
+      n = read(fdlist_shmem[fd].fd, &doorbell, 1);
+   } while (n == -1 && errno == EINTR);
+   if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK) && block == LDCS_READ_NO_BLOCK)
+      return 0;
+
+   if (n != 1 || !fdlist_shmem[fd].region)
+      goto disconnect;
+
+   ring = &fdlist_shmem[fd].region->to_server;
+   state.fd = fd;
+   state.stalled_ms = 0;
+   if (shmem_ring_read(ring, &msg->header, sizeof(msg->header), wait_client_data, &state) == -1)
+      goto disconnect;
+   if (msg->header.len > MAX_PATH_LEN) {
+      err_printf("Client message of type %d has length %d, larger than the receive buffer.  Dropping client\n",
+                 (int) msg->header.type, msg->header.len);
+      goto disconnect;
+   }
+   if (msg->header.len > 0) {
+      if (shmem_ring_read(ring, msg->data, msg->header.len, wait_client_data, &state) == -1)
+         goto disconnect;
+   }
+   else {
+      *msg->data = '\0';
+   }
+
+   debug_printf3("received message of type: %s len=%d data=%s ...\n",
+                 _message_type_to_str(msg->header.type),
+                 msg->header.len, msg->data);
+   return 0;
+
+  disconnect:
+   /* Disconnect.  Return an artificial client end message */
+   if (n == -1)
+      err_printf("Error reading from client socket %d: %s\n", fdlist_shmem[fd].fd, strerror(errno));
+   debug_printf2("Client disconnected.  Returning END message\n");
+   msg->header.type = LDCS_MSG_END;
+   msg->header.len = 0;
+   msg->data = NULL;
+   return 0;
+}
+
+/**
+ * Pass an open descriptor to the client over the connection's socket.  The
+ * client collects it right after reading the reply that announces it.
+ **/
+int ldcs_send_fd_shmem(int fd, int passfd)
+{
+   struct msghdr hdr;
+   struct iovec iov;
+   struct cmsghdr *cmsg;
+   char c = 0;
+   ssize_t result;
+   union {
+      char buf[CMSG_SPACE(sizeof(int))];
+      struct cmsghdr align;
+   } control;
+
+   if ((fd<0) || (fd>=fdlist_shmem_size))  _error("wrong fd");
+
+   memset(&hdr, 0, sizeof(hdr));
+   memset(&control, 0, sizeof(control));
+   iov.iov_base = &c;
+   iov.iov_len = 1;
+   hdr.msg_iov = &iov;
+   hdr.msg_iovlen = 1;
+   hdr.msg_control = control.buf;
+   hdr.msg_controllen = sizeof(control.buf);
+   cmsg = CMSG_FIRSTHDR(&hdr);
+   cmsg->cmsg_level = SOL_SOCKET;
+   cmsg->cmsg_type = SCM_RIGHTS;
+   cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+   memcpy(CMSG_DATA(cmsg), &passfd, sizeof(int));
+   do {
+      result = sendmsg(fdlist_shmem[fd].fd, &hdr, MSG_NOSIGNAL);
+   } while (result == -1 && errno == EINTR);
+   if (result != 1) {
+      err_printf("Could not pass fd %d to client %d: %s\n", passfd, (int) fdlist_shmem[fd].pid,
+                 strerror(errno));
+      return -1;
+   }
+   return 0;
+}
+
+int ldcs_get_aux_fd_shmem()
+{
+   return -1;
+}
+
+int ldcs_socket_id_to_nc_shmem(int id, int fd, ldcs_process_data_t *process_data)
+{
+   return id;
+}
@@ -336,6 +336,11 @@ int ldcs_recv_msg_static_socket(int fd, ldcs_message_t *msg,  ldcs_read_block_t
   return(0);
 }
 
+int ldcs_send_fd_socket(int fd, int passfd)
+{
+   return -1;
+}
+
 int ldcs_get_aux_fd_socket()
 {
    return -1;
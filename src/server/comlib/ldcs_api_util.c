@@ -45,6 +45,10 @@ char* _message_type_to_str (ldcs_message_ids_t type) {
       STR_CASE(LDCS_MSG_EXISTS_ANSWER);
       STR_CASE(LDCS_MSG_ORIGPATH_QUERY);
       STR_CASE(LDCS_MSG_ORIGPATH_ANSWER);
+      STR_CASE(LDCS_MSG_SONAME_QUERY);
+      STR_CASE(LDCS_MSG_SONAME_ANSWER);
+      STR_CASE(LDCS_MSG_EXECPATH_QUERY);
+      STR_CASE(LDCS_MSG_EXECPATH_ANSWER);
       STR_CASE(LDCS_MSG_END);
       STR_CASE(LDCS_MSG_CWD);
       STR_CASE(LDCS_MSG_PID);
@@ -80,6 +84,14 @@ char* _message_type_to_str (ldcs_message_ids_t type) {
       STR_CASE(LDCS_MSG_EXIT_CANCEL);
       STR_CASE(LDCS_MSG_BUNDLE);
       STR_CASE(LDCS_MSG_ALIAS);
+      STR_CASE(LDCS_MSG_PYPACK);
+      STR_CASE(LDCS_MSG_FILE_QUERY_FD);
+      STR_CASE(LDCS_MSG_EXIT_DRAINING);
+      STR_CASE(LDCS_MSG_EXIT_STATUS_REQ);
+      STR_CASE(LDCS_MSG_EXIT_STATUS);
+      STR_CASE(LDCS_MSG_TRACE);
+      STR_CASE(LDCS_MSG_TRACE_DATA);
+      STR_CASE(LDCS_MSG_FILESTATS);
       STR_CASE(LDCS_MSG_UNKNOWN);
    }
    return "unknown";
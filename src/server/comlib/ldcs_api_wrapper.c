@@ -42,6 +42,7 @@ extern int RENAME(ldcs_open_server_connections) (int fd, int nc, int *more_avail
 extern int RENAME(ldcs_close_server_connection) (int connid);
 extern int RENAME(ldcs_destroy_server) (int cid);
 extern int RENAME(ldcs_send_msg) (int fd, ldcs_message_t *msg);
+extern int RENAME(ldcs_send_fd) (int fd, int passfd);
 extern int RENAME(ldcs_get_fd)(int fd);
 extern int RENAME(ldcs_get_aux_fd)();
 extern int RENAME(ldcs_recv_msg_static)(int connid, ldcs_message_t *msg, ldcs_read_block_t block);
@@ -77,6 +78,11 @@ int ldcs_send_msg(int fd, ldcs_message_t *msg)
    return RENAME(ldcs_send_msg)(fd, msg);
 }
 
+int ldcs_send_fd(int fd, int passfd)
+{
+   return RENAME(ldcs_send_fd)(fd, passfd);
+}
+
 int ldcs_get_fd(int fd) 
 {
    return RENAME(ldcs_get_fd)(fd);
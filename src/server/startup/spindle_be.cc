@@ -23,6 +23,7 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 #include "handshake.h"
 #include "ldcs_cobo.h"
 #include "exitnote.h"
+#include "ldcs_audit_server_trace.h"
 
 #include <cstdlib>
 #include <cassert>
@@ -66,6 +67,7 @@ static int unpack_data(spindle_args_t *args, void *buffer, int buffer_size)
    unpack_param(args->numa_files, buf, pos);
    unpack_param(args->numa_excludes, buf, pos);
    unpack_param(args->rsh_command, buf, pos);
+   unpack_param(args->fdpass_limit, buf, pos);
    assert(pos == buffer_size);
 
    return 0;    
@@ -119,6 +121,7 @@ int spindleRunBE(unsigned int port, unsigned int num_ports, unique_id_t unique_i
    spindle_args_t args;
 
    LOGGING_INIT(const_cast<char *>("Server"));
+   trace_server_event(TRACE_BE_START, TRACE_INSTANT);
 
    initSecurity(security_type, unique_id);
 
@@ -0,0 +1,281 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT
+file in the top level directory, or at
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms
+and conditions of the GNU Lesser General Public License for more details.  You should
+have received a copy of the GNU Lesser General Public License along with this
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <sys/mman.h>
+
+#include "dirindex.h"
+#include "spindle_debug.h"
+
+#define SLOT_MASK (DIRINDEX_SLOTS - 1)
+#define ALIGN4(X) (((X) + 3) & ~((size_t) 3))
+#define DATA_SIZE(INDEX) ((INDEX)->size - offsetof(dirindex_t, data))
+#define BLOOM_BITS_PER_NAME 12
+#define BLOOM_HASHES 4
+
+static uint32_t dir_hash(const char *dir, size_t len)
+{
+   uint32_t hash = 2166136261u;
+   size_t i;
+   for (i = 0; i < len; i++) {
+      hash ^= (unsigned char) dir[i];
+      hash *= 16777619u;
+   }
+   return hash;
+}
+
+static uint64_t name_hash(const char *name, size_t len)
+{
+   uint64_t hash = 14695981039346656037ull;
+   size_t i;
+   for (i = 0; i < len; i++) {
+      hash ^= (unsigned char) name[i];
+      hash *= 1099511628211ull;
+   }
+   return hash;
+}
+
+/* Double hashing: the i'th bit for a name is h1 + i*h2 */
+#define FOREACH_BLOOM_BIT(HASH, BITS, BIT, I)                           \
+   for (I = 0, BIT = (uint32_t) (HASH) & ((BITS) - 1);                   \
+        I < BLOOM_HASHES;                                               \
+        I++, BIT = ((uint32_t) (HASH) + I * ((uint32_t) ((HASH) >> 32) | 1)) & ((BITS) - 1))
+
+static dirindex_dir_t *slot_record(dirindex_t *index, uint32_t slot)
+{
+   uint32_t off = __atomic_load_n(&index->slots[slot], __ATOMIC_ACQUIRE);
+   if (!off || off - 1 >= DATA_SIZE(index))
+      return NULL;
+   return (dirindex_dir_t *) (index->data + off - 1);
+}
+
+static const char *record_dir(dirindex_dir_t *rec)
+{
+   return (const char *) (rec + 1);
+}
+
+static uint32_t *record_bloom(dirindex_dir_t *rec)
+{
+   return (uint32_t *) ((char *) (rec + 1) + ALIGN4(rec->dir_len + 1));
+}
+
+/**
+ * Return the slot holding dir's record, or the empty slot where it would
+ * go.  Returns -1 if the table is full.
+ **/
+static int find_slot(dirindex_t *index, const char *dir, size_t dir_len, uint32_t hash)
+{
+   uint32_t slot = hash & SLOT_MASK, i;
+   dirindex_dir_t *rec;
+
+   for (i = 0; i < DIRINDEX_SLOTS; i++, slot = (slot + 1) & SLOT_MASK) {
+      rec = slot_record(index, slot);
+      if (!rec)
+         return (int) slot;
+      if (rec->hash == hash && rec->dir_len == dir_len &&
+          memcmp(record_dir(rec), dir, dir_len) == 0)
+         return (int) slot;
+   }
+   return -1;
+}
+
+dirindex_t *dirindex_create(const char *location)
+{
+   char path[4096];
+   dirindex_t *index;
+   int fd;
+
+   snprintf(path, sizeof(path), "%s/%s", location, DIRINDEX_FILENAME);
+   fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0600);
+   if (fd == -1) {
+      err_printf("Could not create directory index %s: %s\n", path, strerror(errno));
+      return NULL;
+   }
+   if (ftruncate(fd, DIRINDEX_SIZE) == -1) {
+      err_printf("Could not size directory index %s: %s\n", path, strerror(errno));
+      close(fd);
+      return NULL;
+   }
+   index = (dirindex_t *) mmap(NULL, DIRINDEX_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd);
+   if (index == MAP_FAILED) {
+      err_printf("Could not map directory index %s: %s\n", path, strerror(errno));
+      return NULL;
+   }
+
+   index->size = DIRINDEX_SIZE;
+   __atomic_store_n(&index->magic, DIRINDEX_MAGIC, __ATOMIC_RELEASE);
+   debug_printf2("Created directory index at %s\n", path);
+   return index;
+}
+
+/**
+ * Publish the entries found in dir.  names are the directory's entries,
+ * or NULL for a directory that doesn't exist.  Returns -1 if the index is
+ * out of space, in which case clients keep asking the server.
+ **/
+int dirindex_add_dir(dirindex_t *index, const char *dir, char **names, int num_names)
+{
+   size_t dir_len = strlen(dir), rec_size;
+   uint32_t hash = dir_hash(dir, dir_len), used, bloom_bits = 0, bit, *bloom;
+   uint64_t nhash;
+   dirindex_dir_t *rec;
+   int i, j, slot;
+
+   slot = find_slot(index, dir, dir_len, hash);
+   if (slot == -1 || (!slot_record(index, slot) && index->num_dirs >= DIRINDEX_SLOTS / 2)) {
+      debug_printf("Directory index has no free slots.  Not indexing %s\n", dir);
+      return -1;
+   }
+
+   if (num_names) {
+      bloom_bits = 64;
+      while (bloom_bits < (uint32_t) num_names * BLOOM_BITS_PER_NAME)
+         bloom_bits *= 2;
+   }
+
+   rec_size = sizeof(dirindex_dir_t) + ALIGN4(dir_len + 1) + bloom_bits / 8;
+   used = index->data_used;
+   if (used + rec_size > DATA_SIZE(index)) {
+      debug_printf("Directory index is full.  Not indexing %s\n", dir);
+      return -1;
+   }
+
+   rec = (dirindex_dir_t *) (index->data + used);
+   rec->hash = hash;
+   rec->dir_len = dir_len;
+   rec->num_names = num_names;
+   rec->bloom_bits = bloom_bits;
+   memcpy((char *) (rec + 1), dir, dir_len + 1);
+   bloom = record_bloom(rec);
+   memset(bloom, 0, bloom_bits / 8);
+   for (i = 0; i < num_names; i++) {
+      nhash = name_hash(names[i], strlen(names[i]));
+      FOREACH_BLOOM_BIT(nhash, bloom_bits, bit, j)
+         bloom[bit / 32] |= 1u << (bit % 32);
+   }
+
+   __atomic_store_n(&index->data_used, used + rec_size, __ATOMIC_RELEASE);
+   if (!slot_record(index, slot))
+      index->num_dirs++;
+   __atomic_store_n(&index->slots[slot], used + 1, __ATOMIC_RELEASE);
+   debug_printf3("Indexed %d entries of %s\n", num_names, dir);
+   return 0;
+}
+
+dirindex_t *dirindex_map(const char *location)
+{
+   char path[4096];
+   dirindex_t *index;
+   int fd;
+
+   snprintf(path, sizeof(path), "%s/%s", location, DIRINDEX_FILENAME);
+   fd = open(path, O_RDONLY);
+   if (fd == -1) {
+      debug_printf2("No directory index at %s\n", path);
+      return NULL;
+   }
+   index = (dirindex_t *) mmap(NULL, DIRINDEX_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if (index == MAP_FAILED) {
+      debug_printf("Could not map directory index %s\n", path);
+      return NULL;
+   }
+   if (__atomic_load_n(&index->magic, __ATOMIC_ACQUIRE) != DIRINDEX_MAGIC || index->size != DIRINDEX_SIZE) {
+      debug_printf("Directory index %s is not initialized\n", path);
+      munmap(index, DIRINDEX_SIZE);
+      return NULL;
+   }
+   return index;
+}
+
+/**
+ * Find dir's record and check whether the entry name of length len might
+ * be in it.  Returns -1 if dir isn't indexed.
+ **/
+static int may_have_entry(dirindex_t *index, const char *dir, size_t dir_len, const char *name, size_t len)
+{
+   dirindex_dir_t *rec;
+   uint32_t *bloom, bit;
+   uint64_t nhash;
+   int slot, i;
+
+   slot = find_slot(index, dir, dir_len, dir_hash(dir, dir_len));
+   if (slot == -1)
+      return -1;
+   rec = slot_record(index, slot);
+   if (!rec)
+      return -1;
+   if (!rec->bloom_bits)
+      return 0;
+
+   bloom = record_bloom(rec);
+   nhash = name_hash(name, len);
+   FOREACH_BLOOM_BIT(nhash, rec->bloom_bits, bit, i) {
+      if (!(bloom[bit / 32] & (1u << (bit % 32))))
+         return 0;
+   }
+   return 1;
+}
+
+static int is_dot_name(const char *name, size_t len)
+{
+   return (len == 1 && name[0] == '.') || (len == 2 && name[0] == '.' && name[1] == '.');
+}
+
+/**
+ * Returns DIRINDEX_MISSING if the index shows path can't exist, or
+ * DIRINDEX_UNKNOWN if the server must be asked.  If path's directory
+ * hasn't been listed we check for the directory in its parent, which
+ * answers probes like pkg/__init__.py for a pkg that doesn't exist.
+ **/
+int dirindex_lookup(dirindex_t *index, const char *path)
+{
+   const char *last_slash, *parent_slash;
+   size_t dir_len, len;
+   int result;
+
+   last_slash = strrchr(path, '/');
+   if (!last_slash || last_slash == path || last_slash[1] == '\0')
+      return DIRINDEX_UNKNOWN;
+   dir_len = last_slash - path;
+   len = strlen(last_slash + 1);
+   if (is_dot_name(last_slash + 1, len))
+      return DIRINDEX_UNKNOWN;
+
+   result = may_have_entry(index, path, dir_len, last_slash + 1, len);
+   if (result != -1)
+      return result ? DIRINDEX_UNKNOWN : DIRINDEX_MISSING;
+
+   parent_slash = memrchr(path, '/', dir_len);
+   if (!parent_slash || parent_slash == path)
+      return DIRINDEX_UNKNOWN;
+   len = dir_len - (parent_slash + 1 - path);
+   if (!len || is_dot_name(parent_slash + 1, len))
+      return DIRINDEX_UNKNOWN;
+   result = may_have_entry(index, path, parent_slash - path, parent_slash + 1, len);
+   return result == 0 ? DIRINDEX_MISSING : DIRINDEX_UNKNOWN;
+}
@@ -0,0 +1,79 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT
+file in the top level directory, or at
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms
+and conditions of the GNU Lesser General Public License for more details.  You should
+have received a copy of the GNU Lesser General Public License along with this
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#if !defined(DIRINDEX_H_)
+#define DIRINDEX_H_
+
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * Index of the entries in each directory the server has listed.  The
+ * server is the only writer and publishes it in a file under its location,
+ * which clients map read-only.  Each directory's record holds a bloom
+ * filter of its entry names.  If a probe's name misses the filter of its
+ * directory the file can't exist, and the client answers ENOENT without
+ * asking the server or touching the shmcache.  A hit only means the
+ * server must be asked.
+ *
+ * Records are appended to data and never changed once published.  A slot
+ * holds the offset (plus one) of a directory's current record; relisting a
+ * directory publishes a new record and swaps the slot.
+ **/
+
+#define DIRINDEX_MAGIC 0x44495849
+#define DIRINDEX_FILENAME "spindle_dirindex"
+#define DIRINDEX_SIZE (16*1024*1024)
+#define DIRINDEX_SLOTS 65536
+
+typedef struct dirindex_t {
+   uint32_t magic;
+   uint32_t size;
+   volatile uint32_t data_used;
+   volatile uint32_t num_dirs;
+   volatile uint32_t slots[DIRINDEX_SLOTS];
+   unsigned char data[];
+} dirindex_t;
+
+/* Followed by the NUL-terminated directory name, padded to 4 bytes, then
+   bloom_bits/32 words of bloom filter.  A directory with no entries (or
+   that doesn't exist) has no filter bits. */
+typedef struct {
+   uint32_t hash;
+   uint32_t dir_len;
+   uint32_t num_names;
+   uint32_t bloom_bits;
+} dirindex_dir_t;
+
+#define DIRINDEX_UNKNOWN 0
+#define DIRINDEX_MISSING 1
+
+/* Server side */
+dirindex_t *dirindex_create(const char *location);
+int dirindex_add_dir(dirindex_t *index, const char *dir, char **names, int num_names);
+
+/* Client side */
+dirindex_t *dirindex_map(const char *location);
+int dirindex_lookup(dirindex_t *index, const char *path);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
@@ -0,0 +1,288 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT
+file in the top level directory, or at
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms
+and conditions of the GNU Lesser General Public License for more details.  You should
+have received a copy of the GNU Lesser General Public License along with this
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pathcode.h"
+
+#define MAX_NAME_LEN 4096
+#define INITIAL_SIZE 4096
+
+typedef struct {
+   char *data;
+   size_t size;
+   size_t pos;
+} writer_t;
+
+typedef struct {
+   const char *data;
+   size_t len;
+   size_t pos;
+} reader_t;
+
+static int reserve(writer_t *w, size_t bytes)
+{
+   char *new_data;
+   size_t new_size = w->size ? w->size : INITIAL_SIZE;
+
+   if (w->pos + bytes <= w->size)
+      return 0;
+   while (w->pos + bytes > new_size)
+      new_size *= 2;
+   new_data = (char *) realloc(w->data, new_size);
+   if (!new_data)
+      return -1;
+   w->data = new_data;
+   w->size = new_size;
+   return 0;
+}
+
+static int put_varint(writer_t *w, uint64_t val)
+{
+   if (reserve(w, 10) == -1)
+      return -1;
+   while (val >= 0x80) {
+      w->data[w->pos++] = (char) ((val & 0x7f) | 0x80);
+      val >>= 7;
+   }
+   w->data[w->pos++] = (char) val;
+   return 0;
+}
+
+static int put_frontcoded(writer_t *w, const char *prev, const char *str)
+{
+   size_t shared = 0, rest;
+
+   if (prev) {
+      while (prev[shared] && prev[shared] == str[shared])
+         shared++;
+   }
+   rest = strlen(str + shared);
+   if (put_varint(w, shared) == -1 || put_varint(w, rest) == -1 || reserve(w, rest) == -1)
+      return -1;
+   memcpy(w->data + w->pos, str + shared, rest);
+   w->pos += rest;
+   return 0;
+}
+
+static int get_varint(reader_t *r, uint64_t *val)
+{
+   unsigned int shift = 0;
+   unsigned char c;
+
+   *val = 0;
+   do {
+      if (r->pos >= r->len || shift > 63)
+         return -1;
+      c = (unsigned char) r->data[r->pos++];
+      *val |= ((uint64_t) (c & 0x7f)) << shift;
+      shift += 7;
+   } while (c & 0x80);
+   return 0;
+}
+
+/**
+ * str holds the previous string, and is overwritten with the next one.
+ **/
+static int get_frontcoded(reader_t *r, char *str, size_t size)
+{
+   uint64_t shared, rest;
+
+   if (get_varint(r, &shared) == -1 || get_varint(r, &rest) == -1)
+      return -1;
+   if (shared > strlen(str) || shared + rest >= size || rest > r->len - r->pos)
+      return -1;
+   memcpy(str + shared, r->data + r->pos, rest);
+   str[shared + rest] = '\0';
+   r->pos += rest;
+   return 0;
+}
+
+static int cmp_strs(const void *a, const void *b)
+{
+   return strcmp(*((const char **) a), *((const char **) b));
+}
+
+int pathcode_encode_dir(const char *dir, const char **names, int num_names, int exists,
+                        char **data, size_t *len)
+{
+   writer_t w = { NULL, 0, 0 };
+   int i;
+
+   if (num_names)
+      qsort(names, num_names, sizeof(char *), cmp_strs);
+   if (put_frontcoded(&w, NULL, dir) == -1 || put_varint(&w, exists ? num_names + 1 : 0) == -1)
+      goto error;
+   for (i = 0; exists && i < num_names; i++) {
+      if (put_frontcoded(&w, i ? names[i-1] : NULL, names[i]) == -1)
+         goto error;
+   }
+   *data = w.data;
+   *len = w.pos;
+   return 0;
+
+  error:
+   free(w.data);
+   return -1;
+}
+
+int pathcode_decode_dir(const char *data, size_t len,
+                        void (*entry_cb)(const char *dir, const char *name, void *arg), void *arg)
+{
+   reader_t r = { data, len, 0 };
+   char dir[MAX_NAME_LEN], name[MAX_NAME_LEN];
+   uint64_t count, i;
+
+   dir[0] = name[0] = '\0';
+   if (get_frontcoded(&r, dir, sizeof(dir)) == -1 || get_varint(&r, &count) == -1)
+      return -1;
+   if (!count) {
+      entry_cb(dir, NULL, arg);
+      return 0;
+   }
+   for (i = 0; i < count - 1; i++) {
+      if (get_frontcoded(&r, name, sizeof(name)) == -1)
+         return -1;
+      entry_cb(dir, name, arg);
+   }
+   return 0;
+}
+
+int pathcode_encode_list(const char **dirs, int num_dirs, const char **files, int num_files,
+                         char **data, size_t *len)
+{
+   writer_t w = { NULL, 0, 0 };
+   const char *slash, *dir, **found, *prev_name = NULL;
+   char dirname[MAX_NAME_LEN];
+   size_t dir_len;
+   int i;
+
+   if (num_dirs)
+      qsort(dirs, num_dirs, sizeof(char *), cmp_strs);
+   if (num_files)
+      qsort(files, num_files, sizeof(char *), cmp_strs);
+
+   if (put_varint(&w, num_dirs) == -1)
+      goto error;
+   for (i = 0; i < num_dirs; i++) {
+      if (put_frontcoded(&w, i ? dirs[i-1] : NULL, dirs[i]) == -1)
+         goto error;
+   }
+
+   if (put_varint(&w, num_files) == -1)
+      goto error;
+   for (i = 0; i < num_files; i++) {
+      slash = strrchr(files[i], '/');
+      if (!slash)
+         goto error;
+      dir_len = (slash == files[i]) ? 1 : (size_t) (slash - files[i]);
+      if (dir_len >= sizeof(dirname))
+         goto error;
+      memcpy(dirname, files[i], dir_len);
+      dirname[dir_len] = '\0';
+      dir = dirname;
+      found = (const char **) bsearch(&dir, dirs, num_dirs, sizeof(char *), cmp_strs);
+      if (!found)
+         goto error;
+      if (put_varint(&w, found - dirs) == -1 || put_frontcoded(&w, prev_name, slash + 1) == -1)
+         goto error;
+      prev_name = slash + 1;
+   }
+   *data = w.data;
+   *len = w.pos;
+   return 0;
+
+  error:
+   free(w.data);
+   return -1;
+}
+
+int pathcode_list_open(pathcode_list_t *list, const char *data, size_t len)
+{
+   reader_t r = { data, len, 0 };
+   char dir[MAX_NAME_LEN];
+   uint64_t num_dirs, num_files, i;
+
+   memset(list, 0, sizeof(*list));
+   if (get_varint(&r, &num_dirs) == -1 || num_dirs > len)
+      return -1;
+   list->dirs = (char **) calloc(num_dirs ? num_dirs : 1, sizeof(char *));
+   if (!list->dirs)
+      return -1;
+   dir[0] = '\0';
+   for (i = 0; i < num_dirs; i++) {
+      if (get_frontcoded(&r, dir, sizeof(dir)) == -1 || !(list->dirs[i] = strdup(dir)))
+         goto error;
+      list->num_dirs++;
+   }
+   if (get_varint(&r, &num_files) == -1 || num_files > len)
+      goto error;
+
+   list->data = data;
+   list->len = len;
+   list->pos = r.pos;
+   list->num_files = (int) num_files;
+   return 0;
+
+  error:
+   pathcode_list_close(list);
+   return -1;
+}
+
+int pathcode_list_next(pathcode_list_t *list, char *path, size_t path_size, int *is_dir)
+{
+   reader_t r = { list->data, list->len, list->pos };
+   uint64_t dir_index;
+   const char *dir;
+   int result;
+
+   if (list->cur < list->num_dirs) {
+      if (strlen(list->dirs[list->cur]) >= path_size)
+         return -1;
+      strcpy(path, list->dirs[list->cur++]);
+      *is_dir = 1;
+      return 1;
+   }
+   if (list->cur >= list->num_dirs + list->num_files)
+      return 0;
+
+   if (get_varint(&r, &dir_index) == -1 || dir_index >= (uint64_t) list->num_dirs ||
+       get_frontcoded(&r, list->name, sizeof(list->name)) == -1)
+      return -1;
+   list->pos = r.pos;
+   list->cur++;
+
+   dir = list->dirs[dir_index];
+   if (strcmp(dir, "/") == 0)
+      dir = "";
+   result = snprintf(path, path_size, "%s/%s", dir, list->name);
+   if (result < 0 || (size_t) result >= path_size)
+      return -1;
+   *is_dir = 0;
+   return 1;
+}
+
+void pathcode_list_close(pathcode_list_t *list)
+{
+   int i;
+   for (i = 0; i < list->num_dirs; i++)
+      free(list->dirs[i]);
+   free(list->dirs);
+   list->dirs = NULL;
+   list->num_dirs = 0;
+}
@@ -0,0 +1,78 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT
+file in the top level directory, or at
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms
+and conditions of the GNU Lesser General Public License for more details.  You should
+have received a copy of the GNU Lesser General Public License along with this
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#if !defined(PATHCODE_H_)
+#define PATHCODE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * Compact wire encodings for lists of paths, which share long prefixes.
+ * Lengths and counts are varints (7 bits per byte, low bits first).  A
+ * string is front-coded against the one before it as the length of the
+ * prefix it shares, the length of the rest, then the rest.
+ *
+ * A directory listing is the directory, then the number of names plus
+ * one (zero if the directory doesn't exist), then the sorted names each
+ * front-coded against the previous one.
+ *
+ * A path list is the number of directories, the sorted directories each
+ * front-coded against the previous one, then the number of files and for
+ * each the index of its directory and its name front-coded against the
+ * previous file's name.
+ **/
+
+int pathcode_encode_dir(const char *dir, const char **names, int num_names, int exists,
+                        char **data, size_t *len);
+
+/* Calls entry_cb(dir, name, arg) for each name, or entry_cb(dir, NULL, arg)
+   once if the directory doesn't exist.  The strings are only valid during
+   the call.  Returns -1 if data is malformed. */
+int pathcode_decode_dir(const char *data, size_t len,
+                        void (*entry_cb)(const char *dir, const char *name, void *arg), void *arg);
+
+/* files are full paths.  dirs and files are sorted in place. */
+int pathcode_encode_list(const char **dirs, int num_dirs, const char **files, int num_files,
+                         char **data, size_t *len);
+
+typedef struct {
+   const char *data;
+   size_t len;
+   size_t pos;
+   char **dirs;
+   int num_dirs;
+   int num_files;
+   int cur;
+   int last_dir;
+   char name[4096];
+} pathcode_list_t;
+
+int pathcode_list_open(pathcode_list_t *list, const char *data, size_t len);
+/* Copies the next path into path, directories first.  Returns 1 and sets
+   *is_dir for a path, 0 at the end of the list and -1 if it's malformed. */
+int pathcode_list_next(pathcode_list_t *list, char *path, size_t path_size, int *is_dir);
+void pathcode_list_close(pathcode_list_t *list);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
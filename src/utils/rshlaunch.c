@@ -32,8 +32,9 @@ Place, Suite 330, Boston, MA 02111-1307 USA
 
 static int daemon_argc;
 static char **daemon_argv;
-static int rsh_start_daemon(const char *hostname);
+static int rsh_start_daemons(const char **hostnames, int num_hosts);
 static char *rsh_cmd = NULL;
+static int rsh_max_procs = 1;
 static int is_fe;
 static pid_t fe_rsh_pid = (pid_t) -1;
 static int daemon_argv_needs_free = 0;
@@ -49,6 +50,15 @@ static int daemon_argv_needs_free = 0;
 
 #define SPINDLE_BE_PATH LIBEXECDIR "/spindle_be"
 
+/* Number of times a failed rsh is re-run before giving up on a child */
+#define RSH_SPAWN_RETRIES 3
+/* Milliseconds before the first re-run of a failed rsh, doubled for each later one */
+#define RSH_RETRY_BACKOFF_MS 250
+/* Exit code ssh reserves for its own errors, such as failing to connect */
+#define RSH_CONNECT_FAILED 255
+/* Milliseconds between checks on running rsh processes */
+#define RSH_POLL_MS 5
+
 static char *get_rsh_command(spindle_args_t *args)
 {
    char *rsh_command;
@@ -72,6 +82,7 @@ void init_rsh_launch_fe(spindle_args_t *args)
 {
    int n = 0;
    char sec_mode_str[32], number_str[32], port_str[32], num_ports_str[32], unique_id_str[32], debug_str[32];
+   char max_procs_str[32];
    char *pwd, *debug;
 
    if (!(args->opts & OPT_RSHLAUNCH))
@@ -80,6 +91,8 @@ void init_rsh_launch_fe(spindle_args_t *args)
    is_fe = 1;
 
    rsh_cmd = get_rsh_command(args);
+   rsh_max_procs = args->rsh_max_procs ? (int) args->rsh_max_procs : 1;
+   cobo_set_tree_fanout((int) args->rsh_fanout);
 
    snprintf(sec_mode_str, sizeof(sec_mode_str), "%d", (int) OPT_GET_SEC(args->opts));
    snprintf(number_str, sizeof(number_str), "%u",  args->number);
@@ -87,8 +100,9 @@ void init_rsh_launch_fe(spindle_args_t *args)
    snprintf(num_ports_str, sizeof(num_ports_str), "%u", args->num_ports);
    snprintf(unique_id_str, sizeof(unique_id_str), "%lu", (unsigned long) args->unique_id);
    snprintf(debug_str, sizeof(debug_str), "%d", (int) spindle_debug_prints);
+   snprintf(max_procs_str, sizeof(max_procs_str), "%d", rsh_max_procs);
 
-#define NUM_SPINDLEBE_ARGS 15
+#define NUM_SPINDLEBE_ARGS 17
    daemon_argv = (char **) malloc(sizeof(char*) * NUM_SPINDLEBE_ARGS);
    daemon_argv[n++] = strdup(SPINDLE_BE_PATH);
    //Don't have environment forwarding.  So add SPINDLE_DEBUG, SPINDLE_TEST, and PWD to command line.
@@ -112,13 +126,15 @@ void init_rsh_launch_fe(spindle_args_t *args)
    daemon_argv[n++] = strdup(port_str);
    daemon_argv[n++] = strdup(num_ports_str);
    daemon_argv[n++] = strdup(unique_id_str);
+   daemon_argv[n++] = strdup("--rsh_max_procs");
+   daemon_argv[n++] = strdup(max_procs_str);
    daemon_argv[n] = NULL;
    daemon_argv_needs_free = 1;
    assert(n < NUM_SPINDLEBE_ARGS);
    daemon_argc = n;
 
    debug_printf2("Registering preconnect callback\n");
-   cobo_register_preconnect_cb(rsh_start_daemon);
+   cobo_register_preconnect_cb(rsh_start_daemons);
 }
 
 int collect_rsh_pid_fe()
@@ -177,6 +193,12 @@ void init_rsh_launch_be(int argc, char **argv)
          rsh_cmd = argv[i+1];
       }
 
+      if (strcmp(argv[i], "--rsh_max_procs") == 0 && i+1 < argc) {
+         rsh_max_procs = atoi(argv[i+1]);
+         if (rsh_max_procs < 1)
+            rsh_max_procs = 1;
+      }
+
       if (strcmp(argv[i], "--dochild") == 0) {
          has_dochild = i;
       }
@@ -185,8 +207,8 @@ void init_rsh_launch_be(int argc, char **argv)
       debug_printf2("No rsh launch\n");
       return;
    }
-   debug_printf2("RSH launch enabled.  %s dochild. Rsh command is %s\n",
-                 (has_dochild == -1) ? "Do not have" : "Have", rsh_cmd);
+   debug_printf2("RSH launch enabled.  %s dochild. Rsh command is %s. Running up to %d rsh at once\n",
+                 (has_dochild == -1) ? "Do not have" : "Have", rsh_cmd, rsh_max_procs);
 
    //We'll do a nohup style fork here and re-exec ourselves to
    // close the parent's rsh session.  Strip the --dochild
@@ -232,15 +254,18 @@ void init_rsh_launch_be(int argc, char **argv)
    daemon_argv = new_argv;
 
    debug_printf2("Registering preconnect callback\n");
-   cobo_register_preconnect_cb(rsh_start_daemon);   
+   cobo_register_preconnect_cb(rsh_start_daemons);   
 }
 
-static int rsh_start_daemon(const char *hostname)
+/* Forks an rsh to start a daemon on hostname.  Returns -1, with nothing left running,
+   if the rsh could not be forked or exec'd. */
+static pid_t rsh_fork_daemon(const char *hostname)
 {
    pid_t pid;
-   int result, status;
    char **new_argv;
    int i = 0, j = 0;
+   int exec_pipe[2], exec_errno;
+   ssize_t result;
 
    debug_printf3("Starting child daemon on %s with rsh\n", hostname);
 
@@ -260,52 +285,204 @@ static int rsh_start_daemon(const char *hostname)
       bare_printf3("\n");
    }
    
+   //The child writes errno down a close-on-exec pipe if exec fails, so
+   // EOF on the pipe means the rsh is running.
+   if (pipe(exec_pipe) == -1) {
+      err_printf("Could not create pipe for rsh process for %s: %s\n", hostname, strerror(errno));
+      free(new_argv);
+      return (pid_t) -1;
+   }
+   fcntl(exec_pipe[1], F_SETFD, FD_CLOEXEC);
+
    pid = fork();
-   if (pid) {
-      debug_printf3("Forked process %d to be our rsh proc\n", (int) pid);
+   if (pid == -1) {
+      err_printf("Could not fork rsh process for %s: %s\n", hostname, strerror(errno));
+      close(exec_pipe[0]);
+      close(exec_pipe[1]);
+      free(new_argv);
+      return (pid_t) -1;
+   }
+   else if (pid == 0) {
+      close(exec_pipe[0]);
+      execvp(new_argv[0], new_argv);
+      exec_errno = errno;
+      err_printf("Exec for rsh command %s did not succeed\n", new_argv[0]);
+      result = write(exec_pipe[1], &exec_errno, sizeof(exec_errno));
+      exit(-1);
+   }
 
-      if (!is_fe) {
-         for(;;) {
-            result = waitpid(pid, &status, 0);
-            if (result == -1 && errno == EINTR)
+   close(exec_pipe[1]);
+   do {
+      result = read(exec_pipe[0], &exec_errno, sizeof(exec_errno));
+   } while (result == -1 && errno == EINTR);
+   close(exec_pipe[0]);
+   if (result == sizeof(exec_errno)) {
+      err_printf("Could not exec rsh command %s for %s: %s\n", new_argv[0], hostname, strerror(exec_errno));
+      while (waitpid(pid, NULL, 0) == -1 && errno == EINTR);
+      free(new_argv);
+      return (pid_t) -1;
+   }
+
+   debug_printf3("Forked process %d to be our rsh proc\n", (int) pid);
+   free(new_argv);
+   return pid;
+}
+
+/* Returns 1 if the rsh process in pid finished, 0 if it is still running, and -1 if
+   it could not be waited on.  *success is set to whether rsh exited with code 0, and
+   *can_retry to whether it failed before reaching the host.  Any other failure may
+   have happened after the daemon started, so re-running it could start a second one. */
+static int rsh_check_daemon(pid_t pid, const char *hostname, int *success, int *can_retry)
+{
+   int result, status;
+
+   do {
+      result = waitpid(pid, &status, WNOHANG);
+   } while (result == -1 && errno == EINTR);
+
+   if (result == 0)
+      return 0;
+   if (result == -1) {
+      err_printf("Error calling waitpid(%d) for rsh to %s: %s\n", (int) pid, hostname, strerror(errno));
+      return -1;
+   }
+
+   *success = 0;
+   *can_retry = 0;
+   if (WIFSIGNALED(status)) {
+      err_printf("Child rsh to %s exited with signal %d\n", hostname, WTERMSIG(status));
+   }
+   else if (WIFEXITED(status) && WEXITSTATUS(status) == RSH_CONNECT_FAILED) {
+      err_printf("Rsh to %s could not connect\n", hostname);
+      *can_retry = 1;
+   }
+   else if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+      err_printf("Rsh to %s did not exit with code 0.  Got %d instead\n", hostname, WEXITSTATUS(status));
+   }
+   else if (WIFEXITED(status)) {
+      debug_printf3("rsh to hostname %s completed successfully\n", hostname);
+      *success = 1;
+   }
+   else {
+      err_printf("Unexpected return from waitpid.  result = %d, status = %d\n", result, status);
+   }
+   return 1;
+}
+
+/* Starts daemons on each of hostnames.  On the FE the rsh process is left running and collected
+   by collect_rsh_pid_fe.  On the BE up to rsh_max_procs rsh processes run at once.  An rsh that
+   failed before reaching its host is retried up to RSH_SPAWN_RETRIES times, waiting
+   RSH_RETRY_BACKOFF_MS before the first retry and twice as long before each later one. */
+static int rsh_start_daemons(const char **hostnames, int num_hosts)
+{
+   pid_t *pids = NULL;
+   int *attempts = NULL;
+   long *retry_at = NULL;
+   long now = 0;
+   int next = 0, running = 0, done = 0, failed = 0;
+   int i, success, can_retry;
+
+   if (is_fe) {
+      assert(num_hosts == 1);
+      fe_rsh_pid = rsh_fork_daemon(hostnames[0]);
+      if (fe_rsh_pid == (pid_t) -1)
+         failed = 1;
+      goto done;
+   }
+
+   debug_printf2("Starting %d child daemons with up to %d concurrent rsh processes\n", num_hosts, rsh_max_procs);
+   pids = (pid_t *) malloc(sizeof(pid_t) * num_hosts);
+   attempts = (int *) malloc(sizeof(int) * num_hosts);
+   retry_at = (long *) malloc(sizeof(long) * num_hosts);
+   for (i = 0; i < num_hosts; i++) {
+      pids[i] = (pid_t) -1;
+      attempts[i] = 0;
+      retry_at[i] = 0;
+   }
+
+   //now counts the milliseconds slept below, which is never more than the time that passed
+   while (done < num_hosts) {
+      /* Fill free slots, first with retries that are due and then with new hosts */
+      for (i = 0; i < num_hosts && running < rsh_max_procs; i++) {
+         if (pids[i] != (pid_t) -1 || attempts[i] == 0 || attempts[i] > RSH_SPAWN_RETRIES)
+            continue;
+         if (retry_at[i] > now)
+            continue;
+         debug_printf("Retrying rsh to %s (attempt %d)\n", hostnames[i], attempts[i] + 1);
+         pids[i] = rsh_fork_daemon(hostnames[i]);
+         attempts[i]++;
+         if (pids[i] != (pid_t) -1)
+            running++;
+         else
+            retry_at[i] = now + ((long) RSH_RETRY_BACKOFF_MS << (attempts[i] - 1));
+      }
+      while (next < num_hosts && running < rsh_max_procs) {
+         pids[next] = rsh_fork_daemon(hostnames[next]);
+         attempts[next]++;
+         if (pids[next] != (pid_t) -1)
+            running++;
+         else
+            retry_at[next] = now + RSH_RETRY_BACKOFF_MS;
+         next++;
+      }
+
+      /* Give up on hosts that have exhausted their retries */
+      for (i = 0; i < next; i++) {
+         if (pids[i] == (pid_t) -1 && attempts[i] > RSH_SPAWN_RETRIES) {
+            err_printf("Giving up on starting daemon on %s after %d attempts\n", hostnames[i], attempts[i]);
+            attempts[i] = 0;
+            pids[i] = (pid_t) 0;
+            failed = 1;
+            done++;
+         }
+      }
+      if (done == num_hosts)
+         break;
+
+      usleep(RSH_POLL_MS * 1000);
+      now += RSH_POLL_MS;
+      for (i = 0; i < next; i++) {
+         if (pids[i] == (pid_t) -1 || pids[i] == (pid_t) 0)
+            continue;
+         switch (rsh_check_daemon(pids[i], hostnames[i], &success, &can_retry)) {
+            case 0:
                continue;
-            else if (WIFSIGNALED(status)) {
-               err_printf("Child rsh exited with signal %d\n", WTERMSIG(status));
-               return -1;
-            }
-            else if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
-               err_printf("Rsh did not exit with code 0.  Got %d instead\n", WEXITSTATUS(status));
-               return -1;
-            }
-            else if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+            case -1:
+               success = 0;
+               can_retry = 0;
                break;
-            }
-            else {
-               err_printf("Unexpected return from waitpid.  result = %d, status = %d\n", result, status);
-               return -1;
-            }
+         }
+         running--;
+         if (success) {
+            pids[i] = (pid_t) 0;
+            done++;
+         }
+         else if (can_retry) {
+            pids[i] = (pid_t) -1;
+            retry_at[i] = now + ((long) RSH_RETRY_BACKOFF_MS << (attempts[i] - 1));
+         }
+         else {
+            err_printf("Not retrying rsh to %s, as its daemon may already have started\n", hostnames[i]);
+            pids[i] = (pid_t) 0;
+            failed = 1;
+            done++;
          }
       }
-      else {
-         fe_rsh_pid = pid;
-      }
+   }
 
-      if (daemon_argv_needs_free) {
-         char **s;
-         for (s = daemon_argv; *s != NULL; s++) {
-            free(*s);
-         }
-         free(daemon_argv);
-         daemon_argv_needs_free = 0;
+   free(retry_at);
+   free(pids);
+   free(attempts);
+
+  done:
+   if (daemon_argv_needs_free) {
+      char **s;
+      for (s = daemon_argv; *s != NULL; s++) {
+         free(*s);
       }
-      free(new_argv);
-      
-      debug_printf3("rsh to hostname %s completed successfully\n", hostname);
-      return 0;
+      free(daemon_argv);
+      daemon_argv_needs_free = 0;
    }
-   else {
-      execvp(new_argv[0], new_argv);
-      err_printf("Exec for rsh command %s did not succeed\n", new_argv[0]);
-      exit(-1);
-   }   
+
+   return failed ? -1 : 0;
 }
@@ -0,0 +1,240 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT
+file in the top level directory, or at
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms
+and conditions of the GNU Lesser General Public License for more details.  You should
+have received a copy of the GNU Lesser General Public License along with this
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "shmem_ring.h"
+
+#define RING_MASK (SHMEM_RING_SIZE - 1)
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __asm__ __volatile__("pause" ::: "memory")
+#elif defined(__aarch64__)
+#define cpu_relax() __asm__ __volatile__("yield" ::: "memory")
+#elif defined(__powerpc__) || defined(__powerpc64__)
+#define cpu_relax() __asm__ __volatile__("or 27,27,27" ::: "memory")
+#else
+#define cpu_relax() __asm__ __volatile__("" ::: "memory")
+#endif
+
+static int futex_wait(volatile int32_t *addr, int32_t val, int timeout_ms)
+{
+   struct timespec ts;
+   ts.tv_sec = timeout_ms / 1000;
+   ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+   return syscall(SYS_futex, addr, FUTEX_WAIT, val, timeout_ms < 0 ? NULL : &ts, NULL, 0);
+}
+
+static void futex_wake(volatile int32_t *addr)
+{
+   syscall(SYS_futex, addr, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+void shmem_ring_init(shmem_ring_t *ring)
+{
+   ring->head = 0;
+   ring->tail = 0;
+   ring->waiting = 0;
+   ring->space_waiting = 0;
+}
+
+uint32_t shmem_ring_used(shmem_ring_t *ring)
+{
+   return __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+}
+
+/* Make new bytes visible to the consumer and wake it if it went to sleep.
+   The sequentially consistent store/exchange pair orders against the
+   consumer's store of waiting followed by its load of tail, so one side
+   always sees the other. */
+static void publish_tail(shmem_ring_t *ring, uint32_t tail)
+{
+   __atomic_store_n(&ring->tail, tail, __ATOMIC_SEQ_CST);
+   if (__atomic_load_n(&ring->waiting, __ATOMIC_SEQ_CST) &&
+       __atomic_exchange_n(&ring->waiting, 0, __ATOMIC_SEQ_CST))
+      futex_wake(&ring->waiting);
+}
+
+/* The same handshake in the other direction, for a producer waiting on
+   space.  It sleeps on head itself, since that's the word that changes. */
+static void publish_head(shmem_ring_t *ring, uint32_t head)
+{
+   __atomic_store_n(&ring->head, head, __ATOMIC_SEQ_CST);
+   if (__atomic_load_n(&ring->space_waiting, __ATOMIC_SEQ_CST) &&
+       __atomic_exchange_n(&ring->space_waiting, 0, __ATOMIC_SEQ_CST))
+      futex_wake((volatile int32_t *) &ring->head);
+}
+
+int shmem_ring_write(shmem_ring_t *ring, const struct iovec *iov, int iovcnt,
+                     shmem_ring_wait_t wait_space, void *arg)
+{
+   uint32_t tail = ring->tail, head, space, off, chunk;
+   int i, published = 1;
+
+   for (i = 0; i < iovcnt; i++) {
+      const unsigned char *src = (const unsigned char *) iov[i].iov_base;
+      size_t left = iov[i].iov_len;
+      while (left) {
+         head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+         space = SHMEM_RING_SIZE - (tail - head);
+         if (!space) {
+            /* Full.  Let the consumer see what we have before waiting on it */
+            if (!published) {
+               publish_tail(ring, tail);
+               published = 1;
+            }
+            if (wait_space(ring, arg) == -1)
+               return -1;
+            continue;
+         }
+         chunk = left < space ? (uint32_t) left : space;
+         off = tail & RING_MASK;
+         if (chunk > SHMEM_RING_SIZE - off)
+            chunk = SHMEM_RING_SIZE - off;
+         memcpy(ring->data + off, src, chunk);
+         tail += chunk;
+         src += chunk;
+         left -= chunk;
+         published = 0;
+      }
+   }
+   if (!published)
+      publish_tail(ring, tail);
+   return 0;
+}
+
+int shmem_ring_read(shmem_ring_t *ring, void *buf, uint32_t len,
+                    shmem_ring_wait_t wait_data, void *arg)
+{
+   unsigned char *dst = (unsigned char *) buf;
+   uint32_t head = ring->head, tail, avail, off, chunk;
+
+   while (len) {
+      tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+      avail = tail - head;
+      if (!avail) {
+         if (wait_data(ring, arg) == -1)
+            return -1;
+         continue;
+      }
+      chunk = len < avail ? len : avail;
+      off = head & RING_MASK;
+      if (chunk > SHMEM_RING_SIZE - off)
+         chunk = SHMEM_RING_SIZE - off;
+      memcpy(dst, ring->data + off, chunk);
+      head += chunk;
+      dst += chunk;
+      len -= chunk;
+      publish_head(ring, head);
+   }
+   return 0;
+}
+
+/**
+ * Wait for the producer to publish data.  Spins briefly first, since a
+ * cached reply from the server usually arrives within a few microseconds,
+ * then sleeps on the ring's futex.  Returns 0 once data is available or 1
+ * if timeout_ms expired first.
+ **/
+int shmem_ring_wait_data(shmem_ring_t *ring, unsigned int spins, int timeout_ms)
+{
+   unsigned int i;
+   int result;
+
+   for (i = 0; i < spins; i++) {
+      if (shmem_ring_used(ring))
+         return 0;
+      cpu_relax();
+   }
+
+   for (;;) {
+      __atomic_store_n(&ring->waiting, 1, __ATOMIC_SEQ_CST);
+      if (__atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) != ring->head) {
+         __atomic_store_n(&ring->waiting, 0, __ATOMIC_RELAXED);
+         return 0;
+      }
+      result = futex_wait(&ring->waiting, 1, timeout_ms);
+      __atomic_store_n(&ring->waiting, 0, __ATOMIC_RELAXED);
+      if (shmem_ring_used(ring))
+         return 0;
+      if (result == -1 && errno == ETIMEDOUT)
+         return 1;
+   }
+}
+
+/**
+ * Wait for the consumer to make room in a full ring.  Returns 0 once there
+ * is space or 1 if timeout_ms expired first.
+ **/
+int shmem_ring_wait_space(shmem_ring_t *ring, int timeout_ms)
+{
+   uint32_t head;
+   int result;
+
+   for (;;) {
+      __atomic_store_n(&ring->space_waiting, 1, __ATOMIC_SEQ_CST);
+      head = __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);
+      if (ring->tail - head < SHMEM_RING_SIZE) {
+         __atomic_store_n(&ring->space_waiting, 0, __ATOMIC_RELAXED);
+         return 0;
+      }
+      result = futex_wait((volatile int32_t *) &ring->head, (int32_t) head, timeout_ms);
+      __atomic_store_n(&ring->space_waiting, 0, __ATOMIC_RELAXED);
+      if (ring->tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) < SHMEM_RING_SIZE)
+         return 0;
+      if (result == -1 && errno == ETIMEDOUT)
+         return 1;
+   }
+}
+
+/**
+ * Fill in the address of the server's rendezvous socket.  Locations can be
+ * longer than sun_path allows, in which case we open the directory and
+ * reach the socket through /proc/self/fd.  The caller closes *dir_fd (if
+ * not -1) once it has bound or connected.
+ **/
+int shmem_socket_addr(const char *location, struct sockaddr_un *addr, int *dir_fd)
+{
+   char dir[4096];
+   int result;
+
+   memset(addr, 0, sizeof(*addr));
+   addr->sun_family = AF_UNIX;
+   *dir_fd = -1;
+
+   result = snprintf(addr->sun_path, sizeof(addr->sun_path), "%s/spindle_comm/%s", location, SHMEM_SOCKET_NAME);
+   if (result >= 0 && result < (int) sizeof(addr->sun_path))
+      return 0;
+
+   snprintf(dir, sizeof(dir), "%s/spindle_comm", location);
+   *dir_fd = open(dir, O_RDONLY | O_DIRECTORY);
+   if (*dir_fd == -1)
+      return -1;
+   snprintf(addr->sun_path, sizeof(addr->sun_path), "/proc/self/fd/%d/%s", *dir_fd, SHMEM_SOCKET_NAME);
+   return 0;
+}
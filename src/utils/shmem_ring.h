@@ -0,0 +1,88 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT
+file in the top level directory, or at
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms
+and conditions of the GNU Lesser General Public License for more details.  You should
+have received a copy of the GNU Lesser General Public License along with this
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#if !defined(SHMEM_RING_H_)
+#define SHMEM_RING_H_
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * Single-producer/single-consumer byte ring that lives in memory shared
+ * between a client and the server.  The producer only ever writes tail and
+ * the consumer only ever writes head, so no lock is needed.  A consumer that
+ * wants to sleep sets waiting and blocks on it as a futex; the producer clears
+ * it and issues a wakeup after publishing data.  A producer that finds the
+ * ring full likewise sets space_waiting and blocks on head, and the consumer
+ * wakes it after moving head.
+ **/
+
+#define SHMEM_RING_SIZE (64*1024)
+#define SHMEM_CACHE_LINE 64
+
+typedef struct {
+   volatile uint32_t head;
+   char pad0[SHMEM_CACHE_LINE - sizeof(uint32_t)];
+   volatile uint32_t tail;
+   char pad1[SHMEM_CACHE_LINE - sizeof(uint32_t)];
+   volatile int32_t waiting;
+   char pad2[SHMEM_CACHE_LINE - sizeof(int32_t)];
+   volatile int32_t space_waiting;
+   char pad3[SHMEM_CACHE_LINE - sizeof(int32_t)];
+   unsigned char data[SHMEM_RING_SIZE];
+} shmem_ring_t;
+
+#define SHMEM_REGION_MAGIC 0x5350524e
+
+/* The region a client shares with the server: one ring in each direction */
+typedef struct {
+   uint32_t magic;
+   uint32_t size;
+   int32_t client_pid;
+   char pad[SHMEM_CACHE_LINE - 3*sizeof(uint32_t)];
+   shmem_ring_t to_server;
+   shmem_ring_t to_client;
+} shmem_region_t;
+
+/* Called when a read finds the ring empty or a write finds it full.
+   Returns 0 to try again, or -1 to abandon the operation. */
+typedef int (*shmem_ring_wait_t)(shmem_ring_t *ring, void *arg);
+
+void shmem_ring_init(shmem_ring_t *ring);
+uint32_t shmem_ring_used(shmem_ring_t *ring);
+
+int shmem_ring_write(shmem_ring_t *ring, const struct iovec *iov, int iovcnt,
+                     shmem_ring_wait_t wait_space, void *arg);
+int shmem_ring_read(shmem_ring_t *ring, void *buf, uint32_t len,
+                    shmem_ring_wait_t wait_data, void *arg);
+
+int shmem_ring_wait_data(shmem_ring_t *ring, unsigned int spins, int timeout_ms);
+int shmem_ring_wait_space(shmem_ring_t *ring, int timeout_ms);
+
+/* Rendezvous socket the server listens on under location/spindle_comm */
+#define SHMEM_SOCKET_NAME "shmem_sock"
+int shmem_socket_addr(const char *location, struct sockaddr_un *addr, int *dir_fd);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
@@ -0,0 +1,278 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT
+file in the top level directory, or at
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms
+and conditions of the GNU Lesser General Public License for more details.  You should
+have received a copy of the GNU Lesser General Public License along with this
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "warmcache.h"
+#include "spindle_debug.h"
+
+#define ALIGN4(X) (((X) + 3) & ~((size_t) 3))
+#define INITIAL_SLOTS 1024
+#define INITIAL_DATA (64*1024)
+
+/* The log's slots and entries are laid out as they are in the image, so
+   publishing is a copy. */
+struct warmcache_log_t {
+   uint32_t *slots;
+   uint32_t num_slots;
+   uint32_t num_entries;
+   char *data;
+   size_t data_used;
+   size_t data_size;
+   int dirty;
+};
+
+static uint32_t key_hash(const char *prefix, const char *path)
+{
+   uint32_t hash = 2166136261u;
+   const char *c;
+   for (c = prefix; *c; c++) {
+      hash ^= (unsigned char) *c;
+      hash *= 16777619u;
+   }
+   for (c = path; *c; c++) {
+      hash ^= (unsigned char) *c;
+      hash *= 16777619u;
+   }
+   return hash;
+}
+
+static int key_matches(const char *key, const char *prefix, const char *path)
+{
+   size_t prefix_len = strlen(prefix);
+   return strncmp(key, prefix, prefix_len) == 0 && strcmp(key + prefix_len, path) == 0;
+}
+
+/**
+ * Return the slot holding the entry for prefix+path, or the empty slot
+ * where it would go.  num_slots is a power of two and never more than
+ * half full, so there is always an empty slot.
+ **/
+static uint32_t find_slot(uint32_t *slots, uint32_t num_slots, const char *entries,
+                          const char *prefix, const char *path, uint32_t hash)
+{
+   uint32_t mask = num_slots - 1, slot = hash & mask;
+   const uint32_t *entry;
+
+   for (;; slot = (slot + 1) & mask) {
+      if (!slots[slot])
+         return slot;
+      entry = (const uint32_t *) (entries + slots[slot] - 1);
+      if (*entry == hash && key_matches((const char *) (entry + 1), prefix, path))
+         return slot;
+   }
+}
+
+warmcache_log_t *warmcache_log_create()
+{
+   warmcache_log_t *log;
+
+   log = (warmcache_log_t *) calloc(1, sizeof(warmcache_log_t));
+   if (!log)
+      return NULL;
+   log->num_slots = INITIAL_SLOTS;
+   log->slots = (uint32_t *) calloc(log->num_slots, sizeof(uint32_t));
+   log->data_size = INITIAL_DATA;
+   log->data = (char *) malloc(log->data_size);
+   if (!log->slots || !log->data) {
+      free(log->slots);
+      free(log->data);
+      free(log);
+      return NULL;
+   }
+   return log;
+}
+
+static int grow_slots(warmcache_log_t *log)
+{
+   uint32_t new_num = log->num_slots * 2, i, slot, mask = new_num - 1;
+   uint32_t *new_slots;
+
+   new_slots = (uint32_t *) calloc(new_num, sizeof(uint32_t));
+   if (!new_slots)
+      return -1;
+   for (i = 0; i < log->num_slots; i++) {
+      if (!log->slots[i])
+         continue;
+      slot = *((uint32_t *) (log->data + log->slots[i] - 1)) & mask;
+      while (new_slots[slot])
+         slot = (slot + 1) & mask;
+      new_slots[slot] = log->slots[i];
+   }
+   free(log->slots);
+   log->slots = new_slots;
+   log->num_slots = new_num;
+   return 0;
+}
+
+/**
+ * Record that the shmcache key prefix+path has value.  The first answer
+ * for a key is kept, as it was the one clients saw.  Returns -1 once the
+ * image would grow past WARMCACHE_MAX_SIZE, after which new answers
+ * are dropped.
+ **/
+int warmcache_log_add(warmcache_log_t *log, const char *prefix, const char *path, const char *value)
+{
+   size_t prefix_len = strlen(prefix), path_len = strlen(path), value_len = strlen(value);
+   size_t entry_size, image_size;
+   uint32_t hash = key_hash(prefix, path), slot;
+   char *entry, *new_data;
+
+   slot = find_slot(log->slots, log->num_slots, log->data, prefix, path, hash);
+   if (log->slots[slot])
+      return 0;
+
+   entry_size = ALIGN4(sizeof(uint32_t) + prefix_len + path_len + 1 + value_len + 1);
+   image_size = sizeof(warmcache_t) + log->num_slots * 2 * sizeof(uint32_t) + log->data_used + entry_size;
+   if (image_size > WARMCACHE_MAX_SIZE)
+      return -1;
+
+   if (log->data_used + entry_size > log->data_size) {
+      new_data = (char *) realloc(log->data, log->data_size * 2);
+      if (!new_data)
+         return -1;
+      log->data = new_data;
+      log->data_size *= 2;
+   }
+
+   entry = log->data + log->data_used;
+   *((uint32_t *) entry) = hash;
+   memcpy(entry + sizeof(uint32_t), prefix, prefix_len);
+   memcpy(entry + sizeof(uint32_t) + prefix_len, path, path_len + 1);
+   memcpy(entry + sizeof(uint32_t) + prefix_len + path_len + 1, value, value_len + 1);
+   log->slots[slot] = log->data_used + 1;
+   log->data_used += entry_size;
+   log->num_entries++;
+   log->dirty = 1;
+
+   if (log->num_entries * 2 > log->num_slots)
+      grow_slots(log);
+   return 0;
+}
+
+/**
+ * Write the log to an image under location if anything was added since
+ * the last publish.  The image is written beside the old one and renamed
+ * over it, so clients that mapped the old image keep a consistent copy.
+ **/
+int warmcache_publish(warmcache_log_t *log, const char *location)
+{
+   char path[PATH_MAX], tmppath[PATH_MAX + 16];
+   warmcache_t header;
+   int fd, len, result = -1;
+
+   if (!log->dirty)
+      return 0;
+
+   len = snprintf(path, sizeof(path), "%s/%s", location, WARMCACHE_FILENAME);
+   if (len < 0 || (size_t) len >= sizeof(path)) {
+      err_printf("Location %s is too long for a warm cache path\n", location);
+      return -1;
+   }
+   snprintf(tmppath, sizeof(tmppath), "%s.%d", path, (int) getpid());
+   fd = open(tmppath, O_CREAT | O_TRUNC | O_WRONLY, 0600);
+   if (fd == -1) {
+      err_printf("Could not create warm cache %s: %s\n", tmppath, strerror(errno));
+      return -1;
+   }
+
+   header.magic = WARMCACHE_MAGIC;
+   header.num_slots = log->num_slots;
+   header.num_entries = log->num_entries;
+   header.size = sizeof(header) + log->num_slots * sizeof(uint32_t) + log->data_used;
+   if (write(fd, &header, sizeof(header)) != sizeof(header) ||
+       write(fd, log->slots, log->num_slots * sizeof(uint32_t)) != (ssize_t) (log->num_slots * sizeof(uint32_t)) ||
+       write(fd, log->data, log->data_used) != (ssize_t) log->data_used) {
+      err_printf("Could not write warm cache %s: %s\n", tmppath, strerror(errno));
+      goto done;
+   }
+   if (rename(tmppath, path) == -1) {
+      err_printf("Could not rename warm cache %s to %s: %s\n", tmppath, path, strerror(errno));
+      goto done;
+   }
+   debug_printf("Published warm cache with %u entries (%u bytes) to %s\n",
+                header.num_entries, header.size, path);
+   log->dirty = 0;
+   result = 0;
+
+  done:
+   close(fd);
+   if (result == -1)
+      unlink(tmppath);
+   return result;
+}
+
+warmcache_t *warmcache_map(const char *location)
+{
+   char path[PATH_MAX];
+   warmcache_t *cache;
+   struct stat buf;
+   int fd, len;
+
+   len = snprintf(path, sizeof(path), "%s/%s", location, WARMCACHE_FILENAME);
+   if (len < 0 || (size_t) len >= sizeof(path)) {
+      debug_printf("Location %s is too long for a warm cache path\n", location);
+      return NULL;
+   }
+   fd = open(path, O_RDONLY);
+   if (fd == -1) {
+      debug_printf2("No warm cache at %s\n", path);
+      return NULL;
+   }
+   if (fstat(fd, &buf) == -1 || buf.st_size < (off_t) sizeof(warmcache_t) || buf.st_size > WARMCACHE_MAX_SIZE) {
+      debug_printf("Warm cache %s has a bad size\n", path);
+      close(fd);
+      return NULL;
+   }
+   cache = (warmcache_t *) mmap(NULL, buf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if (cache == MAP_FAILED) {
+      debug_printf("Could not map warm cache %s\n", path);
+      return NULL;
+   }
+   if (cache->magic != WARMCACHE_MAGIC || cache->size != (uint32_t) buf.st_size ||
+       !cache->num_slots || (cache->num_slots & (cache->num_slots - 1)) ||
+       sizeof(warmcache_t) + cache->num_slots * sizeof(uint32_t) > cache->size) {
+      debug_printf("Warm cache %s is not valid\n", path);
+      munmap(cache, buf.st_size);
+      return NULL;
+   }
+   debug_printf2("Mapped warm cache with %u entries from %s\n", cache->num_entries, path);
+   return cache;
+}
+
+/**
+ * Returns the value the server gave for key in an earlier job, or NULL.
+ **/
+const char *warmcache_lookup(warmcache_t *cache, const char *key)
+{
+   const char *entries = (const char *) (cache->slots + cache->num_slots), *entry_key;
+   uint32_t hash = key_hash("", key), slot;
+
+   slot = find_slot(cache->slots, cache->num_slots, entries, "", key, hash);
+   if (!cache->slots[slot])
+      return NULL;
+   entry_key = entries + cache->slots[slot] - 1 + sizeof(uint32_t);
+   return entry_key + strlen(entry_key) + 1;
+}
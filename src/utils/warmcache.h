@@ -0,0 +1,66 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT
+file in the top level directory, or at
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms
+and conditions of the GNU Lesser General Public License for more details.  You should
+have received a copy of the GNU Lesser General Public License along with this
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#if !defined(WARMCACHE_H_)
+#define WARMCACHE_H_
+
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * Answers a persistent server gave its clients, for the next job.  The
+ * server logs each file, stat, existence and ld.so answer under the same
+ * key a client uses in the shmcache ("" + path, "*" + path, "&" + path,
+ * ...).  Whenever its last client exits it writes the log out as an image
+ * under its location.  Clients of later jobs map the image at startup and
+ * look there before asking the server.
+ *
+ * The image is a warmcache_t, then num_slots slots holding the offset (plus
+ * one) of an entry, then the entries.  Each is a uint32_t hash followed by
+ * the NUL-terminated key and value, padded to 4 bytes.  A new image is
+ * renamed over the old one, so a mapped image never changes.
+ **/
+
+#define WARMCACHE_MAGIC 0x5741524d
+#define WARMCACHE_FILENAME "spindle_warmcache"
+#define WARMCACHE_MAX_SIZE (64*1024*1024)
+
+typedef struct {
+   uint32_t magic;
+   uint32_t size;
+   uint32_t num_slots;
+   uint32_t num_entries;
+   uint32_t slots[];
+} warmcache_t;
+
+/* Server side */
+typedef struct warmcache_log_t warmcache_log_t;
+warmcache_log_t *warmcache_log_create();
+int warmcache_log_add(warmcache_log_t *log, const char *prefix, const char *path, const char *value);
+int warmcache_publish(warmcache_log_t *log, const char *location);
+
+/* Client side */
+warmcache_t *warmcache_map(const char *location);
+const char *warmcache_lookup(warmcache_t *cache, const char *key);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
@@ -0,0 +1,236 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT
+file in the top level directory, or at
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms
+and conditions of the GNU Lesser General Public License for more details.  You should
+have received a copy of the GNU Lesser General Public License along with this
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+/**
+ * Microbenchmark for lookup_in_binding_hash.  Replays the PLT symbol names
+ * of every object loaded into this process, which is the stream of names
+ * the audit client checks as an application binds its calls, through:
+ *   probe   - the old 128-slot linear-probe table with a djb2 hash
+ *   perfect - binding_hash_find over the perfect hash generated at build
+ *             time, which is all lookup_in_binding_hash does
+ * Extra libraries are dlopened to make the stream look like a large
+ * application.  Both lookups must agree on every name.
+ *
+ * Usage: bindbench [iterations] [library ...]
+ **/
+
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <dlfcn.h>
+#include <elf.h>
+#include <link.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "binding_hash.h"
+#include "bindings_hash_table.h"
+
+static const char *names[] = {
+   "",
+#define SPINDLE_BINDING(NAME, LIBC_FUNC, SPINDLE_NAME, SPINDLE_FUNC) NAME,
+#include "intercept_bindings.def"
+#undef SPINDLE_BINDING
+   NULL
+};
+
+#if __WORDSIZE == 64
+#define R_SYM(X) ELF64_R_SYM(X)
+#else
+#define R_SYM(X) ELF32_R_SYM(X)
+#endif
+
+static const char *default_libs[] = { "libstdc++.so.6", "libm.so.6", "libz.so.1", NULL };
+
+static const char **stream;
+static size_t stream_len, stream_size;
+static unsigned long memcmps;
+
+/* The lookup from intercept.c before the perfect hash */
+#define MAX_BINDING_STR_SIZE 20
+#define HASH_TABLE_SIZE 128
+static int probe_table[HASH_TABLE_SIZE];
+
+static unsigned int probe_hash(const char *str)
+{
+   unsigned int hash = 5381, c, len = 0;
+   while ((c = *str++)) {
+      hash = ((hash << 5) + hash) + c;
+      if (++len > MAX_BINDING_STR_SIZE)
+         return UINT_MAX;
+   }
+   return hash % HASH_TABLE_SIZE;
+}
+
+static void probe_init()
+{
+   unsigned int pos;
+   int i;
+   for (i = 1; names[i]; i++) {
+      pos = probe_hash(names[i]);
+      while (probe_table[pos] != 0)
+         pos = (pos + 1) % HASH_TABLE_SIZE;
+      probe_table[pos] = i;
+   }
+}
+
+static int probe_lookup(const char *name)
+{
+   unsigned int pos = probe_hash(name), idx;
+   if (pos == UINT_MAX)
+      return 0;
+   while ((idx = probe_table[pos]) != 0) {
+      if (strcmp(name, names[idx]) == 0)
+         return idx;
+      pos = (pos + 1) % HASH_TABLE_SIZE;
+   }
+   return 0;
+}
+
+static const char *binding_name(unsigned int idx)
+{
+   memcmps++;
+   return names[idx];
+}
+
+/* The same lookup lookup_in_binding_hash does, over the same table */
+static int perfect_lookup(const char *name)
+{
+   return (int) binding_hash_find(name, binding_hash_table, BINDING_HASH_SEED, BINDING_HASH_SIZE,
+                                  BINDING_MAX_NAME_LEN, binding_name);
+}
+
+static void add_name(const char *name)
+{
+   if (stream_len == stream_size) {
+      stream_size = stream_size ? stream_size * 2 : 4096;
+      stream = (const char **) realloc(stream, stream_size * sizeof(*stream));
+   }
+   stream[stream_len++] = name;
+}
+
+/* Collect the names of every PLT relocation in the loaded objects */
+static void collect_names()
+{
+   struct link_map *map;
+   ElfW(Dyn) *dyn;
+   ElfW(Sym) *symtab;
+   ElfW(Addr) jmprel, symaddr, straddr;
+   size_t relsz, relent, i;
+   int is_rela;
+   char *strtab;
+   unsigned long symidx;
+
+   for (map = _r_debug.r_map; map; map = map->l_next) {
+      if (!map->l_ld)
+         continue;
+      jmprel = symaddr = straddr = 0;
+      relsz = 0;
+      is_rela = 1;
+      for (dyn = map->l_ld; dyn->d_tag != DT_NULL; dyn++) {
+         switch (dyn->d_tag) {
+            case DT_JMPREL: jmprel = dyn->d_un.d_ptr; break;
+            case DT_PLTRELSZ: relsz = dyn->d_un.d_val; break;
+            case DT_PLTREL: is_rela = (dyn->d_un.d_val == DT_RELA); break;
+            case DT_SYMTAB: symaddr = dyn->d_un.d_ptr; break;
+            case DT_STRTAB: straddr = dyn->d_un.d_ptr; break;
+         }
+      }
+      if (!jmprel || !symaddr || !straddr)
+         continue;
+      if (symaddr < map->l_addr) {
+         jmprel += map->l_addr;
+         symaddr += map->l_addr;
+         straddr += map->l_addr;
+      }
+      symtab = (ElfW(Sym) *) symaddr;
+      strtab = (char *) straddr;
+      relent = is_rela ? sizeof(ElfW(Rela)) : sizeof(ElfW(Rel));
+      for (i = 0; i < relsz / relent; i++) {
+         if (is_rela)
+            symidx = R_SYM(((ElfW(Rela) *) jmprel)[i].r_info);
+         else
+            symidx = R_SYM(((ElfW(Rel) *) jmprel)[i].r_info);
+         if (symidx)
+            add_name(strtab + symtab[symidx].st_name);
+      }
+   }
+}
+
+static double now()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+int main(int argc, char *argv[])
+{
+   int iterations = argc > 1 ? atoi(argv[1]) : 200;
+   const char **libs = argc > 2 ? (const char **) argv + 2 : default_libs;
+   unsigned long matches = 0, sum;
+   double start, probe_time, perfect_time;
+   size_t i;
+   int j, result = 0;
+
+   for (; *libs; libs++) {
+      if (!dlopen(*libs, RTLD_LAZY))
+         fprintf(stderr, "Could not dlopen %s: %s\n", *libs, dlerror());
+   }
+   collect_names();
+   if (!stream_len) {
+      fprintf(stderr, "No PLT symbols found\n");
+      return -1;
+   }
+
+   probe_init();
+   for (i = 0; i < stream_len; i++) {
+      int a = probe_lookup(stream[i]), b = perfect_lookup(stream[i]);
+      if (a != b) {
+         fprintf(stderr, "Lookups disagree on %s: %d vs %d\n", stream[i], a, b);
+         result = -1;
+      }
+      if (b)
+         matches++;
+   }
+
+   sum = 0;
+   start = now();
+   for (j = 0; j < iterations; j++)
+      for (i = 0; i < stream_len; i++)
+         sum += probe_lookup(stream[i]);
+   probe_time = now() - start;
+
+   memcmps = 0;
+   start = now();
+   for (j = 0; j < iterations; j++)
+      for (i = 0; i < stream_len; i++)
+         sum += perfect_lookup(stream[i]);
+   perfect_time = now() - start;
+
+   printf("%lu names, %lu bindings, %d iterations (checksum %lu)\n",
+          (unsigned long) stream_len, matches, iterations, sum);
+   printf("%-8s %8.2f ns/lookup\n", "probe", probe_time * 1e9 / (stream_len * (double) iterations));
+   printf("%-8s %8.2f ns/lookup, %.2f%% of misses reached memcmp\n", "perfect",
+          perfect_time * 1e9 / (stream_len * (double) iterations),
+          stream_len > matches ?
+          100.0 * (memcmps / (double) iterations - matches) / (stream_len - matches) : 0.0);
+   return result;
+}
@@ -0,0 +1,405 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT
+file in the top level directory, or at
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms
+and conditions of the GNU Lesser General Public License for more details.  You should
+have received a copy of the GNU Lesser General Public License along with this
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+/**
+ * Round-trip latency benchmark for the client/server transports.  A forked
+ * child plays the server and echoes each request the way the real transports
+ * move a message (header then payload):
+ *   pipe   - a pair of FIFOs, as in client_api_pipe.c
+ *   socket - a TCP loopback connection, as in client_api_socket.c
+ *   shmem  - shared rings with a socket doorbell and futex replies, as in
+ *            client_api_shmem.c, which only spins for a reply before
+ *            sleeping on multi-CPU nodes.  shmem-spin always spins first.
+ *
+ * Usage: commbench [iterations] [payload bytes]
+ **/
+
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "shmem_ring.h"
+
+#define WARMUP 1000
+#define SHMEM_SPINS 4096
+
+typedef struct {
+   int type;
+   int len;
+} header_t;
+
+typedef struct {
+   const char *name;
+   int (*setup)();
+   void (*serve)(char *buffer);
+   int (*roundtrip)(char *buffer, int len);
+   void (*teardown)();
+} transport_t;
+
+static int client_in = -1, client_out = -1, server_in = -1, server_out = -1;
+static shmem_region_t *region;
+static unsigned int client_spins;
+
+static int full_write(int fd, const void *buf, size_t len)
+{
+   const char *p = (const char *) buf;
+   while (len) {
+      ssize_t r = write(fd, p, len);
+      if (r == -1 && errno == EINTR)
+         continue;
+      if (r <= 0)
+         return -1;
+      p += r;
+      len -= r;
+   }
+   return 0;
+}
+
+static int full_read(int fd, void *buf, size_t len)
+{
+   char *p = (char *) buf;
+   while (len) {
+      ssize_t r = read(fd, p, len);
+      if (r == -1 && errno == EINTR)
+         continue;
+      if (r <= 0)
+         return -1;
+      p += r;
+      len -= r;
+   }
+   return 0;
+}
+
+/* Pipes and sockets: separate header and payload writes, like the transports */
+static void stream_serve(char *buffer)
+{
+   header_t hdr;
+   for (;;) {
+      if (full_read(server_in, &hdr, sizeof(hdr)) == -1)
+         return;
+      if (hdr.len && full_read(server_in, buffer, hdr.len) == -1)
+         return;
+      if (full_write(server_out, &hdr, sizeof(hdr)) == -1)
+         return;
+      if (hdr.len && full_write(server_out, buffer, hdr.len) == -1)
+         return;
+   }
+}
+
+static int stream_roundtrip(char *buffer, int len)
+{
+   header_t hdr;
+   hdr.type = 1;
+   hdr.len = len;
+   if (full_write(client_out, &hdr, sizeof(hdr)) == -1)
+      return -1;
+   if (len && full_write(client_out, buffer, len) == -1)
+      return -1;
+   if (full_read(client_in, &hdr, sizeof(hdr)) == -1)
+      return -1;
+   if (hdr.len && full_read(client_in, buffer, hdr.len) == -1)
+      return -1;
+   return 0;
+}
+
+static void close_all()
+{
+   if (client_in != -1) close(client_in);
+   if (client_out != -1 && client_out != client_in) close(client_out);
+   if (server_in != -1) close(server_in);
+   if (server_out != -1 && server_out != server_in) close(server_out);
+   client_in = client_out = server_in = server_out = -1;
+}
+
+static int pipe_setup()
+{
+   int to_server[2], to_client[2];
+   if (pipe(to_server) == -1 || pipe(to_client) == -1)
+      return -1;
+   server_in = to_server[0];
+   client_out = to_server[1];
+   client_in = to_client[0];
+   server_out = to_client[1];
+   return 0;
+}
+
+static int socket_setup()
+{
+   struct sockaddr_in addr;
+   socklen_t addrlen = sizeof(addr);
+   int listen_fd, one = 1;
+
+   listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+   if (listen_fd == -1)
+      return -1;
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   addr.sin_port = 0;
+   if (bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 ||
+       listen(listen_fd, 1) == -1 ||
+       getsockname(listen_fd, (struct sockaddr *) &addr, &addrlen) == -1) {
+      close(listen_fd);
+      return -1;
+   }
+
+   client_in = client_out = socket(AF_INET, SOCK_STREAM, 0);
+   if (client_in == -1 || connect(client_in, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+      close(listen_fd);
+      return -1;
+   }
+   server_in = server_out = accept(listen_fd, NULL, NULL);
+   close(listen_fd);
+   if (server_in == -1)
+      return -1;
+   setsockopt(client_in, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+   setsockopt(server_in, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+   return 0;
+}
+
+/* Shared memory: requests ring a one-byte doorbell that the server polls,
+   replies come back through the ring's futex. */
+static int shmem_setup_common(unsigned int spins)
+{
+   int fds[2];
+   void *mem;
+
+   mem = mmap(NULL, sizeof(shmem_region_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+   if (mem == MAP_FAILED)
+      return -1;
+   region = (shmem_region_t *) mem;
+   shmem_ring_init(&region->to_server);
+   shmem_ring_init(&region->to_client);
+
+   if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+      return -1;
+   client_in = client_out = fds[0];
+   server_in = server_out = fds[1];
+   client_spins = spins;
+   return 0;
+}
+
+static int shmem_setup()
+{
+   return shmem_setup_common(sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SHMEM_SPINS : 0);
+}
+
+static int shmem_spin_setup()
+{
+   return shmem_setup_common(SHMEM_SPINS);
+}
+
+static int yield_wait(shmem_ring_t *ring, void *arg)
+{
+   sched_yield();
+   return 0;
+}
+
+/* Large requests are streamed, so the server must hear the doorbell
+   before the client waits for it to drain the ring */
+static int doorbell_wait(shmem_ring_t *ring, void *arg)
+{
+   int *rang = (int *) arg;
+   char doorbell = 0;
+   if (!*rang) {
+      if (full_write(client_out, &doorbell, 1) == -1)
+         return -1;
+      *rang = 1;
+   }
+   sched_yield();
+   return 0;
+}
+
+static int client_wait(shmem_ring_t *ring, void *arg)
+{
+   while (shmem_ring_wait_data(ring, client_spins, 1000) != 0);
+   return 0;
+}
+
+static void shmem_serve(char *buffer)
+{
+   struct pollfd pfd;
+   struct iovec iov[2];
+   header_t hdr;
+   char doorbell;
+
+   pfd.fd = server_in;
+   pfd.events = POLLIN;
+   for (;;) {
+      if (poll(&pfd, 1, -1) == -1 && errno != EINTR)
+         return;
+      if (read(server_in, &doorbell, 1) != 1)
+         return;
+      shmem_ring_read(&region->to_server, &hdr, sizeof(hdr), yield_wait, NULL);
+      if (hdr.len)
+         shmem_ring_read(&region->to_server, buffer, hdr.len, yield_wait, NULL);
+      iov[0].iov_base = &hdr;
+      iov[0].iov_len = sizeof(hdr);
+      iov[1].iov_base = buffer;
+      iov[1].iov_len = hdr.len;
+      shmem_ring_write(&region->to_client, iov, hdr.len ? 2 : 1, yield_wait, NULL);
+   }
+}
+
+static int shmem_roundtrip(char *buffer, int len)
+{
+   struct iovec iov[2];
+   header_t hdr;
+   char doorbell = 0;
+   int rang = 0;
+
+   hdr.type = 1;
+   hdr.len = len;
+   iov[0].iov_base = &hdr;
+   iov[0].iov_len = sizeof(hdr);
+   iov[1].iov_base = buffer;
+   iov[1].iov_len = len;
+   if (shmem_ring_write(&region->to_server, iov, len ? 2 : 1, doorbell_wait, &rang) == -1)
+      return -1;
+   if (!rang && full_write(client_out, &doorbell, 1) == -1)
+      return -1;
+
+   shmem_ring_read(&region->to_client, &hdr, sizeof(hdr), client_wait, NULL);
+   if (hdr.len)
+      shmem_ring_read(&region->to_client, buffer, hdr.len, client_wait, NULL);
+   return 0;
+}
+
+static void shmem_teardown()
+{
+   close_all();
+   munmap(region, sizeof(shmem_region_t));
+   region = NULL;
+}
+
+static transport_t transports[] = {
+   { "pipe", pipe_setup, stream_serve, stream_roundtrip, close_all },
+   { "socket", socket_setup, stream_serve, stream_roundtrip, close_all },
+   { "shmem", shmem_setup, shmem_serve, shmem_roundtrip, shmem_teardown },
+   { "shmem-spin", shmem_spin_setup, shmem_serve, shmem_roundtrip, shmem_teardown },
+   { NULL, NULL, NULL, NULL, NULL }
+};
+
+static double now_usec()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+   double x = *(const double *) a, y = *(const double *) b;
+   return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static int run(transport_t *t, int iterations, int payload, char *buffer, double *samples)
+{
+   pid_t pid;
+   int i, status;
+   double start, total = 0.0;
+
+   if (t->setup() == -1) {
+      fprintf(stderr, "%s: setup failed: %s\n", t->name, strerror(errno));
+      return -1;
+   }
+
+   pid = fork();
+   if (pid == -1) {
+      fprintf(stderr, "%s: fork failed: %s\n", t->name, strerror(errno));
+      return -1;
+   }
+   if (pid == 0) {
+      if (client_in != server_in) close(client_in);
+      if (client_out != server_out && client_out != client_in) close(client_out);
+      t->serve(buffer);
+      _exit(0);
+   }
+   if (server_in != client_in) close(server_in);
+   if (server_out != client_out && server_out != server_in) close(server_out);
+   server_in = server_out = -1;
+
+   for (i = 0; i < WARMUP; i++)
+      t->roundtrip(buffer, payload);
+   for (i = 0; i < iterations; i++) {
+      start = now_usec();
+      if (t->roundtrip(buffer, payload) == -1) {
+         fprintf(stderr, "%s: round trip %d failed\n", t->name, i);
+         break;
+      }
+      samples[i] = now_usec() - start;
+      total += samples[i];
+   }
+
+   t->teardown();
+   waitpid(pid, &status, 0);
+   if (i < iterations)
+      return -1;
+
+   qsort(samples, iterations, sizeof(double), cmp_double);
+   printf("%-14s %10.2f %10.2f %10.2f %10.2f\n", t->name,
+          total / iterations, samples[0], samples[iterations / 2], samples[(int) (iterations * 0.99)]);
+   return 0;
+}
+
+int main(int argc, char *argv[])
+{
+   int iterations = 100000, payload = 256, i, result = 0;
+   char *buffer;
+   double *samples;
+
+   if (argc > 1)
+      iterations = atoi(argv[1]);
+   if (argc > 2)
+      payload = atoi(argv[2]);
+   if (iterations <= 0 || payload < 0) {
+      fprintf(stderr, "Usage: %s [iterations] [payload bytes]\n", argv[0]);
+      return -1;
+   }
+
+   buffer = (char *) malloc(payload + 1);
+   samples = (double *) malloc(iterations * sizeof(double));
+   if (!buffer || !samples) {
+      fprintf(stderr, "Out of memory\n");
+      return -1;
+   }
+   memset(buffer, 'x', payload);
+   signal(SIGPIPE, SIG_IGN);
+
+   printf("%d round trips of a %d byte message (usec)\n", iterations, payload);
+   printf("%-14s %10s %10s %10s %10s\n", "transport", "mean", "min", "median", "p99");
+   for (i = 0; transports[i].name; i++) {
+      if (run(transports + i, iterations, payload, buffer, samples) == -1)
+         result = -1;
+   }
+   return result;
+}
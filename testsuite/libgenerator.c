@@ -14,10 +14,47 @@ program; if not, write to the Free Software Foundation, Inc., 59 Temple
 Place, Suite 330, Boston, MA 02111-1307 USA
 */
 
+/**
+ * Generates test libraries.  With three arguments it writes one C file of
+ * Fibonacci functions for a libtest library:
+ *
+ *   libgenerator file.c size prefix
+ *
+ * With -w it writes a synthetic workload for scaling runs into a
+ * directory, which is then built with make -C dir:
+ *   - a DAG of shared libraries, depth levels deep, where each library
+ *     has DT_NEEDED entries on fanout libraries further down and every
+ *     library is needed by one above it.  The libraries are spread over
+ *     lib/d0..lib/d3 and find each other through $ORIGIN RUNPATHs,
+ *     absolute RUNPATHs or old DT_RPATHs.  Most have a soname reached
+ *     through a symlink chain (libwN.so -> libwN.so.1 -> libwN.so.1.0),
+ *     and each can be padded out to a given size.
+ *   - python packages under python/, each with submodules in nested
+ *     subpackages and compiled extensions that link to the top of the DAG.
+ *     Extensions are only built if python3-config is found.
+ *   - driver (links to the top of the DAG), driver_dlopen (dlopens it)
+ *     and driver.py (imports every package).
+ *   - workload.list, the top libraries and every python file, which
+ *     scalebench reads as @dir/workload.list.
+ *
+ *   libgenerator -w dir [-l libraries] [-d depth] [-f fanout] [-F functions per library]
+ *                [-k KB of padding per library] [-p packages] [-m modules per package]
+ *                [-e extensions per package] [-s seed]
+ **/
+
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 
 void writeFile(FILE *f, char *prefix, int size)
 {
@@ -50,12 +87,436 @@ void writeFile(FILE *f, char *prefix, int size)
    fclose(f);
 };
 
+#define LIB_DIRS 4
+#define MODULES_PER_SUBPACKAGE 10
+
+/* Ways a library finds its dependencies */
+typedef enum {
+   runpath_origin,
+   runpath_absolute,
+   rpath_absolute,
+   num_runpath_kinds
+} runpath_kind_t;
+
+typedef struct {
+   int level;
+   int dir;
+   int versioned;
+   runpath_kind_t runpath;
+   int *deps;
+   int num_deps;
+   int has_parent;
+} wlib_t;
+
+static char *workdir;
+static int num_libs = 200, depth = 8, fanout = 3, num_funcs = 20, pad_kb = 0;
+static int num_packages = 10, num_modules = 20, num_extensions = 1;
+static unsigned long long seed = 1;
+static wlib_t *libs;
+static int *level_start;
+static int num_roots;
+
+/* xorshift, so a seed gives the same workload with any libc */
+static unsigned int next_random()
+{
+   seed ^= seed << 13;
+   seed ^= seed >> 7;
+   seed ^= seed << 17;
+   return (unsigned int) (seed >> 32);
+}
+
+static void make_dir(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+static void make_dir(const char *fmt, ...)
+{
+   char path[PATH_MAX];
+   va_list ap;
+
+   va_start(ap, fmt);
+   vsnprintf(path, sizeof(path), fmt, ap);
+   va_end(ap);
+   if (mkdir(path, 0755) == -1 && errno != EEXIST) {
+      fprintf(stderr, "Failed to create %s: %s\n", path, strerror(errno));
+      exit(-1);
+   }
+}
+
+static FILE *open_file(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+static FILE *open_file(const char *fmt, ...)
+{
+   char path[PATH_MAX];
+   va_list ap;
+   FILE *f;
+
+   va_start(ap, fmt);
+   vsnprintf(path, sizeof(path), fmt, ap);
+   va_end(ap);
+   f = fopen(path, "w");
+   if (!f) {
+      fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+      exit(-1);
+   }
+   return f;
+}
+
+static int has_dep(wlib_t *lib, int dep)
+{
+   int i;
+   for (i = 0; i < lib->num_deps; i++) {
+      if (lib->deps[i] == dep)
+         return 1;
+   }
+   return 0;
+}
+
+static void add_dep(wlib_t *lib, int dep)
+{
+   if (has_dep(lib, dep))
+      return;
+   lib->deps = (int *) realloc(lib->deps, (lib->num_deps + 1) * sizeof(int));
+   lib->deps[lib->num_deps++] = dep;
+   libs[dep].has_parent = 1;
+}
+
+static int random_lib_in_level(int level)
+{
+   return level_start[level] + next_random() % (level_start[level+1] - level_start[level]);
+}
+
+/**
+ * Spread the libraries over the levels and pick their dependencies.  Most
+ * dependencies are on the next level down, some skip further, and any
+ * library nothing picked is given to a random one on the level above.
+ **/
+static void plan_libraries()
+{
+   int i, j, level;
+
+   if (depth > num_libs)
+      depth = num_libs;
+   libs = (wlib_t *) calloc(num_libs, sizeof(wlib_t));
+   level_start = (int *) calloc(depth + 1, sizeof(int));
+   for (i = num_libs - 1; i >= 0; i--) {
+      libs[i].level = (int) ((long) i * depth / num_libs);
+      level_start[libs[i].level] = i;
+      libs[i].dir = next_random() % LIB_DIRS;
+      libs[i].versioned = (i % 3 != 2);
+      libs[i].runpath = (runpath_kind_t) ((i / 3) % num_runpath_kinds);
+   }
+   level_start[depth] = num_libs;
+   num_roots = level_start[1 < depth ? 1 : depth];
+
+   for (i = 0; i < num_libs; i++) {
+      level = libs[i].level;
+      if (level == depth - 1)
+         continue;
+      add_dep(libs + i, random_lib_in_level(level + 1));
+      for (j = 1; j < fanout; j++) {
+         if (level + 2 < depth && next_random() % 4 == 0)
+            add_dep(libs + i, random_lib_in_level(level + 2 + next_random() % (depth - level - 2)));
+         else
+            add_dep(libs + i, random_lib_in_level(level + 1));
+      }
+   }
+   for (i = num_roots; i < num_libs; i++) {
+      if (!libs[i].has_parent)
+         add_dep(libs + random_lib_in_level(libs[i].level - 1), i);
+   }
+}
+
+static void write_library_source(int n)
+{
+   wlib_t *lib = libs + n;
+   FILE *f;
+   int i;
+
+   f = open_file("%s/src/libw%d.c", workdir, n);
+   fprintf(f, "/* Generated by libgenerator */\n");
+   for (i = 0; i < lib->num_deps; i++)
+      fprintf(f, "extern int w%d_entry(int);\n", lib->deps[i]);
+   if (pad_kb)
+      fprintf(f, "__attribute__((used)) const char w%d_pad[%d] = { %d };\n", n, pad_kb * 1024, n % 127 + 1);
+   for (i = 0; i < num_funcs; i++)
+      fprintf(f, "int w%d_f%d(int x) { return x * %d + %d; }\n", n, i, i % 7 + 1, n);
+   fprintf(f, "int w%d_entry(int x)\n{\n", n);
+   fprintf(f, "   static int done, result;\n");
+   fprintf(f, "   if (done) return result;\n");
+   fprintf(f, "   result = x;\n");
+   for (i = 0; i < num_funcs; i++)
+      fprintf(f, "   result = w%d_f%d(result) %% 1000003;\n", n, i);
+   for (i = 0; i < lib->num_deps; i++)
+      fprintf(f, "   result = (result + w%d_entry(x)) %% 1000003;\n", lib->deps[i]);
+   fprintf(f, "   done = 1;\n");
+   fprintf(f, "   return result;\n}\n");
+   fclose(f);
+}
+
+/* The file under lib/dN that other objects link against */
+static void print_library_path(FILE *f, int n)
+{
+   fprintf(f, "lib/d%d/libw%d.so", libs[n].dir, n);
+}
+
+/* Linker arguments for the dependencies of an object, which reaches the
+   workload directory through from_dir */
+static void print_link_args(FILE *f, int *deps, int num_deps, runpath_kind_t runpath, const char *from_dir)
+{
+   int i, dirs_used[LIB_DIRS], first = 1;
+
+   memset(dirs_used, 0, sizeof(dirs_used));
+   for (i = 0; i < num_deps; i++)
+      dirs_used[libs[deps[i]].dir] = 1;
+   for (i = 0; i < LIB_DIRS; i++) {
+      if (dirs_used[i])
+         fprintf(f, " -Llib/d%d", i);
+   }
+   for (i = 0; i < num_deps; i++)
+      fprintf(f, " -lw%d", deps[i]);
+   if (!num_deps)
+      return;
+
+   fprintf(f, " -Wl,%s,-rpath,", runpath == rpath_absolute ? "--disable-new-dtags" : "--enable-new-dtags");
+   for (i = 0; i < LIB_DIRS; i++) {
+      if (!dirs_used[i])
+         continue;
+      if (runpath == runpath_origin)
+         fprintf(f, "%s'$$ORIGIN/%s/lib/d%d'", first ? "" : ":", from_dir, i);
+      else
+         fprintf(f, "%s$(TOP)/lib/d%d", first ? "" : ":", i);
+      first = 0;
+   }
+}
+
+static void write_library_rule(FILE *f, int n)
+{
+   wlib_t *lib = libs + n;
+   int i;
+
+   print_library_path(f, n);
+   fprintf(f, ": src/libw%d.c", n);
+   for (i = 0; i < lib->num_deps; i++) {
+      fprintf(f, " ");
+      print_library_path(f, lib->deps[i]);
+   }
+   fprintf(f, "\n");
+   if (lib->versioned) {
+      fprintf(f, "\t$(CC) $(WCFLAGS) -shared -o lib/d%d/libw%d.so.1.0 -Wl,-soname,libw%d.so.1 $<",
+              lib->dir, n, n);
+      print_link_args(f, lib->deps, lib->num_deps, lib->runpath, "../..");
+      fprintf(f, "\n\tln -sf libw%d.so.1.0 lib/d%d/libw%d.so.1\n", n, lib->dir, n);
+      fprintf(f, "\tln -sf libw%d.so.1 lib/d%d/libw%d.so\n\n", n, lib->dir, n);
+   }
+   else {
+      fprintf(f, "\t$(CC) $(WCFLAGS) -shared -o $@ -Wl,-soname,libw%d.so $<", n);
+      print_link_args(f, lib->deps, lib->num_deps, lib->runpath, "../..");
+      fprintf(f, "\n\n");
+   }
+}
+
+static void write_drivers(FILE *makefile)
+{
+   int *roots, i;
+   FILE *f;
+
+   roots = (int *) malloc(num_roots * sizeof(int));
+   for (i = 0; i < num_roots; i++)
+      roots[i] = i;
+
+   f = open_file("%s/src/driver.c", workdir);
+   fprintf(f, "/* Generated by libgenerator */\n#include <stdio.h>\n");
+   for (i = 0; i < num_roots; i++)
+      fprintf(f, "extern int w%d_entry(int);\n", i);
+   fprintf(f, "int main()\n{\n   int result = 0;\n");
+   for (i = 0; i < num_roots; i++)
+      fprintf(f, "   result = (result + w%d_entry(1)) %% 1000003;\n", i);
+   fprintf(f, "   printf(\"driver: %%d\\n\", result);\n   return 0;\n}\n");
+   fclose(f);
+
+   f = open_file("%s/src/driver_dlopen.c", workdir);
+   fprintf(f, "/* Generated by libgenerator */\n#include <stdio.h>\n#include <dlfcn.h>\n");
+   fprintf(f, "int main()\n{\n   char name[64];\n   void *lib;\n   int i, result = 0, (*entry)(int);\n");
+   fprintf(f, "   for (i = 0; i < %d; i++) {\n", num_roots);
+   fprintf(f, "      snprintf(name, sizeof(name), \"libw%%d.so\", i);\n");
+   fprintf(f, "      lib = dlopen(name, RTLD_NOW);\n");
+   fprintf(f, "      if (!lib) { fprintf(stderr, \"%%s\\n\", dlerror()); return -1; }\n");
+   fprintf(f, "      snprintf(name, sizeof(name), \"w%%d_entry\", i);\n");
+   fprintf(f, "      entry = (int (*)(int)) dlsym(lib, name);\n");
+   fprintf(f, "      if (!entry) { fprintf(stderr, \"%%s\\n\", dlerror()); return -1; }\n");
+   fprintf(f, "      result = (result + entry(1)) %% 1000003;\n   }\n");
+   fprintf(f, "   printf(\"driver_dlopen: %%d\\n\", result);\n   return 0;\n}\n");
+   fclose(f);
+
+   fprintf(makefile, "driver: src/driver.c");
+   for (i = 0; i < num_roots; i++) {
+      fprintf(makefile, " ");
+      print_library_path(makefile, i);
+   }
+   fprintf(makefile, "\n\t$(CC) -o $@ $<");
+   print_link_args(makefile, roots, num_roots, runpath_origin, ".");
+   fprintf(makefile, " -Wl,-rpath-link,$(LIBDIRS)\n\n");
+
+   fprintf(makefile, "driver_dlopen: src/driver_dlopen.c\n");
+   fprintf(makefile, "\t$(CC) -o $@ $< -ldl -Wl,--enable-new-dtags,-rpath,'$$ORIGIN/lib/d0:$$ORIGIN/lib/d1:$$ORIGIN/lib/d2:$$ORIGIN/lib/d3'\n\n");
+   free(roots);
+}
+
+/**
+ * Package p has num_modules modules split among subpackages s0, s1, ...
+ * Its extensions each call into one of the top libraries.
+ **/
+static void write_package(FILE *makefile, FILE *list, int p)
+{
+   int num_subpackages = (num_modules + MODULES_PER_SUBPACKAGE - 1) / MODULES_PER_SUBPACKAGE;
+   int s, m, e, root;
+   FILE *init, *subinit, *f;
+
+   make_dir("%s/python/wpkg%d", workdir, p);
+   init = open_file("%s/python/wpkg%d/__init__.py", workdir, p);
+   fprintf(list, "%s/python/wpkg%d/__init__.py\n", workdir, p);
+   fprintf(init, "# Generated by libgenerator\n");
+   for (s = 0; s < num_subpackages; s++) {
+      make_dir("%s/python/wpkg%d/s%d", workdir, p, s);
+      subinit = open_file("%s/python/wpkg%d/s%d/__init__.py", workdir, p, s);
+      fprintf(list, "%s/python/wpkg%d/s%d/__init__.py\n", workdir, p, s);
+      fprintf(subinit, "# Generated by libgenerator\n");
+      for (m = s * MODULES_PER_SUBPACKAGE; m < num_modules && m < (s + 1) * MODULES_PER_SUBPACKAGE; m++) {
+         f = open_file("%s/python/wpkg%d/s%d/m%d.py", workdir, p, s, m);
+         fprintf(list, "%s/python/wpkg%d/s%d/m%d.py\n", workdir, p, s, m);
+         fprintf(f, "# Generated by libgenerator\n");
+         fprintf(f, "VALUE = %d\n", p * num_modules + m);
+         fprintf(f, "def f(x):\n    return x * %d + VALUE\n", m % 7 + 1);
+         fprintf(f, "class C%d(object):\n    def value(self):\n        return f(VALUE)\n", m);
+         fclose(f);
+         fprintf(subinit, "from . import m%d\n", m);
+      }
+      fclose(subinit);
+      fprintf(init, "from . import s%d\n", s);
+   }
+
+   for (e = 0; e < num_extensions; e++) {
+      root = (p * num_extensions + e) % num_roots;
+      f = open_file("%s/python/wpkg%d/_ext%d.c", workdir, p, e);
+      fprintf(f, "/* Generated by libgenerator */\n#include <Python.h>\n");
+      fprintf(f, "extern int w%d_entry(int);\n", root);
+      fprintf(f, "static PyObject *value(PyObject *self, PyObject *args) { return PyLong_FromLong(w%d_entry(1)); }\n", root);
+      fprintf(f, "static PyMethodDef methods[] = { { \"value\", value, METH_NOARGS, NULL }, { NULL, NULL, 0, NULL } };\n");
+      fprintf(f, "static struct PyModuleDef module = { PyModuleDef_HEAD_INIT, \"_ext%d\", NULL, -1, methods };\n", e);
+      fprintf(f, "PyMODINIT_FUNC PyInit__ext%d(void) { return PyModule_Create(&module); }\n", e);
+      fclose(f);
+      fprintf(init, "try:\n    from . import _ext%d\nexcept ImportError:\n    pass\n", e);
+
+      fprintf(makefile, "python/wpkg%d/_ext%d$(EXT_SUFFIX): python/wpkg%d/_ext%d.c ", p, e, p, e);
+      print_library_path(makefile, root);
+      fprintf(makefile, "\n\t$(CC) $(WCFLAGS) $(PYTHON_INCLUDES) -shared -o $@ $<");
+      print_link_args(makefile, &root, 1, runpath_origin, "../..");
+      fprintf(makefile, "\n\n");
+   }
+   fclose(init);
+}
+
+static int workload_main(int argc, char *argv[])
+{
+   FILE *makefile, *list, *f;
+   char *fullpath;
+   int opt, i, p, e, edges = 0;
+
+   while ((opt = getopt(argc, argv, "w:l:d:f:F:k:p:m:e:s:")) != -1) {
+      switch (opt) {
+         case 'w': workdir = optarg; break;
+         case 'l': num_libs = atoi(optarg); break;
+         case 'd': depth = atoi(optarg); break;
+         case 'f': fanout = atoi(optarg); break;
+         case 'F': num_funcs = atoi(optarg); break;
+         case 'k': pad_kb = atoi(optarg); break;
+         case 'p': num_packages = atoi(optarg); break;
+         case 'm': num_modules = atoi(optarg); break;
+         case 'e': num_extensions = atoi(optarg); break;
+         case 's': seed = strtoull(optarg, NULL, 10); break;
+         default: workdir = NULL; optind = argc; break;
+      }
+   }
+   if (!workdir || num_libs < 1 || depth < 1 || fanout < 1 || num_funcs < 0 || pad_kb < 0 ||
+       num_packages < 0 || num_modules < 0 || num_extensions < 0) {
+      fprintf(stderr, "Usage: %s -w dir [-l libraries] [-d depth] [-f fanout] [-F functions per library]\n"
+              "          [-k KB of padding per library] [-p packages] [-m modules per package]\n"
+              "          [-e extensions per package] [-s seed]\n", argv[0]);
+      return -1;
+   }
+   seed = seed * 2654435761ull + 88172645463325252ull;
+
+   make_dir("%s", workdir);
+   fullpath = realpath(workdir, NULL);
+   if (!fullpath) {
+      fprintf(stderr, "Failed to find %s: %s\n", workdir, strerror(errno));
+      return -1;
+   }
+   workdir = fullpath;
+   make_dir("%s/src", workdir);
+   make_dir("%s/lib", workdir);
+   for (i = 0; i < LIB_DIRS; i++)
+      make_dir("%s/lib/d%d", workdir, i);
+   make_dir("%s/python", workdir);
+
+   plan_libraries();
+
+   makefile = open_file("%s/Makefile", workdir);
+   fprintf(makefile, "# Generated by libgenerator.  Build with make -j.\n");
+   fprintf(makefile, "TOP := $(CURDIR)\n");
+   fprintf(makefile, "WCFLAGS = -fPIC -O1 -w\n");
+   fprintf(makefile, "LIBDIRS = $(TOP)/lib/d0:$(TOP)/lib/d1:$(TOP)/lib/d2:$(TOP)/lib/d3\n");
+   fprintf(makefile, "PYTHON_CONFIG ?= python3-config\n");
+   fprintf(makefile, "PYTHON_INCLUDES := $(shell $(PYTHON_CONFIG) --includes 2>/dev/null)\n");
+   fprintf(makefile, "EXT_SUFFIX := $(shell $(PYTHON_CONFIG) --extension-suffix 2>/dev/null)\n\n");
+   fprintf(makefile, "LIBRARIES =");
+   for (i = 0; i < num_libs; i++) {
+      fprintf(makefile, " ");
+      print_library_path(makefile, i);
+   }
+   fprintf(makefile, "\nEXTENSIONS =");
+   for (p = 0; p < num_packages; p++) {
+      for (e = 0; e < num_extensions; e++)
+         fprintf(makefile, " python/wpkg%d/_ext%d$(EXT_SUFFIX)", p, e);
+   }
+   fprintf(makefile, "\n\nall: $(LIBRARIES) driver driver_dlopen\n");
+   fprintf(makefile, "ifneq ($(PYTHON_INCLUDES),)\nall: $(EXTENSIONS)\nendif\n\n");
+
+   for (i = 0; i < num_libs; i++) {
+      write_library_source(i);
+      write_library_rule(makefile, i);
+      edges += libs[i].num_deps;
+   }
+   write_drivers(makefile);
+
+   list = open_file("%s/workload.list", workdir);
+   for (i = 0; i < num_roots; i++) {
+      fprintf(list, "%s/", workdir);
+      print_library_path(list, i);
+      fprintf(list, "\n");
+   }
+   for (p = 0; p < num_packages; p++)
+      write_package(makefile, list, p);
+   fclose(list);
+   fclose(makefile);
+
+   f = open_file("%s/driver.py", workdir);
+   fprintf(f, "# Generated by libgenerator\nimport importlib, os, sys\n");
+   fprintf(f, "sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), \"python\"))\n");
+   fprintf(f, "for p in range(%d):\n    importlib.import_module(\"wpkg%%d\" %% p)\n", num_packages);
+   fprintf(f, "print(\"driver.py: imported %d packages\")\n", num_packages);
+   fclose(f);
+
+   printf("Wrote %d libraries (%d top, %d levels, %d dependencies) and %d python packages of %d modules to %s\n",
+          num_libs, num_roots, depth, edges, num_packages, num_modules, workdir);
+   return 0;
+}
+
 int main(int argc, char *argv[])
 {
    char *prefix;
    FILE *f;
    int size;
 
+   if (argc > 1 && argv[1][0] == '-')
+      return workload_main(argc, argv);
    if (argc != 4) {
       fprintf(stderr, "Argument error\n");
       return -1;
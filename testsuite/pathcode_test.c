@@ -0,0 +1,210 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT
+file in the top level directory, or at
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms
+and conditions of the GNU Lesser General Public License for more details.  You should
+have received a copy of the GNU Lesser General Public License along with this
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+/**
+ * Round-trips directory listings and path lists through the encodings in
+ * src/utils/pathcode.c, and checks that every truncated encoding is
+ * reported as malformed rather than decoded.  Name lengths and counts go
+ * past 127 so varints take more than one byte.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pathcode.h"
+
+#define MAX_NAMES 300
+
+static int had_error = 0;
+
+#define CHECK(COND, ...)                                \
+   do {                                                 \
+      if (!(COND)) {                                    \
+         fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); \
+         fprintf(stderr, __VA_ARGS__);                  \
+         fprintf(stderr, "\n");                         \
+         had_error = 1;                                 \
+      }                                                 \
+   } while (0)
+
+typedef struct {
+   const char *dir;
+   const char **names;
+   int num_names;
+   int exists;
+   int count;
+   int bad;
+} dir_check_t;
+
+static int cmp_strs(const void *a, const void *b)
+{
+   return strcmp(*((const char **) a), *((const char **) b));
+}
+
+static void check_entry(const char *dir, const char *name, void *arg)
+{
+   dir_check_t *check = (dir_check_t *) arg;
+
+   if (strcmp(dir, check->dir) != 0)
+      check->bad = 1;
+   else if (!name)
+      check->bad |= check->exists || check->count;
+   else if (!check->exists || check->count >= check->num_names ||
+            strcmp(name, check->names[check->count]) != 0)
+      check->bad = 1;
+   check->count++;
+}
+
+static void ignore_entry(const char *dir, const char *name, void *arg)
+{
+}
+
+static void test_dir(const char *dir, const char **names, int num_names, int exists)
+{
+   dir_check_t check;
+   char *data;
+   size_t len, i;
+   int result;
+
+   result = pathcode_encode_dir(dir, names, num_names, exists, &data, &len);
+   CHECK(result == 0, "Could not encode listing of %s", dir);
+   if (result == -1)
+      return;
+
+   if (num_names)
+      qsort(names, num_names, sizeof(char *), cmp_strs);
+   memset(&check, 0, sizeof(check));
+   check.dir = dir;
+   check.names = names;
+   check.num_names = num_names;
+   check.exists = exists;
+   result = pathcode_decode_dir(data, len, check_entry, &check);
+   CHECK(result == 0 && !check.bad, "Listing of %s did not decode to what was encoded", dir);
+   CHECK(check.count == (exists ? num_names : 1), "Listing of %s decoded %d entries, expected %d",
+         dir, check.count, exists ? num_names : 1);
+
+   for (i = 0; i < len; i++) {
+      result = pathcode_decode_dir(data, i, ignore_entry, NULL);
+      CHECK(result == -1, "Listing of %s truncated to %lu bytes was not rejected", dir,
+            (unsigned long) i);
+   }
+   free(data);
+}
+
+/* Walks an encoded list, comparing against dirs then files.  Returns -1
+   if pathcode reports it as malformed. */
+static int walk_list(const char *data, size_t len, const char **dirs, int num_dirs,
+                     const char **files, int num_files, int expect_ok)
+{
+   pathcode_list_t list;
+   char path[4096];
+   int result, is_dir, n = 0;
+
+   if (pathcode_list_open(&list, data, len) == -1)
+      return -1;
+   while ((result = pathcode_list_next(&list, path, sizeof(path), &is_dir)) == 1) {
+      if (expect_ok) {
+         if (n < num_dirs)
+            CHECK(is_dir && strcmp(path, dirs[n]) == 0, "Path list entry %d is %s, expected %s",
+                  n, path, dirs[n]);
+         else if (n < num_dirs + num_files)
+            CHECK(!is_dir && strcmp(path, files[n - num_dirs]) == 0,
+                  "Path list entry %d is %s, expected %s", n, path, files[n - num_dirs]);
+      }
+      n++;
+   }
+   pathcode_list_close(&list);
+   if (result == -1)
+      return -1;
+   if (expect_ok)
+      CHECK(n == num_dirs + num_files, "Path list had %d entries, expected %d", n,
+            num_dirs + num_files);
+   return 0;
+}
+
+static void test_list(const char **dirs, int num_dirs, const char **files, int num_files)
+{
+   char *data;
+   size_t len, i;
+   int result;
+
+   result = pathcode_encode_list(dirs, num_dirs, files, num_files, &data, &len);
+   CHECK(result == 0, "Could not encode path list of %d files", num_files);
+   if (result == -1)
+      return;
+
+   result = walk_list(data, len, dirs, num_dirs, files, num_files, 1);
+   CHECK(result == 0, "Path list of %d files was reported as malformed", num_files);
+
+   for (i = 0; i < len; i++) {
+      result = walk_list(data, i, dirs, num_dirs, files, num_files, 0);
+      CHECK(result == -1, "Path list truncated to %lu bytes was not rejected", (unsigned long) i);
+   }
+   free(data);
+}
+
+int main(int argc, char *argv[])
+{
+   static char name_storage[MAX_NAMES][256];
+   static char file_storage[MAX_NAMES][512];
+   const char *names[MAX_NAMES], *files[MAX_NAMES + 2];
+   char long_name[201];
+   const char *one_name[1];
+   int i;
+
+   /* A missing directory, an empty one and one with a single long name */
+   test_dir("/no/such/dir", NULL, 0, 0);
+   test_dir("/empty", NULL, 0, 1);
+   memset(long_name, 'x', sizeof(long_name) - 1);
+   long_name[sizeof(long_name) - 1] = '\0';
+   one_name[0] = long_name;
+   test_dir("/", one_name, 1, 1);
+
+   /* Many unsorted names sharing long prefixes */
+   for (i = 0; i < MAX_NAMES; i++) {
+      snprintf(name_storage[i], sizeof(name_storage[i]), "libpynamic_module_%s_%03d.so",
+               (i % 3) ? "common_prefix_that_is_shared" : "other", (i * 7) % MAX_NAMES);
+      names[i] = name_storage[i];
+   }
+   test_dir("/usr/workspace/project/lib", names, MAX_NAMES, 1);
+
+   /* A path list across directories, including the root and a directory
+      with nothing in it */
+   {
+      const char *dirs[] = { "/usr/lib64", "/", "/usr/workspace/project/lib", "/usr/lib", "/opt/empty" };
+      int num_dirs = sizeof(dirs) / sizeof(dirs[0]);
+      int num_files = 0;
+
+      for (i = 0; i < MAX_NAMES; i++) {
+         snprintf(file_storage[i], sizeof(file_storage[i]), "%s/%s",
+                  (i % 2) ? "/usr/workspace/project/lib" : ((i % 5) ? "/usr/lib64" : "/usr/lib"),
+                  name_storage[i]);
+         files[num_files++] = file_storage[i];
+      }
+      files[num_files++] = "/init.so";
+      files[num_files++] = "/usr/lib/libc.so.6";
+      test_list(dirs, num_dirs, files, num_files);
+      test_list(dirs, num_dirs, NULL, 0);
+   }
+
+   if (had_error) {
+      printf("FAILED\n");
+      return -1;
+   }
+   printf("PASSED\n");
+   return 0;
+}
@@ -0,0 +1,473 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT
+file in the top level directory, or at
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms
+and conditions of the GNU Lesser General Public License for more details.  You should
+have received a copy of the GNU Lesser General Public License along with this
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+/**
+ * Scaling benchmark that runs a real spindle server tree on one machine.
+ * Each of the daemons is given its own loopback address (127.0.x.y) as a
+ * hostname and its own location, and they are started through spindle's
+ * rsh launch with this program standing in for rsh.  The daemons find
+ * each other over COBO like they would across nodes.  Several daemons can
+ * share a host because each one only listens on a port in the range until
+ * its parent connects.
+ *
+ * Once the tree is up, each daemon gets its clients: scalebench_app under
+ * spindle_bootstrap, which dlopens each library and reads each python file
+ * of the workload, as Pynamic does.  Directories in the workload stand for
+ * their .so and python files, and @file for the files listed in file.
+ * "make scaleworkload" generates one with libgenerator -w, which is run
+ * as @scaleworkload/workload.list.  Reported are:
+ *   time to main   - from forking a client to its main
+ *   time to loaded - from forking a client to its loading everything
+ *   bytes moved    - bytes the servers read off disk or moved between
+ *                    each other, from the --file-stats report
+ *   server cpu     - user and system time of the spindle_be processes,
+ *                    which this process reaps as their subreaper
+ * Options after -o are passed to spindle, eg. -o --push -o --cobo.
+ * Spindle must be installed.
+ *
+ * Usage: scalebench [-n daemons] [-c clients per daemon] [-o spindle option]... file|dir|@list...
+ **/
+
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "spindle_launch.h"
+#include "scalebench.h"
+
+/* Set while the tree starts, which tells our rsh stand-in it is one */
+#define SCALEBENCH_RSH_ENV "SCALEBENCH_RSH"
+/* The hostname a daemon was started for, which its location includes */
+#define SCALEBENCH_NODE_ENV "SCALEBENCH_NODE"
+/* How long to wait for the daemons to exit after spindle shuts down */
+#define SERVER_EXIT_SECS 30
+
+static char **files;
+static int num_files, num_libs, num_python;
+static char *lib_dirs, *python_dirs;
+
+/**
+ * Called by a daemon as "rsh host command...".  Everything is on this
+ * machine, so just run the command as that host.
+ **/
+static int rsh_main(int argc, char *argv[])
+{
+   if (argc < 3) {
+      fprintf(stderr, "%s: rsh stand-in got no command\n", argv[0]);
+      return -1;
+   }
+   setenv(SCALEBENCH_NODE_ENV, argv[1], 1);
+   execv(argv[2], argv + 2);
+   fprintf(stderr, "%s: could not run %s: %s\n", argv[0], argv[2], strerror(errno));
+   return -1;
+}
+
+static int is_python(const char *name)
+{
+   size_t len = strlen(name);
+   return (len > 3 && strcmp(name + len - 3, ".py") == 0) ||
+      (len > 4 && (strcmp(name + len - 4, ".pyc") == 0 || strcmp(name + len - 4, ".pyo") == 0));
+}
+
+static int is_library(const char *name)
+{
+   const char *so = strstr(name, ".so");
+   return so && (so[3] == '\0' || so[3] == '.');
+}
+
+/* Add dir to a colon-separated list, unless it's there */
+static void add_dir(char **list, const char *path)
+{
+   char dir[PATH_MAX], *slash, *cur, *newlist;
+   size_t len;
+
+   strncpy(dir, path, sizeof(dir) - 1);
+   dir[sizeof(dir) - 1] = '\0';
+   slash = strrchr(dir, '/');
+   if (!slash)
+      return;
+   *slash = '\0';
+   len = strlen(dir);
+
+   for (cur = *list; cur; cur = strchr(cur, ':')) {
+      if (*cur == ':')
+         cur++;
+      if (strncmp(cur, dir, len) == 0 && (cur[len] == ':' || cur[len] == '\0'))
+         return;
+   }
+   if (asprintf(&newlist, "%s%s%s", *list ? *list : "", *list ? ":" : "", dir) == -1)
+      return;
+   free(*list);
+   *list = newlist;
+}
+
+/* Relative paths are made absolute, but symlinks are left for spindle */
+static void add_file(const char *path)
+{
+   char *fullpath = path[0] == '/' ? strdup(path) : realpath(path, NULL);
+   if (!fullpath || access(fullpath, R_OK) == -1) {
+      fprintf(stderr, "Could not find %s: %s\n", path, strerror(errno));
+      exit(-1);
+   }
+   files = (char **) realloc(files, (num_files + 1) * sizeof(char *));
+   files[num_files++] = fullpath;
+   if (is_python(fullpath)) {
+      num_python++;
+      add_dir(&python_dirs, fullpath);
+   }
+   else {
+      num_libs++;
+      add_dir(&lib_dirs, fullpath);
+   }
+}
+
+static int workload_filter(const struct dirent *d)
+{
+   return is_python(d->d_name) || is_library(d->d_name);
+}
+
+static void add_workload(const char *path);
+
+/* Add each line of a workload list, such as libgenerator -w writes */
+static void add_workload_list(const char *listfile)
+{
+   char line[PATH_MAX];
+   size_t len;
+   FILE *f;
+
+   f = fopen(listfile, "r");
+   if (!f) {
+      fprintf(stderr, "Could not open workload list %s: %s\n", listfile, strerror(errno));
+      exit(-1);
+   }
+   while (fgets(line, sizeof(line), f)) {
+      len = strlen(line);
+      while (len && (line[len-1] == '\n' || line[len-1] == ' '))
+         line[--len] = '\0';
+      if (len && line[0] != '#')
+         add_workload(line);
+   }
+   fclose(f);
+}
+
+static void add_workload(const char *path)
+{
+   struct dirent **entries;
+   struct stat buf;
+   char entry_path[PATH_MAX];
+   int num, i;
+
+   if (path[0] == '@') {
+      add_workload_list(path + 1);
+      return;
+   }
+   if (stat(path, &buf) == -1 || !S_ISDIR(buf.st_mode)) {
+      add_file(path);
+      return;
+   }
+   num = scandir(path, &entries, workload_filter, alphasort);
+   if (num == -1) {
+      fprintf(stderr, "Could not read directory %s: %s\n", path, strerror(errno));
+      exit(-1);
+   }
+   for (i = 0; i < num; i++) {
+      snprintf(entry_path, sizeof(entry_path), "%s/%s", path, entries[i]->d_name);
+      add_file(entry_path);
+      free(entries[i]);
+   }
+   free(entries);
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+   double da = *(const double *) a, db = *(const double *) b;
+   return (da > db) - (da < db);
+}
+
+static double percentile(double *sorted, int num, double p)
+{
+   int rank = (int) (p * num + 0.999999);
+   if (rank < 1)
+      rank = 1;
+   return sorted[rank - 1];
+}
+
+static void print_times(const char *name, double *samples, int num)
+{
+   if (!num) {
+      printf("%-16s %10s\n", name, "-");
+      return;
+   }
+   qsort(samples, num, sizeof(double), compare_doubles);
+   printf("%-16s %10.4f %10.4f %10.4f %10.4f\n", name, percentile(samples, num, 0.5),
+          percentile(samples, num, 0.9), percentile(samples, num, 0.99), samples[num - 1]);
+}
+
+/* Sum the bytes column of a --file-stats report */
+static unsigned long long read_bytes_moved(const char *filename)
+{
+   char line[PATH_MAX + 256];
+   unsigned long long bytes, total = 0;
+   double wait, latency;
+   FILE *f;
+
+   f = fopen(filename, "r");
+   if (!f)
+      return 0;
+   while (fgets(line, sizeof(line), f)) {
+      if (line[0] != '#' && sscanf(line, "%lf %lf %llu", &wait, &latency, &bytes) == 3)
+         total += bytes;
+   }
+   fclose(f);
+   return total;
+}
+
+/**
+ * Reap the daemons, which were all started beneath us and so come to us
+ * when their parents exit, and total their CPU time.
+ **/
+static int reap_servers(double *total_cpu, double *max_cpu)
+{
+   struct rusage usage;
+   double cpu, deadline = scalebench_now() + SERVER_EXIT_SECS;
+   int status, num = 0;
+   pid_t pid;
+
+   *total_cpu = *max_cpu = 0.0;
+   for (;;) {
+      pid = wait4(-1, &status, WNOHANG, &usage);
+      if (pid == -1 && errno == EINTR)
+         continue;
+      if (pid == -1)
+         break;
+      if (pid == 0) {
+         if (scalebench_now() > deadline) {
+            fprintf(stderr, "Gave up waiting for spindle servers to exit\n");
+            break;
+         }
+         usleep(10000);
+         continue;
+      }
+      cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+      *total_cpu += cpu;
+      if (cpu > *max_cpu)
+         *max_cpu = cpu;
+      num++;
+   }
+   return num;
+}
+
+static void usage(const char *exe)
+{
+   fprintf(stderr, "Usage: %s [-n daemons] [-c clients per daemon] [-o spindle option]... file|dir|@list...\n", exe);
+   exit(-1);
+}
+
+int main(int argc, char *argv[])
+{
+   spindle_args_t params;
+   scalebench_record_t record;
+   char **hosts, **sargv, **client_argv, **spindle_argv;
+   char self[PATH_MAX], app[PATH_MAX], fd_str[32], client_str[32], filestats[PATH_MAX];
+   char *errstr = NULL, *location, *prefix, *libpath, *slash, *tmpdir;
+   double start, tree_time, *fork_times, *main_times, *done_times, total_cpu, max_cpu;
+   int num_daemons = 4, clients_per_daemon = 4, num_clients, sargc = 0, spindle_argc;
+   int opt, i, n, fds[2], num_records = 0, failed = 0, num_servers;
+   pid_t *pids;
+   ssize_t result;
+
+   if (getenv(SCALEBENCH_RSH_ENV))
+      return rsh_main(argc, argv);
+
+   sargv = (char **) calloc(argc + 1, sizeof(char *));
+   while ((opt = getopt(argc, argv, "n:c:o:")) != -1) {
+      switch (opt) {
+         case 'n': num_daemons = atoi(optarg); break;
+         case 'c': clients_per_daemon = atoi(optarg); break;
+         case 'o': sargv[sargc++] = optarg; break;
+         default: usage(argv[0]);
+      }
+   }
+   if (num_daemons < 1 || clients_per_daemon < 1 || optind == argc)
+      usage(argv[0]);
+   for (i = optind; i < argc; i++)
+      add_workload(argv[i]);
+   num_clients = num_daemons * clients_per_daemon;
+
+   n = readlink("/proc/self/exe", self, sizeof(self) - 1);
+   if (n == -1) {
+      fprintf(stderr, "Could not find own executable: %s\n", strerror(errno));
+      return -1;
+   }
+   self[n] = '\0';
+   strncpy(app, self, sizeof(app) - 1);
+   app[sizeof(app) - 1] = '\0';
+   slash = strrchr(app, '/');
+   snprintf(slash + 1, sizeof(app) - (slash + 1 - app), "scalebench_app");
+
+   if (fillInSpindleArgsCmdlineFE(&params, 0, sargc, sargv, &errstr) == -1) {
+      fprintf(stderr, "Bad spindle options: %s\n", errstr ? errstr : "unknown error");
+      return -1;
+   }
+
+   /* Each daemon runs as its own host, with its own location */
+   hosts = (char **) calloc(num_daemons + 1, sizeof(char *));
+   for (i = 0; i < num_daemons; i++) {
+      if (asprintf(&hosts[i], "127.0.%d.%d", i / 250, i % 250 + 1) == -1)
+         return -1;
+   }
+   if (asprintf(&location, "%s/$%s", params.location, SCALEBENCH_NODE_ENV) == -1)
+      return -1;
+   params.location = location;
+   if (python_dirs) {
+      if (asprintf(&prefix, "%s:%s", params.pythonprefix ? params.pythonprefix : "", python_dirs) == -1)
+         return -1;
+      params.pythonprefix = prefix;
+   }
+   tmpdir = getenv("TMPDIR");
+   snprintf(filestats, sizeof(filestats), "%s/scalebench_filestats.%d", tmpdir ? tmpdir : "/tmp", (int) getpid());
+   params.filestats_file = filestats;
+   params.rsh_command = self;
+   params.opts |= OPT_RSHLAUNCH | OPT_FILESTATS;
+   params.opts &= ~(OPT_PERSIST | OPT_SESSION);
+   if (params.num_ports < (unsigned int) num_daemons + 1)
+      params.num_ports = num_daemons + 1;
+
+   if (prctl(PR_SET_CHILD_SUBREAPER, 1) == -1) {
+      fprintf(stderr, "Could not become a subreaper: %s\n", strerror(errno));
+      return -1;
+   }
+
+   setenv(SCALEBENCH_RSH_ENV, "1", 1);
+   start = scalebench_now();
+   if (spindleInitFE((const char **) hosts, &params) == -1) {
+      fprintf(stderr, "Could not start spindle\n");
+      return -1;
+   }
+   tree_time = scalebench_now() - start;
+   unsetenv(SCALEBENCH_RSH_ENV);
+
+   if (getApplicationArgsFE(&params, &spindle_argc, &spindle_argv) == -1) {
+      fprintf(stderr, "Could not get spindle's application arguments\n");
+      return -1;
+   }
+   client_argv = (char **) calloc(spindle_argc + num_files + 2, sizeof(char *));
+   for (i = 0; i < spindle_argc; i++)
+      client_argv[i] = spindle_argv[i];
+   client_argv[i++] = app;
+   memcpy(client_argv + i, files, num_files * sizeof(char *));
+
+   /* Libraries from the workload can need each other */
+   if (lib_dirs) {
+      libpath = getenv("LD_LIBRARY_PATH");
+      if (libpath && *libpath) {
+         if (asprintf(&prefix, "%s:%s", lib_dirs, libpath) == -1)
+            return -1;
+         setenv("LD_LIBRARY_PATH", prefix, 1);
+      }
+      else
+         setenv("LD_LIBRARY_PATH", lib_dirs, 1);
+   }
+
+   if (pipe(fds) == -1) {
+      fprintf(stderr, "Could not create pipe: %s\n", strerror(errno));
+      return -1;
+   }
+   snprintf(fd_str, sizeof(fd_str), "%d", fds[1]);
+   setenv(SCALEBENCH_FD_ENV, fd_str, 1);
+
+   pids = (pid_t *) calloc(num_clients, sizeof(pid_t));
+   fork_times = (double *) calloc(num_clients, sizeof(double));
+   main_times = (double *) calloc(num_clients, sizeof(double));
+   done_times = (double *) calloc(num_clients, sizeof(double));
+   for (i = 0; i < num_clients; i++) {
+      setenv(SCALEBENCH_NODE_ENV, hosts[i / clients_per_daemon], 1);
+      snprintf(client_str, sizeof(client_str), "%d", i);
+      setenv(SCALEBENCH_CLIENT_ENV, client_str, 1);
+      fork_times[i] = scalebench_now();
+      pids[i] = fork();
+      if (pids[i] == -1) {
+         fprintf(stderr, "Could not fork client: %s\n", strerror(errno));
+         return -1;
+      }
+      if (pids[i] == 0) {
+         close(fds[0]);
+         execv(client_argv[0], client_argv);
+         fprintf(stderr, "Could not run %s: %s\n", client_argv[0], strerror(errno));
+         _exit(-1);
+      }
+   }
+   close(fds[1]);
+
+   for (;;) {
+      result = read(fds[0], &record, sizeof(record));
+      if (result == -1 && errno == EINTR)
+         continue;
+      if (result != sizeof(record))
+         break;
+      if (record.client < 0 || record.client >= num_clients)
+         continue;
+      if (record.errors)
+         failed++;
+      main_times[num_records] = record.main_time - fork_times[record.client];
+      done_times[num_records] = record.done_time - fork_times[record.client];
+      num_records++;
+   }
+   close(fds[0]);
+
+   for (i = 0; i < num_clients; i++) {
+      int status;
+      while (waitpid(pids[i], &status, 0) == -1 && errno == EINTR);
+   }
+
+   spindleWaitForCloseFE(&params);
+   markRSHPidReapedFE();
+   spindleCloseFE(&params);
+   num_servers = reap_servers(&total_cpu, &max_cpu);
+
+   printf("%d daemons, %d clients, %d libraries, %d python files\n",
+          num_daemons, num_clients, num_libs, num_python);
+   printf("%-16s %10.4f\n", "tree startup", tree_time);
+   printf("%-16s %10s %10s %10s %10s\n", "(seconds)", "median", "p90", "p99", "max");
+   print_times("time to main", main_times, num_records);
+   print_times("time to loaded", done_times, num_records);
+   printf("%-16s %10llu\n", "bytes moved", read_bytes_moved(filestats));
+   printf("%-16s %10.4f total, %.4f max over %d processes\n", "server cpu", total_cpu, max_cpu, num_servers);
+   unlink(filestats);
+
+   if (num_records != num_clients || failed) {
+      fprintf(stderr, "%d of %d clients did not finish their workload\n",
+              num_clients - num_records + failed, num_clients);
+      return -1;
+   }
+   return 0;
+}
@@ -0,0 +1,42 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT
+file in the top level directory, or at
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms
+and conditions of the GNU Lesser General Public License for more details.  You should
+have received a copy of the GNU Lesser General Public License along with this
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+#if !defined(SCALEBENCH_H_)
+#define SCALEBENCH_H_
+
+#include <time.h>
+
+/* Environment scalebench passes to each scalebench_app */
+#define SCALEBENCH_FD_ENV "SCALEBENCH_FD"
+#define SCALEBENCH_CLIENT_ENV "SCALEBENCH_CLIENT"
+
+/* What each scalebench_app writes down the pipe when it is done.  It's
+   smaller than PIPE_BUF, so records from different clients don't mix. */
+typedef struct {
+   int client;
+   int errors;
+   double main_time;
+   double done_time;
+} scalebench_record_t;
+
+static inline double scalebench_now()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#endif
@@ -0,0 +1,99 @@
+/*
+This file is part of Spindle.  For copyright information see the COPYRIGHT
+file in the top level directory, or at
+https://github.com/hpc/Spindle/blob/master/COPYRIGHT
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License (as published by the Free Software
+Foundation) version 2.1 dated February 1999.  This program is distributed in the
+hope that it will be useful, but WITHOUT ANY WARRANTY; without even the IMPLIED
+WARRANTY OF MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the terms
+and conditions of the GNU Lesser General Public License for more details.  You should
+have received a copy of the GNU Lesser General Public License along with this
+program; if not, write to the Free Software Foundation, Inc., 59 Temple
+Place, Suite 330, Boston, MA 02111-1307 USA
+*/
+
+/**
+ * The client scalebench runs under spindle.  Like a Pynamic process it
+ * reaches main, then loads its modules: each library on the command line
+ * is dlopened and each python file is read through.  It reports when it
+ * reached main and when it finished loading to scalebench.
+ *
+ * Usage: scalebench_app file...
+ **/
+
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "scalebench.h"
+
+/* Libraries built with registerlib.c look these up in the executable */
+typedef struct libs_list_t libs_list_t;
+libs_list_t *master_liblist_head = NULL;
+int liblist_error_code;
+
+static int is_python(const char *path)
+{
+   size_t len = strlen(path);
+   return (len > 3 && strcmp(path + len - 3, ".py") == 0) ||
+      (len > 4 && (strcmp(path + len - 4, ".pyc") == 0 || strcmp(path + len - 4, ".pyo") == 0));
+}
+
+static int read_file(const char *path)
+{
+   char buffer[65536];
+   ssize_t result;
+   int fd;
+
+   fd = open(path, O_RDONLY);
+   if (fd == -1) {
+      fprintf(stderr, "Could not open %s\n", path);
+      return -1;
+   }
+   while ((result = read(fd, buffer, sizeof(buffer))) > 0);
+   close(fd);
+   return result == -1 ? -1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+   scalebench_record_t record;
+   char *fd_str, *client_str;
+   int i;
+
+   record.main_time = scalebench_now();
+   record.errors = 0;
+
+   fd_str = getenv(SCALEBENCH_FD_ENV);
+   client_str = getenv(SCALEBENCH_CLIENT_ENV);
+   if (!fd_str || !client_str) {
+      fprintf(stderr, "%s should be run by scalebench\n", argv[0]);
+      return -1;
+   }
+   record.client = atoi(client_str);
+
+   for (i = 1; i < argc; i++) {
+      if (is_python(argv[i])) {
+         if (read_file(argv[i]) == -1)
+            record.errors++;
+      }
+      else if (!dlopen(argv[i], RTLD_NOW | RTLD_GLOBAL)) {
+         fprintf(stderr, "Could not dlopen %s: %s\n", argv[i], dlerror());
+         record.errors++;
+      }
+   }
+   record.done_time = scalebench_now();
+
+   if (write(atoi(fd_str), &record, sizeof(record)) != sizeof(record))
+      return -1;
+   return record.errors ? -1 : 0;
+}